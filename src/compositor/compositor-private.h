@@ -46,9 +46,23 @@ struct _MetaCompositor
                          MetaWindow     *window);
   Pixmap (*get_window_pixmap) (MetaCompositor *compositor,
                                MetaWindow     *window);
+  GdkPixbuf *(*get_window_thumbnail) (MetaCompositor *compositor,
+                                      MetaWindow     *window,
+                                      int             max_size);
   void (*set_active_window) (MetaCompositor *compositor,
                              MetaScreen     *screen,
                              MetaWindow     *window);
+  void (*begin_move) (MetaCompositor *compositor,
+                      MetaWindow     *window,
+                      MetaRectangle  *initial,
+                      int             grab_x,
+                      int             grab_y);
+  void (*update_move) (MetaCompositor *compositor,
+                       MetaWindow     *window,
+                       int             x,
+                       int             y);
+  void (*end_move) (MetaCompositor *compositor,
+                    MetaWindow     *window);
 };
 
 #endif
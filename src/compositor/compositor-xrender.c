@@ -43,6 +43,7 @@
 #include "compositor-private.h"
 #include "compositor-xrender.h"
 #include "xprops.h"
+#include "ui.h"
 #include <X11/Xatom.h>
 #include <X11/extensions/shape.h>
 #include <X11/extensions/Xcomposite.h>
@@ -62,6 +63,15 @@
 
 #define USE_IDLE_REPAINT 1
 
+/* Alt-tab thumbnails are kept up to date from damage events, but a
+ * window's thumbnail is re-rendered at most once per
+ * THUMBNAIL_REFRESH_INTERVAL, and no more than THUMBNAIL_REFRESH_BATCH
+ * of them are rendered per THUMBNAIL_REFRESH_TICK.
+ */
+#define THUMBNAIL_REFRESH_INTERVAL 1000 /* ms */
+#define THUMBNAIL_REFRESH_TICK 250 /* ms */
+#define THUMBNAIL_REFRESH_BATCH 4
+
 #ifdef HAVE_COMPOSITE_EXTENSIONS
 static inline gboolean
 composite_at_least_version (MetaDisplay *display,
@@ -171,6 +181,11 @@ typedef struct _MetaCompScreen
   gboolean clip_changed;
 
   GSList *dock_windows;
+
+  /* The size thumbnails were last asked for; zero until the tab popup
+     has wanted one, so we don't render thumbnails nobody looks at */
+  int thumbnail_size;
+  guint thumbnail_refresh_id;
 } MetaCompScreen;
 
 typedef struct _MetaCompWindow 
@@ -220,6 +235,16 @@ typedef struct _MetaCompWindow
 
   gboolean updates_frozen;
   gboolean update_pending;
+
+  GdkPixbuf *thumbnail;
+  GTimeVal thumbnail_time;
+  gboolean thumbnail_dirty;
+
+  /* Set while the window is being dragged: we draw it where the
+     pointer is, and its ConfigureNotifies only tell us where it was */
+  gboolean moving;
+  int move_offset_x;
+  int move_offset_y;
 } MetaCompWindow;
 
 #define OPAQUE 0xffffffff
@@ -1501,6 +1526,240 @@ damage_screen (MetaScreen *screen)
   add_damage (screen, region);
 }
 
+/* The pixmap holding what the window last looked like; for shaded
+   windows that is the copy taken before it was shaded */
+static Pixmap
+window_back_pixmap (MetaCompWindow *cw)
+{
+#ifdef HAVE_NAME_WINDOW_PIXMAP
+  if (have_name_window_pixmap (meta_screen_get_display (cw->screen)))
+    {
+      if (cw->window && meta_window_is_shaded (cw->window))
+        return cw->shaded_back_pixmap;
+      else
+        return cw->back_pixmap;
+    }
+#endif
+  return None;
+}
+
+static Pixmap
+scale_picture (Display           *xdisplay,
+               Window             xroot,
+               Picture            src,
+               XRenderPictFormat *format,
+               int                src_width,
+               int                src_height,
+               int                width,
+               int                height)
+{
+  XTransform transform;
+  Pixmap pixmap;
+  Picture dest;
+
+  pixmap = XCreatePixmap (xdisplay, xroot, width, height, format->depth);
+  dest = XRenderCreatePicture (xdisplay, pixmap, format, 0, NULL);
+
+  memset (&transform, 0, sizeof (transform));
+  transform.matrix[0][0] = XDoubleToFixed ((double) src_width / width);
+  transform.matrix[1][1] = XDoubleToFixed ((double) src_height / height);
+  transform.matrix[2][2] = XDoubleToFixed (1.0);
+
+  XRenderSetPictureTransform (xdisplay, src, &transform);
+  XRenderSetPictureFilter (xdisplay, src, FilterBilinear, NULL, 0);
+  XRenderComposite (xdisplay, PictOpSrc, src, None, dest,
+                    0, 0, 0, 0, 0, 0, width, height);
+
+  XRenderFreePicture (xdisplay, dest);
+  return pixmap;
+}
+
+/* Scales the window down on the server and reads back only the result,
+ * so a thumbnail costs a few kilobytes of traffic rather than a copy
+ * of the whole window.  A single bilinear pass would only sample four
+ * source pixels per thumbnail pixel, so we halve the size repeatedly
+ * first, which averages everything in.
+ */
+static GdkPixbuf *
+render_thumbnail (MetaCompWindow *cw,
+                  int             max_size)
+{
+  MetaScreen *screen = cw->screen;
+  MetaDisplay *display = meta_screen_get_display (screen);
+  Display *xdisplay = meta_display_get_xdisplay (display);
+  Window xroot = meta_screen_get_xroot (screen);
+  XRenderPictFormat *format;
+  Pixmap src_pixmap, pixmap;
+  Picture pict;
+  GdkPixbuf *pixbuf;
+  int width, height, t_width, t_height;
+
+  src_pixmap = window_back_pixmap (cw);
+  format = get_window_format (cw);
+  if (src_pixmap == None || format == NULL)
+    return NULL;
+
+  meta_error_trap_push (display);
+
+  if (src_pixmap == cw->back_pixmap)
+    {
+      width = cw->attrs.width + cw->attrs.border_width * 2;
+      height = cw->attrs.height + cw->attrs.border_width * 2;
+    }
+  else
+    {
+      Window root;
+      int x, y;
+      unsigned int w, h, border, depth;
+
+      if (!XGetGeometry (xdisplay, src_pixmap, &root, &x, &y,
+                         &w, &h, &border, &depth))
+        {
+          meta_error_trap_pop (display, FALSE);
+          return NULL;
+        }
+      width = w;
+      height = h;
+    }
+
+  if (width <= 0 || height <= 0)
+    {
+      meta_error_trap_pop (display, FALSE);
+      return NULL;
+    }
+
+  if (width > height)
+    {
+      t_width = max_size;
+      t_height = MAX (1, (int) (((double) height * max_size) / width));
+    }
+  else
+    {
+      t_height = max_size;
+      t_width = MAX (1, (int) (((double) width * max_size) / height));
+    }
+
+  pict = XRenderCreatePicture (xdisplay, src_pixmap, format, 0, NULL);
+  pixmap = None;
+
+  do
+    {
+      int next_width = MAX (t_width, width / 2);
+      int next_height = MAX (t_height, height / 2);
+      Pixmap next;
+
+      next = scale_picture (xdisplay, xroot, pict, format,
+                            width, height, next_width, next_height);
+      XRenderFreePicture (xdisplay, pict);
+      if (pixmap != None)
+        XFreePixmap (xdisplay, pixmap);
+
+      pixmap = next;
+      pict = XRenderCreatePicture (xdisplay, pixmap, format, 0, NULL);
+      width = next_width;
+      height = next_height;
+    }
+  while (width != t_width || height != t_height);
+
+  XRenderFreePicture (xdisplay, pict);
+
+  if (meta_error_trap_pop_with_return (display, FALSE) != Success)
+    {
+      meta_error_trap_push (display);
+      XFreePixmap (xdisplay, pixmap);
+      meta_error_trap_pop (display, FALSE);
+      return NULL;
+    }
+
+  pixbuf = meta_ui_get_pixbuf_from_pixmap (pixmap);
+  XFreePixmap (xdisplay, pixmap);
+
+  return pixbuf;
+}
+
+static void
+update_thumbnail (MetaCompWindow *cw,
+                  int             max_size)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = render_thumbnail (cw, max_size);
+
+  /* Keep showing the old one if the window has gone away under us */
+  if (pixbuf != NULL)
+    {
+      if (cw->thumbnail)
+        g_object_unref (cw->thumbnail);
+      cw->thumbnail = pixbuf;
+    }
+
+  g_get_current_time (&cw->thumbnail_time);
+  cw->thumbnail_dirty = FALSE;
+}
+
+static glong
+thumbnail_age (MetaCompWindow *cw,
+               GTimeVal       *now)
+{
+  return (now->tv_sec - cw->thumbnail_time.tv_sec) * 1000 +
+    (now->tv_usec - cw->thumbnail_time.tv_usec) / 1000;
+}
+
+static gboolean
+thumbnail_refresh_cb (gpointer data)
+{
+  MetaScreen *screen = data;
+  MetaCompScreen *info = meta_screen_get_compositor_data (screen);
+  GTimeVal now;
+  GList *index;
+  gboolean pending;
+  int rendered;
+
+  g_get_current_time (&now);
+  pending = FALSE;
+  rendered = 0;
+
+  for (index = info->windows; index; index = index->next)
+    {
+      MetaCompWindow *cw = (MetaCompWindow *) index->data;
+
+      if (!cw->thumbnail_dirty)
+        continue;
+
+      if (rendered == THUMBNAIL_REFRESH_BATCH ||
+          thumbnail_age (cw, &now) < THUMBNAIL_REFRESH_INTERVAL)
+        {
+          pending = TRUE;
+          continue;
+        }
+
+      update_thumbnail (cw, info->thumbnail_size);
+      rendered++;
+    }
+
+  if (!pending)
+    info->thumbnail_refresh_id = 0;
+
+  return pending;
+}
+
+/* Called whenever the window's contents may have changed */
+static void
+invalidate_thumbnail (MetaCompWindow *cw)
+{
+  MetaCompScreen *info = meta_screen_get_compositor_data (cw->screen);
+
+  if (cw->window == NULL || info == NULL || info->thumbnail_size == 0)
+    return;
+
+  cw->thumbnail_dirty = TRUE;
+
+  if (info->thumbnail_refresh_id == 0)
+    info->thumbnail_refresh_id =
+      g_timeout_add_full (G_PRIORITY_LOW, THUMBNAIL_REFRESH_TICK,
+                          thumbnail_refresh_cb, cw->screen, NULL);
+}
+
 static void
 repair_win (MetaCompWindow *cw)
 {
@@ -1529,6 +1788,8 @@ repair_win (MetaCompWindow *cw)
   dump_xserver_region ("repair_win", display, parts);
   add_damage (screen, parts);
   cw->damaged = TRUE;
+
+  invalidate_thumbnail (cw);
 }
 
 static void
@@ -1614,6 +1875,9 @@ free_win (MetaCompWindow *cw,
       if (info!=NULL && cw->type == META_COMP_WINDOW_DOCK)
         info->dock_windows = g_slist_remove (info->dock_windows, cw);
 
+      if (cw->thumbnail)
+        g_object_unref (cw->thumbnail);
+
       g_free (cw);
     }
 }
@@ -2091,6 +2355,45 @@ resize_win (MetaCompWindow *cw,
     }
 }
 
+/* Moves the window without anything else about it changing, so
+   the regions we have for it can just be shifted */
+static void
+move_win (MetaCompWindow *cw,
+          int             x,
+          int             y)
+{
+  MetaScreen *screen = cw->screen;
+  MetaDisplay *display = meta_screen_get_display (screen);
+  Display *xdisplay = meta_display_get_xdisplay (display);
+  XserverRegion damage;
+  int dx, dy;
+
+  dx = x - cw->attrs.x;
+  dy = y - cw->attrs.y;
+  if (dx == 0 && dy == 0)
+    return;
+
+  damage = XFixesCreateRegion (xdisplay, NULL, 0);
+  if (cw->extents)
+    XFixesCopyRegion (xdisplay, damage, cw->extents);
+
+  cw->attrs.x = x;
+  cw->attrs.y = y;
+
+  if (cw->extents)
+    XFixesTranslateRegion (xdisplay, cw->extents, dx, dy);
+  else
+    cw->extents = win_extents (cw);
+
+  if (cw->border_size)
+    XFixesTranslateRegion (xdisplay, cw->border_size, dx, dy);
+
+  XFixesUnionRegion (xdisplay, damage, damage, cw->extents);
+
+  dump_xserver_region ("move_win", display, damage);
+  add_damage (screen, damage);
+}
+
 /* event processors must all be called with an error trap in place */
 static void
 process_circulate_notify (MetaCompositorXRender  *compositor,
@@ -2165,8 +2468,22 @@ process_configure_notify (MetaCompositorXRender  *compositor,
         }
 
       restack_win (cw, event->above);
-      resize_win (cw, event->x, event->y, event->width, event->height,
-                  event->border_width, event->override_redirect);
+
+      if (cw->moving)
+        {
+          /* The window is already drawn further along the drag than
+           * this; only a change of size is news to us.
+           */
+          if (event->width != cw->attrs.width ||
+              event->height != cw->attrs.height ||
+              event->border_width != cw->attrs.border_width)
+            resize_win (cw, cw->attrs.x, cw->attrs.y,
+                        event->width, event->height,
+                        event->border_width, event->override_redirect);
+        }
+      else
+        resize_win (cw, event->x, event->y, event->width, event->height,
+                    event->border_width, event->override_redirect);
     }
   else
     { 
@@ -2644,6 +2961,9 @@ xrender_unmanage_screen (MetaCompositor *compositor,
 
   hide_overlay_window (screen, info->output);
 
+  if (info->thumbnail_refresh_id)
+    g_source_remove (info->thumbnail_refresh_id);
+
   /* Destroy the windows */
   for (index = info->windows; index; index = index->next) 
     {
@@ -2700,39 +3020,10 @@ xrender_destroy (MetaCompositor *compositor)
 }
 
 #if 0
-/* Taking these out because they're empty and never called, and the
+/* Taking this out because it's empty and never called, and the
  * compiler complains -- tthurman
  */
 
-static void
-xrender_begin_move (MetaCompositor *compositor,
-                    MetaWindow     *window,
-                    MetaRectangle  *initial,
-                    int             grab_x,
-                    int             grab_y)
-{
-#ifdef HAVE_COMPOSITE_EXTENSIONS
-#endif
-}
-
-static void
-xrender_update_move (MetaCompositor *compositor,
-                     MetaWindow     *window,
-                     int             x,
-                     int             y)
-{
-#ifdef HAVE_COMPOSITE_EXTENSIONS
-#endif
-}
-
-static void
-xrender_end_move (MetaCompositor *compositor,
-                  MetaWindow     *window)
-{
-#ifdef HAVE_COMPOSITE_EXTENSIONS
-#endif
-}
-
 static void
 xrender_free_window (MetaCompositor *compositor,
                      MetaWindow     *window)
@@ -2825,31 +3116,125 @@ xrender_process_event (MetaCompositor *compositor,
 #endif
 }
 
+static MetaCompWindow *
+find_window_for_meta_window (MetaWindow *window)
+{
+  MetaScreen *screen = meta_window_get_screen (window);
+  MetaFrame *frame = meta_window_get_frame (window);
+
+  return find_window_for_screen (screen, frame ? meta_frame_get_xwindow (frame) : 
+                                 meta_window_get_xwindow (window));
+}
+
+static void
+xrender_begin_move (MetaCompositor *compositor,
+                    MetaWindow     *window,
+                    MetaRectangle  *initial,
+                    int             grab_x,
+                    int             grab_y)
+{
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  MetaCompositorXRender *xrc = (MetaCompositorXRender *) compositor;
+  MetaCompWindow *cw = find_window_for_meta_window (window);
+
+  if (cw == NULL)
+    return;
+
+  cw->moving = TRUE;
+  cw->move_offset_x = initial->x - grab_x;
+  cw->move_offset_y = initial->y - grab_y;
+
+  /* We may be starting over after the window was resized mid-drag,
+     before the server has told us where that left it */
+  meta_error_trap_push (xrc->display);
+  move_win (cw, initial->x, initial->y);
+  meta_error_trap_pop (xrc->display, FALSE);
+#endif
+}
+
+static void
+xrender_update_move (MetaCompositor *compositor,
+                     MetaWindow     *window,
+                     int             x,
+                     int             y)
+{
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  MetaCompositorXRender *xrc = (MetaCompositorXRender *) compositor;
+  MetaCompWindow *cw = find_window_for_meta_window (window);
+
+  if (cw == NULL || !cw->moving)
+    return;
+
+  meta_error_trap_push (xrc->display);
+  move_win (cw, x + cw->move_offset_x, y + cw->move_offset_y);
+  meta_error_trap_pop (xrc->display, FALSE);
+
+#ifndef USE_IDLE_REPAINT
+  repair_display (xrc->display);
+#endif
+#endif
+}
+
+static void
+xrender_end_move (MetaCompositor *compositor,
+                  MetaWindow     *window)
+{
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  MetaCompWindow *cw = find_window_for_meta_window (window);
+
+  /* The window's last ConfigureNotify will put it where it really
+     ended up */
+  if (cw != NULL)
+    cw->moving = FALSE;
+#endif
+}
+
 static Pixmap
 xrender_get_window_pixmap (MetaCompositor *compositor,
                            MetaWindow     *window)
 {
 #ifdef HAVE_COMPOSITE_EXTENSIONS
-  MetaCompWindow *cw = NULL;
-  MetaScreen *screen = meta_window_get_screen (window);
-  MetaFrame *frame = meta_window_get_frame (window);
+  MetaCompWindow *cw = find_window_for_meta_window (window);
 
-  cw = find_window_for_screen (screen, frame ? meta_frame_get_xwindow (frame) : 
-                               meta_window_get_xwindow (window));
   if (cw == NULL)
     return None;
 
-#ifdef HAVE_NAME_WINDOW_PIXMAP
-  if (have_name_window_pixmap (meta_window_get_display (window)))
+  return window_back_pixmap (cw);
+#endif
+}
+
+static GdkPixbuf *
+xrender_get_window_thumbnail (MetaCompositor *compositor,
+                              MetaWindow     *window,
+                              int             max_size)
+{
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  MetaCompWindow *cw = find_window_for_meta_window (window);
+  MetaCompScreen *info;
+
+  if (cw == NULL)
+    return NULL;
+
+  info = meta_screen_get_compositor_data (cw->screen);
+  if (info == NULL)
+    return NULL;
+
+  /* A thumbnail that is merely stale is good enough: the refresh is
+     already queued, and waiting for it is what we're here to avoid */
+  if (cw->thumbnail == NULL ||
+      MAX (gdk_pixbuf_get_width (cw->thumbnail),
+           gdk_pixbuf_get_height (cw->thumbnail)) != max_size)
     {
-      if (meta_window_is_shaded (window))
-        return cw->shaded_back_pixmap;
-      else
-        return cw->back_pixmap;
+      info->thumbnail_size = max_size;
+      update_thumbnail (cw, max_size);
     }
-  else
-#endif
-    return None;
+
+  if (cw->thumbnail == NULL)
+    return NULL;
+
+  return g_object_ref (cw->thumbnail);
+#else
+  return NULL;
 #endif
 }
 
@@ -3004,7 +3389,11 @@ static MetaCompositor comp_info = {
   xrender_set_updates,
   xrender_process_event,
   xrender_get_window_pixmap,
-  xrender_set_active_window
+  xrender_get_window_thumbnail,
+  xrender_set_active_window,
+  xrender_begin_move,
+  xrender_update_move,
+  xrender_end_move
 };
 
 MetaCompositor *
@@ -121,6 +121,26 @@ meta_compositor_get_window_pixmap (MetaCompositor *compositor,
 #endif
 }
 
+/* Returns a new reference to a copy of the window's contents whose
+ * larger dimension is max_size, or NULL if there is none to be had.
+ * The compositor keeps these cached, so this is cheap to call for
+ * every window each time the tab popup is shown.
+ */
+GdkPixbuf *
+meta_compositor_get_window_thumbnail (MetaCompositor *compositor,
+                                      MetaWindow     *window,
+                                      int             max_size)
+{
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (compositor && compositor->get_window_thumbnail)
+    return compositor->get_window_thumbnail (compositor, window, max_size);
+  else
+    return NULL;
+#else
+  return NULL;
+#endif
+}
+
 void
 meta_compositor_set_active_window (MetaCompositor *compositor,
                                    MetaScreen     *screen,
@@ -132,27 +152,48 @@ meta_compositor_set_active_window (MetaCompositor *compositor,
 #endif
 }
 
-/* These functions are unused at the moment */
-void meta_compositor_begin_move (MetaCompositor *compositor,
-                                 MetaWindow     *window,
-                                 MetaRectangle  *initial,
-                                 int             grab_x, 
-                                 int             grab_y)
+/* Tells the compositor that window is being dragged.  initial is the
+ * window's outer rectangle in root coordinates, and grab_x, grab_y a
+ * point that moves with the window, such as the pointer.  From then
+ * on the compositor draws the window wherever update_move takes that
+ * point, without waiting for the server to say the window has moved.
+ */
+void
+meta_compositor_begin_move (MetaCompositor *compositor,
+                            MetaWindow     *window,
+                            MetaRectangle  *initial,
+                            int             grab_x, 
+                            int             grab_y)
 {
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (compositor && compositor->begin_move)
+    compositor->begin_move (compositor, window, initial, grab_x, grab_y);
+#endif
 }
 
-void meta_compositor_update_move (MetaCompositor *compositor,
-                                  MetaWindow     *window,
-                                  int             x, 
-                                  int             y)
+void
+meta_compositor_update_move (MetaCompositor *compositor,
+                             MetaWindow     *window,
+                             int             x, 
+                             int             y)
 {
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (compositor && compositor->update_move)
+    compositor->update_move (compositor, window, x, y);
+#endif
 }
 
-void meta_compositor_end_move (MetaCompositor *compositor,
-                               MetaWindow     *window)
+void
+meta_compositor_end_move (MetaCompositor *compositor,
+                          MetaWindow     *window)
 {
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (compositor && compositor->end_move)
+    compositor->end_move (compositor, window);
+#endif
 }
 
+/* This function is unused at the moment */
 void meta_compositor_free_window (MetaCompositor *compositor,
                                   MetaWindow     *window)
 {
@@ -29,6 +29,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #undef DEBUG_SPEW
 #ifdef DEBUG_SPEW
@@ -45,13 +46,30 @@
 #endif
 
 typedef struct _ListNode ListNode;
+typedef struct _AgPendingSlot AgPendingSlot;
 typedef struct _AgPerDisplayData AgPerDisplayData;
 
 struct _ListNode
 {
   ListNode *next;
+  ListNode *prev;
 };
 
+/* Pending tasks live in a ring ordered by request sequence; a task
+ * that gets its reply out of order leaves a NULL behind until the
+ * slots on either side of it are gone too.
+ */
+struct _AgPendingSlot
+{
+  unsigned long request_seq;
+  AgGetPropertyTask *task;
+};
+
+#define INITIAL_PENDING_SLOTS 32
+
+/* How many freed tasks to keep around for reuse */
+#define MAX_FREE_TASKS 256
+
 struct _AgGetPropertyTask
 {
   ListNode node;
@@ -79,8 +97,10 @@ struct _AgPerDisplayData
   _XAsyncHandler async;
   
   Display *display;
-  ListNode *pending_tasks;
-  ListNode *pending_tasks_tail;
+  AgPendingSlot *pending;
+  unsigned int n_pending_slots;  /* always a power of two */
+  unsigned int pending_head;
+  unsigned int pending_len;      /* slots in use, including NULL ones */
   ListNode *completed_tasks;
   ListNode *completed_tasks_tail;
   int n_tasks_pending;
@@ -89,6 +109,14 @@ struct _AgPerDisplayData
 
 static ListNode *display_datas = NULL;
 static ListNode *display_datas_tail = NULL;
+/* there's almost always just the one display */
+static AgPerDisplayData *last_display_data = NULL;
+
+static ListNode *free_tasks = NULL;
+static int n_free_tasks = 0;
+
+#define PENDING_SLOT(dd, i) \
+  (&(dd)->pending[((dd)->pending_head + (i)) & ((dd)->n_pending_slots - 1)])
 
 static void
 append_to_list (ListNode **head,
@@ -96,6 +124,7 @@ append_to_list (ListNode **head,
                 ListNode  *task)
 {
   task->next = NULL;
+  task->prev = *tail;
   
   if (*tail == NULL)
     {
@@ -115,43 +144,86 @@ remove_from_list (ListNode **head,
                   ListNode **tail,
                   ListNode  *task)
 {
-  ListNode *prev;
-  ListNode *node;
+  /* can't remove what's not there */
+  assert (task->prev != NULL || *head == task);
+  assert (task->next != NULL || *tail == task);
 
-  prev = NULL;
-  node = *head;
-  while (node != NULL)
+  if (task->prev)
+    task->prev->next = task->next;
+  else
+    *head = task->next;
+
+  if (task->next)
+    task->next->prev = task->prev;
+  else
+    *tail = task->prev;
+
+  task->next = NULL;
+  task->prev = NULL;
+}
+
+static Bool
+append_to_pending (AgPerDisplayData  *dd,
+                   AgGetPropertyTask *task)
+{
+  AgPendingSlot *slot;
+
+  if (dd->pending_len == dd->n_pending_slots)
     {
-      if (node == task)
-        {
-          if (prev)
-            prev->next = node->next;
-          else
-            *head = node->next;
-
-          if (node == *tail)
-            *tail = prev;
-          
-          break;
-        }
-      
-      prev = node;
-      node = node->next;
+      AgPendingSlot *slots;
+      unsigned int n_slots;
+      unsigned int i;
+
+      n_slots = dd->n_pending_slots ?
+        dd->n_pending_slots * 2 : INITIAL_PENDING_SLOTS;
+      slots = Xmalloc (n_slots * sizeof (AgPendingSlot));
+      if (slots == NULL)
+        return False;
+
+      for (i = 0; i < dd->pending_len; i++)
+        slots[i] = *PENDING_SLOT (dd, i);
+
+      if (dd->pending)
+        XFree (dd->pending);
+      dd->pending = slots;
+      dd->n_pending_slots = n_slots;
+      dd->pending_head = 0;
     }
 
-  /* can't remove what's not there */
-  assert (node != NULL);
+  /* requests only ever go out in sequence order */
+  assert (dd->pending_len == 0 ||
+          PENDING_SLOT (dd, dd->pending_len - 1)->request_seq <
+          task->request_seq);
 
-  node->next = NULL;
+  slot = PENDING_SLOT (dd, dd->pending_len);
+  slot->request_seq = task->request_seq;
+  slot->task = task;
+  dd->pending_len += 1;
+  dd->n_tasks_pending += 1;
+
+  return True;
 }
 
 static void
-move_to_completed (AgPerDisplayData  *dd,
-                   AgGetPropertyTask *task)
+move_to_completed (AgPerDisplayData *dd,
+                   AgPendingSlot    *slot)
 {
-  remove_from_list (&dd->pending_tasks,
-                    &dd->pending_tasks_tail,
-                    &task->node);
+  AgGetPropertyTask *task;
+
+  task = slot->task;
+  slot->task = NULL;
+
+  /* Trim finished slots off both ends so the first and last
+   * slots always hold a pending task
+   */
+  while (dd->pending_len > 0 && PENDING_SLOT (dd, 0)->task == NULL)
+    {
+      dd->pending_head = (dd->pending_head + 1) & (dd->n_pending_slots - 1);
+      dd->pending_len -= 1;
+    }
+  while (dd->pending_len > 0 &&
+         PENDING_SLOT (dd, dd->pending_len - 1)->task == NULL)
+    dd->pending_len -= 1;
   
   append_to_list (&dd->completed_tasks,
                   &dd->completed_tasks_tail,
@@ -161,42 +233,42 @@ move_to_completed (AgPerDisplayData  *dd,
   dd->n_tasks_completed += 1;
 }
 
-static AgGetPropertyTask*
+static AgPendingSlot*
 find_pending_by_request_sequence (AgPerDisplayData *dd,
                                   unsigned long     request_seq)
 {
-  ListNode *node;
+  AgPendingSlot *slot;
+  unsigned int low;
+  unsigned int high;
 
-  /* if the sequence is after our last pending task, we
-   * aren't going to find a match
-   */
-  {
-    AgGetPropertyTask *task = (AgGetPropertyTask*) dd->pending_tasks_tail;
-    if (task != NULL)
-      {
-        if (task->request_seq < request_seq)
-          return NULL;
-        else if (task->request_seq == request_seq)
-          return task; /* why not check this */
-      }
-  }
-
-  /* Generally we should get replies in the order we sent
-   * requests, so we should usually be using the task
-   * at the head of the list, if we use any task at all.
-   * I'm not sure this is 100% guaranteed, if it is,
-   * it would be a big speedup.
+  if (dd->pending_len == 0)
+    return NULL;
+
+  /* Replies come back in the order we sent the requests, so if the
+   * reply is ours at all it's nearly always for the oldest task.
    */
-  
-  node = dd->pending_tasks;
-  while (node != NULL)
+  slot = PENDING_SLOT (dd, 0);
+  if (slot->request_seq == request_seq)
+    return slot;
+  else if (request_seq < slot->request_seq ||
+           request_seq > PENDING_SLOT (dd, dd->pending_len - 1)->request_seq)
+    return NULL;
+
+  low = 1;
+  high = dd->pending_len;
+  while (low < high)
     {
-      AgGetPropertyTask *task = (AgGetPropertyTask*) node;
-      
-      if (task->request_seq == request_seq)
-        return task;
-      
-      node = node->next;
+      unsigned int mid;
+
+      mid = low + (high - low) / 2;
+      slot = PENDING_SLOT (dd, mid);
+
+      if (slot->request_seq == request_seq)
+        return slot->task ? slot : NULL;
+      else if (slot->request_seq < request_seq)
+        low = mid + 1;
+      else
+        high = mid;
     }
   
   return NULL;
@@ -212,6 +284,7 @@ async_get_property_handler (Display *dpy,
   xGetPropertyReply  replbuf;
   xGetPropertyReply *reply;
   AgGetPropertyTask *task;
+  AgPendingSlot *slot;
   AgPerDisplayData *dd;
   int bytes_read;
 
@@ -222,15 +295,16 @@ async_get_property_handler (Display *dpy,
           dpy->last_request_read, len);
 #endif
   
-  task = find_pending_by_request_sequence (dd, dpy->last_request_read);
+  slot = find_pending_by_request_sequence (dd, dpy->last_request_read);
 
-  if (task == NULL)
+  if (slot == NULL)
     return False;
 
+  task = slot->task;
   assert (dpy->last_request_read == task->request_seq);
 
   task->have_reply = True;
-  move_to_completed (dd, task);
+  move_to_completed (dd, slot);
   
   /* read bytes so far */
   bytes_read = SIZEOF (xReply);
@@ -468,6 +542,9 @@ get_display_data (Display *display,
 {
   ListNode *node;
   AgPerDisplayData *dd;
+
+  if (last_display_data != NULL && last_display_data->display == display)
+    return last_display_data;
   
   node = display_datas;
   while (node != NULL)
@@ -475,7 +552,10 @@ get_display_data (Display *display,
       dd = (AgPerDisplayData*) node;
       
       if (dd->display == display)
-        return dd;
+        {
+          last_display_data = dd;
+          return dd;
+        }
       
       node = node->next;
     }
@@ -496,6 +576,7 @@ get_display_data (Display *display,
   append_to_list (&display_datas,
                   &display_datas_tail,
                   &dd->node);
+  last_display_data = dd;
   
   return dd;
 }
@@ -503,16 +584,51 @@ get_display_data (Display *display,
 static void
 maybe_free_display_data (AgPerDisplayData *dd)
 {
-  if (dd->pending_tasks == NULL &&
+  if (dd->n_tasks_pending == 0 &&
       dd->completed_tasks == NULL)
     {
       DeqAsyncHandler (dd->display, &dd->async);
       remove_from_list (&display_datas, &display_datas_tail,
                         &dd->node);
+      if (last_display_data == dd)
+        last_display_data = NULL;
+      if (dd->pending)
+        XFree (dd->pending);
       XFree (dd);
     }
 }
 
+static AgGetPropertyTask*
+alloc_task (void)
+{
+  AgGetPropertyTask *task;
+
+  if (free_tasks == NULL)
+    return Xcalloc (1, sizeof (AgGetPropertyTask));
+
+  task = (AgGetPropertyTask*) free_tasks;
+  free_tasks = free_tasks->next;
+  n_free_tasks -= 1;
+
+  memset (task, 0, sizeof (AgGetPropertyTask));
+
+  return task;
+}
+
+static void
+release_task (AgGetPropertyTask *task)
+{
+  if (n_free_tasks >= MAX_FREE_TASKS)
+    {
+      XFree (task);
+      return;
+    }
+
+  task->node.next = free_tasks;
+  free_tasks = &task->node;
+  n_free_tasks += 1;
+}
+
 AgGetPropertyTask*
 ag_task_create (Display *dpy,
                 Window   window,
@@ -545,7 +661,7 @@ ag_task_create (Display *dpy,
   req->longLength = length;
 
   /* Queue up our async task */
-  task = Xcalloc (1, sizeof (AgGetPropertyTask));
+  task = alloc_task ();
   if (task == NULL)
     {
       UnlockDisplay (dpy);
@@ -557,10 +673,12 @@ ag_task_create (Display *dpy,
   task->property = property;
   task->request_seq = dpy->request;
 
-  append_to_list (&dd->pending_tasks,
-                  &dd->pending_tasks_tail,
-                  &task->node);
-  dd->n_tasks_pending += 1;
+  if (!append_to_pending (dd, task))
+    {
+      release_task (task);
+      UnlockDisplay (dpy);
+      return NULL;
+    }
   
   UnlockDisplay (dpy);
 
@@ -577,7 +695,7 @@ free_task (AgGetPropertyTask *task)
                     &task->node);
   task->dd->n_tasks_completed -= 1;
   maybe_free_display_data (task->dd);
-  XFree (task);
+  release_task (task);
 }
 
 Status
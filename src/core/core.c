@@ -756,24 +756,20 @@ void
 meta_invalidate_default_icons (void)
 {
   MetaDisplay *display = meta_get_display ();
-  GSList *windows;
-  GSList *l;
+  MetaDisplayWindowIter iter;
+  MetaWindow *window;
 
   if (display == NULL)
     return; /* We can validly be called before the display is opened. */
 
-  windows = meta_display_list_windows (display);
-  for (l = windows; l != NULL; l = l->next)
+  meta_display_window_iter_init (&iter, display);
+  while ((window = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *window = (MetaWindow*)l->data;
-
       if (window->icon_cache.origin == USING_FALLBACK_ICON)
         {
           meta_icon_cache_free (&(window->icon_cache));
           meta_window_update_icon_now (window);
         }
     }
-
-  g_slist_free (windows);
 }
 
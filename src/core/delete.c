@@ -237,19 +237,16 @@ meta_window_present_delete_dialog (MetaWindow *window, guint32 timestamp)
   
   if (window->dialog_pid >= 0)
     {
-      GSList *windows;
-      GSList *tmp;
+      MetaDisplayWindowIter iter;
+      MetaWindow *w;
 
       /* Activate transient for window that belongs to
        * metacity-dialog
        */
       
-      windows = meta_display_list_windows (window->display);
-      tmp = windows;
-      while (tmp != NULL)
+      meta_display_window_iter_init (&iter, window->display);
+      while ((w = meta_display_window_iter_next (&iter)) != NULL)
         {
-          MetaWindow *w = tmp->data;
-
           if (w->xtransient_for == window->xwindow &&
               w->res_class &&
               g_ascii_strcasecmp (w->res_class, "metacity-dialog") == 0)
@@ -257,10 +254,6 @@ meta_window_present_delete_dialog (MetaWindow *window, guint32 timestamp)
               meta_window_activate (w, timestamp);
               break;
             }
-          
-          tmp = tmp->next;
         }
-
-      g_slist_free (windows);
     }
 }
@@ -53,6 +53,8 @@ typedef struct _MetaWorkspace  MetaWorkspace;
 
 typedef struct _MetaGroupPropHooks  MetaGroupPropHooks;
 
+typedef struct _MetaIconStore MetaIconStore;
+
 typedef struct MetaEdgeResistanceData MetaEdgeResistanceData;
 
 typedef void (* MetaWindowPingFunc) (MetaDisplay *display,
@@ -129,9 +131,17 @@ struct _MetaDisplay
   GSList *screens;
   MetaScreen *active_screen;
   GHashTable *window_ids;
+  /* Every managed MetaWindow, indexed by window->registry_index;
+   * unused slots are NULL and listed in free_window_slots.
+   */
+  GPtrArray *window_registry;
+  GSList *free_window_slots;
   int error_traps;
   int (* error_trap_handler) (Display     *display,
                               XErrorEvent *error);  
+  /* Managed by errors.c */
+  unsigned long error_trap_start_serial;
+  GQueue *ignored_errors;
   int server_grab_count;
 
   /* serials of leave/unmap events that may
@@ -164,22 +174,23 @@ struct _MetaDisplay
   MetaRectangle grab_anchor_window_pos;
   int         grab_latest_motion_x;
   int         grab_latest_motion_y;
+  GTimeVal    grab_latest_motion_time;
+  double      grab_motion_velocity_x;  /* pixels per ms, smoothed */
+  double      grab_motion_velocity_y;
   gulong      grab_mask;
   guint       grab_have_pointer : 1;
   guint       grab_have_keyboard : 1;
   guint       grab_wireframe_active : 1;
   guint       grab_was_cancelled : 1;    /* Only used in wireframe mode */
   guint       grab_frame_action : 1;
+  guint       grab_compositor_move : 1;  /* compositor draws the drag */
   MetaRectangle grab_wireframe_rect;
-  MetaRectangle grab_wireframe_last_xor_rect;
   MetaRectangle grab_initial_window_pos;
   int         grab_initial_x, grab_initial_y;  /* These are only relevant for */
   gboolean    grab_threshold_movement_reached; /* raise_on_click == FALSE.    */
   MetaResizePopup *grab_resize_popup;
   GTimeVal    grab_last_moveresize_time;
   guint32     grab_motion_notify_time;
-  int         grab_wireframe_last_display_width;
-  int         grab_wireframe_last_display_height;
   GList*      grab_old_window_stacking;
   MetaEdgeResistanceData *grab_edge_resistance_data;
   unsigned int grab_last_user_action_was_snap;
@@ -198,6 +209,14 @@ struct _MetaDisplay
   XSyncAlarm  grab_sync_request_alarm;
 #endif
   int	      grab_resize_timeout_id;
+  /* While the compositor draws a move, the window's real position is
+   * only sent to the server once a frame; see update_move()
+   */
+  guint       grab_move_commit_id;
+  int         grab_pending_move_x;
+  int         grab_pending_move_y;
+  int         grab_move_correction_x;  /* where constraints last put it, */
+  int         grab_move_correction_y;  /* relative to where we asked     */
 
   /* Keybindings stuff */
   MetaKeyBinding *key_bindings;
@@ -238,6 +257,9 @@ struct _MetaDisplay
   /* Managed by group-props.c */
   MetaGroupPropHooks *group_prop_hooks;
 
+  /* Managed by iconcache.c */
+  MetaIconStore *icon_store;
+
   /* Managed by compositor.c */
   MetaCompositor *compositor;
   
@@ -356,8 +378,23 @@ void        meta_display_unregister_x_window (MetaDisplay *display,
 gboolean    meta_display_xwindow_is_a_no_focus_window (MetaDisplay *display,
                                                        Window xwindow);
 
+void        meta_display_register_window     (MetaDisplay *display,
+                                              MetaWindow  *window);
+void        meta_display_unregister_window   (MetaDisplay *display,
+                                              MetaWindow  *window);
+
 GSList*     meta_display_list_windows        (MetaDisplay *display);
 
+typedef struct
+{
+  MetaDisplay *display;
+  guint        index;
+} MetaDisplayWindowIter;
+
+void        meta_display_window_iter_init    (MetaDisplayWindowIter *iter,
+                                              MetaDisplay           *display);
+MetaWindow* meta_display_window_iter_next    (MetaDisplayWindowIter *iter);
+
 MetaDisplay* meta_display_for_x_display  (Display     *xdisplay);
 MetaDisplay* meta_get_display            (void);
 
@@ -494,6 +531,12 @@ void meta_display_focus_the_no_focus_window (MetaDisplay *display,
                                              MetaScreen  *screen,
                                              guint32      timestamp);
 
+/* Records the window we expect to get focus next; the workspace
+ * popup draws it as the active window
+ */
+void meta_display_set_expected_focus_window (MetaDisplay *display,
+                                             MetaWindow  *window);
+
 void meta_display_queue_autoraise_callback  (MetaDisplay *display,
                                              MetaWindow  *window);
 void meta_display_remove_autoraise_callback (MetaDisplay *display);
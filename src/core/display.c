@@ -355,6 +355,8 @@ meta_display_open (void)
   the_display->error_trap_synced_at_last_pop = TRUE;
   the_display->error_traps = 0;
   the_display->error_trap_handler = NULL;
+  the_display->error_trap_start_serial = 0;
+  the_display->ignored_errors = g_queue_new ();
   the_display->server_grab_count = 0;
   the_display->display_opening = TRUE;
 
@@ -398,6 +400,8 @@ meta_display_open (void)
   meta_display_init_window_prop_hooks (the_display);
   the_display->group_prop_hooks = NULL;
   meta_display_init_group_prop_hooks (the_display);
+
+  the_display->icon_store = meta_icon_store_new ();
   
   /* Offscreen unmapped window used for _NET_SUPPORTING_WM_CHECK,
    * created in screen_new
@@ -430,6 +434,8 @@ meta_display_open (void)
   
   the_display->window_ids = g_hash_table_new (meta_unsigned_long_hash,
                                           meta_unsigned_long_equal);
+  the_display->window_registry = g_ptr_array_new ();
+  the_display->free_window_slots = NULL;
   
   i = 0;
   while (i < N_IGNORED_SERIALS)
@@ -443,6 +449,7 @@ meta_display_open (void)
   the_display->sentinel_counter = 0;
 
   the_display->grab_resize_timeout_id = 0;
+  the_display->grab_move_commit_id = 0;
   the_display->grab_have_keyboard = FALSE;
   
 #ifdef HAVE_XKB  
@@ -783,75 +790,92 @@ meta_display_open (void)
   return TRUE;
 }
 
-static void
-listify_func (gpointer key, gpointer value, gpointer data)
+/* Returns a list of every MetaWindow; the caller frees the list.
+ * Callers that only want to look at each window once should use
+ * meta_display_window_iter_init() instead, which doesn't allocate.
+ */
+GSList*
+meta_display_list_windows (MetaDisplay *display)
 {
-  GSList **listp;
+  GSList *winlist;
+  guint i;
+
+  winlist = NULL;
+  i = display->window_registry->len;
+  while (i > 0)
+    {
+      MetaWindow *window;
 
-  listp = data;
-  *listp = g_slist_prepend (*listp, value);
+      --i;
+      window = g_ptr_array_index (display->window_registry, i);
+      if (window)
+        winlist = g_slist_prepend (winlist, window);
+    }
+
+  return winlist;
 }
 
-static gint
-ptrcmp (gconstpointer a, gconstpointer b)
+void
+meta_display_register_window (MetaDisplay *display,
+                              MetaWindow  *window)
 {
-  if (a < b)
-    return -1;
-  else if (a > b)
-    return 1;
+  if (display->free_window_slots)
+    {
+      GSList *slot = display->free_window_slots;
+
+      window->registry_index = GPOINTER_TO_UINT (slot->data);
+      display->free_window_slots = g_slist_delete_link (slot, slot);
+
+      g_ptr_array_index (display->window_registry,
+                         window->registry_index) = window;
+    }
   else
-    return 0;
+    {
+      window->registry_index = display->window_registry->len;
+      g_ptr_array_add (display->window_registry, window);
+    }
 }
 
-GSList*
-meta_display_list_windows (MetaDisplay *display)
+void
+meta_display_unregister_window (MetaDisplay *display,
+                                MetaWindow  *window)
 {
-  GSList *winlist;
-  GSList *tmp;
-  GSList *prev;
-  
-  winlist = NULL;
-  g_hash_table_foreach (display->window_ids,
-                        listify_func,
-                        &winlist);
+  g_return_if_fail (g_ptr_array_index (display->window_registry,
+                                       window->registry_index) == window);
 
-  /* Uniquify the list, since both frame windows and plain
-   * windows are in the hash
-   */
-  winlist = g_slist_sort (winlist, ptrcmp);
-
-  prev = NULL;
-  tmp = winlist;
-  while (tmp != NULL)
-    {
-      GSList *next;
+  g_ptr_array_index (display->window_registry, window->registry_index) = NULL;
+  display->free_window_slots =
+    g_slist_prepend (display->free_window_slots,
+                     GUINT_TO_POINTER (window->registry_index));
+}
 
-      next = tmp->next;
-      
-      if (next &&
-          next->data == tmp->data)
-        {
-          /* Delete tmp from list */
+/* Iterates over every MetaWindow.  It is fine to manage or unmanage
+ * windows while iterating: windows that go away are not returned,
+ * and new ones may or may not be.
+ */
+void
+meta_display_window_iter_init (MetaDisplayWindowIter *iter,
+                               MetaDisplay           *display)
+{
+  iter->display = display;
+  iter->index = 0;
+}
 
-          if (prev)
-            prev->next = next;
+MetaWindow*
+meta_display_window_iter_next (MetaDisplayWindowIter *iter)
+{
+  GPtrArray *registry = iter->display->window_registry;
 
-          if (tmp == winlist)
-            winlist = next;
-          
-          g_slist_free_1 (tmp);
+  while (iter->index < registry->len)
+    {
+      MetaWindow *window = g_ptr_array_index (registry, iter->index);
 
-          /* leave prev unchanged */
-        }
-      else
-        {
-          prev = tmp;
-        }
-      
-      tmp = next;
+      iter->index++;
+      if (window)
+        return window;
     }
 
-  return winlist;
+  return NULL;
 }
 
 void
@@ -909,6 +933,8 @@ meta_display_close (MetaDisplay *display,
    * unregister windows
    */
   g_hash_table_destroy (display->window_ids);
+  g_ptr_array_free (display->window_registry, TRUE);
+  g_slist_free (display->free_window_slots);
 
   if (display->leader_window != None)
     XDestroyWindow (display->xdisplay, display->leader_window);
@@ -917,6 +943,8 @@ meta_display_close (MetaDisplay *display,
 
   meta_display_free_window_prop_hooks (display);
   meta_display_free_group_prop_hooks (display);
+
+  meta_icon_store_free (display->icon_store);
   
   g_free (display->name);
 
@@ -924,6 +952,9 @@ meta_display_close (MetaDisplay *display,
 
   if (display->compositor)
     meta_compositor_destroy (display->compositor);
+
+  meta_errors_forget_ignored (display);
+  g_queue_free (display->ignored_errors);
   
   g_free (display);
   the_display = NULL;
@@ -3210,16 +3241,6 @@ meta_display_begin_grab_op (MetaDisplay *display,
 {
   Window grab_xwindow;
   
-  if (grab_op_is_mouse (op) && meta_grab_op_is_moving (op))
-    {
-      if (display->compositor)
-	{
-	  meta_compositor_begin_move (display->compositor,
-				      window, &window->rect,
-				      root_x, root_y);
-	}
-    }
-  
   meta_topic (META_DEBUG_WINDOW_OPS,
               "Doing grab op %u on window %s button %d pointer already grabbed: %d pointer pos %d,%d\n",
               op, window ? window->desc : "none", button, pointer_already_grabbed,
@@ -3304,6 +3325,9 @@ meta_display_begin_grab_op (MetaDisplay *display,
   display->grab_anchor_root_y = root_y;
   display->grab_latest_motion_x = root_x;
   display->grab_latest_motion_y = root_y;
+  g_get_current_time (&display->grab_latest_motion_time);
+  display->grab_motion_velocity_x = 0.0;
+  display->grab_motion_velocity_y = 0.0;
   display->grab_last_moveresize_time.tv_sec = 0;
   display->grab_last_moveresize_time.tv_usec = 0;
   display->grab_motion_notify_time = 0;
@@ -3314,6 +3338,9 @@ meta_display_begin_grab_op (MetaDisplay *display,
 #endif
   display->grab_was_cancelled = FALSE;
   display->grab_frame_action = frame_action;
+  display->grab_compositor_move = FALSE;
+  display->grab_move_correction_x = 0;
+  display->grab_move_correction_y = 0;
 
   if (display->grab_resize_timeout_id)
     {
@@ -3358,8 +3385,7 @@ meta_display_begin_grab_op (MetaDisplay *display,
 			   display->grab_window->sync_request_counter, init);
 	  
 	  display->grab_window->sync_request_serial = 0;
-	  display->grab_window->sync_request_time.tv_sec = 0;
-	  display->grab_window->sync_request_time.tv_usec = 0;
+	  display->grab_window->sync_request_acked = 0;
 	  
           values.trigger.counter = display->grab_window->sync_request_counter;
           values.trigger.value_type = XSyncAbsolute;
@@ -3394,6 +3420,26 @@ meta_display_begin_grab_op (MetaDisplay *display,
 #endif
     }
   
+  if (display->compositor &&
+      window &&
+      grab_op_is_mouse (op) &&
+      meta_grab_op_is_moving (op) &&
+      !display->grab_wireframe_active)
+    {
+      MetaRectangle outer;
+      MetaRectangle client;
+
+      /* update_move() follows the client window rather than the
+       * pointer, so that it can show where constraints put it
+       */
+      meta_window_get_outer_rect (window, &outer);
+      meta_window_get_client_root_coords (window, &client);
+      meta_compositor_begin_move (display->compositor,
+                                  window, &outer,
+                                  client.x, client.y);
+      display->grab_compositor_move = TRUE;
+    }
+
   meta_topic (META_DEBUG_WINDOW_OPS,
               "Grab op %u on window %s successful\n",
               display->grab_op, window ? window->desc : "(null)");
@@ -3553,13 +3599,34 @@ meta_display_end_grab_op (MetaDisplay *display,
       meta_window_calc_showing (display->grab_window);
     }
 
-  if (display->compositor &&
-      display->grab_window &&
-      grab_op_is_mouse (display->grab_op) && 
-      meta_grab_op_is_moving (display->grab_op))
+  if (display->grab_compositor_move)
     {
+      MetaRectangle client;
+
+      /* Put the window where the compositor has been showing it,
+       * unless cancelling the move has already put it back
+       */
+      if (display->grab_move_commit_id)
+        {
+          g_source_remove (display->grab_move_commit_id);
+          display->grab_move_commit_id = 0;
+
+          if (!display->grab_was_cancelled)
+            meta_window_move (display->grab_window,
+                              TRUE,
+                              display->grab_pending_move_x,
+                              display->grab_pending_move_y);
+        }
+
+      /* The compositor may still be showing where the drag was going */
+      meta_window_get_client_root_coords (display->grab_window, &client);
+      meta_compositor_update_move (display->compositor,
+                                   display->grab_window,
+                                   client.x, client.y);
+
       meta_compositor_end_move (display->compositor,
 				display->grab_window);
+      display->grab_compositor_move = FALSE;
     }
   
   if (display->grab_have_pointer)
@@ -3875,15 +3942,12 @@ meta_display_update_active_window_hint (MetaDisplay *display)
 void
 meta_display_queue_retheme_all_windows (MetaDisplay *display)
 {
-  GSList* windows;
-  GSList *tmp;
+  MetaDisplayWindowIter iter;
+  MetaWindow *window;
 
-  windows = meta_display_list_windows (display);
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, display);
+  while ((window = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *window = tmp->data;
-      
       meta_window_queue (window, META_QUEUE_MOVE_RESIZE);
       if (window->frame)
         {
@@ -3891,11 +3955,7 @@ meta_display_queue_retheme_all_windows (MetaDisplay *display)
           
           meta_frame_queue_draw (window->frame);
         }
-      
-      tmp = tmp->next;
     }
-
-  g_slist_free (windows);
 }
 
 void
@@ -4385,16 +4445,14 @@ meta_display_get_tab_list (MetaDisplay   *display,
   tab_list = g_list_reverse (tab_list);
 
   {
-    GSList *tmp;
+    MetaDisplayWindowIter iter;
     MetaWindow *l_window;
 
-    tmp = meta_display_list_windows (display);
+    meta_display_window_iter_init (&iter, display);
 
     /* Go through all windows */
-    while (tmp != NULL)
+    while ((l_window = meta_display_window_iter_next (&iter)) != NULL)
       {
-        l_window=tmp->data;
-
         /* Check to see if it demands attention */
         if (l_window->wm_state_demands_attention && 
             l_window->workspace!=workspace &&
@@ -4403,9 +4461,7 @@ meta_display_get_tab_list (MetaDisplay   *display,
             /* if it does, add it to the popup */
             tab_list = g_list_prepend (tab_list, l_window);
           }
-
-        tmp = tmp->next;
-      } /* End while tmp!=NULL */
+      }
   }
   
   return tab_list;
@@ -4861,19 +4917,15 @@ prefs_changed_callback (MetaPreference pref,
       pref == META_PREF_FOCUS_MODE)
     {
       MetaDisplay *display = data;
-      GSList *windows;
-      GSList *tmp;
-      
-      windows = meta_display_list_windows (display);
+      MetaDisplayWindowIter iter;
+      MetaWindow *w;
       
       /* Ungrab all */
-      tmp = windows;
-      while (tmp != NULL)
+      meta_display_window_iter_init (&iter, display);
+      while ((w = meta_display_window_iter_next (&iter)) != NULL)
         {
-          MetaWindow *w = tmp->data;
           meta_display_ungrab_window_buttons (display, w->xwindow);
           meta_display_ungrab_focus_window_button (display, w);
-          tmp = tmp->next;
         }
 
       /* change our modifier */
@@ -4881,19 +4933,15 @@ prefs_changed_callback (MetaPreference pref,
         update_window_grab_modifiers (display);
 
       /* Grab all */
-      tmp = windows;
-      while (tmp != NULL)
+      meta_display_window_iter_init (&iter, display);
+      while ((w = meta_display_window_iter_next (&iter)) != NULL)
         {
-          MetaWindow *w = tmp->data;
           if (w->type != META_WINDOW_DOCK)
             {
               meta_display_grab_focus_window_button (display, w);
               meta_display_grab_window_buttons (display, w->xwindow);
             }
-          tmp = tmp->next;
         }
-
-      g_slist_free (windows);
     }
   else if (pref == META_PREF_AUDIBLE_BELL)
     {
@@ -4956,8 +5004,8 @@ sanity_check_timestamps (MetaDisplay *display,
     }
   if (XSERVER_TIME_IS_BEFORE (timestamp, display->last_user_time))
     {
-      GSList *windows;
-      GSList *tmp;
+      MetaDisplayWindowIter iter;
+      MetaWindow *window;
 
       meta_warning ("last_user_time (%u) is greater than comparison "
                     "timestamp (%u).  This most likely represents a buggy "
@@ -4966,12 +5014,9 @@ sanity_check_timestamps (MetaDisplay *display,
                     display->last_user_time, timestamp);
       display->last_user_time = timestamp;
 
-      windows = meta_display_list_windows (display);
-      tmp = windows;
-      while (tmp != NULL)
+      meta_display_window_iter_init (&iter, display);
+      while ((window = meta_display_window_iter_next (&iter)) != NULL)
         {
-          MetaWindow *window = tmp->data;
-          
           if (XSERVER_TIME_IS_BEFORE (timestamp, window->net_wm_user_time))
             {
               meta_warning ("%s appears to be one of the offending windows "
@@ -4979,11 +5024,7 @@ sanity_check_timestamps (MetaDisplay *display,
                             window->desc, window->net_wm_user_time);
               window->net_wm_user_time = timestamp;
             }
-          
-          tmp = tmp->next;
         }
-
-      g_slist_free (windows);
     }
 }
 
@@ -5055,7 +5096,7 @@ meta_display_set_input_focus_window (MetaDisplay *display,
                   timestamp);
   meta_error_trap_pop (display, FALSE);
 
-  display->expected_focus_window = window;
+  meta_display_set_expected_focus_window (display, window);
   display->last_focus_time = timestamp;
   display->active_screen = window->screen;
 
@@ -5063,6 +5104,21 @@ meta_display_set_input_focus_window (MetaDisplay *display,
     meta_display_remove_autoraise_callback (window->display);
 }
 
+void
+meta_display_set_expected_focus_window (MetaDisplay *display,
+                                        MetaWindow  *window)
+{
+  if (display->expected_focus_window == window)
+    return;
+
+  if (display->expected_focus_window)
+    meta_window_invalidate_workspace_thumbnails (display->expected_focus_window);
+  if (window)
+    meta_window_invalidate_workspace_thumbnails (window);
+
+  display->expected_focus_window = window;
+}
+
 void
 meta_display_focus_the_no_focus_window (MetaDisplay *display, 
                                         MetaScreen  *screen,
@@ -5075,7 +5131,7 @@ meta_display_focus_the_no_focus_window (MetaDisplay *display,
                   screen->no_focus_window,
                   RevertToPointerRoot,
                   timestamp);
-  display->expected_focus_window = NULL;
+  meta_display_set_expected_focus_window (display, NULL);
   display->last_focus_time = timestamp;
   display->active_screen = screen;
 
@@ -513,36 +513,87 @@ draw_box_animation (MetaScreen     *screen,
   XFlush (context->screen->display->xdisplay);  
 }
 
-void
-meta_effects_begin_wireframe (MetaScreen          *screen,
-                              const MetaRectangle *rect,
-                              int                  width,
-                              int                  height)
+/* The wireframe shown while moving or resizing with reduced_resources.
+ *
+ * Where we have the shape extension it's a shaped override-redirect
+ * window, which stays on screen by itself: no server grab, no erasing,
+ * and each update is a few requests without a round trip.  It can't
+ * invert what's under it, so its lines are black with a white inner
+ * half instead.  Otherwise
+ * it's XOR-ed onto the root window under a server grab, as it always
+ * was.  Either way updates that come in faster than one per
+ * WIREFRAME_FRAME_INTERVAL are folded into the next one.
+ */
+#define WIREFRAME_FRAME_INTERVAL 16
+
+/* Room for the longest label we'll draw, "99999 x 99999" */
+#define WIREFRAME_LABEL_MAX_CHARS 13
+
+#define LINE_WIDTH META_WIREFRAME_XOR_LINE_WIDTH
+
+typedef struct
 {
-  /* Grab the X server to avoid screen dirt */
-  meta_display_grab (screen->display);
-  meta_ui_push_delay_exposes (screen->ui);  
+  /* the outline is drawn along this, LINE_WIDTH wide */
+  MetaRectangle outline;
 
-  meta_effects_update_wireframe (screen, 
-                                 NULL, -1, -1,
-                                 rect, width, height);
-}
+  gboolean has_label;
+  XRectangle label_box;
+  char label[32];
+  int label_length;
+
+  int n_segments;
+  XSegment segments[8];
+} WireframeShape;
+
+typedef struct
+{
+  MetaScreen *screen;
+
+  /* what's on the screen */
+  gboolean drawn;
+  MetaRectangle drawn_rect;
+  int drawn_width;
+  int drawn_height;
+
+  /* what should be, at the end of this frame */
+  gboolean pending;
+  MetaRectangle pending_rect;
+  int pending_width;
+  int pending_height;
+  guint frame_timeout;
+
+  /* None if we're XOR-ing onto the root window */
+  Window xwindow;
+  /* White child of xwindow, shaped to the inner half of the lines, so
+   * the outline shows up on dark and light backgrounds alike
+   */
+  Window inner_xwindow;
+  Pixmap label_mask;
+  GC label_gc;
+  int label_mask_width;
+  int label_mask_height;
+} Wireframe;
+
+/* There's only ever one grab op going on */
+static Wireframe *wireframe = NULL;
 
 static void
-draw_xor_rect (MetaScreen          *screen,
-               const MetaRectangle *rect,
-               int                  width,
-               int                  height)
+compute_wireframe_shape (MetaScreen          *screen,
+                         const MetaRectangle *rect,
+                         int                  width,
+                         int                  height,
+                         WireframeShape      *shape)
 {
   /* The lines in the center can't overlap the rectangle or each
    * other, or the XOR gets reversed. So we have to draw things
    * a bit oddly.
    */
-  XSegment segments[8];
   MetaRectangle shrunk_rect;
+  XSegment *segments;
   int i;
-  
-#define LINE_WIDTH META_WIREFRAME_XOR_LINE_WIDTH
+
+  shape->has_label = FALSE;
+  shape->n_segments = 0;
 
   /* We don't want the wireframe going outside the window area.
    * It makes it harder for the user to position windows and it exposes other
@@ -555,81 +606,49 @@ draw_xor_rect (MetaScreen          *screen,
   shrunk_rect.width -= LINE_WIDTH + 2 * (LINE_WIDTH % 2);
   shrunk_rect.height -= LINE_WIDTH + 2 * (LINE_WIDTH % 2);
 
-  XDrawRectangle (screen->display->xdisplay,
-                  screen->xroot,
-                  screen->root_xor_gc,
-                  shrunk_rect.x, shrunk_rect.y,
-                  shrunk_rect.width, shrunk_rect.height);
+  shape->outline = shrunk_rect;
 
   /* Don't put lines inside small rectangles where they won't fit */
   if (shrunk_rect.width < (LINE_WIDTH * 4) ||
       shrunk_rect.height < (LINE_WIDTH * 4))
     return;
 
-  if ((width >= 0) && (height >= 0))
+  if ((width >= 0) && (height >= 0) && screen->wireframe_font != None)
     {
-      XGCValues gc_values = { 0 };
+      int text_width, text_height; 
+      int box_width, box_height;
 
-      if (XGetGCValues (screen->display->xdisplay,
-                        screen->root_xor_gc, 
-                        GCFont, &gc_values))
-        {
-          char *text;
-          int text_length;
-
-          XFontStruct *font_struct;
-          int text_width, text_height; 
-          int box_x, box_y;
-          int box_width, box_height;
-
-          font_struct = XQueryFont (screen->display->xdisplay,
-                                    gc_values.font);
-
-          if (font_struct != NULL)
-            {
-              text = g_strdup_printf ("%d x %d", width, height);
-              text_length = strlen (text);
-
-              text_width = text_length * font_struct->max_bounds.width;
-              text_height = font_struct->max_bounds.descent + 
-                            font_struct->max_bounds.ascent;
-
-              box_width = text_width + 2 * LINE_WIDTH;
-              box_height = text_height + 2 * LINE_WIDTH;
+      g_snprintf (shape->label, sizeof (shape->label),
+                  "%d x %d", width, height);
+      shape->label_length = strlen (shape->label);
 
+      text_width = shape->label_length * screen->wireframe_char_width;
+      text_height = screen->wireframe_font_ascent +
+                    screen->wireframe_font_descent;
 
-              box_x = shrunk_rect.x + (shrunk_rect.width - box_width) / 2;
-              box_y = shrunk_rect.y + (shrunk_rect.height - box_height) / 2;
+      box_width = text_width + 2 * LINE_WIDTH;
+      box_height = text_height + 2 * LINE_WIDTH;
 
-              if ((box_width < shrunk_rect.width) &&
-                  (box_height < shrunk_rect.height))
-                {
-                  XFillRectangle (screen->display->xdisplay,
-                                  screen->xroot,
-                                  screen->root_xor_gc,
-                                  box_x, box_y,
-                                  box_width, box_height);
-                  XDrawString (screen->display->xdisplay, 
-                               screen->xroot,
-                               screen->root_xor_gc,
-                               box_x + LINE_WIDTH,
-                               box_y + LINE_WIDTH + font_struct->max_bounds.ascent,
-                               text, text_length);
-                }
-
-              g_free (text);
-
-              XFreeFontInfo (NULL, font_struct, 1);
+      if ((box_width < shrunk_rect.width) &&
+          (box_height < shrunk_rect.height))
+        {
+          shape->has_label = TRUE;
+          shape->label_box.x = shrunk_rect.x + (shrunk_rect.width - box_width) / 2;
+          shape->label_box.y = shrunk_rect.y + (shrunk_rect.height - box_height) / 2;
+          shape->label_box.width = box_width;
+          shape->label_box.height = box_height;
+        }
 
-              if ((box_width + LINE_WIDTH) >= (shrunk_rect.width / 3))
-                return;
+      if ((box_width + LINE_WIDTH) >= (shrunk_rect.width / 3))
+        return;
 
-              if ((box_height + LINE_WIDTH) >= (shrunk_rect.height / 3))
-                return;
-            }
-        }
+      if ((box_height + LINE_WIDTH) >= (shrunk_rect.height / 3))
+        return;
     }
 
+  segments = shape->segments;
+  shape->n_segments = G_N_ELEMENTS (shape->segments);
+
   /* Two vertical lines at 1/3 and 2/3 */
   segments[0].x1 = shrunk_rect.x + shrunk_rect.width / 3;
   segments[0].y1 = shrunk_rect.y + LINE_WIDTH / 2 + LINE_WIDTH % 2;
@@ -668,44 +687,406 @@ draw_xor_rect (MetaScreen          *screen,
       segments[i].y2 = segments[i].y1;
       ++i;
     }
-  
-  XDrawSegments (screen->display->xdisplay,
-                 screen->xroot,
-                 screen->root_xor_gc,
-                 segments,
-                 G_N_ELEMENTS (segments));
+}
+
+static void
+draw_xor_rect (MetaScreen          *screen,
+               const MetaRectangle *rect,
+               int                  width,
+               int                  height)
+{
+  WireframeShape shape;
+
+  compute_wireframe_shape (screen, rect, width, height, &shape);
+
+  XDrawRectangle (screen->display->xdisplay,
+                  screen->xroot,
+                  screen->root_xor_gc,
+                  shape.outline.x, shape.outline.y,
+                  shape.outline.width, shape.outline.height);
+
+  if (shape.has_label)
+    {
+      XFillRectangle (screen->display->xdisplay,
+                      screen->xroot,
+                      screen->root_xor_gc,
+                      shape.label_box.x, shape.label_box.y,
+                      shape.label_box.width, shape.label_box.height);
+      XDrawString (screen->display->xdisplay, 
+                   screen->xroot,
+                   screen->root_xor_gc,
+                   shape.label_box.x + LINE_WIDTH,
+                   shape.label_box.y + LINE_WIDTH +
+                   screen->wireframe_font_ascent,
+                   shape.label, shape.label_length);
+    }
+
+  if (shape.n_segments > 0)
+    XDrawSegments (screen->display->xdisplay,
+                   screen->xroot,
+                   screen->root_xor_gc,
+                   shape.segments,
+                   shape.n_segments);
+}
+
+#ifdef HAVE_SHAPE
+static void
+create_wireframe_window (Wireframe *wf)
+{
+  MetaScreen *screen;
+  XSetWindowAttributes attrs;
+
+  screen = wf->screen;
+
+  attrs.override_redirect = True;
+  attrs.background_pixel = BlackPixel (screen->display->xdisplay,
+                                       screen->number);
+
+  wf->xwindow = XCreateWindow (screen->display->xdisplay,
+                               screen->xroot,
+                               0, 0, 1, 1,
+                               0,
+                               CopyFromParent,
+                               CopyFromParent,
+                               (Visual *)CopyFromParent,
+                               CWOverrideRedirect | CWBackPixel,
+                               &attrs);
+
+  attrs.background_pixel = WhitePixel (screen->display->xdisplay,
+                                       screen->number);
+
+  wf->inner_xwindow = XCreateWindow (screen->display->xdisplay,
+                                     wf->xwindow,
+                                     0, 0, 1, 1,
+                                     0,
+                                     CopyFromParent,
+                                     CopyFromParent,
+                                     (Visual *)CopyFromParent,
+                                     CWBackPixel,
+                                     &attrs);
+  XMapWindow (screen->display->xdisplay, wf->inner_xwindow);
+
+  if (screen->wireframe_font == None)
+    return;
+
+  /* The label is a black box with a white inside, the text cut out
+   * of the white with a bitmap: set inside the border, clear where
+   * the text goes.
+   */
+  wf->label_mask_width = WIREFRAME_LABEL_MAX_CHARS *
+    screen->wireframe_char_width + 2 * LINE_WIDTH;
+  wf->label_mask_height = screen->wireframe_font_ascent +
+    screen->wireframe_font_descent + 2 * LINE_WIDTH;
+
+  wf->label_mask = XCreatePixmap (screen->display->xdisplay,
+                                  screen->xroot,
+                                  wf->label_mask_width,
+                                  wf->label_mask_height,
+                                  1);
+
+  {
+    XGCValues gc_values;
+
+    gc_values.font = screen->wireframe_font;
+    wf->label_gc = XCreateGC (screen->display->xdisplay,
+                              wf->label_mask,
+                              GCFont,
+                              &gc_values);
+  }
+}
+
+static void
+shape_wireframe_window (Wireframe *wf)
+{
+  MetaScreen *screen;
+  Display *xdisplay;
+  WireframeShape shape;
+  XRectangle xrects[4 + 8 + 1];
+  XRectangle inner_xrects[4 + 8];
+  int n_xrects;
+  int outer_x, outer_y, outer_width, outer_height;
+  int half;
+  gboolean draw_label;
+  int i;
+
+  screen = wf->screen;
+  xdisplay = screen->display->xdisplay;
+
+  compute_wireframe_shape (screen, &wf->pending_rect,
+                           wf->pending_width, wf->pending_height,
+                           &shape);
+
+  XMoveResizeWindow (xdisplay,
+                     wf->xwindow,
+                     wf->pending_rect.x, wf->pending_rect.y,
+                     MAX (wf->pending_rect.width, 1),
+                     MAX (wf->pending_rect.height, 1));
+  XResizeWindow (xdisplay,
+                 wf->inner_xwindow,
+                 MAX (wf->pending_rect.width, 1),
+                 MAX (wf->pending_rect.height, 1));
+
+  /* Everything below is relative to the window.  The outline is
+   * what XDrawRectangle() would have covered with a LINE_WIDTH pen;
+   * the outer half of each line is black and the inner half white.
+   */
+  outer_x = shape.outline.x - wf->pending_rect.x - LINE_WIDTH / 2;
+  outer_y = shape.outline.y - wf->pending_rect.y - LINE_WIDTH / 2;
+  outer_width = shape.outline.width + LINE_WIDTH;
+  outer_height = shape.outline.height + LINE_WIDTH;
+  half = LINE_WIDTH / 2;
+
+  xrects[0].x = outer_x;
+  xrects[0].y = outer_y;
+  xrects[0].width = MAX (outer_width, 0);
+  xrects[0].height = LINE_WIDTH;
+
+  xrects[1] = xrects[0];
+  xrects[1].y = outer_y + outer_height - LINE_WIDTH;
+
+  xrects[2].x = outer_x;
+  xrects[2].y = outer_y;
+  xrects[2].width = LINE_WIDTH;
+  xrects[2].height = MAX (outer_height, 0);
+
+  xrects[3] = xrects[2];
+  xrects[3].x = outer_x + outer_width - LINE_WIDTH;
+
+  inner_xrects[0].x = outer_x + half;
+  inner_xrects[0].y = outer_y + half;
+  inner_xrects[0].width = MAX (outer_width - 2 * half, 0);
+  inner_xrects[0].height = LINE_WIDTH - half;
+
+  inner_xrects[1] = inner_xrects[0];
+  inner_xrects[1].y = outer_y + outer_height - LINE_WIDTH;
+
+  inner_xrects[2].x = outer_x + half;
+  inner_xrects[2].y = outer_y + half;
+  inner_xrects[2].width = LINE_WIDTH - half;
+  inner_xrects[2].height = MAX (outer_height - 2 * half, 0);
+
+  inner_xrects[3] = inner_xrects[2];
+  inner_xrects[3].x = outer_x + outer_width - LINE_WIDTH;
+
+  n_xrects = 4;
+  for (i = 0; i < shape.n_segments; i++)
+    {
+      XSegment *seg = &shape.segments[i];
+      XRectangle *xrect = &xrects[n_xrects];
+      XRectangle *inner_xrect = &inner_xrects[n_xrects];
+
+      if (seg->x1 == seg->x2)
+        {
+          xrect->x = seg->x1 - wf->pending_rect.x - LINE_WIDTH / 2;
+          xrect->y = seg->y1 - wf->pending_rect.y;
+          xrect->width = LINE_WIDTH;
+          xrect->height = MAX (seg->y2 - seg->y1, 0);
+
+          *inner_xrect = *xrect;
+          inner_xrect->x += half;
+          inner_xrect->width -= half;
+        }
+      else
+        {
+          xrect->x = seg->x1 - wf->pending_rect.x;
+          xrect->y = seg->y1 - wf->pending_rect.y - LINE_WIDTH / 2;
+          xrect->width = MAX (seg->x2 - seg->x1, 0);
+          xrect->height = LINE_WIDTH;
+
+          *inner_xrect = *xrect;
+          inner_xrect->y += half;
+          inner_xrect->height -= half;
+        }
+
+      ++n_xrects;
+    }
+
+  draw_label = shape.has_label && wf->label_mask != None &&
+    shape.label_box.width <= wf->label_mask_width &&
+    shape.label_box.height <= wf->label_mask_height;
+
+  if (draw_label)
+    {
+      xrects[n_xrects].x = shape.label_box.x - wf->pending_rect.x;
+      xrects[n_xrects].y = shape.label_box.y - wf->pending_rect.y;
+      xrects[n_xrects].width = shape.label_box.width;
+      xrects[n_xrects].height = shape.label_box.height;
+    }
+
+  XShapeCombineRectangles (xdisplay, wf->xwindow,
+                           ShapeBounding, 0, 0,
+                           xrects, n_xrects + (draw_label ? 1 : 0),
+                           ShapeSet, Unsorted);
+  XShapeCombineRectangles (xdisplay, wf->inner_xwindow,
+                           ShapeBounding, 0, 0, inner_xrects, n_xrects,
+                           ShapeSet, Unsorted);
+
+  if (draw_label)
+    {
+      XSetForeground (xdisplay, wf->label_gc, 0);
+      XFillRectangle (xdisplay, wf->label_mask, wf->label_gc,
+                      0, 0, wf->label_mask_width, wf->label_mask_height);
+      XSetForeground (xdisplay, wf->label_gc, 1);
+      XFillRectangle (xdisplay, wf->label_mask, wf->label_gc,
+                      half, half,
+                      shape.label_box.width - 2 * half,
+                      shape.label_box.height - 2 * half);
+      XSetForeground (xdisplay, wf->label_gc, 0);
+      XDrawString (xdisplay, wf->label_mask, wf->label_gc,
+                   LINE_WIDTH, LINE_WIDTH + screen->wireframe_font_ascent,
+                   shape.label, shape.label_length);
+
+      XShapeCombineMask (xdisplay, wf->inner_xwindow, ShapeBounding,
+                         shape.label_box.x - wf->pending_rect.x,
+                         shape.label_box.y - wf->pending_rect.y,
+                         wf->label_mask, ShapeUnion);
+    }
+
+  if (!wf->drawn)
+    XMapWindow (screen->display->xdisplay, wf->xwindow);
+}
+#endif /* HAVE_SHAPE */
+
+static void
+wireframe_flush (Wireframe *wf)
+{
+  if (!wf->pending)
+    return;
+
+#ifdef HAVE_SHAPE
+  if (wf->xwindow != None)
+    shape_wireframe_window (wf);
+  else
+#endif
+    {
+      if (wf->drawn)
+        draw_xor_rect (wf->screen, &wf->drawn_rect,
+                       wf->drawn_width, wf->drawn_height);
+      draw_xor_rect (wf->screen, &wf->pending_rect,
+                     wf->pending_width, wf->pending_height);
+    }
+
+  wf->drawn = TRUE;
+  wf->drawn_rect = wf->pending_rect;
+  wf->drawn_width = wf->pending_width;
+  wf->drawn_height = wf->pending_height;
+  wf->pending = FALSE;
+
+  XFlush (wf->screen->display->xdisplay);
+}
+
+static gboolean
+wireframe_frame_timeout (gpointer data)
+{
+  Wireframe *wf = data;
+
+  if (!wf->pending)
+    {
+      /* nothing happened for a whole frame; draw the next update
+       * straight away
+       */
+      wf->frame_timeout = 0;
+      return FALSE;
+    }
+
+  wireframe_flush (wf);
+
+  return TRUE;
+}
+
+void
+meta_effects_begin_wireframe (MetaScreen          *screen,
+                              const MetaRectangle *rect,
+                              int                  width,
+                              int                  height)
+{
+  Wireframe *wf;
+
+  g_return_if_fail (wireframe == NULL);
+
+  wf = g_new0 (Wireframe, 1);
+  wf->screen = screen;
+  wf->xwindow = None;
+  wf->inner_xwindow = None;
+  wf->label_mask = None;
+
+#ifdef HAVE_SHAPE
+  if (META_DISPLAY_HAS_SHAPE (screen->display))
+    create_wireframe_window (wf);
+#endif
+
+  if (wf->xwindow == None)
+    {
+      /* Grab the X server to avoid screen dirt */
+      meta_display_grab (screen->display);
+      meta_ui_push_delay_exposes (screen->ui);  
+    }
+
+  wireframe = wf;
+
+  meta_effects_update_wireframe (screen, rect, width, height);
 }
 
 void
 meta_effects_update_wireframe (MetaScreen          *screen,
-                               const MetaRectangle *old_rect,
-                               int                  old_width,
-                               int                  old_height,
-                               const MetaRectangle *new_rect,
-                               int                  new_width,
-                               int                  new_height)
+                               const MetaRectangle *rect,
+                               int                  width,
+                               int                  height)
 {
-  if (old_rect)
-    draw_xor_rect (screen, old_rect, old_width, old_height);
-    
-  if (new_rect)
-    draw_xor_rect (screen, new_rect, new_width, new_height);
-    
-  XFlush (screen->display->xdisplay);
+  Wireframe *wf = wireframe;
+
+  g_return_if_fail (wf != NULL && wf->screen == screen);
+
+  wf->pending = TRUE;
+  wf->pending_rect = *rect;
+  wf->pending_width = width;
+  wf->pending_height = height;
+
+  /* Draw at once unless we drew less than a frame ago, in which
+   * case the timeout picks up the latest position.
+   */
+  if (wf->frame_timeout == 0)
+    {
+      wireframe_flush (wf);
+      wf->frame_timeout = g_timeout_add (WIREFRAME_FRAME_INTERVAL,
+                                         wireframe_frame_timeout,
+                                         wf);
+    }
 }
 
 void
-meta_effects_end_wireframe (MetaScreen          *screen,
-                            const MetaRectangle *old_rect,
-                            int                  old_width,
-                            int                  old_height)
+meta_effects_end_wireframe (MetaScreen *screen)
 {
-  meta_effects_update_wireframe (screen, 
-                                 old_rect, old_width, old_height,
-                                 NULL, -1, -1);
-  
-  meta_display_ungrab (screen->display);
-  meta_ui_pop_delay_exposes (screen->ui);
+  Wireframe *wf = wireframe;
+
+  g_return_if_fail (wf != NULL && wf->screen == screen);
+
+  if (wf->frame_timeout != 0)
+    g_source_remove (wf->frame_timeout);
+
+  if (wf->xwindow != None)
+    {
+      XDestroyWindow (screen->display->xdisplay, wf->xwindow);
+      if (wf->label_mask != None)
+        {
+          XFreeGC (screen->display->xdisplay, wf->label_gc);
+          XFreePixmap (screen->display->xdisplay, wf->label_mask);
+        }
+    }
+  else
+    {
+      if (wf->drawn)
+        draw_xor_rect (screen, &wf->drawn_rect,
+                       wf->drawn_width, wf->drawn_height);
+
+      meta_display_ungrab (screen->display);
+      meta_ui_pop_delay_exposes (screen->ui);
+    }
+
+  XFlush (screen->display->xdisplay);
+
+  g_free (wf);
+  wireframe = NULL;
 }
 
 static void
@@ -118,11 +118,11 @@ void        meta_effect_run_focus        (MetaWindow         *window,
                                           gpointer            data);
 
 /**
- * Grabs the server and paints a wireframe rectangle on the screen.
- * Since this involves starting a grab, please be considerate of other
- * users and don't keep the grab for long.  You may move the wireframe
- * around using meta_effects_update_wireframe() and remove it, and undo
- * the grab, using meta_effects_end_wireframe().
+ * Puts a wireframe rectangle on the screen.  Without the shape
+ * extension this grabs the server and draws on the root window, so
+ * please be considerate of other users and don't keep it up for long.
+ * You may move the wireframe around using meta_effects_update_wireframe()
+ * and remove it, and undo any grab, using meta_effects_end_wireframe().
  *
  * \param screen  The screen to draw the rectangle on.
  * \param rect    The size of the rectangle to draw.
@@ -136,35 +136,23 @@ void meta_effects_begin_wireframe  (MetaScreen          *screen,
 
 /**
  * Moves a wireframe rectangle around after its creation by
- * meta_effects_begin_wireframe().  (Perhaps we ought to remember the old
- * positions and not require people to pass them in?)
+ * meta_effects_begin_wireframe().  Updates coming faster than the
+ * screen could show them are merged, so the rectangle may lag this
+ * call by up to a frame.
  *
- * \param old_rect  Where the rectangle is now
- * \param old_width The width that was displayed on it (or 0 if there wasn't)
- * \param old_height The height that was displayed on it (or 0 if there wasn't)
- * \param new_rect  Where the rectangle is going
- * \param new_width The width that will be displayed on it (or 0 not to)
- * \param new_height The height that will be displayed on it (or 0 not to)
+ * \param rect    Where the rectangle is going
+ * \param width   The width that will be displayed on it (or 0 not to)
+ * \param height  The height that will be displayed on it (or 0 not to)
  */
 void meta_effects_update_wireframe (MetaScreen          *screen,
-                                    const MetaRectangle *old_rect,
-                                    int                  old_width,
-                                    int                  old_height,
-                                    const MetaRectangle *new_rect,
-                                    int                  new_width,
-                                    int                  new_height);
+                                    const MetaRectangle *rect,
+                                    int                  width,
+                                    int                  height);
 
 /**
- * Removes a wireframe rectangle from the screen and ends the grab started by
- * meta_effects_begin_wireframe().
- *
- * \param old_rect  Where the rectangle is now
- * \param old_width The width that was displayed on it (or 0 if there wasn't)
- * \param old_height The height that was displayed on it (or 0 if there wasn't)
+ * Removes the wireframe rectangle from the screen and ends any grab
+ * started by meta_effects_begin_wireframe().
  */
-void meta_effects_end_wireframe    (MetaScreen          *screen,
-                                    const MetaRectangle *old_rect,
-                                    int                  width,
-                                    int                  height);
+void meta_effects_end_wireframe    (MetaScreen          *screen);
 
 #endif /* META_EFFECTS_H */
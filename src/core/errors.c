@@ -65,6 +65,89 @@ meta_errors_register_foreign_display (Display      *foreign_dpy,
     foreign_displays = info;
 }
 
+/* A run of requests made under error traps that were popped without
+ * waiting for the server.  Any error whose serial falls inside it
+ * belongs to a caller that has already said it doesn't care, so it's
+ * dropped when it finally arrives instead of being reported.
+ */
+typedef struct
+{
+  unsigned long start_serial;
+  unsigned long end_serial;
+} MetaIgnoredErrors;
+
+/* Errors arrive in request order, so once the server is known to have
+ * got past a range none of its errors can still be on the way.
+ */
+static void
+drop_ignored_before (MetaDisplay   *display,
+                     unsigned long  serial)
+{
+  MetaIgnoredErrors *range;
+
+  while ((range = g_queue_peek_head (display->ignored_errors)) != NULL &&
+         range->end_serial < serial)
+    {
+      g_queue_pop_head (display->ignored_errors);
+      g_slice_free (MetaIgnoredErrors, range);
+    }
+}
+
+static void
+ignore_errors_in_range (MetaDisplay   *display,
+                        unsigned long  start_serial,
+                        unsigned long  end_serial)
+{
+  MetaIgnoredErrors *range;
+
+  drop_ignored_before (display,
+                       LastKnownRequestProcessed (display->xdisplay) + 1);
+
+  /* No requests were made under the trap */
+  if (end_serial < start_serial)
+    return;
+
+  /* Back-to-back traps just extend the previous range */
+  range = g_queue_peek_tail (display->ignored_errors);
+  if (range != NULL && range->end_serial + 1 >= start_serial)
+    {
+      range->end_serial = end_serial;
+      return;
+    }
+
+  range = g_slice_new (MetaIgnoredErrors);
+  range->start_serial = start_serial;
+  range->end_serial = end_serial;
+  g_queue_push_tail (display->ignored_errors, range);
+
+  meta_topic (META_DEBUG_ERRORS,
+              "Ignoring errors for requests %lu-%lu, %u ranges pending\n",
+              start_serial, end_serial,
+              g_queue_get_length (display->ignored_errors));
+}
+
+static gboolean
+error_is_ignored (MetaDisplay *display,
+                  XErrorEvent *error)
+{
+  MetaIgnoredErrors *range;
+
+  drop_ignored_before (display, error->serial);
+
+  range = g_queue_peek_head (display->ignored_errors);
+
+  return range != NULL && range->start_serial <= error->serial;
+}
+
+void
+meta_errors_forget_ignored (MetaDisplay *display)
+{
+  MetaIgnoredErrors *range;
+
+  while ((range = g_queue_pop_head (display->ignored_errors)) != NULL)
+    g_slice_free (MetaIgnoredErrors, range);
+}
+
 static void
 meta_error_trap_push_internal (MetaDisplay *display,
                                gboolean     need_sync)
@@ -93,6 +176,9 @@ meta_error_trap_push_internal (MetaDisplay *display,
       g_assert (display->error_trap_handler != x_error_handler);
     }
 
+  if (display->error_traps == 0)
+    display->error_trap_start_serial = NextRequest (display->xdisplay);
+
   display->error_traps += 1;
 
   meta_topic (META_DEBUG_ERRORS, "%d traps remain\n", display->error_traps);
@@ -145,18 +231,18 @@ void
 meta_error_trap_pop (MetaDisplay *display,
                      gboolean     last_request_was_roundtrip)
 {
-  gboolean need_sync;
-
-  /* we only have to sync when popping the outermost trap */
-  need_sync = (display->error_traps == 1 && !last_request_was_roundtrip);
-
-  if (need_sync)
-    meta_topic (META_DEBUG_SYNC, "Syncing on error_trap_pop, traps = %d, roundtrip = %d\n",
-                display->error_traps, last_request_was_roundtrip);
+  /* Nobody is going to look at the result, so rather than syncing
+   * when the outermost trap is popped, remember which requests it
+   * covered and drop their errors whenever they show up.
+   */
+  if (display->error_traps == 1 && !last_request_was_roundtrip)
+    ignore_errors_in_range (display,
+                            display->error_trap_start_serial,
+                            NextRequest (display->xdisplay) - 1);
 
-  display->error_trap_synced_at_last_pop = need_sync || last_request_was_roundtrip;
+  display->error_trap_synced_at_last_pop = last_request_was_roundtrip;
   
-  meta_error_trap_pop_internal (display, need_sync);
+  meta_error_trap_pop_internal (display, FALSE);
 }
 
 void
@@ -189,14 +275,21 @@ int
 meta_error_trap_pop_with_return  (MetaDisplay *display,
                                   gboolean     last_request_was_roundtrip)
 {
+  int result;
+
   if (!last_request_was_roundtrip)
     meta_topic (META_DEBUG_SYNC, "Syncing on error_trap_pop_with_return, traps = %d, roundtrip = %d\n",
                 display->error_traps, last_request_was_roundtrip);
 
   display->error_trap_synced_at_last_pop = TRUE;
   
-  return meta_error_trap_pop_internal (display,
-                                       !last_request_was_roundtrip);
+  result = meta_error_trap_pop_internal (display,
+                                         !last_request_was_roundtrip);
+
+  /* Everything up to here has been answered now */
+  drop_ignored_before (display, NextRequest (display->xdisplay));
+
+  return result;
 }
 
 static int
@@ -225,7 +318,22 @@ x_error_handler (Display     *xdisplay,
   /* Display can be NULL here because the compositing manager
    * has its own Display, but Xlib only has one global error handler
    */
-  if (display->error_traps > 0)
+  if (error_is_ignored (display, error))
+    {
+      /* from a trap that has already been popped; checked first so
+       * it can't be blamed on a trap that's open now
+       */
+      meta_topic (META_DEBUG_ERRORS,
+                  "Ignoring X error from popped trap: %s serial %ld error_code %d request_code %d minor_code %d)\n",
+                  buf,
+                  error->serial, 
+                  error->error_code, 
+                  error->request_code,
+                  error->minor_code);
+
+      retval = 0;
+    }
+  else if (display->error_traps > 0)
     {
       /* we're in an error trap, chain to the trap handler
        * saved from GDK
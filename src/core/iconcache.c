@@ -25,8 +25,17 @@
 #include "iconcache.h"
 #include "ui.h"
 #include "errors.h"
+#include "util.h"
 
 #include <X11/Xatom.h>
+#include <string.h>
+
+#if (defined (__i386__) || defined (__x86_64__)) && \
+    (defined (__clang__) || \
+     (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_X86_ICON_KERNELS 1
+#include <immintrin.h>
+#endif
 
 /* The icon-reading code is also in libwnck, please sync bugfixes */
 
@@ -46,164 +55,595 @@ get_fallback_icons (MetaScreen     *screen,
   *mini_iconp = meta_ui_get_default_mini_icon (screen->ui);
 }
 
+typedef struct
+{
+  int     width;
+  int     height;
+  gulong *data;
+} IconImage;
+
+/* Splits a _NET_WM_ICON property into its images in one pass.
+ * Returns FALSE if the property is malformed anywhere.
+ */
 static gboolean
-find_largest_sizes (gulong *data,
-                    gulong  nitems,
-                    int    *width,
-                    int    *height)
+parse_icon_images (gulong  *data,
+                   gulong   nitems,
+                   GArray  *images,
+                   int     *max_width,
+                   int     *max_height)
 {
-  *width = 0;
-  *height = 0;
+  *max_width = 0;
+  *max_height = 0;
 
   while (nitems > 0)
     {
-      int w, h;
+      IconImage image;
+      gulong size;
 
       if (nitems < 3)
         return FALSE; /* no space for w, h */
 
-      w = data[0];
-      h = data[1];
+      if (data[0] > G_MAXINT16 || data[1] > G_MAXINT16)
+        return FALSE; /* nonsense */
+
+      image.width = data[0];
+      image.height = data[1];
+      image.data = data + 2;
+      size = (gulong) image.width * image.height;
 
-      if (nitems < ((gulong)(w * h) + 2))
+      if (nitems < size + 2)
         return FALSE; /* not enough data */
 
-      *width = MAX (w, *width);
-      *height = MAX (h, *height);
+      g_array_append_val (images, image);
 
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
+      *max_width = MAX (image.width, *max_width);
+      *max_height = MAX (image.height, *max_height);
+
+      data += size + 2;
+      nitems -= size + 2;
     }
 
-  return TRUE;
+  return images->len > 0;
 }
 
-static gboolean
-find_best_size (gulong  *data,
-                gulong   nitems,
-                int      ideal_width,
-                int      ideal_height,
-                int     *width,
-                int     *height,
-                gulong **start)
-{
-  int best_w;
-  int best_h;
-  gulong *best_start;
-  int max_width, max_height;
-
-  *width = 0;
-  *height = 0;
-  *start = NULL;
-
-  if (!find_largest_sizes (data, nitems, &max_width, &max_height))
-    return FALSE;
+static const IconImage *
+find_best_size (GArray *images,
+                int     ideal_width,
+                int     ideal_height,
+                int     max_width,
+                int     max_height)
+{
+  const IconImage *best;
+  int ideal_size;
+  guint i;
 
   if (ideal_width < 0)
     ideal_width = max_width;
   if (ideal_height < 0)
     ideal_height = max_height;
 
-  best_w = 0;
-  best_h = 0;
-  best_start = NULL;
+  /* work with averages */
+  ideal_size = (ideal_width + ideal_height) / 2;
 
-  while (nitems > 0)
+  best = &g_array_index (images, IconImage, 0);
+
+  for (i = 1; i < images->len; i++)
     {
-      int w, h;
-      gboolean replace;
+      const IconImage *this = &g_array_index (images, IconImage, i);
+      int best_size = (best->width + best->height) / 2;
+      int this_size = (this->width + this->height) / 2;
+
+      /* larger than desired is always better than smaller */
+      if (best_size < ideal_size &&
+          this_size >= ideal_size)
+        best = this;
+      /* if we have too small, pick anything bigger */
+      else if (best_size < ideal_size &&
+               this_size > best_size)
+        best = this;
+      /* if we have too large, pick anything smaller
+       * but still >= the ideal
+       */
+      else if (best_size > ideal_size &&
+               this_size >= ideal_size &&
+               this_size < best_size)
+        best = this;
+    }
 
-      replace = FALSE;
+  return best;
+}
 
-      if (nitems < 3)
-        return FALSE; /* no space for w, h */
+/* _NET_WM_ICON is native-endian ARGB held in longs, GdkPixbuf wants
+ * RGBA bytes.
+ */
+static void
+argbdata_to_pixdata_scalar (const gulong *argb_data,
+                            int           len,
+                            guchar       *p)
+{
+  int i;
 
-      w = data[0];
-      h = data[1];
+  for (i = 0; i < len; i++)
+    {
+      gulong argb = argb_data[i];
 
-      if (nitems < ((gulong)(w * h) + 2))
-        break; /* not enough data */
+      p[0] = (argb >> 16) & 0xff;
+      p[1] = (argb >> 8) & 0xff;
+      p[2] = argb & 0xff;
+      p[3] = (argb >> 24) & 0xff;
+      p += 4;
+    }
+}
 
-      if (best_start == NULL)
-        {
-          replace = TRUE;
-        }
-      else
-        {
-          /* work with averages */
-          const int ideal_size = (ideal_width + ideal_height) / 2;
-          int best_size = (best_w + best_h) / 2;
-          int this_size = (w + h) / 2;
-
-          /* larger than desired is always better than smaller */
-          if (best_size < ideal_size &&
-              this_size >= ideal_size)
-            replace = TRUE;
-          /* if we have too small, pick anything bigger */
-          else if (best_size < ideal_size &&
-                   this_size > best_size)
-            replace = TRUE;
-          /* if we have too large, pick anything smaller
-           * but still >= the ideal
-           */
-          else if (best_size > ideal_size &&
-                   this_size >= ideal_size &&
-                   this_size < best_size)
-            replace = TRUE;
-        }
+#ifdef HAVE_X86_ICON_KERNELS
 
-      if (replace)
-        {
-          best_start = data + 2;
-          best_w = w;
-          best_h = h;
-        }
+/* On little-endian x86 each pixel is stored B, G, R, A (followed by
+ * four bytes of padding if longs are 64 bits), so one byte shuffle
+ * turns four of them into RGBA.
+ */
+__attribute__ ((target ("ssse3"))) static void
+argbdata_to_pixdata_ssse3 (const gulong *argb_data,
+                           int           len,
+                           guchar       *p)
+{
+  int i;
+#if GLIB_SIZEOF_LONG == 8
+  const __m128i lo = _mm_setr_epi8 (2, 1, 0, 3, 10, 9, 8, 11,
+                                    -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i hi = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1,
+                                    2, 1, 0, 3, 10, 9, 8, 11);
+
+  for (i = 0; i + 4 <= len; i += 4)
+    {
+      __m128i a, b;
 
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
+      a = _mm_loadu_si128 ((const __m128i *) (argb_data + i));
+      b = _mm_loadu_si128 ((const __m128i *) (argb_data + i + 2));
+      _mm_storeu_si128 ((__m128i *) (p + i * 4),
+                        _mm_or_si128 (_mm_shuffle_epi8 (a, lo),
+                                      _mm_shuffle_epi8 (b, hi)));
     }
+#else
+  const __m128i shuffle = _mm_setr_epi8 (2, 1, 0, 3, 6, 5, 4, 7,
+                                         10, 9, 8, 11, 14, 13, 12, 15);
 
-  if (best_start)
+  for (i = 0; i + 4 <= len; i += 4)
     {
-      *start = best_start;
-      *width = best_w;
-      *height = best_h;
-      return TRUE;
+      __m128i a;
+
+      a = _mm_loadu_si128 ((const __m128i *) (argb_data + i));
+      _mm_storeu_si128 ((__m128i *) (p + i * 4),
+                        _mm_shuffle_epi8 (a, shuffle));
     }
-  else
-    return FALSE;
+#endif
+
+  argbdata_to_pixdata_scalar (argb_data + i, len - i, p + i * 4);
+}
+
+#endif /* HAVE_X86_ICON_KERNELS */
+
+static void
+argbdata_to_pixdata (const gulong *argb_data,
+                     int           len,
+                     guchar       *pixdata)
+{
+  static void (*convert) (const gulong *, int, guchar *) = NULL;
+
+  if (convert == NULL)
+    {
+      convert = argbdata_to_pixdata_scalar;
+#ifdef HAVE_X86_ICON_KERNELS
+      __builtin_cpu_init ();
+      if (g_getenv ("METACITY_DISABLE_SIMD") == NULL &&
+          __builtin_cpu_supports ("ssse3"))
+        convert = argbdata_to_pixdata_ssse3;
+#endif
+    }
+
+  convert (argb_data, len, pixdata);
 }
 
 static void
-argbdata_to_pixdata (gulong *argb_data, int len, guchar **pixdata)
+free_pixels (guchar *pixels, gpointer data)
 {
-  guchar *p;
-  int i;
+  g_free (pixels);
+}
 
-  *pixdata = g_new (guchar, len * 4);
-  p = *pixdata;
+static GdkPixbuf *
+pixbuf_from_icon_image (const IconImage *image)
+{
+  guchar *pixdata;
+  GdkPixbuf *pixbuf;
 
-  /* One could speed this up a lot. */
-  i = 0;
-  while (i < len)
+  if (image->width <= 0 || image->height <= 0)
+    return NULL;
+
+  pixdata = g_new (guchar, image->width * image->height * 4);
+  argbdata_to_pixdata (image->data, image->width * image->height, pixdata);
+
+  pixbuf = gdk_pixbuf_new_from_data (pixdata,
+                                     GDK_COLORSPACE_RGB,
+                                     TRUE,
+                                     8,
+                                     image->width, image->height,
+                                     image->width * 4,
+                                     free_pixels,
+                                     NULL);
+  if (pixbuf == NULL)
+    g_free (pixdata);
+
+  return pixbuf;
+}
+
+/* Scales src to new_w x new_h as if it had first been centred in a
+ * transparent square, but in one pass and without the square.
+ */
+static GdkPixbuf *
+scale_icon (GdkPixbuf *src,
+            int        new_w,
+            int        new_h)
+{
+  GdkPixbuf *dest;
+  int w, h, size;
+  double scale_x, scale_y;
+  int dest_x, dest_y, dest_w, dest_h;
+
+  w = gdk_pixbuf_get_width (src);
+  h = gdk_pixbuf_get_height (src);
+
+  if (w == new_w && h == new_h)
+    return g_object_ref (src);
+
+  if (w == h)
+    return gdk_pixbuf_scale_simple (src, new_w, new_h, GDK_INTERP_BILINEAR);
+
+  dest = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, new_w, new_h);
+  if (dest == NULL)
+    return NULL;
+
+  gdk_pixbuf_fill (dest, 0);
+
+  size = MAX (w, h);
+  scale_x = (double) new_w / size;
+  scale_y = (double) new_h / size;
+
+  dest_x = (int) (((size - w) / 2) * scale_x + 0.5);
+  dest_y = (int) (((size - h) / 2) * scale_y + 0.5);
+  dest_w = MIN (new_w - dest_x, (int) (w * scale_x + 0.5));
+  dest_h = MIN (new_h - dest_y, (int) (h * scale_y + 0.5));
+
+  if (dest_w > 0 && dest_h > 0)
+    gdk_pixbuf_scale (src, dest,
+                      dest_x, dest_y, dest_w, dest_h,
+                      ((size - w) / 2) * scale_x,
+                      ((size - h) / 2) * scale_y,
+                      scale_x, scale_y,
+                      GDK_INTERP_BILINEAR);
+
+  return dest;
+}
+
+/* The icon store holds the decoded icons of every window on the
+ * display, keyed by where they were decoded from, so that windows
+ * with identical icon sources share one pair of pixbufs.  Applications
+ * with many windows tend to set the same large icons on each of them.
+ *
+ * For _NET_WM_ICON the key is a SHA-256 digest of the property
+ * contents.  For WM_HINTS and KWM_WIN_ICON it is a digest of the
+ * pixels read back from the pixmap and mask, so a hit saves the
+ * scaling and the memory.  Any client can set any icon, so the digest
+ * has to be one nobody can collide on purpose.
+ *
+ * The store holds no references: windows own their icons as before,
+ * and an entry goes away when both of its pixbufs have been finalized.
+ */
+typedef enum
+{
+  ICON_SOURCE_NET_WM_ICON,
+  ICON_SOURCE_PIXMAP
+} IconSource;
+
+/* SHA-256 */
+#define ICON_DIGEST_LENGTH 32
+
+typedef struct
+{
+  IconSource source;
+  gulong     length;  /* property items, or pixmap width << 16 | height */
+  guint8     digest[ICON_DIGEST_LENGTH]; /* of the property or the pixels */
+  int        ideal_width;
+  int        ideal_height;
+  int        ideal_mini_width;
+  int        ideal_mini_height;
+} IconKey;
+
+typedef struct
+{
+  IconKey        key;
+  MetaIconStore *store;
+  GdkPixbuf     *icon;
+  GdkPixbuf     *mini_icon;
+  gsize          bytes;
+} StoredIcon;
+
+struct _MetaIconStore
+{
+  GHashTable         *icons;
+  GTimer             *timer;
+  MetaIconStoreStats  stats;
+};
+
+static guint
+icon_key_hash (gconstpointer v)
+{
+  const IconKey *key = v;
+
+  /* Any bits of a cryptographic digest are as good as any others */
+  return ((guint) key->digest[0] << 24 | (guint) key->digest[1] << 16 |
+          (guint) key->digest[2] << 8 | (guint) key->digest[3]) ^
+    key->source;
+}
+
+static gboolean
+icon_key_equal (gconstpointer a,
+                gconstpointer b)
+{
+  const IconKey *ka = a;
+  const IconKey *kb = b;
+
+  return ka->source == kb->source &&
+    ka->length == kb->length &&
+    memcmp (ka->digest, kb->digest, ICON_DIGEST_LENGTH) == 0 &&
+    ka->ideal_width == kb->ideal_width &&
+    ka->ideal_height == kb->ideal_height &&
+    ka->ideal_mini_width == kb->ideal_mini_width &&
+    ka->ideal_mini_height == kb->ideal_mini_height;
+}
+
+static void
+icon_key_init (IconKey    *key,
+               IconSource  source,
+               int         ideal_width,
+               int         ideal_height,
+               int         ideal_mini_width,
+               int         ideal_mini_height)
+{
+  key->source = source;
+  key->length = 0;
+  memset (key->digest, 0, ICON_DIGEST_LENGTH);
+  key->ideal_width = ideal_width;
+  key->ideal_height = ideal_height;
+  key->ideal_mini_width = ideal_mini_width;
+  key->ideal_mini_height = ideal_mini_height;
+}
+
+static void
+finish_digest (GChecksum *checksum,
+               guint8    *digest)
+{
+  gsize length;
+
+  length = ICON_DIGEST_LENGTH;
+  g_checksum_get_digest (checksum, digest, &length);
+  g_assert (length == ICON_DIGEST_LENGTH);
+  g_checksum_free (checksum);
+}
+
+/* Digests the 32 bits that matter in each item, least significant
+ * byte first, whatever the size of a long
+ */
+static void
+digest_icon_data (const gulong *data,
+                  gulong        nitems,
+                  guint8       *digest)
+{
+  GChecksum *checksum;
+  guchar buf[4 * 256];
+  gulong i;
+  int n;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  n = 0;
+  for (i = 0; i < nitems; i++)
     {
-      guint argb;
-      guint rgba;
+      buf[n++] = data[i] & 0xff;
+      buf[n++] = (data[i] >> 8) & 0xff;
+      buf[n++] = (data[i] >> 16) & 0xff;
+      buf[n++] = (data[i] >> 24) & 0xff;
 
-      argb = argb_data[i];
-      rgba = (argb << 8) | (argb >> 24);
+      if (n == sizeof (buf))
+        {
+          g_checksum_update (checksum, buf, n);
+          n = 0;
+        }
+    }
+  g_checksum_update (checksum, buf, n);
 
-      *p = rgba >> 24;
-      ++p;
-      *p = (rgba >> 16) & 0xff;
-      ++p;
-      *p = (rgba >> 8) & 0xff;
-      ++p;
-      *p = rgba & 0xff;
-      ++p;
+  finish_digest (checksum, digest);
+}
 
-      ++i;
+/* The same over the pixels of a decoded pixmap; row padding is left
+ * out, the channel count is mixed in
+ */
+static void
+digest_pixbuf (GdkPixbuf *pixbuf,
+               guint8    *digest)
+{
+  GChecksum *checksum;
+  const guchar *pixels;
+  guchar n_channels;
+  int rowstride, row_bytes, height;
+  int y;
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  row_bytes = gdk_pixbuf_get_width (pixbuf) * n_channels;
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, &n_channels, 1);
+
+  for (y = 0; y < height; y++)
+    g_checksum_update (checksum, pixels + y * rowstride, row_bytes);
+
+  finish_digest (checksum, digest);
+}
+
+static gsize
+pixbuf_bytes (GdkPixbuf *pixbuf)
+{
+  return (gsize) gdk_pixbuf_get_rowstride (pixbuf) *
+    gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+stored_icon_forget (StoredIcon *stored)
+{
+  stored->store->stats.n_icons -= 1;
+  stored->store->stats.bytes -= stored->bytes;
+  g_slice_free (StoredIcon, stored);
+}
+
+static void
+stored_icon_weak_notify (gpointer  data,
+                         GObject  *where_the_object_was)
+{
+  StoredIcon *stored = data;
+  GObject *other;
+
+  other = (GObject *) stored->icon == where_the_object_was ?
+    (GObject *) stored->mini_icon : (GObject *) stored->icon;
+
+  if (other != where_the_object_was)
+    g_object_weak_unref (other, stored_icon_weak_notify, stored);
+
+  g_hash_table_remove (stored->store->icons, &stored->key);
+  stored_icon_forget (stored);
+}
+
+MetaIconStore *
+meta_icon_store_new (void)
+{
+  MetaIconStore *store;
+
+  store = g_new0 (MetaIconStore, 1);
+  store->icons = g_hash_table_new (icon_key_hash, icon_key_equal);
+  store->timer = g_timer_new ();
+
+  return store;
+}
+
+static void
+unref_stored_icon (gpointer key,
+                   gpointer value,
+                   gpointer data)
+{
+  StoredIcon *stored = value;
+
+  g_object_weak_unref (G_OBJECT (stored->icon),
+                       stored_icon_weak_notify, stored);
+  if (stored->mini_icon != stored->icon)
+    g_object_weak_unref (G_OBJECT (stored->mini_icon),
+                         stored_icon_weak_notify, stored);
+
+  stored_icon_forget (stored);
+}
+
+void
+meta_icon_store_free (MetaIconStore *store)
+{
+  MetaIconStoreStats stats;
+
+  meta_icon_store_get_stats (store, &stats);
+  meta_topic (META_DEBUG_ICONS,
+              "Icon store: %u lookups, %u hits, %lu bytes saved, "
+              "%g seconds decoding\n",
+              stats.lookups, stats.hits,
+              (gulong) stats.bytes_saved,
+              stats.decode_time);
+
+  g_hash_table_foreach (store->icons, unref_stored_icon, NULL);
+  g_hash_table_destroy (store->icons);
+  g_timer_destroy (store->timer);
+  g_free (store);
+}
+
+void
+meta_icon_store_get_stats (MetaIconStore      *store,
+                           MetaIconStoreStats *stats)
+{
+  *stats = store->stats;
+}
+
+static gboolean
+icon_store_lookup (MetaIconStore  *store,
+                   const IconKey  *key,
+                   GdkPixbuf     **iconp,
+                   GdkPixbuf     **mini_iconp)
+{
+  StoredIcon *stored;
+
+  store->stats.lookups += 1;
+
+  stored = g_hash_table_lookup (store->icons, key);
+  if (stored == NULL)
+    {
+      g_timer_start (store->timer);
+      return FALSE;
     }
+
+  store->stats.hits += 1;
+  store->stats.bytes_saved += stored->bytes;
+
+  *iconp = g_object_ref (stored->icon);
+  *mini_iconp = g_object_ref (stored->mini_icon);
+
+  return TRUE;
+}
+
+/* Call after a failed icon_store_lookup(), once the icons have been
+ * decoded; the time since the lookup is charged as decode time.
+ */
+static void
+icon_store_insert (MetaIconStore *store,
+                   const IconKey *key,
+                   GdkPixbuf     *icon,
+                   GdkPixbuf     *mini_icon)
+{
+  StoredIcon *stored;
+  double elapsed;
+
+  elapsed = g_timer_elapsed (store->timer, NULL);
+  store->stats.decode_time += elapsed;
+
+  stored = g_slice_new (StoredIcon);
+  stored->key = *key;
+  stored->store = store;
+  stored->icon = icon;
+  stored->mini_icon = mini_icon;
+  stored->bytes = pixbuf_bytes (icon);
+
+  g_object_weak_ref (G_OBJECT (icon), stored_icon_weak_notify, stored);
+  if (mini_icon != icon)
+    {
+      g_object_weak_ref (G_OBJECT (mini_icon), stored_icon_weak_notify, stored);
+      stored->bytes += pixbuf_bytes (mini_icon);
+    }
+
+  g_hash_table_insert (store->icons, &stored->key, stored);
+
+  store->stats.n_icons += 1;
+  store->stats.bytes += stored->bytes;
+
+  meta_topic (META_DEBUG_ICONS,
+              "Decoded %s icon in %g seconds; store holds %u icons, "
+              "%lu bytes, %u of %u lookups hit\n",
+              key->source == ICON_SOURCE_NET_WM_ICON ?
+              "_NET_WM_ICON" : "pixmap",
+              elapsed, store->stats.n_icons, (gulong) store->stats.bytes,
+              store->stats.hits, store->stats.lookups);
 }
 
 static gboolean
@@ -213,12 +653,8 @@ read_rgb_icon (MetaDisplay   *display,
                int            ideal_height,
                int            ideal_mini_width,
                int            ideal_mini_height,
-               int           *width,
-               int           *height,
-               guchar       **pixdata,
-               int           *mini_width,
-               int           *mini_height,
-               guchar       **mini_pixdata)
+               GdkPixbuf    **iconp,
+               GdkPixbuf    **mini_iconp)
 {
   Atom type;
   int format;
@@ -226,11 +662,12 @@ read_rgb_icon (MetaDisplay   *display,
   gulong bytes_after;
   int result, err;
   guchar *data;
-  gulong *best;
-  int w, h;
-  gulong *best_mini;
-  int mini_w, mini_h;
   gulong *data_as_long;
+  GArray *images;
+  const IconImage *best, *best_mini;
+  int max_width, max_height;
+  IconKey key;
+  GdkPixbuf *src, *mini_src;
 
   meta_error_trap_push_with_return (display);
   type = None;
@@ -255,43 +692,70 @@ read_rgb_icon (MetaDisplay   *display,
 
   data_as_long = (gulong *)data;
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_width, ideal_height,
-                       &w, &h, &best))
+  icon_key_init (&key, ICON_SOURCE_NET_WM_ICON,
+                 ideal_width, ideal_height,
+                 ideal_mini_width, ideal_mini_height);
+  key.length = nitems;
+  digest_icon_data (data_as_long, nitems, key.digest);
+
+  if (icon_store_lookup (display->icon_store, &key, iconp, mini_iconp))
     {
       XFree (data);
-      return FALSE;
+      return TRUE;
     }
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_mini_width, ideal_mini_height,
-                       &mini_w, &mini_h, &best_mini))
+  images = g_array_new (FALSE, FALSE, sizeof (IconImage));
+
+  if (!parse_icon_images (data_as_long, nitems, images,
+                          &max_width, &max_height))
     {
+      g_array_free (images, TRUE);
       XFree (data);
       return FALSE;
     }
 
-  *width = w;
-  *height = h;
+  best = find_best_size (images, ideal_width, ideal_height,
+                         max_width, max_height);
+  best_mini = find_best_size (images, ideal_mini_width, ideal_mini_height,
+                              max_width, max_height);
 
-  *mini_width = mini_w;
-  *mini_height = mini_h;
-
-  argbdata_to_pixdata (best, w * h, pixdata);
-  argbdata_to_pixdata (best_mini, mini_w * mini_h, mini_pixdata);
+  /* Usually both sizes come from the same image, so decode it once */
+  src = pixbuf_from_icon_image (best);
+  if (best_mini == best)
+    mini_src = src ? g_object_ref (src) : NULL;
+  else
+    mini_src = pixbuf_from_icon_image (best_mini);
 
+  g_array_free (images, TRUE);
   XFree (data);
 
-  return TRUE;
-}
+  *iconp = src ? scale_icon (src, ideal_width, ideal_height) : NULL;
+  *mini_iconp = mini_src ?
+    scale_icon (mini_src, ideal_mini_width, ideal_mini_height) : NULL;
 
-static void
-free_pixels (guchar *pixels, gpointer data)
-{
-  g_free (pixels);
+  if (src)
+    g_object_unref (G_OBJECT (src));
+  if (mini_src)
+    g_object_unref (G_OBJECT (mini_src));
+
+  if (*iconp == NULL || *mini_iconp == NULL)
+    {
+      if (*iconp)
+        g_object_unref (G_OBJECT (*iconp));
+      if (*mini_iconp)
+        g_object_unref (G_OBJECT (*mini_iconp));
+      *iconp = NULL;
+      *mini_iconp = NULL;
+      return FALSE;
+    }
+
+  icon_store_insert (display->icon_store, &key, *iconp, *mini_iconp);
+
+  return TRUE;
 }
 
-static void
+/* Returns FALSE if the pixmap is gone; call with an error trap pushed */
+static gboolean
 get_pixmap_geometry (MetaDisplay *display,
                      Pixmap       pixmap,
                      int         *w,
@@ -311,9 +775,10 @@ get_pixmap_geometry (MetaDisplay *display,
   if (d)
     *d = 1;
 
-  XGetGeometry (display->xdisplay,
-                pixmap, &root_ignored, &x_ignored, &y_ignored,
-                &width, &height, &border_width_ignored, &depth);
+  if (!XGetGeometry (display->xdisplay,
+                     pixmap, &root_ignored, &x_ignored, &y_ignored,
+                     &width, &height, &border_width_ignored, &depth))
+    return FALSE;
 
   if (w)
     *w = width;
@@ -321,6 +786,8 @@ get_pixmap_geometry (MetaDisplay *display,
     *h = height;
   if (d)
     *d = depth;
+
+  return TRUE;
 }
 
 static GdkPixbuf*
@@ -386,13 +853,18 @@ try_pixmap_and_mask (MetaDisplay *display,
   GdkPixbuf *unscaled = NULL;
   GdkPixbuf *mask = NULL;
   int w, h;
+  IconKey key;
 
   if (src_pixmap == None)
     return FALSE;
 
   meta_error_trap_push (display);
 
-  get_pixmap_geometry (display, src_pixmap, &w, &h, NULL);
+  if (!get_pixmap_geometry (display, src_pixmap, &w, &h, NULL))
+    {
+      meta_error_trap_pop (display, FALSE);
+      return FALSE;
+    }
 
   unscaled = meta_gdk_pixbuf_get_from_pixmap (NULL,
                                               src_pixmap,
@@ -424,6 +896,22 @@ try_pixmap_and_mask (MetaDisplay *display,
 
   if (unscaled)
     {
+      /* Pixmaps can be drawn on again and their IDs reused, so only
+       * what was actually read back says whether we've seen it before
+       */
+      icon_key_init (&key, ICON_SOURCE_PIXMAP,
+                     ideal_width, ideal_height,
+                     ideal_mini_width, ideal_mini_height);
+      key.length = ((gulong) gdk_pixbuf_get_width (unscaled) << 16) |
+        gdk_pixbuf_get_height (unscaled);
+      digest_pixbuf (unscaled, key.digest);
+
+      if (icon_store_lookup (display->icon_store, &key, iconp, mini_iconp))
+        {
+          g_object_unref (G_OBJECT (unscaled));
+          return TRUE;
+        }
+
       *iconp =
         gdk_pixbuf_scale_simple (unscaled,
                                  ideal_width > 0 ? ideal_width :
@@ -442,7 +930,10 @@ try_pixmap_and_mask (MetaDisplay *display,
       g_object_unref (G_OBJECT (unscaled));
       
       if (*iconp && *mini_iconp)
-        return TRUE;
+        {
+          icon_store_insert (display->icon_store, &key, *iconp, *mini_iconp);
+          return TRUE;
+        }
       else
         {
           if (*iconp)
@@ -615,62 +1106,6 @@ replace_cache (MetaIconCache *icon_cache,
 #endif
 }
 
-static GdkPixbuf*
-scaled_from_pixdata (guchar *pixdata,
-                     int     w,
-                     int     h,
-                     int     new_w,
-                     int     new_h)
-{
-  GdkPixbuf *src;
-  GdkPixbuf *dest;
-  
-  src = gdk_pixbuf_new_from_data (pixdata,
-                                  GDK_COLORSPACE_RGB,
-                                  TRUE,
-                                  8,
-                                  w, h, w * 4,
-                                  free_pixels, 
-                                  NULL);
-
-  if (src == NULL)
-    return NULL;
-
-  if (w != h)
-    {
-      GdkPixbuf *tmp;
-      int size;
-
-      size = MAX (w, h);
-      
-      tmp = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, size, size);
-
-      if (tmp)
-	{
-	  gdk_pixbuf_fill (tmp, 0);
-	  gdk_pixbuf_copy_area (src, 0, 0, w, h,
-				tmp,
-				(size - w) / 2, (size - h) / 2);
-	  
-	  g_object_unref (src);
-	  src = tmp;
-	}
-    }
-  
-  if (w != new_w || h != new_h)
-    {
-      dest = gdk_pixbuf_scale_simple (src, new_w, new_h, GDK_INTERP_BILINEAR);
-      
-      g_object_unref (G_OBJECT (src));
-    }
-  else
-    {
-      dest = src;
-    }
-
-  return dest;
-}
-
 gboolean
 meta_read_icons (MetaScreen     *screen,
                  Window          xwindow,
@@ -684,10 +1119,6 @@ meta_read_icons (MetaScreen     *screen,
                  int             ideal_mini_width,
                  int             ideal_mini_height)
 {
-  guchar *pixdata;
-  int w, h;
-  guchar *mini_pixdata;
-  int mini_w, mini_h;
   Pixmap pixmap;
   Pixmap mask;
 
@@ -714,8 +1145,6 @@ meta_read_icons (MetaScreen     *screen,
   if (!meta_icon_cache_get_icon_invalidated (icon_cache))
     return FALSE; /* we have no new info to use */
 
-  pixdata = NULL;
-
   /* Our algorithm here assumes that we can't have for example origin
    * < USING_NET_WM_ICON and icon_cache->net_wm_icon_dirty == FALSE
    * unless we have tried to read NET_WM_ICON.
@@ -734,29 +1163,12 @@ meta_read_icons (MetaScreen     *screen,
       if (read_rgb_icon (screen->display, xwindow,
                          ideal_width, ideal_height,
                          ideal_mini_width, ideal_mini_height,
-                         &w, &h, &pixdata,
-                         &mini_w, &mini_h, &mini_pixdata))
+                         iconp, mini_iconp))
         {
-          *iconp = scaled_from_pixdata (pixdata, w, h,
-                                        ideal_width, ideal_height);
-
-          *mini_iconp = scaled_from_pixdata (mini_pixdata, mini_w, mini_h,
-                                             ideal_mini_width, ideal_mini_height);
+          replace_cache (icon_cache, USING_NET_WM_ICON,
+                         *iconp, *mini_iconp);
 
-          if (*iconp && *mini_iconp)
-            {
-              replace_cache (icon_cache, USING_NET_WM_ICON,
-                             *iconp, *mini_iconp);
-              
-              return TRUE;
-            }
-          else
-            {
-              if (*iconp)
-                g_object_unref (G_OBJECT (*iconp));
-              if (*mini_iconp)
-                g_object_unref (G_OBJECT (*mini_iconp));
-            }
+          return TRUE;
         }
     }
 
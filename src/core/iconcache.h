@@ -60,6 +60,22 @@ void           meta_icon_cache_property_changed     (MetaIconCache *icon_cache,
                                                      Atom           atom);
 gboolean       meta_icon_cache_get_icon_invalidated (MetaIconCache *icon_cache);
 
+/* What the display's icon store has done since it was created */
+typedef struct
+{
+  guint  lookups;
+  guint  hits;
+  guint  n_icons;     /* icon pairs currently held */
+  gsize  bytes;       /* pixel memory of those */
+  gsize  bytes_saved; /* pixel memory that hits didn't have to allocate */
+  double decode_time; /* seconds spent decoding on misses */
+} MetaIconStoreStats;
+
+MetaIconStore *meta_icon_store_new       (void);
+void           meta_icon_store_free      (MetaIconStore      *store);
+void           meta_icon_store_get_stats (MetaIconStore      *store,
+                                          MetaIconStoreStats *stats);
+
 gboolean meta_read_icons         (MetaScreen     *screen,
                                   Window          xwindow,
                                   MetaIconCache  *icon_cache,
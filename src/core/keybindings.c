@@ -461,7 +461,8 @@ static void
 regrab_key_bindings (MetaDisplay *display)
 {
   GSList *tmp;
-  GSList *windows;
+  MetaDisplayWindowIter iter;
+  MetaWindow *w;
 
   meta_error_trap_push (display); /* for efficiency push outer trap */
   
@@ -476,20 +477,13 @@ regrab_key_bindings (MetaDisplay *display)
       tmp = tmp->next;
     }
 
-  windows = meta_display_list_windows (display);
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, display);
+  while ((w = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *w = tmp->data;
-      
       meta_window_ungrab_keys (w);
       meta_window_grab_keys (w);
-      
-      tmp = tmp->next;
     }
   meta_error_trap_pop (display, FALSE);
-
-  g_slist_free (windows);
 }
 
 static MetaKeyBindingAction
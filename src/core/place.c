@@ -812,26 +812,18 @@ meta_window_place (MetaWindow        *window,
    * for placement purposes)
    */
   {
-    GSList *all_windows;
-    GSList *tmp;
+    MetaDisplayWindowIter iter;
+    MetaWindow *w;
     
-    all_windows = meta_display_list_windows (window->display);
-
-    tmp = all_windows;
-    while (tmp != NULL)
+    meta_display_window_iter_init (&iter, window->display);
+    while ((w = meta_display_window_iter_next (&iter)) != NULL)
       {
-        MetaWindow *w = tmp->data;
-
         if (meta_window_showing_on_its_workspace (w) &&
             w != window && 
             (window->workspace == w->workspace ||
              window->on_all_workspaces || w->on_all_workspaces))
           windows = g_list_prepend (windows, w);
-
-        tmp = tmp->next;
       }
-
-    g_slist_free (all_windows);
   }
 
   /* Warning, this is a round trip! */
@@ -131,6 +131,14 @@ struct _MetaScreen
   /* gc for XOR on root window */
   GC root_xor_gc;
 
+  /* root_xor_gc's font, or None, with its metrics looked up once so
+   * the wireframe size label costs no round trips
+   */
+  Font wireframe_font;
+  int wireframe_char_width;
+  int wireframe_font_ascent;
+  int wireframe_font_descent;
+
   /* Managed by compositor.c */
   gpointer compositor_data;
 };
@@ -219,6 +227,9 @@ void     meta_screen_unshow_desktop      (MetaScreen *screen);
 /* Update whether the destkop is being shown for the current active_workspace */
 void     meta_screen_update_showing_desktop_hint          (MetaScreen *screen);
 
+/* Drop the workspace popup's cached drawing of every workspace */
+void     meta_screen_invalidate_workspace_thumbnails (MetaScreen *screen);
+
 gboolean meta_screen_apply_startup_properties (MetaScreen *screen,
                                                MetaWindow *window);
 void	 meta_screen_composite_all_windows (MetaScreen *screen);
@@ -512,10 +512,17 @@ meta_screen_new (MetaDisplay *display,
 
     font_info = XLoadQueryFont (screen->display->xdisplay, "fixed");
 
+    screen->wireframe_font = None;
     if (font_info != NULL)
       {
         gc_values.font = font_info->fid;
         value_mask |= GCFont;
+
+        screen->wireframe_font = font_info->fid;
+        screen->wireframe_char_width = font_info->max_bounds.width;
+        screen->wireframe_font_ascent = font_info->max_bounds.ascent;
+        screen->wireframe_font_descent = font_info->max_bounds.descent;
+
         XFreeFontInfo (NULL, font_info, 1);
       }
     else
@@ -620,7 +627,6 @@ meta_screen_free (MetaScreen *screen,
                   guint32     timestamp)
 {
   MetaDisplay *display;
-  XGCValues gc_values = { 0 };
 
   display = screen->display;
 
@@ -677,14 +683,9 @@ meta_screen_free (MetaScreen *screen,
     g_source_remove (screen->work_area_idle);
 
 
-  if (XGetGCValues (screen->display->xdisplay,
-                    screen->root_xor_gc,
-                    GCFont,
-                    &gc_values))
-    {
-      XUnloadFont (screen->display->xdisplay,
-                   gc_values.font);
-    }
+  if (screen->wireframe_font != None)
+    XUnloadFont (screen->display->xdisplay,
+                 screen->wireframe_font);
 
   XFreeGC (screen->display->xdisplay,
            screen->root_xor_gc);
@@ -1197,49 +1198,73 @@ meta_screen_update_cursor (MetaScreen *screen)
   XFreeCursor (screen->display->xdisplay, xcursor);
 }
 
-#define MAX_PREVIEW_SIZE 150.0
+#define MAX_PREVIEW_SIZE 150
 
 static GdkPixbuf *
 get_window_pixbuf (MetaWindow *window,
                    int        *width,
                    int        *height)
 {
-  Pixmap pmap;
-  GdkPixbuf *pixbuf, *scaled;
-  double ratio;
+  GdkPixbuf *pixbuf;
 
-  pmap = meta_compositor_get_window_pixmap (window->display->compositor,
-                                            window);
-  if (pmap == None)
-    return NULL;
-
-  pixbuf = meta_ui_get_pixbuf_from_pixmap (pmap);
-  if (pixbuf == NULL) 
+  /* The compositor keeps these scaled and up to date for us */
+  pixbuf = meta_compositor_get_window_thumbnail (window->display->compositor,
+                                                 window,
+                                                 MAX_PREVIEW_SIZE);
+  if (pixbuf == NULL)
     return NULL;
 
   *width = gdk_pixbuf_get_width (pixbuf);
   *height = gdk_pixbuf_get_height (pixbuf);
 
-  /* Scale pixbuf to max dimension MAX_PREVIEW_SIZE */
-  if (*width > *height)
-    {
-      ratio = ((double) *width) / MAX_PREVIEW_SIZE;
-      *width = (int) MAX_PREVIEW_SIZE;
-      *height = (int) (((double) *height) / ratio);
-    }
-  else
-    {
-      ratio = ((double) *height) / MAX_PREVIEW_SIZE;
-      *height = (int) MAX_PREVIEW_SIZE;
-      *width = (int) (((double) *width) / ratio);
-    }
-
-  scaled = gdk_pixbuf_scale_simple (pixbuf, *width, *height,
-                                    GDK_INTERP_BILINEAR);
-  g_object_unref (pixbuf);
-  return scaled;
+  return pixbuf;
 }
                                          
+/* The window's thumbnail with its icon in the corner, for the tab
+ * popup to swap in once an entry is on screen
+ */
+static GdkPixbuf *
+get_tab_entry_icon (MetaTabEntryKey key,
+                    gpointer        data)
+{
+  MetaScreen *screen = data;
+  MetaWindow *window;
+  GdkPixbuf *win_pixbuf;
+  GdkPixbuf *icon;
+  int width, height;
+  int icon_width, icon_height, t_width, t_height;
+
+  window = meta_display_lookup_x_window (screen->display, (Window) key);
+  if (window == NULL)
+    return NULL;
+
+  win_pixbuf = get_window_pixbuf (window, &width, &height);
+  if (win_pixbuf == NULL)
+    return NULL;
+
+#define ICON_OFFSET 6
+
+  icon_width = gdk_pixbuf_get_width (window->icon);
+  icon_height = gdk_pixbuf_get_height (window->icon);
+
+  t_width = width + ICON_OFFSET;
+  t_height = height + ICON_OFFSET;
+
+  icon = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+                         t_width, t_height);
+  gdk_pixbuf_fill (icon, 0x00000000);
+  gdk_pixbuf_copy_area (win_pixbuf, 0, 0, width, height,
+                        icon, 0, 0);
+  g_object_unref (win_pixbuf);
+  gdk_pixbuf_composite (window->icon, icon,
+                        t_width - icon_width, t_height - icon_height,
+                        icon_width, icon_height,
+                        t_width - icon_width, t_height - icon_height, 
+                        1.0, 1.0, GDK_INTERP_BILINEAR, 255);
+
+  return icon;
+}
+
 void
 meta_screen_ensure_tab_popup (MetaScreen      *screen,
                               MetaTabList      list_type,
@@ -1272,41 +1297,17 @@ meta_screen_ensure_tab_popup (MetaScreen      *screen,
     {
       MetaWindow *window;
       MetaRectangle r;
-      GdkPixbuf *win_pixbuf;
-      int width, height;
 
       window = tmp->data;
       
       entries[i].key = (MetaTabEntryKey) window->xwindow;
       entries[i].title = window->title;
 
-      win_pixbuf = get_window_pixbuf (window, &width, &height);
-      if (win_pixbuf == NULL)
-        entries[i].icon = g_object_ref (window->icon);
-      else
-        {
-          int icon_width, icon_height, t_width, t_height;
-#define ICON_OFFSET 6
+      /* Thumbnails are only put together for the entries the popup
+       * shows, once it is up; see get_tab_entry_icon()
+       */
+      entries[i].icon = g_object_ref (window->icon);
 
-          icon_width = gdk_pixbuf_get_width (window->icon);
-          icon_height = gdk_pixbuf_get_height (window->icon);
-
-          t_width = width + ICON_OFFSET;
-          t_height = height + ICON_OFFSET;
-
-          entries[i].icon = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
-                                            t_width, t_height);
-          gdk_pixbuf_fill (entries[i].icon, 0x00000000);
-          gdk_pixbuf_copy_area (win_pixbuf, 0, 0, width, height,
-                                entries[i].icon, 0, 0);
-          g_object_unref (win_pixbuf);
-          gdk_pixbuf_composite (window->icon, entries[i].icon, 
-                                t_width - icon_width, t_height - icon_height,
-                                icon_width, icon_height,
-                                t_width - icon_width, t_height - icon_height, 
-                                1.0, 1.0, GDK_INTERP_BILINEAR, 255);
-        }
-                                
       entries[i].blank = FALSE;
       entries[i].hidden = !meta_window_showing_on_its_workspace (window);
       entries[i].demands_attention = window->wm_state_demands_attention;
@@ -1366,6 +1367,9 @@ meta_screen_ensure_tab_popup (MetaScreen      *screen,
                                              len,
                                              5, /* FIXME */
                                              TRUE);
+  meta_ui_tab_popup_set_icon_func (screen->tab_popup,
+                                   get_tab_entry_icon,
+                                   screen);
 
   for (i = 0; i < len; i++) 
     g_object_unref (entries[i].icon);
@@ -2295,6 +2299,21 @@ meta_screen_resize (MetaScreen *screen,
   
   /* Queue a resize on all the windows */
   meta_screen_foreach_window (screen, meta_screen_resize_func, 0);
+
+  meta_screen_invalidate_workspace_thumbnails (screen);
+}
+
+void
+meta_screen_invalidate_workspace_thumbnails (MetaScreen *screen)
+{
+  GList *tmp;
+
+  tmp = screen->workspaces;
+  while (tmp != NULL)
+    {
+      meta_workspace_invalidate_thumbnail (tmp->data);
+      tmp = tmp->next;
+    }
 }
 
 void
@@ -2315,27 +2334,19 @@ meta_screen_update_showing_desktop_hint (MetaScreen *screen)
 static void
 queue_windows_showing (MetaScreen *screen)
 {
-  GSList *windows;
-  GSList *tmp;
+  MetaDisplayWindowIter iter;
+  MetaWindow *w;
 
   /* Must operate on all windows on display instead of just on the
    * active_workspace's window list, because the active_workspace's
    * window list may not contain the on_all_workspace windows.
    */
-  windows = meta_display_list_windows (screen->display);
-
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, screen->display);
+  while ((w = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *w = tmp->data;
-
       if (w->screen == screen)
         meta_window_queue (w, META_QUEUE_CALC_SHOWING);
-      
-      tmp = tmp->next;
     }
-
-  g_slist_free (windows);
 }
 
 void
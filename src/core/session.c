@@ -1752,31 +1752,23 @@ static void
 warn_about_lame_clients_and_finish_interact (gboolean shutdown)
 {
   GSList *lame = NULL;
-  GSList *windows;
+  MetaDisplayWindowIter iter;
+  MetaWindow *window;
   GSList *lame_details = NULL;
   GSList *tmp;
   GSList *columns = NULL;
   GPid pid;
   
-  windows = meta_display_list_windows (meta_get_display ());
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, meta_get_display ());
+  while ((window = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *window;
-          
-      window = tmp->data;
-
       /* only complain about normal windows, the others
        * are kind of dumb to worry about
        */
       if (window->sm_client_id == NULL &&
           window->type == META_WINDOW_NORMAL)
         lame = g_slist_prepend (lame, window);
-          
-      tmp = tmp->next;
     }
-      
-  g_slist_free (windows);
   
   if (lame == NULL)
     {
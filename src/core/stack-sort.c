@@ -0,0 +1,210 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/**
+ * \file stack-sort.c  Ordering windows by layer and stack position,
+ * and finding the window to focus in that order
+ *
+ * Kept apart from stack.c, which needs the rest of the window manager,
+ * so that teststack can time the sort and the focus scan the stack
+ * actually uses.
+ */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <config.h>
+#include "stack.h"
+#include "window-private.h"
+#include "group.h"
+
+#include <stdlib.h>
+
+/* What the sort compares, copied out of the windows so the sort
+ * itself walks one dense array instead of chasing a pointer into a
+ * different MetaWindow on every comparison.
+ */
+typedef struct
+{
+  MetaStackLayer layer;
+  int stack_position;
+  MetaWindow *window;
+} StackSortKey;
+
+/* Front of the layer list is the topmost window,
+ * so the lower stack position is later in the list
+ */
+static int
+compare_sort_keys (const void *a,
+                   const void *b)
+{
+  const StackSortKey *key_a = a;
+  const StackSortKey *key_b = b;
+
+  /* Go by layer, then stack_position */
+  if (key_a->layer < key_b->layer)
+    return 1; /* move key_a later in list */
+  else if (key_a->layer > key_b->layer)
+    return -1;
+  else if (key_a->stack_position < key_b->stack_position)
+    return 1; /* move key_a later in list */
+  else if (key_a->stack_position > key_b->stack_position)
+    return -1;
+  else
+    return 0; /* not reached */
+}
+
+GList*
+meta_stack_sort_windows (GList *windows)
+{
+  StackSortKey *keys;
+  guint n_keys;
+  guint i;
+  GList *tmp;
+
+  n_keys = g_list_length (windows);
+  keys = g_new (StackSortKey, n_keys);
+
+  i = 0;
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+    {
+      MetaWindow *w = tmp->data;
+
+      keys[i].layer = w->layer;
+      keys[i].stack_position = w->stack_position;
+      keys[i].window = w;
+      ++i;
+    }
+
+  qsort (keys, n_keys, sizeof (StackSortKey), compare_sort_keys);
+
+  /* Reuse the existing links, just put the windows back in order */
+  i = 0;
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
+    tmp->data = keys[i++].window;
+
+  g_free (keys);
+
+  return windows;
+}
+
+static gboolean
+window_contains_point (MetaWindow *window,
+                       int         root_x,
+                       int         root_y)
+{
+  MetaRectangle rect;
+
+  meta_window_get_outer_rect (window, &rect);
+
+  return POINT_IN_RECT (root_x, root_y, rect);
+}
+
+MetaWindow*
+meta_stack_find_default_focus (GList         *sorted,
+                               MetaWorkspace *workspace,
+                               MetaWindow    *not_this_one,
+                               gboolean       must_be_at_point,
+                               int            root_x,
+                               int            root_y)
+{
+  /* Find the topmost, focusable, mapped, window.
+   * not_this_one is being unfocused or going away, so exclude it.
+   * Also, prefer to focus transient parent of not_this_one,
+   * or top window in same group as not_this_one.
+   */
+
+  MetaWindow *topmost_dock;
+  MetaWindow *transient_parent;
+  MetaWindow *topmost_in_group;
+  MetaWindow *topmost_overall;
+  MetaGroup *not_this_one_group;
+  GList *link;
+  
+  topmost_dock = NULL;
+  transient_parent = NULL;
+  topmost_in_group = NULL;
+  topmost_overall = NULL;
+  if (not_this_one)
+    not_this_one_group = meta_window_get_group (not_this_one);
+  else
+    not_this_one_group = NULL;
+
+  /* top of this layer is at the front of the list */
+  link = sorted;
+      
+  while (link)
+    {
+      MetaWindow *window = link->data;
+
+      if (window &&
+          window != not_this_one &&
+          (window->unmaps_pending == 0) &&
+          !window->minimized &&
+          (window->input || window->take_focus) &&
+          (workspace == NULL ||
+           meta_window_located_on_workspace (window, workspace)))
+        {
+          if (topmost_dock == NULL &&
+              window->type == META_WINDOW_DOCK)
+            topmost_dock = window;
+
+          if (not_this_one != NULL)
+            {
+              if (transient_parent == NULL &&
+                  not_this_one->xtransient_for != None &&
+                  not_this_one->xtransient_for == window->xwindow &&
+                  (!must_be_at_point ||
+                   window_contains_point (window, root_x, root_y)))
+                transient_parent = window;
+
+              if (topmost_in_group == NULL &&
+                  not_this_one_group != NULL &&
+                  not_this_one_group == meta_window_get_group (window) &&
+                  (!must_be_at_point ||
+                   window_contains_point (window, root_x, root_y)))
+                topmost_in_group = window;
+            }
+
+          /* Note that DESKTOP windows can be topmost_overall so
+           * we prefer focusing desktop or other windows over
+           * focusing dock, even though docks are stacked higher.
+           */
+          if (topmost_overall == NULL &&
+              window->type != META_WINDOW_DOCK &&
+              (!must_be_at_point ||
+               window_contains_point (window, root_x, root_y)))
+            topmost_overall = window;
+
+          /* We could try to bail out early here for efficiency in
+           * some cases, but it's just not worth the code.
+           */
+        }
+
+      link = link->next;
+    }
+
+  if (transient_parent)
+    return transient_parent;
+  else if (topmost_in_group)
+    return topmost_in_group;
+  else if (topmost_overall)
+    return topmost_overall;
+  else
+    return topmost_dock;
+}
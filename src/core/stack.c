@@ -36,6 +36,7 @@
 #include "workspace.h"
 
 #include <X11/Xatom.h>
+#include <string.h>
 
 #define WINDOW_HAS_TRANSIENT_TYPE(w)                    \
           (w->type == META_WINDOW_DIALOG ||             \
@@ -356,29 +357,6 @@ compute_layer (MetaWindow *window)
               window->desc, window->layer,
               window->type, window->has_focus);
 }
-
-/* Front of the layer list is the topmost window,
- * so the lower stack position is later in the list
- */
-static int
-compare_window_position (void *a,
-                         void *b)
-{
-  MetaWindow *window_a = a;
-  MetaWindow *window_b = b;
-
-  /* Go by layer, then stack_position */
-  if (window_a->layer < window_b->layer)
-    return 1; /* move window_a later in list */
-  else if (window_a->layer > window_b->layer)
-    return -1;
-  else if (window_a->stack_position < window_b->stack_position)
-    return 1; /* move window_a later in list */
-  else if (window_a->stack_position > window_b->stack_position)
-    return -1;
-  else
-    return 0; /* not reached */
-}
   
 /*
  * Stacking constraints
@@ -913,8 +891,7 @@ stack_do_resort (MetaStack *stack)
   meta_topic (META_DEBUG_STACK,
               "Sorting stack list\n");
       
-  stack->sorted = g_list_sort (stack->sorted,
-                               (GCompareFunc) compare_window_position);
+  stack->sorted = meta_stack_sort_windows (stack->sorted);
 
   stack->need_resort = FALSE;
 }
@@ -1232,6 +1209,14 @@ stack_sync_to_server (MetaStack *stack)
 
   g_array_free (stacked, TRUE);
 
+  /* The workspace popup draws windows in stacking order */
+  if (stack->last_root_children_stacked == NULL ||
+      stack->last_root_children_stacked->len != root_children_stacked->len ||
+      memcmp (stack->last_root_children_stacked->data,
+              root_children_stacked->data,
+              root_children_stacked->len * sizeof (Window)) != 0)
+    meta_screen_invalidate_workspace_thumbnails (stack->screen);
+
   if (stack->last_root_children_stacked)
     g_array_free (stack->last_root_children_stacked, TRUE);
   stack->last_root_children_stacked = root_children_stacked;
@@ -1315,18 +1300,6 @@ meta_stack_get_below (MetaStack      *stack,
     return below;
 }
 
-static gboolean
-window_contains_point (MetaWindow *window,
-                       int         root_x,
-                       int         root_y)
-{
-  MetaRectangle rect;
-
-  meta_window_get_outer_rect (window, &rect);
-
-  return POINT_IN_RECT (root_x, root_y, rect);
-}
-
 static MetaWindow*
 get_default_focus_window (MetaStack     *stack,
                           MetaWorkspace *workspace,
@@ -1335,92 +1308,11 @@ get_default_focus_window (MetaStack     *stack,
                           int            root_x,
                           int            root_y)
 {
-  /* Find the topmost, focusable, mapped, window.
-   * not_this_one is being unfocused or going away, so exclude it.
-   * Also, prefer to focus transient parent of not_this_one,
-   * or top window in same group as not_this_one.
-   */
-
-  MetaWindow *topmost_dock;
-  MetaWindow *transient_parent;
-  MetaWindow *topmost_in_group;
-  MetaWindow *topmost_overall;
-  MetaGroup *not_this_one_group;
-  GList *link;
-  
-  topmost_dock = NULL;
-  transient_parent = NULL;
-  topmost_in_group = NULL;
-  topmost_overall = NULL;
-  if (not_this_one)
-    not_this_one_group = meta_window_get_group (not_this_one);
-  else
-    not_this_one_group = NULL;
-
   stack_ensure_sorted (stack);
 
-  /* top of this layer is at the front of the list */
-  link = stack->sorted;
-      
-  while (link)
-    {
-      MetaWindow *window = link->data;
-
-      if (window &&
-          window != not_this_one &&
-          (window->unmaps_pending == 0) &&
-          !window->minimized &&
-          (window->input || window->take_focus) &&
-          (workspace == NULL ||
-           meta_window_located_on_workspace (window, workspace)))
-        {
-          if (topmost_dock == NULL &&
-              window->type == META_WINDOW_DOCK)
-            topmost_dock = window;
-
-          if (not_this_one != NULL)
-            {
-              if (transient_parent == NULL &&
-                  not_this_one->xtransient_for != None &&
-                  not_this_one->xtransient_for == window->xwindow &&
-                  (!must_be_at_point ||
-                   window_contains_point (window, root_x, root_y)))
-                transient_parent = window;
-
-              if (topmost_in_group == NULL &&
-                  not_this_one_group != NULL &&
-                  not_this_one_group == meta_window_get_group (window) &&
-                  (!must_be_at_point ||
-                   window_contains_point (window, root_x, root_y)))
-                topmost_in_group = window;
-            }
-
-          /* Note that DESKTOP windows can be topmost_overall so
-           * we prefer focusing desktop or other windows over
-           * focusing dock, even though docks are stacked higher.
-           */
-          if (topmost_overall == NULL &&
-              window->type != META_WINDOW_DOCK &&
-              (!must_be_at_point ||
-               window_contains_point (window, root_x, root_y)))
-            topmost_overall = window;
-
-          /* We could try to bail out early here for efficiency in
-           * some cases, but it's just not worth the code.
-           */
-        }
-
-      link = link->next;
-    }
-
-  if (transient_parent)
-    return transient_parent;
-  else if (topmost_in_group)
-    return topmost_in_group;
-  else if (topmost_overall)
-    return topmost_overall;
-  else
-    return topmost_dock;
+  return meta_stack_find_default_focus (stack->sorted, workspace,
+                                        not_this_one, must_be_at_point,
+                                        root_x, root_y);
 }
 
 MetaWindow*
@@ -344,6 +344,39 @@ MetaWindow* meta_stack_get_default_focus_window_at_point (MetaStack     *stack,
 GList*      meta_stack_list_windows (MetaStack *stack,
                                      MetaWorkspace *workspace);
 
+/**
+ * Sorts windows into stacking order by their layer and stack position,
+ * topmost first.  This is what the stack does whenever it needs a
+ * resort; it lives in stack-sort.c.
+ *
+ * \param windows  A list of windows, which is sorted in place.
+ * \return The sorted list; the links are the same ones passed in.
+ */
+GList*      meta_stack_sort_windows (GList *windows);
+
+/**
+ * Finds the window to focus when not_this_one loses focus: its
+ * transient parent, else the topmost window in its group, else the
+ * topmost focusable window, else the topmost dock.  This is the scan
+ * behind meta_stack_get_default_focus_window() and
+ * meta_stack_get_default_focus_window_at_point(); it lives in
+ * stack-sort.c.
+ *
+ * \param sorted  Windows in stacking order, topmost first.
+ * \param workspace  Only consider windows on this workspace, or NULL.
+ * \param not_this_one  Window to exclude and prefer relatives of, or NULL.
+ * \param must_be_at_point  Whether the window must contain the point.
+ * \param root_x  X coordinate of the point, relative to the root.
+ * \param root_y  Y coordinate of the point, relative to the root.
+ * \return The window to focus, or NULL if there isn't one.
+ */
+MetaWindow* meta_stack_find_default_focus (GList         *sorted,
+                                           MetaWorkspace *workspace,
+                                           MetaWindow    *not_this_one,
+                                           gboolean       must_be_at_point,
+                                           int            root_x,
+                                           int            root_y);
+
 /**
  * Comparison function for windows within a stack.  This is not directly
  * suitable for use within a standard comparison routine, because it takes
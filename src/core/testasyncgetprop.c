@@ -239,6 +239,8 @@ try_get_reply (Display           *xdisplay,
 
 static void run_speed_comparison (Display *xdisplay,
                                   Window   window);
+static void run_throughput_test  (Display *xdisplay,
+                                  Window   window);
 
 int
 main (int argc, char **argv)
@@ -358,6 +360,7 @@ main (int argc, char **argv)
     }
 
   run_speed_comparison (xdisplay, window);
+  run_throughput_test (xdisplay, window);
   
   return 0;
 }
@@ -495,3 +498,96 @@ run_speed_comparison (Display *xdisplay,
   printf ("Sync time:  %gms\n",
           ELAPSED (start, end));
 }
+
+/* Sends n_props requests before reading any reply, so the replies are
+ * matched against a queue of up to n_props pending tasks.  The time
+ * per reply should stay flat as the batches get bigger.
+ */
+static void
+run_throughput_test (Display *xdisplay,
+                     Window   window)
+{
+  static const int batch_sizes[] = { 100, 1000, 10000, 50000 };
+  int batch;
+
+  printf ("Throughput with all requests outstanding:\n");
+
+  for (batch = 0; batch < (int) (sizeof (batch_sizes) / sizeof (batch_sizes[0])); batch++)
+    {
+      int i;
+      int n_props;
+      int n_left;
+      struct timeval start, end;
+
+      n_props = batch_sizes[batch];
+      
+      gettimeofday (&start, NULL);
+      
+      i = 0;
+      while (i < n_props)
+        {
+          if (ag_task_create (xdisplay,
+                              window, (Atom) i % 200,
+                              0, 0xffffffff,
+                              False,
+                              AnyPropertyType) == NULL)
+            {
+              fprintf (stderr, "Failed to send request\n");
+              exit (1);
+            }
+          
+          ++i;
+        }
+
+      n_left = n_props;
+      
+      while (TRUE)
+        {
+          int connection;
+          fd_set set;
+          XEvent xevent;
+          AgGetPropertyTask *task;
+          
+          while (XPending (xdisplay) > 0)
+            XNextEvent (xdisplay, &xevent);
+          
+          while ((task = ag_get_next_completed_task (xdisplay)))
+            {
+              Atom actual_type;
+              int actual_format;
+              unsigned long n_items;
+              unsigned long bytes_after;
+              unsigned char *data;
+
+              data = NULL;
+              ag_task_get_reply_and_free (task,
+                                          &actual_type,
+                                          &actual_format,
+                                          &n_items,
+                                          &bytes_after,
+                                          &data);
+              
+              if (data)
+                XFree (data);
+              
+              n_left -= 1;
+            }
+          
+          if (n_left == 0)
+            break;
+
+          connection = ConnectionNumber (xdisplay);
+
+          FD_ZERO (&set);
+          FD_SET (connection, &set);
+
+          select (connection + 1, &set, NULL, NULL, NULL);
+        }
+      
+      gettimeofday (&end, NULL);
+
+      printf ("  %6d requests: %gms, %gus per reply\n",
+              n_props, ELAPSED (start, end),
+              ELAPSED (start, end) * 1000.0 / n_props);
+    }
+}
@@ -0,0 +1,273 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity stacking microbenchmark */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Times meta_stack_sort_windows(), which stack_do_resort() runs
+ * whenever the stack needs a resort, and meta_stack_find_default_focus(),
+ * the scan behind choosing a window to focus, on real MetaWindow structs
+ * scattered around the heap the way a long-running window manager's
+ * windows are.
+ */
+
+#include <config.h>
+#include "stack.h"
+#include "window-private.h"
+#include "group-private.h"
+#include "workspace.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+#define N_WINDOWS 1000
+#define N_ROUNDS 200
+#define N_WORKSPACES 4
+#define N_GROUPS 50
+#define CACHE_LINE 64
+
+/* The focus scan calls these from window.c and group.c, which need the
+ * rest of the window manager; these do the same for windows without a
+ * frame, as all of ours are.
+ */
+gboolean
+meta_window_located_on_workspace (MetaWindow    *window,
+                                  MetaWorkspace *workspace)
+{
+  return window->on_all_workspaces || window->workspace == workspace;
+}
+
+MetaGroup*
+meta_window_get_group (MetaWindow *window)
+{
+  if (window->unmanaging)
+    return NULL;
+
+  return window->group;
+}
+
+void
+meta_window_get_outer_rect (const MetaWindow *window,
+                            MetaRectangle    *rect)
+{
+  *rect = window->rect;
+}
+
+static double
+elapsed_usec (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+
+  return (now.tv_sec - start->tv_sec) * 1e6 +
+    (now.tv_usec - start->tv_usec);
+}
+
+static void
+shuffle_positions (MetaWindow **windows,
+                   int          n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    windows[i]->stack_position = i;
+
+  for (i = n - 1; i > 0; i--)
+    {
+      int j;
+      int tmp;
+
+      j = g_random_int_range (0, i + 1);
+      tmp = windows[i]->stack_position;
+      windows[i]->stack_position = windows[j]->stack_position;
+      windows[j]->stack_position = tmp;
+    }
+}
+
+static void
+print_hot_span (void)
+{
+  size_t first;
+  size_t last;
+
+  first = offsetof (MetaWindow, display);
+  last = offsetof (MetaWindow, group) + sizeof (MetaGroup *);
+
+  printf ("MetaWindow is %lu bytes; the hot fields span %lu bytes "
+          "(%lu cache lines)\n",
+          (unsigned long) sizeof (MetaWindow),
+          (unsigned long) (last - first),
+          (unsigned long) ((last - first + CACHE_LINE - 1) / CACHE_LINE));
+}
+
+/* Topmost first: layers from the top down, and within a layer the
+ * highest stack position first
+ */
+static gboolean
+check_sorted (GList *sorted)
+{
+  GList *link;
+
+  for (link = sorted; link != NULL && link->next != NULL; link = link->next)
+    {
+      MetaWindow *above = link->data;
+      MetaWindow *below = link->next->data;
+
+      if (above->layer < below->layer ||
+          (above->layer == below->layer &&
+           above->stack_position < below->stack_position))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Whether the scan picked something it may pick */
+static gboolean
+check_focus (MetaWindow    *focus,
+             MetaWorkspace *workspace,
+             MetaWindow    *not_this_one)
+{
+  return focus != NULL &&
+    focus != not_this_one &&
+    !focus->minimized &&
+    meta_window_located_on_workspace (focus, workspace);
+}
+
+int
+main (int argc, char **argv)
+{
+  MetaWindow *windows[N_WINDOWS];
+  gpointer padding[N_WINDOWS];
+  MetaWorkspace *workspaces[N_WORKSPACES];
+  MetaGroup *groups[N_GROUPS];
+  GList *sorted;
+  struct timeval start;
+  double sort_usec;
+  double focus_usec;
+  double focus_at_point_usec;
+  int i;
+  int round;
+
+  for (i = 0; i < N_WORKSPACES; i++)
+    workspaces[i] = g_new0 (MetaWorkspace, 1);
+  for (i = 0; i < N_GROUPS; i++)
+    groups[i] = g_new0 (MetaGroup, 1);
+
+  /* Interleave the windows with unrelated allocations so consecutive
+   * windows don't end up on neighbouring cache lines.
+   */
+  sorted = NULL;
+  for (i = 0; i < N_WINDOWS; i++)
+    {
+      windows[i] = g_new0 (MetaWindow, 1);
+      padding[i] = g_malloc (g_random_int_range (64, 4096));
+
+      windows[i]->xwindow = i + 1;
+      windows[i]->layer = g_random_int_range (META_LAYER_DESKTOP,
+                                              META_LAYER_LAST);
+      windows[i]->type = g_random_int_range (0, 20) == 0 ?
+        META_WINDOW_DOCK : META_WINDOW_NORMAL;
+      windows[i]->input = TRUE;
+      windows[i]->minimized = g_random_int_range (0, 4) == 0;
+      windows[i]->workspace = workspaces[g_random_int_range (0, N_WORKSPACES)];
+      windows[i]->group = groups[g_random_int_range (0, N_GROUPS)];
+      windows[i]->rect.x = g_random_int_range (0, 1600);
+      windows[i]->rect.y = g_random_int_range (0, 1200);
+      windows[i]->rect.width = g_random_int_range (50, 800);
+      windows[i]->rect.height = g_random_int_range (50, 600);
+
+      sorted = g_list_prepend (sorted, windows[i]);
+    }
+
+  sort_usec = 0;
+  focus_usec = 0;
+  focus_at_point_usec = 0;
+
+  for (round = 0; round < N_ROUNDS; round++)
+    {
+      MetaWindow *not_this_one;
+      MetaWorkspace *workspace;
+      MetaWindow *focus;
+
+      shuffle_positions (windows, N_WINDOWS);
+      gettimeofday (&start, NULL);
+      sorted = meta_stack_sort_windows (sorted);
+      sort_usec += elapsed_usec (&start);
+
+      if (!check_sorted (sorted))
+        {
+          fprintf (stderr, "windows are not in stacking order\n");
+          return 1;
+        }
+
+      /* Focus leaving a random window, as when it's closed */
+      not_this_one = windows[g_random_int_range (0, N_WINDOWS)];
+      workspace = not_this_one->workspace;
+
+      gettimeofday (&start, NULL);
+      focus = meta_stack_find_default_focus (sorted, workspace,
+                                             not_this_one, FALSE, 0, 0);
+      focus_usec += elapsed_usec (&start);
+
+      if (!check_focus (focus, workspace, not_this_one))
+        {
+          fprintf (stderr, "focus scan picked an unfocusable window\n");
+          return 1;
+        }
+
+      /* The sloppy/mouse focus variant, under the window's middle */
+      gettimeofday (&start, NULL);
+      focus = meta_stack_find_default_focus (sorted, workspace,
+                                             not_this_one, TRUE,
+                                             not_this_one->rect.x +
+                                             not_this_one->rect.width / 2,
+                                             not_this_one->rect.y +
+                                             not_this_one->rect.height / 2);
+      focus_at_point_usec += elapsed_usec (&start);
+
+      if (focus != NULL && !check_focus (focus, workspace, not_this_one))
+        {
+          fprintf (stderr, "focus scan picked an unfocusable window\n");
+          return 1;
+        }
+    }
+
+  print_hot_span ();
+  printf ("%d windows, %d rounds: %.1f usec/sort, "
+          "%.1f usec/focus scan, %.1f usec/focus scan at point\n",
+          N_WINDOWS, N_ROUNDS, sort_usec / N_ROUNDS,
+          focus_usec / N_ROUNDS, focus_at_point_usec / N_ROUNDS);
+
+  g_list_free (sorted);
+  for (i = 0; i < N_WINDOWS; i++)
+    {
+      g_free (windows[i]);
+      g_free (padding[i]);
+    }
+  for (i = 0; i < N_WORKSPACES; i++)
+    g_free (workspaces[i]);
+  for (i = 0; i < N_GROUPS; i++)
+    g_free (groups[i]);
+
+  return 0;
+}
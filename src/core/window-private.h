@@ -68,6 +68,12 @@ typedef enum
   META_MAXIMIZE_VERTICAL   = 1 << 1
 } MetaMaximizeFlags;
 
+/* How many _NET_WM_SYNC_REQUESTs a resize may have outstanding at once.
+ * More than one lets a client that answers quickly keep up with the
+ * pointer instead of waiting a round trip between frames.
+ */
+#define META_SYNC_REQUESTS_IN_FLIGHT 2
+
 typedef enum {
   META_CLIENT_TYPE_UNKNOWN = 0,
   META_CLIENT_TYPE_APPLICATION = 1,
@@ -85,50 +91,43 @@ typedef enum {
 
 struct _MetaWindow
 {
+  /* The fields read by every pass over the stack (sorting, picking a
+   * focus window, placement) come first, so such a pass touches as
+   * few cache lines per window as possible.  Everything after the
+   * flags is mostly used when the window's properties change.
+   */
   MetaDisplay *display;
   MetaScreen *screen;
   MetaWorkspace *workspace;
   Window xwindow;
   /* may be NULL! not all windows get decorated */
   MetaFrame *frame;
-  int depth;
-  Visual *xvisual;
-  Colormap colormap;
-  char *desc; /* used in debug spew */
-  char *title;
-
-  char *icon_name;
-  GdkPixbuf *icon;
-  GdkPixbuf *mini_icon;
-  MetaIconCache icon_cache;
-  Pixmap wm_hints_pixmap;
-  Pixmap wm_hints_mask;
-  
   MetaWindowType type;
-  Atom type_atom;
-  
-  /* NOTE these five are not in UTF-8, we just treat them as random
-   * binary data
+
+  /* Managed by stack.c */
+  MetaStackLayer layer;
+  int stack_position; /* see comment in stack.h */
+
+  /* The size we set the window to last (i.e. what we believe
+   * to be its actual size on the server). The x, y are
+   * the actual server-side x,y so are relative to the frame
+   * (meaning that they just hold the frame width and height) 
+   * or the root window (meaning they specify the location
+   * of the top left of the inner window) as appropriate.
    */
-  char *res_class;
-  char *res_name;
-  char *role;
-  char *sm_client_id;
-  char *wm_client_machine;
-  char *startup_id;
+  MetaRectangle rect;
+
+  /* Number of UnmapNotify that are caused by us, if
+   * we get UnmapNotify with none pending then the client
+   * is withdrawing the window.
+   */
+  int unmaps_pending;
 
-  int net_wm_pid;
-  
   Window xtransient_for;
-  Window xgroup_leader;
-  Window xclient_leader;
 
-  /* Initial workspace property */
-  int initial_workspace;  
-  
-  /* Initial timestamp property */
-  guint32 initial_timestamp;  
-  
+  /* maintained by group.c */
+  MetaGroup *group;
+
   /* Whether we're maximized */
   guint maximized_horizontally : 1;
   guint maximized_vertically : 1;
@@ -147,12 +146,6 @@ struct _MetaWindow
   /* Whether we have to fullscreen after placement */
   guint fullscreen_after_placement : 1;
 
-  /* Area to cover when in fullscreen mode.  If _NET_WM_FULLSCREEN_MONITORS has
-   * been overridden (via a client message), the window will cover the union of
-   * these monitors.  If not, this is the single monitor which the window's
-   * origin is on. */
-  long fullscreen_monitors[4];
-  
   /* Whether we're trying to constrain the window to be fully onscreen */
   guint require_fully_onscreen : 1;
 
@@ -307,22 +300,65 @@ struct _MetaWindow
   /* if TRUE, application is buggy and SYNC resizing is turned off */
   guint disable_sync : 1;
 
+  int depth;
+  Visual *xvisual;
+  Colormap colormap;
+  char *desc; /* used in debug spew */
+  char *title;
+
+  char *icon_name;
+  GdkPixbuf *icon;
+  GdkPixbuf *mini_icon;
+  MetaIconCache icon_cache;
+  Pixmap wm_hints_pixmap;
+  Pixmap wm_hints_mask;
+  
+  Atom type_atom;
+  
+  /* NOTE these five are not in UTF-8, we just treat them as random
+   * binary data
+   */
+  char *res_class;
+  char *res_name;
+  char *role;
+  char *sm_client_id;
+  char *wm_client_machine;
+  char *startup_id;
+
+  int net_wm_pid;
+  
+  Window xgroup_leader;
+  Window xclient_leader;
+
+  /* Initial workspace property */
+  int initial_workspace;  
+  
+  /* Initial timestamp property */
+  guint32 initial_timestamp;  
+  
+  /* Area to cover when in fullscreen mode.  If _NET_WM_FULLSCREEN_MONITORS has
+   * been overridden (via a client message), the window will cover the union of
+   * these monitors.  If not, this is the single monitor which the window's
+   * origin is on. */
+  long fullscreen_monitors[4];
+  
   /* Note: can be NULL */
   GSList *struts;
 
 #ifdef HAVE_XSYNC
   /* XSync update counter */
   XSyncCounter sync_request_counter;
+  /* last request sent, and last one the client has answered */
   guint sync_request_serial;
-  GTimeVal sync_request_time;
+  guint sync_request_acked;
+  /* when each request still unanswered was sent, by serial */
+  GTimeVal sync_request_sent[META_SYNC_REQUESTS_IN_FLIGHT];
+  /* how long the client takes to answer, smoothed, in ms; 0 if
+   * we haven't seen an answer yet
+   */
+  double sync_request_latency;
 #endif
   
-  /* Number of UnmapNotify that are caused by us, if
-   * we get UnmapNotify with none pending then the client
-   * is withdrawing the window.
-   */
-  int unmaps_pending;
-
   /* set to the most recent user-interaction event timestamp that we
      know about for this window */
   guint32 net_wm_user_time;
@@ -330,15 +366,6 @@ struct _MetaWindow
   /* window that gets updated net_wm_user_time values */
   Window user_time_window;
   
-  /* The size we set the window to last (i.e. what we believe
-   * to be its actual size on the server). The x, y are
-   * the actual server-side x,y so are relative to the frame
-   * (meaning that they just hold the frame width and height) 
-   * or the root window (meaning they specify the location
-   * of the top left of the inner window) as appropriate.
-   */
-  MetaRectangle rect;
-
   /* The geometry to restore when we unmaximize.  The position is in
    * root window coords, even if there's a frame, which contrasts with
    * window->rect above.  Note that this gives the position and size
@@ -364,15 +391,11 @@ struct _MetaWindow
   /* x/y/w/h here get filled with ConfigureRequest values */
   XSizeHints size_hints;
 
-  /* Managed by stack.c */
-  MetaStackLayer layer;
-  int stack_position; /* see comment in stack.h */
+  /* Our slot in display->window_registry */
+  guint registry_index;
   
   /* Current dialog open for this window */
   int dialog_pid;
-
-  /* maintained by group.c */
-  MetaGroup *group;
 };
 
 /* These differ from window->has_foo_func in that they consider
@@ -564,6 +587,11 @@ void meta_window_handle_mouse_grab_op_event (MetaWindow *window,
 
 GList* meta_window_get_workspaces (MetaWindow *window);
 
+/* Called whenever something the workspace popup draws for this
+ * window changes
+ */
+void meta_window_invalidate_workspace_thumbnails (MetaWindow *window);
+
 gboolean meta_window_located_on_workspace (MetaWindow    *window,
                                            MetaWorkspace *workspace);
 
@@ -398,8 +398,8 @@ meta_window_new_with_attrs (MetaDisplay       *display,
 #ifdef HAVE_XSYNC
   window->sync_request_counter = None;
   window->sync_request_serial = 0;
-  window->sync_request_time.tv_sec = 0;
-  window->sync_request_time.tv_usec = 0;
+  window->sync_request_acked = 0;
+  window->sync_request_latency = 0.0;
 #endif
   
   window->screen = NULL;
@@ -565,6 +565,7 @@ meta_window_new_with_attrs (MetaDisplay       *display,
   window->initial_timestamp = 0; /* not used */
   
   meta_display_register_x_window (display, &window->xwindow, window);
+  meta_display_register_window (display, window);
 
 
   /* assign the window to its group, or create a new group if needed
@@ -1154,6 +1155,7 @@ meta_window_free (MetaWindow  *window,
   meta_display_ungrab_focus_window_button (window->display, window);
   
   meta_display_unregister_x_window (window->display, window->xwindow);
+  meta_display_unregister_window (window->display, window);
   
 
   meta_error_trap_push (window->display);
@@ -2334,6 +2336,9 @@ meta_window_show (MetaWindow *window)
 
   set_net_wm_state (window);
 
+  if (did_show)
+    meta_window_invalidate_workspace_thumbnails (window);
+
   if (did_show && window->struts)
     {
       meta_topic (META_DEBUG_WORKAREA,
@@ -2393,6 +2398,9 @@ meta_window_hide (MetaWindow *window)
     }
   
   set_net_wm_state (window);
+
+  if (did_hide)
+    meta_window_invalidate_workspace_thumbnails (window);
       
   if (did_hide && window->struts)
     {
@@ -2418,6 +2426,7 @@ meta_window_minimize (MetaWindow  *window)
     {
       window->minimized = TRUE;
       meta_window_queue(window, META_QUEUE_CALC_SHOWING);
+      meta_window_invalidate_workspace_thumbnails (window);
 
       meta_window_foreach_transient (window,
                                      queue_calc_showing_func,
@@ -2446,6 +2455,7 @@ meta_window_unminimize (MetaWindow  *window)
       window->minimized = FALSE;
       window->was_minimized = TRUE;
       meta_window_queue(window, META_QUEUE_CALC_SHOWING);
+      meta_window_invalidate_workspace_thumbnails (window);
 
       meta_window_foreach_transient (window,
                                      queue_calc_showing_func,
@@ -3223,7 +3233,8 @@ send_sync_request (MetaWindow *window)
   XSendEvent (window->display->xdisplay,
 	      window->xwindow, False, 0, (XEvent*) &ev);
 
-  g_get_current_time (&window->sync_request_time);
+  g_get_current_time (&window->sync_request_sent[window->sync_request_serial %
+                                                 META_SYNC_REQUESTS_IN_FLIGHT]);
 }
 #endif
 
@@ -3619,8 +3630,8 @@ meta_window_move_resize_internal (MetaWindow          *window,
 #ifdef HAVE_XSYNC
       if (window->sync_request_counter != None &&
 	  window->display->grab_sync_request_alarm != None &&
-	  window->sync_request_time.tv_usec == 0 &&
-	  window->sync_request_time.tv_sec == 0)
+	  window->sync_request_serial - window->sync_request_acked <
+          META_SYNC_REQUESTS_IN_FLIGHT)
 	{
 	  /* turn off updating */	
 	  if (window->display->compositor)
@@ -3659,6 +3670,9 @@ meta_window_move_resize_internal (MetaWindow          *window,
       need_move_client || need_resize_client)
     {
       int newx, newy;
+
+      meta_window_invalidate_workspace_thumbnails (window);
+
       meta_window_get_position (window, &newx, &newy);
       meta_topic (META_DEBUG_GEOMETRY,
                   "New size/position %d,%d %dx%d (user %d,%d %dx%d)\n",
@@ -4017,10 +4031,6 @@ meta_window_begin_wireframe (MetaWindow *window)
 
   meta_effects_begin_wireframe (window->screen,
                                 &new_xor, display_width, display_height);
-
-  window->display->grab_wireframe_last_xor_rect = new_xor;
-  window->display->grab_wireframe_last_display_width = display_width;
-  window->display->grab_wireframe_last_display_height = display_height;
 }
 
 void
@@ -4044,23 +4054,13 @@ meta_window_update_wireframe (MetaWindow *window,
   meta_window_get_wireframe_geometry (window, &display_width, &display_height);
 
   meta_effects_update_wireframe (window->screen,
-                                 &window->display->grab_wireframe_last_xor_rect,
-                                 window->display->grab_wireframe_last_display_width,
-                                 window->display->grab_wireframe_last_display_height,
                                  &new_xor, display_width, display_height);
-
-  window->display->grab_wireframe_last_xor_rect = new_xor;
-  window->display->grab_wireframe_last_display_width = display_width;
-  window->display->grab_wireframe_last_display_height = display_height;
 }
 
 void
 meta_window_end_wireframe (MetaWindow *window)
 {
-  meta_effects_end_wireframe (window->display->grab_window->screen,
-                              &window->display->grab_wireframe_last_xor_rect,
-                              window->display->grab_wireframe_last_display_width,
-                              window->display->grab_wireframe_last_display_height);
+  meta_effects_end_wireframe (window->display->grab_window->screen);
 }
 
 const char*
@@ -4082,8 +4082,8 @@ meta_window_get_startup_id (MetaWindow *window)
 static MetaWindow*
 get_modal_transient (MetaWindow *window)
 {
-  GSList *windows;
-  GSList *tmp;
+  MetaDisplayWindowIter iter;
+  MetaWindow *transient;
   MetaWindow *modal_transient;
 
   /* A window can't be the transient of itself, but this is just for
@@ -4092,25 +4092,17 @@ get_modal_transient (MetaWindow *window)
    */
   modal_transient = window;
 
-  windows = meta_display_list_windows (window->display);
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, window->display);
+  while ((transient = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *transient = tmp->data;
-      
       if (transient->xtransient_for == modal_transient->xwindow &&
           transient->wm_state_modal)
         {
           modal_transient = transient;
-          tmp = windows;
-          continue;
+          meta_display_window_iter_init (&iter, window->display);
         }
-      
-      tmp = tmp->next;
     }
 
-  g_slist_free (windows);
-
   if (window == modal_transient)
     modal_transient = NULL;
 
@@ -4202,7 +4194,7 @@ meta_window_focus (MetaWindow  *window,
           meta_window_send_icccm_message (window,
                                           window->display->atom_WM_TAKE_FOCUS,
                                           timestamp);
-          window->display->expected_focus_window = window;
+          meta_display_set_expected_focus_window (window->display, window);
         }
     }
 
@@ -4270,7 +4262,9 @@ window_stick_impl (MetaWindow  *window)
    * to that original workspace list if on_all_workspaces is
    * toggled back off.
    */
+  meta_window_invalidate_workspace_thumbnails (window);
   window->on_all_workspaces = TRUE;
+  meta_window_invalidate_workspace_thumbnails (window);
 
   /* We do, however, change the MRU lists of all the workspaces
    */
@@ -4300,7 +4294,9 @@ window_unstick_impl (MetaWindow  *window)
 
   /* Revert to window->workspaces */
 
+  meta_window_invalidate_workspace_thumbnails (window);
   window->on_all_workspaces = FALSE;
+  meta_window_invalidate_workspace_thumbnails (window);
 
   /* Remove window from MRU lists that it doesn't belong in */
   tmp = window->screen->workspaces;
@@ -5800,11 +5796,9 @@ meta_window_update_net_wm_type (MetaWindow *window)
 static void
 redraw_icon (MetaWindow *window)
 {
-  /* We could probably be smart and just redraw the icon here,
-   * instead of the whole frame.
-   */
   if (window->frame && (window->mapped || window->frame->mapped))
-    meta_ui_queue_frame_draw (window->screen->ui, window->frame->xwindow);
+    meta_ui_queue_frame_icon_draw (window->screen->ui,
+                                   window->frame->xwindow);
 }
 
 void
@@ -5837,6 +5831,7 @@ meta_window_update_icon_now (MetaWindow *window)
       window->mini_icon = mini_icon;
 
       redraw_icon (window);
+      meta_window_invalidate_workspace_thumbnails (window);
     }
   
   g_assert (window->icon);
@@ -5892,6 +5887,19 @@ meta_window_get_workspaces (MetaWindow *window)
     return window->workspace->list_containing_self;
 }
 
+void
+meta_window_invalidate_workspace_thumbnails (MetaWindow *window)
+{
+  /* Sticky windows only appear on the active workspace's thumbnail */
+  if (window->on_all_workspaces)
+    {
+      if (window->screen->active_workspace)
+        meta_workspace_invalidate_thumbnail (window->screen->active_workspace);
+    }
+  else if (window->workspace)
+    meta_workspace_invalidate_thumbnail (window->workspace);
+}
+
 static void
 invalidate_work_areas (MetaWindow *window)
 {
@@ -6234,6 +6242,7 @@ recalc_window_features (MetaWindow *window)
   gboolean old_has_resize_func;
   gboolean old_has_shade_func;
   gboolean old_always_sticky;
+  gboolean old_skip_pager;
 
   old_has_close_func = window->has_close_func;
   old_has_minimize_func = window->has_minimize_func;
@@ -6241,6 +6250,7 @@ recalc_window_features (MetaWindow *window)
   old_has_resize_func = window->has_resize_func;
   old_has_shade_func = window->has_shade_func;
   old_always_sticky = window->always_sticky;
+  old_skip_pager = window->skip_pager;
 
   /* Use MWM hints initially */
   window->decorated = window->mwm_decorated;
@@ -6420,6 +6430,9 @@ recalc_window_features (MetaWindow *window)
       old_has_shade_func != window->has_shade_func       ||
       old_always_sticky != window->always_sticky)
     set_allowed_actions_hint (window);
+
+  if (old_skip_pager != window->skip_pager)
+    meta_window_invalidate_workspace_thumbnails (window);
     
   /* FIXME perhaps should ensure if we don't have a shade func,
    * we aren't shaded, etc.
@@ -6806,6 +6819,55 @@ time_diff (const GTimeVal *first,
   return first_ms - second_ms;
 }
 
+/* How long (ms) to wait for a client to answer a sync request before
+ * resizing without it: a few times what it usually takes, within
+ * these bounds.
+ */
+#define SYNC_TIMEOUT_FACTOR 4.0
+#define SYNC_TIMEOUT_MIN    200.0
+#define SYNC_TIMEOUT_MAX    1000.0
+
+/* Furthest ahead (ms) of the pointer we aim a synced resize */
+#define RESIZE_PREDICTION_MAX 50.0
+
+#ifdef HAVE_XSYNC
+static void
+record_sync_latency (MetaWindow *window,
+                     guint       acked)
+{
+  GTimeVal current_time;
+  double sample;
+
+  g_get_current_time (&current_time);
+
+  sample = time_diff (&current_time,
+                      &window->sync_request_sent[acked %
+                                                 META_SYNC_REQUESTS_IN_FLIGHT]);
+  if (sample < 0.0)
+    return; /* clock went backwards */
+
+  /* One slow frame shouldn't undo what we know about the client */
+  if (window->sync_request_latency == 0.0)
+    window->sync_request_latency = sample;
+  else
+    window->sync_request_latency += (sample - window->sync_request_latency) / 4.0;
+
+  meta_topic (META_DEBUG_RESIZING,
+              "Sync request %u answered after %g ms, latency now %g ms\n",
+              acked, sample, window->sync_request_latency);
+}
+
+static double
+sync_request_timeout (MetaWindow *window)
+{
+  if (window->sync_request_latency == 0.0)
+    return SYNC_TIMEOUT_MAX;
+
+  return CLAMP (window->sync_request_latency * SYNC_TIMEOUT_FACTOR,
+                SYNC_TIMEOUT_MIN, SYNC_TIMEOUT_MAX);
+}
+#endif /* HAVE_XSYNC */
+
 static gboolean
 check_moveresize_frequency (MetaWindow *window, 
 			    gdouble    *remaining)
@@ -6818,35 +6880,43 @@ check_moveresize_frequency (MetaWindow *window,
   if (!window->disable_sync &&
       window->display->grab_sync_request_alarm != None)
     {
-      if (window->sync_request_time.tv_sec != 0 ||
-	  window->sync_request_time.tv_usec != 0)
+      if (window->sync_request_serial - window->sync_request_acked >=
+          META_SYNC_REQUESTS_IN_FLIGHT)
 	{
+          guint oldest = window->sync_request_acked + 1;
+          double timeout = sync_request_timeout (window);
 	  double elapsed =
-	    time_diff (&current_time, &window->sync_request_time);
+	    time_diff (&current_time,
+                       &window->sync_request_sent[oldest %
+                                                  META_SYNC_REQUESTS_IN_FLIGHT]);
 
-	  if (elapsed < 1000.0)
+	  if (elapsed < timeout)
 	    {
 	      /* We want to be sure that the timeout happens at
 	       * a time where elapsed will definitely be
-	       * greater than 1000, so we can disable sync
+	       * greater than the timeout, so we can disable sync
 	       */
 	      if (remaining)
-		*remaining = 1000.0 - elapsed + 100;
+		*remaining = timeout - elapsed + 10;
 	      
 	      return FALSE;
 	    }
 	  else
 	    {
-	      /* We have now waited for more than a second for the
-	       * application to respond to the sync request
+	      /* The application has taken far longer than usual to
+	       * respond to the sync request
 	       */
+              meta_topic (META_DEBUG_RESIZING,
+                          "No answer to sync request %u after %g ms, "
+                          "resizing without sync\n",
+                          oldest, elapsed);
 	      window->disable_sync = TRUE;
 	      return TRUE;
 	    }
 	}
       else
 	{
-	  /* No outstanding sync requests. Go ahead and resize
+	  /* Room for another sync request. Go ahead and resize
 	   */
 	  return TRUE;
 	}
@@ -6854,10 +6924,18 @@ check_moveresize_frequency (MetaWindow *window,
   else
 #endif /* HAVE_XSYNC */
     {
-      const double max_resizes_per_second = 25.0;
-      const double ms_between_resizes = 1000.0 / max_resizes_per_second;
+      double ms_between_resizes = 1000.0 / 25.0;
       double elapsed;
 
+#ifdef HAVE_XSYNC
+      /* A client that has fallen behind on sync requests has at
+       * least told us how fast it can go
+       */
+      if (window->sync_request_latency > 0.0)
+        ms_between_resizes = CLAMP (window->sync_request_latency,
+                                    1000.0 / 60.0, 250.0);
+#endif
+
       elapsed = time_diff (&current_time, &window->display->grab_last_moveresize_time);
 
       if (elapsed >= 0.0 && elapsed < ms_between_resizes)
@@ -6874,12 +6952,131 @@ check_moveresize_frequency (MetaWindow *window,
       
       meta_topic (META_DEBUG_RESIZING,
 		  " Checked moveresize freq, allowing move/resize now (%g of %g seconds elapsed)\n",
-		  elapsed / 1000.0, 1.0 / max_resizes_per_second);
+		  elapsed / 1000.0, ms_between_resizes / 1000.0);
       
       return TRUE;
     }
 }
 
+/* How often (ms) the real position of a window the compositor is
+ * dragging is sent to the server
+ */
+#define MOVE_COMMIT_INTERVAL 16
+
+/* The compositor is told where the client window's origin goes;
+ * see meta_display_begin_grab_op()
+ */
+static void
+show_move_in_compositor (MetaWindow *window,
+                         int         x,
+                         int         y)
+{
+  MetaDisplay *display = window->display;
+
+  meta_compositor_update_move (display->compositor, window,
+                               x + display->grab_move_correction_x,
+                               y + display->grab_move_correction_y);
+}
+
+/* The window has just really been moved and resized under the
+ * pointer, so start the compositor's drag afresh from there
+ */
+static void
+restart_move_in_compositor (MetaWindow *window)
+{
+  MetaDisplay *display = window->display;
+  MetaRectangle outer;
+  MetaRectangle client;
+
+  if (!display->grab_compositor_move)
+    return;
+
+  if (display->grab_move_commit_id)
+    {
+      g_source_remove (display->grab_move_commit_id);
+      display->grab_move_commit_id = 0;
+    }
+  display->grab_move_correction_x = 0;
+  display->grab_move_correction_y = 0;
+
+  meta_window_get_outer_rect (window, &outer);
+  meta_window_get_client_root_coords (window, &client);
+  meta_compositor_begin_move (display->compositor, window, &outer,
+                              client.x, client.y);
+}
+
+static void
+commit_move (MetaWindow *window)
+{
+  MetaDisplay *display = window->display;
+  MetaRectangle committed;
+  int correction_x, correction_y;
+
+  g_get_current_time (&display->grab_last_moveresize_time);
+
+  meta_window_move (window, TRUE,
+                    display->grab_pending_move_x,
+                    display->grab_pending_move_y);
+
+  /* Constraints may not have let the window go where we asked; keep
+   * the compositor showing it where it really is.
+   */
+  meta_window_get_client_root_coords (window, &committed);
+  correction_x = committed.x - display->grab_pending_move_x;
+  correction_y = committed.y - display->grab_pending_move_y;
+
+  if (correction_x != display->grab_move_correction_x ||
+      correction_y != display->grab_move_correction_y)
+    {
+      display->grab_move_correction_x = correction_x;
+      display->grab_move_correction_y = correction_y;
+      show_move_in_compositor (window,
+                               display->grab_pending_move_x,
+                               display->grab_pending_move_y);
+    }
+}
+
+static gboolean
+commit_move_timeout (gpointer data)
+{
+  MetaWindow *window = data;
+
+  window->display->grab_move_commit_id = 0;
+  commit_move (window);
+
+  return FALSE;
+}
+
+/* The compositor has already drawn the window at x, y; the server
+ * hears about it at most once a frame, and always at the end of the
+ * drag (see meta_display_end_grab_op()).
+ */
+static void
+queue_move_commit (MetaWindow *window,
+                   int         x,
+                   int         y)
+{
+  MetaDisplay *display = window->display;
+  GTimeVal current_time;
+  double elapsed;
+
+  display->grab_pending_move_x = x;
+  display->grab_pending_move_y = y;
+
+  if (display->grab_move_commit_id)
+    return;
+
+  g_get_current_time (&current_time);
+  elapsed = time_diff (&current_time, &display->grab_last_moveresize_time);
+
+  if (elapsed < 0.0 || elapsed >= MOVE_COMMIT_INTERVAL)
+    commit_move (window);
+  else
+    display->grab_move_commit_id =
+      g_timeout_add (MOVE_COMMIT_INTERVAL - (int) elapsed,
+                     commit_move_timeout, window);
+}
+
 static gboolean
 update_move_timeout (gpointer data)
 {
@@ -6967,6 +7164,8 @@ update_move (MetaWindow  *window,
                               META_MAXIMIZE_HORIZONTAL |
                               META_MAXIMIZE_VERTICAL);
 
+      restart_move_in_compositor (window);
+
       return;
     }
   /* remaximize window on an other xinerama monitor if window has
@@ -7021,6 +7220,8 @@ update_move (MetaWindow  *window,
                                     META_MAXIMIZE_HORIZONTAL |
                                     META_MAXIMIZE_VERTICAL);
 
+              restart_move_in_compositor (window);
+
               return;
             }
         }
@@ -7029,7 +7230,15 @@ update_move (MetaWindow  *window,
   if (display->grab_wireframe_active)
     old = display->grab_wireframe_rect;
   else
-    meta_window_get_client_root_coords (window, &old);
+    {
+      meta_window_get_client_root_coords (window, &old);
+
+      if (display->grab_move_commit_id)
+        {
+          old.x = display->grab_pending_move_x;
+          old.y = display->grab_pending_move_y;
+        }
+    }
 
   /* Don't allow movement in the maximized directions */
   if (window->maximized_horizontally)
@@ -7047,19 +7256,15 @@ update_move (MetaWindow  *window,
                                         snap,
                                         FALSE);
 
-  if (display->compositor)
-    {
-      int root_x = new_x - display->grab_anchor_window_pos.x + display->grab_anchor_root_x;
-      int root_y = new_y - display->grab_anchor_window_pos.y + display->grab_anchor_root_y;
-      
-      meta_compositor_update_move (display->compositor,
-				   window, root_x, root_y);
-    }
-  
   if (display->grab_wireframe_active)
     meta_window_update_wireframe (window, new_x, new_y, 
                                   display->grab_wireframe_rect.width,
                                   display->grab_wireframe_rect.height);
+  else if (display->grab_compositor_move)
+    {
+      show_move_in_compositor (window, new_x, new_y);
+      queue_move_commit (window, new_x, new_y);
+    }
   else
     meta_window_move (window, TRUE, new_x, new_y);
 }
@@ -7077,6 +7282,30 @@ update_resize_timeout (gpointer data)
   return FALSE;
 }
 
+/* Keeps a smoothed pointer velocity for the grab, which
+ * update_resize() uses to lead a client that is slow to redraw; call
+ * it for real motion only, before update_resize() takes the position
+ */
+static void
+update_motion_velocity (MetaDisplay *display,
+                        int          x,
+                        int          y)
+{
+  GTimeVal current_time;
+  double dt;
+
+  g_get_current_time (&current_time);
+  dt = time_diff (&current_time, &display->grab_latest_motion_time);
+  if (dt <= 0.0)
+    return;
+
+  display->grab_motion_velocity_x =
+    (display->grab_motion_velocity_x + (x - display->grab_latest_motion_x) / dt) / 2.0;
+  display->grab_motion_velocity_y =
+    (display->grab_motion_velocity_y + (y - display->grab_latest_motion_y) / dt) / 2.0;
+  display->grab_latest_motion_time = current_time;
+}
+
 static void
 update_resize (MetaWindow *window,
                gboolean    snap,
@@ -7154,6 +7383,35 @@ update_resize (MetaWindow *window,
         }
     }
   
+#ifdef HAVE_XSYNC
+  /* The client will show this size a frame or so from now; aim for
+   * where the pointer will be by then.  Sync answers and timeouts lead
+   * the same way, so that they don't snap back to the pointer between
+   * motion events; once the pointer has been still for longer than the
+   * lead we aim at where it is, which takes back any overshoot.
+   */
+  if (!window->display->grab_wireframe_active &&
+      !window->disable_sync &&
+      window->display->grab_sync_request_alarm != None &&
+      window->sync_request_latency > 0.0)
+    {
+      GTimeVal current_time;
+      double lead, still;
+
+      lead = MIN (window->sync_request_latency, RESIZE_PREDICTION_MAX);
+
+      g_get_current_time (&current_time);
+      still = time_diff (&current_time,
+                         &window->display->grab_latest_motion_time);
+
+      if (still < lead)
+        {
+          dx += (int) (window->display->grab_motion_velocity_x * lead);
+          dy += (int) (window->display->grab_motion_velocity_y * lead);
+        }
+    }
+#endif
+
   /* FIXME: This stupidity only needed because of wireframe mode and
    * the fact that wireframe isn't making use of
    * meta_rectangle_resize_with_gravity().  If we were to use that, we
@@ -7387,18 +7645,34 @@ meta_window_handle_mouse_grab_op_event (MetaWindow *window,
 #ifdef HAVE_XSYNC
   if (event->type == (window->display->xsync_event_base + XSyncAlarmNotify))
     {
+      XSyncAlarmNotifyEvent *alarm_event = (XSyncAlarmNotifyEvent*) event;
+      guint acked;
+
       meta_topic (META_DEBUG_RESIZING,
                   "Alarm event received last motion x = %d y = %d\n",
                   window->display->grab_latest_motion_x,
                   window->display->grab_latest_motion_y);
 
+      /* The counter holds the last request the client has drawn
+       * for; it may have skipped straight past earlier ones.
+       */
+      acked = XSyncValueLow32 (alarm_event->counter_value);
+      if (acked > window->sync_request_serial)
+        acked = window->sync_request_serial;
+
+      if (acked > window->sync_request_acked)
+        {
+          record_sync_latency (window, acked);
+          window->sync_request_acked = acked;
+        }
+
       /* If sync was previously disabled, turn it back on and hope
        * the application has come to its senses (maybe it was just
-       * busy with a pagefault or a long computation).
+       * busy with a pagefault or a long computation).  The slow
+       * answer is in its latency now, so we'll wait longer for it
+       * next time rather than flip straight back.
        */
       window->disable_sync = FALSE;
-      window->sync_request_time.tv_sec = 0;
-      window->sync_request_time.tv_usec = 0;
       
       /* This means we are ready for another configure. */
       switch (window->display->grab_op)
@@ -7454,6 +7728,10 @@ meta_window_handle_mouse_grab_op_event (MetaWindow *window,
             }
           else if (meta_grab_op_is_resizing (window->display->grab_op))
             {
+              /* The final size is where the button went up */
+              window->display->grab_motion_velocity_x = 0.0;
+              window->display->grab_motion_velocity_y = 0.0;
+
               if (event->xbutton.root == window->screen->xroot)
                 update_resize (window,
                                event->xbutton.state & ShiftMask,
@@ -7490,11 +7768,16 @@ meta_window_handle_mouse_grab_op_event (MetaWindow *window,
             {
               if (check_use_this_motion_notify (window,
                                                 event))
-                update_resize (window,
-                               event->xmotion.state & ShiftMask,
-                               event->xmotion.x_root,
-                               event->xmotion.y_root,
-                               FALSE);
+                {
+                  update_motion_velocity (window->display,
+                                          event->xmotion.x_root,
+                                          event->xmotion.y_root);
+                  update_resize (window,
+                                 event->xmotion.state & ShiftMask,
+                                 event->xmotion.x_root,
+                                 event->xmotion.y_root,
+                                 FALSE);
+                }
             }
         }
       break;
@@ -7717,26 +8000,18 @@ meta_window_foreach_transient (MetaWindow            *window,
                                MetaWindowForeachFunc  func,
                                void                  *data)
 {
-  GSList *windows;
-  GSList *tmp;
-
-  windows = meta_display_list_windows (window->display);
+  MetaDisplayWindowIter iter;
+  MetaWindow *transient;
 
-  tmp = windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, window->display);
+  while ((transient = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *transient = tmp->data;
-      
       if (meta_window_is_ancestor_of_transient (window, transient))
         {
           if (!(* func) (transient, data))
             break;
         }
-      
-      tmp = tmp->next;
     }
-
-  g_slist_free (windows);
 }
 
 void
@@ -82,6 +82,8 @@ meta_workspace_new (MetaScreen *screen)
   workspace->all_struts = NULL;
 
   workspace->showing_desktop = FALSE;
+
+  workspace->thumbnail = NULL;
   
   return workspace;
 }
@@ -166,6 +168,8 @@ meta_workspace_free (MetaWorkspace *workspace)
       meta_rectangle_free_list_and_elements (workspace->xinerama_edges);
     }
 
+  meta_workspace_invalidate_thumbnail (workspace);
+
   g_free (workspace);
 
   /* don't bother to reset names, pagers can just ignore
@@ -206,6 +210,8 @@ meta_workspace_add_window (MetaWorkspace *workspace,
   workspace->windows = g_list_prepend (workspace->windows, window);
   window->workspace = workspace;
 
+  meta_window_invalidate_workspace_thumbnails (window);
+
   meta_window_set_current_workspace_hint (window);
   
   if (window->struts)
@@ -228,6 +234,8 @@ meta_workspace_remove_window (MetaWorkspace *workspace,
 {
   g_return_if_fail (window->workspace == workspace);
 
+  meta_window_invalidate_workspace_thumbnails (window);
+
   workspace->windows = g_list_remove (workspace->windows, window);
   window->workspace = NULL;
 
@@ -268,6 +276,16 @@ meta_workspace_remove_window (MetaWorkspace *workspace,
   meta_window_queue (window, META_QUEUE_CALC_SHOWING|META_QUEUE_MOVE_RESIZE);
 }
 
+void
+meta_workspace_invalidate_thumbnail (MetaWorkspace *workspace)
+{
+  if (workspace->thumbnail)
+    {
+      g_object_unref (workspace->thumbnail);
+      workspace->thumbnail = NULL;
+    }
+}
+
 void
 meta_workspace_relocate_windows (MetaWorkspace *workspace,
                                  MetaWorkspace *new_home)
@@ -392,6 +410,11 @@ meta_workspace_activate_with_focus (MetaWorkspace *workspace,
   
   workspace->screen->active_workspace = workspace;
 
+  /* Both are drawn differently once the active one changes */
+  meta_workspace_invalidate_thumbnail (workspace);
+  if (old)
+    meta_workspace_invalidate_thumbnail (old);
+
   set_active_space_hint (workspace->screen);
 
   /* If the "show desktop" mode is active for either the old workspace
@@ -478,27 +501,19 @@ meta_workspace_index (MetaWorkspace *workspace)
 GList*
 meta_workspace_list_windows (MetaWorkspace *workspace)
 {
-  GSList *display_windows;
-  GSList *tmp;
+  MetaDisplayWindowIter iter;
+  MetaWindow *window;
   GList *workspace_windows;
   
-  display_windows = meta_display_list_windows (workspace->screen->display);
-
   workspace_windows = NULL;
-  tmp = display_windows;
-  while (tmp != NULL)
+  meta_display_window_iter_init (&iter, workspace->screen->display);
+  while ((window = meta_display_window_iter_next (&iter)) != NULL)
     {
-      MetaWindow *window = tmp->data;
-
       if (meta_window_located_on_workspace (window, workspace))
         workspace_windows = g_list_prepend (workspace_windows,
                                             window);
-
-      tmp = tmp->next;
     }
 
-  g_slist_free (display_windows);
-
   return workspace_windows;
 }
 
@@ -65,6 +65,11 @@ struct _MetaWorkspace
   guint work_areas_invalid : 1;
 
   guint showing_desktop : 1;
+
+  /* The workspace popup's last drawing of this workspace, a pixmap
+   * owned by the UI; dropped whenever anything it shows changes
+   */
+  GObject *thumbnail;
 };
 
 MetaWorkspace* meta_workspace_new           (MetaScreen    *screen);
@@ -73,6 +78,7 @@ void           meta_workspace_add_window    (MetaWorkspace *workspace,
                                              MetaWindow    *window);
 void           meta_workspace_remove_window (MetaWorkspace *workspace,
                                              MetaWindow    *window);
+void           meta_workspace_invalidate_thumbnail (MetaWorkspace *workspace);
 void           meta_workspace_relocate_windows (MetaWorkspace *workspace,
                                                 MetaWorkspace *new_home);
 void           meta_workspace_activate_with_focus (MetaWorkspace *workspace,
@@ -632,6 +632,43 @@ meta_prop_get_cardinal_with_atom_type (MetaDisplay   *display,
   return cardinal_with_atom_type_from_results (&results, prop_type, cardinal_p);
 }
 
+/* Whether the first string in a text property would come out of
+ * gdk_text_property_to_utf8_list() byte for byte the same: it has to
+ * be UTF-8 already (for a Latin-1 STRING that means plain ASCII) and
+ * free of the control characters GDK strips out.
+ */
+static gboolean
+text_is_unchanged_by_conversion (const guchar *text,
+                                 gulong        len,
+                                 gboolean      latin1)
+{
+  gulong i;
+
+  if (len == 0 || text[0] == '\0')
+    return FALSE;
+
+  for (i = 0; i < len && text[i] != '\0'; i++)
+    {
+      guchar c = text[i];
+
+      if ((c < 0x20 && c != '\t' && c != '\n') || c == 0x7f)
+        return FALSE;
+
+      if (c >= 0x80)
+        {
+          if (latin1)
+            return FALSE;
+
+          /* C1 controls, U+0080 to U+009F */
+          if (c == 0xc2 && i + 1 < len &&
+              text[i + 1] >= 0x80 && text[i + 1] <= 0x9f)
+            return FALSE;
+        }
+    }
+
+  return latin1 || g_utf8_validate ((const gchar *) text, i, NULL);
+}
+
 static gboolean
 text_property_from_results (GetPropertyResults *results,
                             char              **utf8_str_p)
@@ -639,6 +676,22 @@ text_property_from_results (GetPropertyResults *results,
   XTextProperty tp;
 
   *utf8_str_p = NULL;
+
+  /* Most clients set plain UTF8_STRING or ASCII STRING titles; those
+   * can be handed out as-is rather than converted into a copy.
+   * XGetWindowProperty() always leaves a nul after the data.
+   */
+  if (results->format == 8 &&
+      (results->type == results->display->atom_UTF8_STRING ||
+       results->type == XA_STRING) &&
+      text_is_unchanged_by_conversion (results->prop, results->n_items,
+                                       results->type == XA_STRING))
+    {
+      *utf8_str_p = (char*) results->prop;
+      results->prop = NULL;
+
+      return TRUE;
+    }
   
   tp.value = results->prop;
   results->prop = NULL;
@@ -915,22 +968,38 @@ get_task (MetaDisplay        *display,
                          False, req_type);
 }
 
+/* Converts in place when the string is ASCII, which it nearly always
+ * is; otherwise returns a new Xmalloc'd string and frees the old one.
+ */
 static char*
-latin1_to_utf8 (const char *text)
+latin1_to_utf8 (char *text)
 {
-  GString *str;
-  const char *p;
-  
-  str = g_string_new ("");
+  const guchar *p;
+  char *utf8;
+  char *q;
+  gulong n_high;
 
-  p = text;
-  while (*p)
-    {
-      g_string_append_unichar (str, *p);
-      ++p;
-    }
+  n_high = 0;
+  for (p = (const guchar *) text; *p; p++)
+    if (*p >= 0x80)
+      ++n_high;
 
-  return g_string_free (str, FALSE);
+  if (n_high == 0)
+    return text;
+
+  /* Everything from 0x80 up takes two bytes in UTF-8 */
+  utf8 = ag_Xmalloc ((p - (const guchar *) text) + n_high + 1);
+  if (utf8 == NULL)
+    return text;
+
+  q = utf8;
+  for (p = (const guchar *) text; *p; p++)
+    q += g_unichar_to_utf8 (*p, q);
+  *q = '\0';
+
+  meta_XFree (text);
+
+  return utf8;
 }
 
 void
@@ -940,6 +1009,7 @@ meta_prop_get_values (MetaDisplay   *display,
                       int            n_values)
 {
   int i;
+  AgGetPropertyTask *stack_tasks[32];
   AgGetPropertyTask **tasks;
 
   meta_verbose ("Requesting %d properties of 0x%lx at once\n",
@@ -948,7 +1018,14 @@ meta_prop_get_values (MetaDisplay   *display,
   if (n_values == 0)
     return;
   
-  tasks = g_new0 (AgGetPropertyTask*, n_values);
+  /* Window property reloads fit on the stack */
+  if (n_values <= (int) G_N_ELEMENTS (stack_tasks))
+    {
+      tasks = stack_tasks;
+      memset (tasks, '\0', sizeof (AgGetPropertyTask*) * n_values);
+    }
+  else
+    tasks = g_new0 (AgGetPropertyTask*, n_values);
 
   /* Start up tasks. The "values" array can have values
    * with atom == None, which means to ignore that element.
@@ -1089,21 +1166,7 @@ meta_prop_get_values (MetaDisplay   *display,
                                            &values[i].v.str))
             values[i].type = META_PROP_VALUE_INVALID;
           else
-            {
-              char *new_str;
-              char *xmalloc_new_str;
-
-              new_str = latin1_to_utf8 (values[i].v.str);
-              xmalloc_new_str = ag_Xmalloc (strlen (new_str) + 1);
-              if (xmalloc_new_str != NULL)
-                {
-                  strcpy (xmalloc_new_str, new_str);
-                  meta_XFree (values[i].v.str);
-                  values[i].v.str = xmalloc_new_str;
-                }
-
-              g_free (new_str);
-            }
+            values[i].v.str = latin1_to_utf8 (values[i].v.str);
           break;
         case META_PROP_VALUE_MOTIF_HINTS:
           if (!motif_hints_from_results (&results,
@@ -1171,7 +1234,8 @@ meta_prop_get_values (MetaDisplay   *display,
       ++i;
     }
 
-  g_free (tasks);
+  if (tasks != stack_tasks)
+    g_free (tasks);
 }
 
 static void
@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <X11/Xlib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 
 #include "types.h"
 #include "boxes.h"
@@ -52,6 +53,9 @@ void meta_compositor_process_event (MetaCompositor *compositor,
                                     MetaWindow     *window);
 Pixmap meta_compositor_get_window_pixmap (MetaCompositor *compositor,
                                           MetaWindow     *window);
+GdkPixbuf *meta_compositor_get_window_thumbnail (MetaCompositor *compositor,
+                                                 MetaWindow     *window,
+                                                 int             max_size);
 void meta_compositor_set_active_window (MetaCompositor *compositor,
                                         MetaScreen     *screen,
                                         MetaWindow     *window);
@@ -47,5 +47,8 @@ void      meta_error_trap_push_with_return (MetaDisplay *display);
 int       meta_error_trap_pop_with_return  (MetaDisplay *display,
                                             gboolean     last_request_was_roundtrip);
 
+/* drops the record of requests whose errors are still to be ignored */
+void      meta_errors_forget_ignored       (MetaDisplay *display);
+
 
 #endif
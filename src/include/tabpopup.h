@@ -48,12 +48,22 @@ struct _MetaTabEntry
   guint            demands_attention : 1;
 };
 
+/* Returns a new reference to a better icon for the entry, e.g. a
+ * thumbnail of the window, or NULL to keep the one it has
+ */
+typedef GdkPixbuf* (* MetaTabEntryIconFunc) (MetaTabEntryKey key,
+                                              gpointer        data);
+
 MetaTabPopup*   meta_ui_tab_popup_new          (const MetaTabEntry *entries,
                                                 int                 screen_number,
                                                 int                 entry_count,
                                                 int                 width,
                                                 gboolean            outline);
 void            meta_ui_tab_popup_free         (MetaTabPopup       *popup);
+/* Entries shown in the popup are passed to func from an idle */
+void            meta_ui_tab_popup_set_icon_func (MetaTabPopup         *popup,
+                                                 MetaTabEntryIconFunc  func,
+                                                 gpointer              data);
 void            meta_ui_tab_popup_set_showing  (MetaTabPopup       *popup,
                                                 gboolean            showing);
 void            meta_ui_tab_popup_forward      (MetaTabPopup       *popup);
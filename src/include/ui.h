@@ -110,6 +110,8 @@ void meta_ui_apply_frame_shape  (MetaUI  *ui,
 
 void meta_ui_queue_frame_draw (MetaUI *ui,
                                Window xwindow);
+void meta_ui_queue_frame_icon_draw (MetaUI *ui,
+                                    Window xwindow);
 
 void meta_ui_set_frame_title (MetaUI *ui,
                               Window xwindow,
@@ -19,54 +19,9 @@
  * 02111-1307, USA.
  */
 
-#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "pixels.h"
 #include <unistd.h>
 #include <stdlib.h>
-#include <math.h>
-
-#define INTENSITY(r, g, b) ((r) * 0.30 + (g) * 0.59 + (b) * 0.11)
-
-static GdkPixbuf*
-grayscale_pixbuf (GdkPixbuf *pixbuf)
-{
-  GdkPixbuf *gray;
-  guchar *pixels;
-  int rowstride;
-  int pixstride;
-  int row;
-  int n_rows;
-  int width;
-  
-  gray = gdk_pixbuf_copy (pixbuf);
-  rowstride = gdk_pixbuf_get_rowstride (gray);
-  pixstride = gdk_pixbuf_get_has_alpha (gray) ? 4 : 3;
-  
-  pixels = gdk_pixbuf_get_pixels (gray);
-  n_rows = gdk_pixbuf_get_height (gray);
-  width = gdk_pixbuf_get_width (gray);
-  
-  row = 0;
-  while (row < n_rows)
-    {
-      guchar *p = pixels + row * rowstride;
-      guchar *end = p + (pixstride * width);
-
-      while (p != end)
-        {
-          double v = INTENSITY (p[0], p[1], p[2]);
-
-          p[0] = (guchar) v;
-          p[1] = (guchar) v;
-          p[2] = (guchar) v;
-          
-          p += pixstride;
-        }
-      
-      ++row;
-    }
-  
-  return gray;
-}
 
 int
 main (int argc, char **argv)
@@ -92,7 +47,7 @@ main (int argc, char **argv)
       return 1;
     }
 
-  gray = grayscale_pixbuf (pixbuf);
+  gray = meta_pixels_grayscale (pixbuf);
   
   err = NULL;
   gdk_pixbuf_save (gray, "grayscale.png", "png", &err, NULL);
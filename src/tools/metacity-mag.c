@@ -22,13 +22,21 @@
 #define _GNU_SOURCE
 #define _XOPEN_SOURCE 600 /* C99 -- for rint() */
 
+#include <config.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include <gdk/gdkkeysyms.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+#endif
+
 static GtkWidget *grab_widget = NULL;
 static GtkWidget *display_window = NULL;
 static int last_grab_x = 0;
@@ -40,43 +48,297 @@ static double width_factor = 4.0;
 static double height_factor = 4.0;
 static GdkInterpType interp_mode = GDK_INTERP_NEAREST;
 static guint regrab_idle_id = 0;
+static gboolean live = FALSE;
+
+/* Kept between grabs and replaced when the size changes.  Since the
+ * view is only grabbed again when it's resized, this saves little
+ * beyond a second grab of the same size.
+ */
+static GdkPixbuf *screenshot = NULL;
+static GdkPixbuf *magnified = NULL;
+
+static GdkPixbuf*
+ensure_pixbuf (GdkPixbuf *pixbuf,
+               int        width,
+               int        height)
+{
+  if (pixbuf != NULL &&
+      gdk_pixbuf_get_width (pixbuf) == width &&
+      gdk_pixbuf_get_height (pixbuf) == height)
+    return pixbuf;
+
+  if (pixbuf != NULL)
+    g_object_unref (G_OBJECT (pixbuf));
+
+  return gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+}
 
 static GdkPixbuf*
 get_pixbuf (void)
 {
-  GdkPixbuf *screenshot;
-  GdkPixbuf *magnified;
+  int magnified_width;
+  int magnified_height;
 
 #if 0
   g_print ("Size %d x %d\n",
            last_grab_width, last_grab_height);
 #endif
-  
-  screenshot = gdk_pixbuf_get_from_drawable (NULL, gdk_get_default_root_window (),
-                                             NULL,
-                                             last_grab_x, last_grab_y, 0, 0,
-                                             last_grab_width, last_grab_height);
 
-  if (screenshot == NULL)
+  magnified_width = last_grab_width * width_factor;
+  magnified_height = last_grab_height * height_factor;
+
+  screenshot = ensure_pixbuf (screenshot, last_grab_width, last_grab_height);
+  magnified = ensure_pixbuf (magnified, magnified_width, magnified_height);
+
+  /* GDK reads this back through its shared memory scratch images
+   * when the server has MIT-SHM.
+   */
+  if (gdk_pixbuf_get_from_drawable (screenshot, gdk_get_default_root_window (),
+                                    NULL,
+                                    last_grab_x, last_grab_y, 0, 0,
+                                    last_grab_width, last_grab_height) == NULL)
     {
       g_printerr ("Screenshot failed\n");
       exit (1);
     }
 
-  magnified = gdk_pixbuf_scale_simple (screenshot, last_grab_width * width_factor,
-                                       last_grab_height * height_factor,
-                                       interp_mode);
+  gdk_pixbuf_scale (screenshot, magnified,
+                    0, 0, magnified_width, magnified_height,
+                    0, 0, width_factor, height_factor,
+                    interp_mode);
+
+  return g_object_ref (G_OBJECT (magnified));
+}
+
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+/* In live mode, the magnified area is drawn straight from the root
+ * window to ours by Render, scaled on the way, so nothing is read
+ * back at all.  Damage on the root window tells us which parts of
+ * the grabbed area changed, and only those parts are drawn again.
+ */
+static Damage root_damage = None;
+static XserverRegion grab_region = None;
+static Picture root_picture = None;
+static Picture window_picture = None;
+static int damage_event_base = 0;
+
+static gboolean
+live_supported (Display *xdisplay)
+{
+  int render_event_base, render_error_base;
+  int fixes_event_base, fixes_error_base;
+  int damage_error_base;
+
+  return XRenderQueryExtension (xdisplay,
+                                &render_event_base, &render_error_base) &&
+    XFixesQueryExtension (xdisplay, &fixes_event_base, &fixes_error_base) &&
+    XDamageQueryExtension (xdisplay, &damage_event_base, &damage_error_base);
+}
+
+/* The grabbed area less our own window.  Where the two overlap, each
+ * repaint would damage what it reads from and we'd redraw for ever;
+ * that part of the view is left as it is instead.
+ */
+static void
+update_grab_region (Display *xdisplay)
+{
+  XRectangle rect;
+
+  rect.x = last_grab_x;
+  rect.y = last_grab_y;
+  rect.width = last_grab_width;
+  rect.height = last_grab_height;
+
+  if (grab_region == None)
+    grab_region = XFixesCreateRegion (xdisplay, &rect, 1);
+  else
+    XFixesSetRegion (xdisplay, grab_region, &rect, 1);
+
+  if (display_window != NULL && gtk_widget_get_realized (display_window))
+    {
+      GdkRectangle extents;
+      XserverRegion self;
+
+      gdk_window_get_frame_extents (display_window->window, &extents);
+      rect.x = extents.x;
+      rect.y = extents.y;
+      rect.width = extents.width;
+      rect.height = extents.height;
+
+      self = XFixesCreateRegion (xdisplay, &rect, 1);
+      XFixesSubtractRegion (xdisplay, grab_region, grab_region, self);
+      XFixesDestroyRegion (xdisplay, self);
+    }
+}
+
+static void
+set_root_transform (Display *xdisplay)
+{
+  XTransform transform;
+
+  /* Maps each pixel of our window to the one it magnifies */
+  memset (&transform, 0, sizeof (transform));
+  transform.matrix[0][0] = XDoubleToFixed (1.0 / width_factor);
+  transform.matrix[0][2] = XDoubleToFixed (last_grab_x);
+  transform.matrix[1][1] = XDoubleToFixed (1.0 / height_factor);
+  transform.matrix[1][2] = XDoubleToFixed (last_grab_y);
+  transform.matrix[2][2] = XDoubleToFixed (1.0);
+
+  XRenderSetPictureTransform (xdisplay, root_picture, &transform);
+}
+
+static gboolean
+live_expose (GtkWidget      *widget,
+             GdkEventExpose *event,
+             gpointer        data)
+{
+  Display *xdisplay = GDK_WINDOW_XDISPLAY (event->window);
+  GdkRectangle *rects;
+  int n_rects;
+  int i;
+
+  if (window_picture == None)
+    {
+      XRenderPictFormat *format;
+
+      format = XRenderFindVisualFormat (xdisplay,
+                                        GDK_VISUAL_XVISUAL (gdk_drawable_get_visual (event->window)));
+      window_picture = XRenderCreatePicture (xdisplay,
+                                             GDK_WINDOW_XID (event->window),
+                                             format, 0, NULL);
+    }
+
+  gdk_region_get_rectangles (event->region, &rects, &n_rects);
+
+  for (i = 0; i < n_rects; i++)
+    XRenderComposite (xdisplay, PictOpSrc,
+                      root_picture, None, window_picture,
+                      rects[i].x, rects[i].y,
+                      0, 0,
+                      rects[i].x, rects[i].y,
+                      rects[i].width, rects[i].height);
+
+  g_free (rects);
+
+  return TRUE;
+}
+
+static GdkFilterReturn
+damage_filter (GdkXEvent *gdk_xevent,
+               GdkEvent  *event,
+               gpointer   data)
+{
+  XEvent *xevent = gdk_xevent;
+  GtkWidget *area = data;
+  Display *xdisplay;
+  XserverRegion parts;
+  XRectangle bounds;
+  XRectangle *rects;
+  int n_rects;
+  int x1, y1, x2, y2;
+
+  if (xevent->type != damage_event_base + XDamageNotify ||
+      ((XDamageNotifyEvent *) xevent)->damage != root_damage)
+    return GDK_FILTER_CONTINUE;
+
+  xdisplay = xevent->xany.display;
+
+  /* Take all the damage so far and keep just what falls in the grab */
+  parts = XFixesCreateRegion (xdisplay, NULL, 0);
+  XDamageSubtract (xdisplay, root_damage, None, parts);
+  XFixesIntersectRegion (xdisplay, parts, parts, grab_region);
+  rects = XFixesFetchRegionAndBounds (xdisplay, parts, &n_rects, &bounds);
+  XFixesDestroyRegion (xdisplay, parts);
+
+  if (rects != NULL)
+    XFree (rects);
+
+  if (n_rects == 0 || area->window == NULL)
+    return GDK_FILTER_REMOVE;
+
+  /* Where the damaged bounds land once magnified, rounded outwards
+   * and grown a pixel for filters that sample neighbours.
+   */
+  x1 = floor ((bounds.x - last_grab_x) * width_factor) - 1;
+  y1 = floor ((bounds.y - last_grab_y) * height_factor) - 1;
+  x2 = ceil ((bounds.x + bounds.width - last_grab_x) * width_factor) + 1;
+  y2 = ceil ((bounds.y + bounds.height - last_grab_y) * height_factor) + 1;
+
+  gtk_widget_queue_draw_area (area, x1, y1, x2 - x1, y2 - y1);
+
+  return GDK_FILTER_REMOVE;
+}
 
+static void
+live_resized (GtkWidget *area)
+{
+  Display *xdisplay = GDK_WINDOW_XDISPLAY (area->window);
+  GtkAllocation allocation;
+
+  gtk_widget_get_allocation (area, &allocation);
+
+  last_grab_width = rint (allocation.width / width_factor);
+  last_grab_height = rint (allocation.height / height_factor);
+  last_grab_allocation = allocation;
+
+  update_grab_region (xdisplay);
+}
+
+static gboolean
+live_window_configured (GtkWidget         *window,
+                        GdkEventConfigure *event,
+                        gpointer           data)
+{
+  update_grab_region (GDK_WINDOW_XDISPLAY (window->window));
 
-  g_object_unref (G_OBJECT (screenshot));
+  return FALSE;
+}
 
-  return magnified;
+static GtkWidget*
+create_live_area (void)
+{
+  Display *xdisplay = gdk_x11_get_default_xdisplay ();
+  Window xroot = gdk_x11_get_default_root_xwindow ();
+  XRenderPictureAttributes pa;
+  GtkWidget *area;
+
+  pa.subwindow_mode = IncludeInferiors;
+  root_picture = XRenderCreatePicture (xdisplay, xroot,
+                                       XRenderFindVisualFormat (xdisplay,
+                                                                DefaultVisual (xdisplay, DefaultScreen (xdisplay))),
+                                       CPSubwindowMode, &pa);
+  XRenderSetPictureFilter (xdisplay, root_picture,
+                           interp_mode == GDK_INTERP_NEAREST ?
+                           FilterNearest : FilterBilinear,
+                           NULL, 0);
+  set_root_transform (xdisplay);
+
+  update_grab_region (xdisplay);
+  root_damage = XDamageCreate (xdisplay, xroot, XDamageReportNonEmpty);
+
+  area = gtk_drawing_area_new ();
+
+  /* We draw straight to the window, never to a GDK backing pixmap */
+  gtk_widget_set_double_buffered (area, FALSE);
+  gtk_widget_set_app_paintable (area, TRUE);
+
+  g_signal_connect (G_OBJECT (area), "expose_event",
+                    G_CALLBACK (live_expose), NULL);
+  g_signal_connect_after (G_OBJECT (area), "size_allocate",
+                          G_CALLBACK (live_resized), NULL);
+  g_signal_connect (G_OBJECT (display_window), "configure_event",
+                    G_CALLBACK (live_window_configured), NULL);
+
+  gdk_window_add_filter (NULL, damage_filter, area);
+
+  return area;
 }
+#endif /* HAVE_COMPOSITE_EXTENSIONS */
 
 static gboolean
 regrab_idle (GtkWidget *image)
 {
-  GdkPixbuf *magnified;
+  GdkPixbuf *pixbuf;
   GtkAllocation allocation;
 
   gtk_widget_get_allocation (image, &allocation);
@@ -88,11 +350,11 @@ regrab_idle (GtkWidget *image)
       last_grab_height = rint (allocation.height / height_factor);
       last_grab_allocation = allocation;
       
-      magnified = get_pixbuf ();
+      pixbuf = get_pixbuf ();
 
-      gtk_image_set_from_pixbuf (GTK_IMAGE (image), magnified);
+      gtk_image_set_from_pixbuf (GTK_IMAGE (image), pixbuf);
 
-      g_object_unref (G_OBJECT (magnified));
+      g_object_unref (G_OBJECT (pixbuf));
     }
 
   regrab_idle_id = 0;
@@ -113,7 +375,7 @@ grab_area_at_mouse (GtkWidget *invisible,
                     int        x_root,
                     int        y_root)
 {
-  GdkPixbuf *magnified;
+  GdkPixbuf *pixbuf;
   int width, height;
   GtkWidget *widget;
   
@@ -125,15 +387,28 @@ grab_area_at_mouse (GtkWidget *invisible,
   last_grab_width = width;
   last_grab_height = height;
   
-  magnified = get_pixbuf ();
-  
   display_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
   gtk_window_set_default_size (GTK_WINDOW (display_window),
                                last_grab_width, last_grab_height);
-  widget = gtk_image_new_from_pixbuf (magnified);
+
+  widget = NULL;
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (live)
+    widget = create_live_area ();
+#endif
+
+  if (widget == NULL)
+    {
+      pixbuf = get_pixbuf ();
+      widget = gtk_image_new_from_pixbuf (pixbuf);
+      g_object_unref (G_OBJECT (pixbuf));
+
+      g_signal_connect_after (G_OBJECT (widget), "size_allocate",
+                              G_CALLBACK (image_resized), NULL);
+    }
+
   gtk_widget_set_size_request (widget, 40, 40);
   gtk_container_add (GTK_CONTAINER (display_window), widget);
-  g_object_unref (G_OBJECT (magnified));
 
   g_object_add_weak_pointer (G_OBJECT (display_window),
                              (gpointer) &display_window);
@@ -141,8 +416,6 @@ grab_area_at_mouse (GtkWidget *invisible,
   g_signal_connect (G_OBJECT (display_window), "destroy",
                     G_CALLBACK (gtk_main_quit), NULL);
 
-  g_signal_connect_after (G_OBJECT (widget), "size_allocate", G_CALLBACK (image_resized), NULL);
-  
   gtk_widget_show_all (display_window);
 }
 
@@ -270,6 +543,30 @@ main (int argc, char **argv)
 {
   gtk_init (&argc, &argv);
 
+  if (argc == 2 && strcmp (argv[1], "--live") == 0)
+    live = TRUE;
+  else if (argc != 1)
+    {
+      g_printerr ("Usage: metacity-mag [--live]\n");
+      return 1;
+    }
+
+#ifdef HAVE_COMPOSITE_EXTENSIONS
+  if (live && !live_supported (gdk_x11_get_default_xdisplay ()))
+    {
+      g_printerr ("The X server lacks Render, XFixes or Damage; "
+                  "not updating live\n");
+      live = FALSE;
+    }
+#else
+  if (live)
+    {
+      g_printerr ("Built without Render, XFixes and Damage; "
+                  "not updating live\n");
+      live = FALSE;
+    }
+#endif
+
   begin_area_grab ();
   
   gtk_main ();
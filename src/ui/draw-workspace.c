@@ -65,14 +65,45 @@ get_window_rect (const WnckWindowDisplayInfo *win,
   rect->height = height;
 }
 
+/* Converting a pixbuf for cairo means a copy and premultiply, so the
+ * result is kept on the icon itself; window icons are replaced rather
+ * than modified when they change.
+ */
+static cairo_surface_t*
+get_icon_surface (GdkPixbuf *icon)
+{
+  static GQuark surface_quark = 0;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  if (surface_quark == 0)
+    surface_quark = g_quark_from_static_string ("wnck-draw-workspace-surface");
+
+  surface = g_object_get_qdata (G_OBJECT (icon), surface_quark);
+  if (surface != NULL)
+    return surface;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        gdk_pixbuf_get_width (icon),
+                                        gdk_pixbuf_get_height (icon));
+  cr = cairo_create (surface);
+  gdk_cairo_set_source_pixbuf (cr, icon, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  g_object_set_qdata_full (G_OBJECT (icon), surface_quark, surface,
+                           (GDestroyNotify) cairo_surface_destroy);
+
+  return surface;
+}
+
 static void
 draw_window (GtkWidget                   *widget,
-             GdkDrawable                 *drawable,
+             cairo_t                     *cr,
              const WnckWindowDisplayInfo *win,
              const GdkRectangle          *winrect,
              GtkStateType                state)
 {
-  cairo_t *cr;
   GdkPixbuf *icon;
   int icon_x, icon_y, icon_w, icon_h;
   gboolean is_active;
@@ -81,7 +112,7 @@ draw_window (GtkWidget                   *widget,
 
   is_active = win->is_active;
   
-  cr = gdk_cairo_create (drawable);
+  cairo_save (cr);
   cairo_rectangle (cr, winrect->x, winrect->y, winrect->width, winrect->height);
   cairo_clip (cr);
 
@@ -137,7 +168,7 @@ draw_window (GtkWidget                   *widget,
       icon_y = winrect->y + (winrect->height - icon_h) / 2;
       
       cairo_save (cr);
-      gdk_cairo_set_source_pixbuf (cr, icon, icon_x, icon_y);
+      cairo_set_source_surface (cr, get_icon_surface (icon), icon_x, icon_y);
       cairo_rectangle (cr, icon_x, icon_y, icon_w, icon_h);
       cairo_clip (cr);
       cairo_paint (cr);
@@ -159,7 +190,7 @@ draw_window (GtkWidget                   *widget,
                    MAX (0, winrect->width - 1), MAX (0, winrect->height - 1));
   cairo_stroke (cr);
   
-  cairo_destroy (cr);
+  cairo_restore (cr);
 }
 
 void
@@ -206,8 +237,6 @@ wnck_draw_workspace (GtkWidget                   *widget,
       cairo_rectangle (cr, x, y, width, height);
       cairo_fill (cr);
     }
-
-  cairo_destroy (cr);
   
   i = 0;
   while (i < n_windows)
@@ -219,11 +248,13 @@ wnck_draw_workspace (GtkWidget                   *widget,
                        screen_height, &workspace_rect, &winrect);
       
       draw_window (widget,
-                   drawable,
+                   cr,
                    win,
                    &winrect,
                    state);
       
       ++i;
     }
+
+  cairo_destroy (cr);
 }
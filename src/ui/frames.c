@@ -25,6 +25,7 @@
 
 #include <config.h>
 #include <math.h>
+#include <string.h>
 #include "boxes.h"
 #include "frames.h"
 #include "util.h"
@@ -43,6 +44,10 @@
 
 #define DEFAULT_INNER_BUTTON_BORDER 3
 
+#ifdef HAVE_SHAPE
+static void frame_shape_free (MetaFrameShape *shape);
+#endif
+
 static void meta_frames_class_init (MetaFramesClass *klass);
 static void meta_frames_init       (MetaFrames      *frames);
 static void meta_frames_destroy    (GtkObject       *object);
@@ -107,6 +112,9 @@ static void clear_tip (MetaFrames *frames);
 static void invalidate_all_caches (MetaFrames *frames);
 static void invalidate_whole_window (MetaFrames *frames,
                                      MetaUIFrame *frame);
+static void invalidate_titlebar_rect (MetaFrames   *frames,
+                                      MetaUIFrame  *frame,
+                                      GdkRectangle *rect);
 
 static GtkWidgetClass *parent_class = NULL;
 
@@ -295,6 +303,11 @@ typedef struct
    * Order: top (titlebar), left, right, bottom.
    */
   CachedFramePiece piece[4];
+
+  /* Parts of the titlebar, in frame coordinates, that have changed
+   * since it was rendered; NULL if none.
+   */
+  GdkRegion *titlebar_damage;
 } CachedPixels;
 
 static CachedPixels *
@@ -324,11 +337,54 @@ invalidate_cache (MetaFrames *frames,
   for (i = 0; i < 4; i++)
     if (pixels->piece[i].pixmap)
       g_object_unref (pixels->piece[i].pixmap);
+
+  if (pixels->titlebar_damage)
+    gdk_region_destroy (pixels->titlebar_damage);
   
   g_free (pixels);
   g_hash_table_remove (frames->cache, frame);
 }
 
+/* Queues a redraw of part of the titlebar.  If the titlebar is
+ * cached, only that part of the cached copy is rendered again, over
+ * the rest of it, so hovering over a button redraws just the button
+ * and the background under it.  A NULL rect, or one reaching outside
+ * the titlebar, throws the whole cache away.
+ */
+static void
+invalidate_titlebar_rect (MetaFrames   *frames,
+                          MetaUIFrame  *frame,
+                          GdkRectangle *rect)
+{
+  CachedPixels *pixels;
+  GdkRectangle titlebar;
+  GdkRectangle damage;
+
+  gdk_window_invalidate_rect (frame->window, rect, FALSE);
+
+  pixels = g_hash_table_lookup (frames->cache, frame);
+  if (!pixels)
+    return;
+
+  titlebar.x = pixels->piece[0].rect.x;
+  titlebar.y = pixels->piece[0].rect.y;
+  titlebar.width = pixels->piece[0].rect.width;
+  titlebar.height = pixels->piece[0].rect.height;
+
+  if (rect == NULL || pixels->piece[0].pixmap == NULL ||
+      !gdk_rectangle_intersect (rect, &titlebar, &damage) ||
+      damage.width != rect->width || damage.height != rect->height)
+    {
+      invalidate_cache (frames, frame);
+      return;
+    }
+
+  if (!pixels->titlebar_damage)
+    pixels->titlebar_damage = gdk_region_new ();
+
+  gdk_region_union_with_rect (pixels->titlebar_damage, &damage);
+}
+
 static void
 invalidate_all_caches (MetaFrames *frames)
 {
@@ -626,6 +682,7 @@ meta_frames_manage_window (MetaFrames *frames,
   frame->title = NULL;
   frame->expose_delayed = FALSE;
   frame->shape_applied = FALSE;
+  frame->shape = NULL;
   frame->prelit_control = META_FRAME_CONTROL_NONE;
 
   /* Don't set the window background yet; we need frame->xwindow to be
@@ -676,6 +733,11 @@ meta_frames_unmanage_window (MetaFrames *frames,
 
       if (frame->title)
         g_free (frame->title);
+
+#ifdef HAVE_SHAPE
+      if (frame->shape)
+        frame_shape_free (frame->shape);
+#endif
       
       g_free (frame);
     }
@@ -791,6 +853,342 @@ meta_frames_unflicker_bg (MetaFrames *frames,
   set_background_none (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow);
 }
 
+#ifdef HAVE_SHAPE
+/* A run of rows at the top or bottom of a rounded frame that are all
+ * cut in by the same amount at each side
+ */
+typedef struct
+{
+  int left;
+  int right;
+  int height;
+} CornerBand;
+
+/* The rectangles making up a frame's bounding shape.  The corner
+ * bands only depend on the corner radii; laying them out for a new
+ * size just moves the right-hand edges and the bottom rows.
+ */
+struct _MetaFrameShape
+{
+  int radii[4]; /* top left, top right, bottom left, bottom right */
+
+  CornerBand *bands; /* top bands, then bottom bands, top to bottom */
+  int n_top_bands;
+  int n_bottom_bands;
+  int top_height;
+  int bottom_height;
+
+  XRectangle *rects;
+  int n_rects;
+  int width;  /* what rects are laid out for; 0 if they aren't yet */
+  int height;
+
+  /* For frames around shaped clients; never mapped */
+  Window shape_window;
+};
+
+/* How far in from the side of the frame row i of a rounded corner
+ * starts (row 0 being the one at the very top or bottom)
+ */
+static int
+corner_inset (int corner,
+              int i)
+{
+  const float radius = sqrt(corner) + corner;
+
+  if (i >= corner)
+    return 0;
+
+  return floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
+}
+
+/* Appends the rows [0, n_rows) of a pair of corners as bands; when
+ * reversed, row 0 is the last one
+ */
+static int
+add_corner_bands (CornerBand *bands,
+                  int         left_corner,
+                  int         right_corner,
+                  gboolean    reversed)
+{
+  int n_rows;
+  int n_bands;
+  int i;
+
+  n_rows = MAX (left_corner, right_corner);
+  n_bands = 0;
+
+  for (i = 0; i < n_rows; i++)
+    {
+      int row = reversed ? n_rows - 1 - i : i;
+      int left = corner_inset (left_corner, row);
+      int right = corner_inset (right_corner, row);
+
+      if (n_bands > 0 &&
+          bands[n_bands - 1].left == left &&
+          bands[n_bands - 1].right == right)
+        {
+          bands[n_bands - 1].height += 1;
+        }
+      else
+        {
+          bands[n_bands].left = left;
+          bands[n_bands].right = right;
+          bands[n_bands].height = 1;
+          ++n_bands;
+        }
+    }
+
+  return n_bands;
+}
+
+static void
+frame_shape_set_radii (MetaFrameShape *shape,
+                       const int       radii[4])
+{
+  int n_rows;
+
+  if (shape->bands != NULL && memcmp (shape->radii, radii, sizeof (shape->radii)) == 0)
+    return;
+
+  memcpy (shape->radii, radii, sizeof (shape->radii));
+
+  g_free (shape->bands);
+  g_free (shape->rects);
+
+  n_rows = MAX (radii[0], radii[1]) + MAX (radii[2], radii[3]);
+  shape->bands = g_new (CornerBand, MAX (n_rows, 1));
+
+  shape->n_top_bands = add_corner_bands (shape->bands,
+                                         radii[0], radii[1], FALSE);
+  shape->n_bottom_bands = add_corner_bands (shape->bands + shape->n_top_bands,
+                                            radii[2], radii[3], TRUE);
+  shape->top_height = MAX (radii[0], radii[1]);
+  shape->bottom_height = MAX (radii[2], radii[3]);
+
+  shape->rects = g_new (XRectangle,
+                        shape->n_top_bands + 1 + shape->n_bottom_bands);
+  shape->n_rects = 0;
+  shape->width = 0;
+  shape->height = 0;
+}
+
+static void
+add_shape_rect (MetaFrameShape *shape,
+                int             x,
+                int             y,
+                int             width,
+                int             height)
+{
+  XRectangle *xrect;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  xrect = &shape->rects[shape->n_rects++];
+  xrect->x = x;
+  xrect->y = y;
+  xrect->width = width;
+  xrect->height = height;
+}
+
+/* Lays out a frame too short for its top and bottom corners to keep
+ * apart.  Where they overlap, each row is cut in by whichever corner
+ * cuts deeper, as subtracting both corners from the frame would.
+ */
+static void
+frame_shape_layout_short (MetaFrameShape *shape,
+                          int             width,
+                          int             height)
+{
+  const CornerBand *top;
+  const CornerBand *bottom;
+  int top_end;
+  int bottom_start;
+  int bottom_end;
+  int run_y, run_left, run_right;
+  int y;
+
+  top = shape->bands;
+  top_end = shape->n_top_bands > 0 ? top->height : 0;
+  bottom = shape->bands + shape->n_top_bands;
+  bottom_start = height - shape->bottom_height;
+  bottom_end = shape->n_bottom_bands > 0 ? bottom_start + bottom->height : 0;
+
+  run_y = 0;
+  run_left = -1;
+  run_right = -1;
+
+  for (y = 0; y < height; y++)
+    {
+      int left = 0;
+      int right = 0;
+
+      if (y < shape->top_height)
+        {
+          while (y >= top_end)
+            {
+              ++top;
+              top_end += top->height;
+            }
+          left = top->left;
+          right = top->right;
+        }
+
+      if (y >= bottom_start)
+        {
+          while (y >= bottom_end)
+            {
+              ++bottom;
+              bottom_end += bottom->height;
+            }
+          left = MAX (left, bottom->left);
+          right = MAX (right, bottom->right);
+        }
+
+      if (left != run_left || right != run_right)
+        {
+          if (y > 0)
+            add_shape_rect (shape, run_left, run_y,
+                            width - run_left - run_right, y - run_y);
+          run_y = y;
+          run_left = left;
+          run_right = right;
+        }
+    }
+
+  if (height > 0)
+    add_shape_rect (shape, run_left, run_y,
+                    width - run_left - run_right, height - run_y);
+}
+
+static void
+frame_shape_layout (MetaFrameShape *shape,
+                    int             width,
+                    int             height)
+{
+  const CornerBand *band;
+  int y;
+  int i;
+
+  if (shape->width == width && shape->height == height)
+    return;
+
+  shape->n_rects = 0;
+  shape->width = width;
+  shape->height = height;
+
+  if (height < shape->top_height + shape->bottom_height)
+    {
+      frame_shape_layout_short (shape, width, height);
+      return;
+    }
+
+  band = shape->bands;
+
+  y = 0;
+  for (i = 0; i < shape->n_top_bands; i++, band++)
+    {
+      add_shape_rect (shape, band->left, y,
+                      width - band->left - band->right, band->height);
+      y += band->height;
+    }
+
+  add_shape_rect (shape, 0, y,
+                  width, height - shape->top_height - shape->bottom_height);
+
+  y = height - shape->bottom_height;
+  for (i = 0; i < shape->n_bottom_bands; i++, band++)
+    {
+      add_shape_rect (shape, band->left, y,
+                      width - band->left - band->right, band->height);
+      y += band->height;
+    }
+}
+
+static void
+frame_shape_free (MetaFrameShape *shape)
+{
+  if (shape->shape_window != None)
+    XDestroyWindow (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()),
+                    shape->shape_window);
+
+  g_free (shape->bands);
+  g_free (shape->rects);
+  g_free (shape);
+}
+
+/* The frame's shape rectangles less the client area, which is left to
+ * the client's own shape
+ */
+static XRectangle *
+frame_shape_punch_client (MetaFrameShape *shape,
+                          XRectangle     *client,
+                          int            *n_rects)
+{
+  XRectangle *rects;
+  int n;
+  int i;
+
+  /* Each rectangle can split into four */
+  rects = g_new (XRectangle, shape->n_rects * 4);
+  n = 0;
+
+  for (i = 0; i < shape->n_rects; i++)
+    {
+      const XRectangle *r = &shape->rects[i];
+      int top, bottom;
+
+      top = MAX (r->y, client->y);
+      bottom = MIN (r->y + r->height, client->y + client->height);
+
+      if (top >= bottom ||
+          r->x + r->width <= client->x ||
+          r->x >= client->x + client->width)
+        {
+          rects[n++] = *r;
+          continue;
+        }
+
+      if (r->y < top)
+        {
+          rects[n] = *r;
+          rects[n].height = top - r->y;
+          ++n;
+        }
+
+      if (r->x < client->x)
+        {
+          rects[n].x = r->x;
+          rects[n].y = top;
+          rects[n].width = client->x - r->x;
+          rects[n].height = bottom - top;
+          ++n;
+        }
+
+      if (r->x + r->width > client->x + client->width)
+        {
+          rects[n].x = client->x + client->width;
+          rects[n].y = top;
+          rects[n].width = r->x + r->width - rects[n].x;
+          rects[n].height = bottom - top;
+          ++n;
+        }
+
+      if (r->y + r->height > bottom)
+        {
+          rects[n] = *r;
+          rects[n].y = bottom;
+          rects[n].height = r->y + r->height - bottom;
+          ++n;
+        }
+    }
+
+  *n_rects = n;
+  return rects;
+}
+#endif /* HAVE_SHAPE */
+
 void
 meta_frames_apply_shapes (MetaFrames *frames,
                           Window      xwindow,
@@ -800,21 +1198,23 @@ meta_frames_apply_shapes (MetaFrames *frames,
 {
 #ifdef HAVE_SHAPE
   /* Apply shapes as if window had new_window_width, new_window_height */
+  Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
   MetaUIFrame *frame;
   MetaFrameGeometry fgeom;
-  XRectangle xrect;
-  Region corners_xregion;
-  Region window_xregion;
+  MetaFrameShape *shape;
+  int radii[4];
   
   frame = meta_frames_lookup_window (frames, xwindow);
   g_return_if_fail (frame != NULL);
 
   meta_frames_calc_geometry (frames, frame, &fgeom);
 
-  if (!(fgeom.top_left_corner_rounded_radius != 0 ||
-        fgeom.top_right_corner_rounded_radius != 0 ||
-        fgeom.bottom_left_corner_rounded_radius != 0 ||
-        fgeom.bottom_right_corner_rounded_radius != 0 ||
+  radii[0] = fgeom.top_left_corner_rounded_radius;
+  radii[1] = fgeom.top_right_corner_rounded_radius;
+  radii[2] = fgeom.bottom_left_corner_rounded_radius;
+  radii[3] = fgeom.bottom_right_corner_rounded_radius;
+
+  if (!(radii[0] != 0 || radii[1] != 0 || radii[2] != 0 || radii[3] != 0 ||
         window_has_shape))
     {
       if (frame->shape_applied)
@@ -823,7 +1223,7 @@ meta_frames_apply_shapes (MetaFrames *frames,
                       "Unsetting shape mask on frame 0x%lx\n",
                       frame->xwindow);
           
-          XShapeCombineMask (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow,
+          XShapeCombineMask (xdisplay, frame->xwindow,
                              ShapeBounding, 0, 0, None, ShapeSet);
           frame->shape_applied = FALSE;
         }
@@ -833,139 +1233,86 @@ meta_frames_apply_shapes (MetaFrames *frames,
                       "Frame 0x%lx still doesn't need a shape mask\n",
                       frame->xwindow);
         }
-      
-      return; /* nothing to do */
-    }
-  
-  corners_xregion = XCreateRegion ();
-  
-  if (fgeom.top_left_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom.top_left_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
 
-      for (i=0; i<corner; i++)
+      if (frame->shape)
         {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          xrect.x = 0;
-          xrect.y = i;
-          xrect.width = width;
-          xrect.height = 1;
-          
-          XUnionRectWithRegion (&xrect, corners_xregion, corners_xregion);
-        }
-    }
-
-  if (fgeom.top_right_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom.top_right_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
-
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          xrect.x = new_window_width - width;
-          xrect.y = i;
-          xrect.width = width;
-          xrect.height = 1;
-          
-          XUnionRectWithRegion (&xrect, corners_xregion, corners_xregion);
+          frame_shape_free (frame->shape);
+          frame->shape = NULL;
         }
+      
+      return; /* nothing to do */
     }
 
-  if (fgeom.bottom_left_corner_rounded_radius != 0)
-    {
-      const int corner = fgeom.bottom_left_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
-
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          xrect.x = 0;
-          xrect.y = new_window_height - i - 1;
-          xrect.width = width;
-          xrect.height = 1;
-          
-          XUnionRectWithRegion (&xrect, corners_xregion, corners_xregion);
-        }
-    }
+  if (frame->shape == NULL)
+    frame->shape = g_new0 (MetaFrameShape, 1);
+  shape = frame->shape;
 
-  if (fgeom.bottom_right_corner_rounded_radius != 0)
+  /* The client's shape may have changed under us, but nothing else
+   * that goes into ours can have.
+   */
+  if (frame->shape_applied &&
+      !window_has_shape &&
+      shape->shape_window == None &&
+      shape->width == new_window_width &&
+      shape->height == new_window_height &&
+      memcmp (shape->radii, radii, sizeof (radii)) == 0)
     {
-      const int corner = fgeom.bottom_right_corner_rounded_radius;
-      const float radius = sqrt(corner) + corner;
-      int i;
-
-      for (i=0; i<corner; i++)
-        {
-          const int width = floor(0.5 + radius - sqrt(radius*radius - (radius-(i+0.5))*(radius-(i+0.5))));
-          xrect.x = new_window_width - width;
-          xrect.y = new_window_height - i - 1;
-          xrect.width = width;
-          xrect.height = 1;
-          
-          XUnionRectWithRegion (&xrect, corners_xregion, corners_xregion);
-        }
+      meta_topic (META_DEBUG_SHAPES,
+                  "Frame 0x%lx already has the right shape\n",
+                  frame->xwindow);
+      return;
     }
-  
-  window_xregion = XCreateRegion ();
-  
-  xrect.x = 0;
-  xrect.y = 0;
-  xrect.width = new_window_width;
-  xrect.height = new_window_height;
 
-  XUnionRectWithRegion (&xrect, window_xregion, window_xregion);
-
-  XSubtractRegion (window_xregion, corners_xregion, window_xregion);
-
-  XDestroyRegion (corners_xregion);
+  frame_shape_set_radii (shape, radii);
+  frame_shape_layout (shape, new_window_width, new_window_height);
   
   if (window_has_shape)
     {
       /* The client window is oclock or something and has a shape
        * mask. To avoid a round trip to get its shape region, we
-       * create a fake window that's never mapped, build up our shape
-       * on that, then combine. Wasting the window is assumed cheaper
-       * than a round trip, but who really knows for sure.
+       * build up our shape on a window that's never mapped, then
+       * copy it over, so the client is never clipped to a partial
+       * shape on the way.  We keep that window for the next resize.
        */
-      XSetWindowAttributes attrs;      
-      Window shape_window;
       Window client_window;
-      Region client_xregion;
-      GdkScreen *screen;
-      int screen_number;
+      XRectangle client_xrect;
+      XRectangle *rects;
+      int n_rects;
       
       meta_topic (META_DEBUG_SHAPES,
                   "Frame 0x%lx needs to incorporate client shape\n",
                   frame->xwindow);
 
-      screen = gtk_widget_get_screen (GTK_WIDGET (frames));
-      screen_number = gdk_x11_screen_get_screen_number (screen);
+      if (shape->shape_window == None)
+        {
+          XSetWindowAttributes attrs;      
+          GdkScreen *screen;
+          int screen_number;
+
+          screen = gtk_widget_get_screen (GTK_WIDGET (frames));
+          screen_number = gdk_x11_screen_get_screen_number (screen);
       
-      attrs.override_redirect = True;
+          attrs.override_redirect = True;
       
-      shape_window = XCreateWindow (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()),
-                                    RootWindow (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), screen_number),
-                                    -5000, -5000,
-                                    new_window_width,
-                                    new_window_height,
-                                    0,
-                                    CopyFromParent,
-                                    CopyFromParent,
-                                    (Visual *)CopyFromParent,
-                                    CWOverrideRedirect,
-                                    &attrs);
-
-      /* Copy the client's shape to the temporary shape_window */
-      meta_core_get (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow,
+          shape->shape_window = XCreateWindow (xdisplay,
+                                               RootWindow (xdisplay, screen_number),
+                                               -5000, -5000,
+                                               new_window_width,
+                                               new_window_height,
+                                               0,
+                                               CopyFromParent,
+                                               CopyFromParent,
+                                               (Visual *)CopyFromParent,
+                                               CWOverrideRedirect,
+                                               &attrs);
+        }
+
+      /* Copy the client's shape to the shape_window */
+      meta_core_get (xdisplay, frame->xwindow,
                      META_CORE_GET_CLIENT_XWINDOW, &client_window,
                      META_CORE_GET_END);
 
-      XShapeCombineShape (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), shape_window, ShapeBounding,
+      XShapeCombineShape (xdisplay, shape->shape_window, ShapeBounding,
                           fgeom.left_width,
                           fgeom.top_height,
                           client_window,
@@ -975,30 +1322,23 @@ meta_frames_apply_shapes (MetaFrames *frames,
       /* Punch the client area out of the normal frame shape,
        * then union it with the shape_window's existing shape
        */
-      client_xregion = XCreateRegion ();
-  
-      xrect.x = fgeom.left_width;
-      xrect.y = fgeom.top_height;
-      xrect.width = new_window_width - fgeom.right_width - xrect.x;
-      xrect.height = new_window_height - fgeom.bottom_height - xrect.y;
-
-      XUnionRectWithRegion (&xrect, client_xregion, client_xregion);
-      
-      XSubtractRegion (window_xregion, client_xregion, window_xregion);
-
-      XDestroyRegion (client_xregion);
-      
-      XShapeCombineRegion (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), shape_window,
-                           ShapeBounding, 0, 0, window_xregion, ShapeUnion);
+      client_xrect.x = fgeom.left_width;
+      client_xrect.y = fgeom.top_height;
+      client_xrect.width = new_window_width - fgeom.right_width - client_xrect.x;
+      client_xrect.height = new_window_height - fgeom.bottom_height - client_xrect.y;
+
+      rects = frame_shape_punch_client (shape, &client_xrect, &n_rects);
+      XShapeCombineRectangles (xdisplay, shape->shape_window,
+                               ShapeBounding, 0, 0, rects, n_rects,
+                               ShapeUnion, Unsorted);
+      g_free (rects);
       
       /* Now copy shape_window shape to the real frame */
-      XShapeCombineShape (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow, ShapeBounding,
+      XShapeCombineShape (xdisplay, frame->xwindow, ShapeBounding,
                           0, 0,
-                          shape_window,
+                          shape->shape_window,
                           ShapeBounding,
                           ShapeSet);
-
-      XDestroyWindow (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), shape_window);
     }
   else
     {
@@ -1007,14 +1347,25 @@ meta_frames_apply_shapes (MetaFrames *frames,
       meta_topic (META_DEBUG_SHAPES,
                   "Frame 0x%lx has shaped corners\n",
                   frame->xwindow);
+
+      if (shape->shape_window != None)
+        {
+          XDestroyWindow (xdisplay, shape->shape_window);
+          shape->shape_window = None;
+        }
       
-      XShapeCombineRegion (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow,
-                           ShapeBounding, 0, 0, window_xregion, ShapeSet);
+      /* The rectangles are in bands from top to bottom unless the
+       * frame is too short to fit its corners
+       */
+      XShapeCombineRectangles (xdisplay, frame->xwindow,
+                               ShapeBounding, 0, 0,
+                               shape->rects, shape->n_rects,
+                               ShapeSet,
+                               new_window_height >= shape->top_height + shape->bottom_height ?
+                               YXBanded : Unsorted);
     }
   
   frame->shape_applied = TRUE;
-  
-  XDestroyRegion (window_xregion);
 #endif /* HAVE_SHAPE */
 }
 
@@ -1049,6 +1400,43 @@ meta_frames_queue_draw (MetaFrames *frames,
   invalidate_whole_window (frames, frame);
 }
 
+/* Queues a redraw of the parts of the frame whose draw ops depend on
+ * what changed, going by meta_theme_get_frame_damage().
+ */
+static void
+invalidate_dependents (MetaFrames           *frames,
+                       MetaUIFrame          *frame,
+                       MetaDrawDependencies  changed)
+{
+  MetaFrameGeometry fgeom;
+  MetaFrameFlags flags;
+  MetaFrameType type;
+  GdkRectangle damage;
+
+  meta_core_get (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()), frame->xwindow,
+                 META_CORE_GET_FRAME_FLAGS, &flags,
+                 META_CORE_GET_FRAME_TYPE, &type,
+                 META_CORE_GET_END);
+
+  meta_frames_calc_geometry (frames, frame, &fgeom);
+
+  if (meta_theme_get_frame_damage (meta_theme_get_current (),
+                                   type, flags, &fgeom, changed,
+                                   &damage))
+    invalidate_titlebar_rect (frames, frame, &damage);
+}
+
+void
+meta_frames_queue_icon_draw (MetaFrames *frames,
+                             Window      xwindow)
+{
+  MetaUIFrame *frame;
+  
+  frame = meta_frames_lookup_window (frames, xwindow);
+
+  invalidate_dependents (frames, frame, META_DRAW_DEPENDS_ICON);
+}
+
 void
 meta_frames_set_title (MetaFrames *frames,
                        Window      xwindow,
@@ -1059,6 +1447,12 @@ meta_frames_set_title (MetaFrames *frames,
   frame = meta_frames_lookup_window (frames, xwindow);
 
   g_assert (frame);
+
+  /* Shells that put the working directory in the title set it
+   * again after every command.
+   */
+  if (frame->title && title && strcmp (frame->title, title) == 0)
+    return;
   
   g_free (frame->title);
   frame->title = g_strdup (title);
@@ -1069,7 +1463,7 @@ meta_frames_set_title (MetaFrames *frames,
       frame->layout = NULL;
     }
 
-  invalidate_whole_window (frames, frame);
+  invalidate_dependents (frames, frame, META_DRAW_DEPENDS_TITLE);
 }
 
 void
@@ -1246,8 +1640,7 @@ redraw_control (MetaFrames *frames,
 
   rect = control_rect (control, &fgeom);
 
-  gdk_window_invalidate_rect (frame->window, rect, FALSE);
-  invalidate_cache (frames, frame);
+  invalidate_titlebar_rect (frames, frame, rect);
 }
 
 static gboolean
@@ -2131,6 +2524,44 @@ generate_pixmap (MetaFrames *frames,
   return result;
 }
 
+/* Renders the damaged parts of a cached titlebar again, over the
+ * parts that are still good.
+ */
+static void
+update_pixmap (MetaFrames       *frames,
+               MetaUIFrame      *frame,
+               CachedFramePiece *piece,
+               GdkRegion        *damage)
+{
+  GdkRectangle *areas;
+  int n_areas;
+  int i;
+
+  gdk_region_get_rectangles (damage, &areas, &n_areas);
+
+  for (i = 0; i < n_areas; i++)
+    {
+      GdkRegion *region;
+      cairo_t *cr;
+
+      cr = gdk_cairo_create (piece->pixmap);
+      setup_bg_cr (cr, frame->window, piece->rect.x, piece->rect.y);
+      cairo_rectangle (cr,
+                       areas[i].x - piece->rect.x,
+                       areas[i].y - piece->rect.y,
+                       areas[i].width, areas[i].height);
+      cairo_fill (cr);
+      cairo_destroy (cr);
+
+      region = gdk_region_rectangle (&areas[i]);
+      meta_frames_paint_to_drawable (frames, frame, piece->pixmap, region,
+                                     -piece->rect.x, -piece->rect.y);
+      gdk_region_destroy (region);
+    }
+
+  g_free (areas);
+}
+
 
 static void
 populate_cache (MetaFrames *frames,
@@ -2198,6 +2629,14 @@ populate_cache (MetaFrames *frames,
       if (!piece->pixmap)
         piece->pixmap = generate_pixmap (frames, frame, piece->rect);
     }
+
+  if (pixels->titlebar_damage)
+    {
+      update_pixmap (frames, frame, &pixels->piece[0],
+                     pixels->titlebar_damage);
+      gdk_region_destroy (pixels->titlebar_damage);
+      pixels->titlebar_damage = NULL;
+    }
   
   if (frames->invalidate_cache_timeout_id)
     g_source_remove (frames->invalidate_cache_timeout_id);
@@ -2264,6 +2703,10 @@ cached_pixels_draw (CachedPixels *pixels,
 
   cr = gdk_cairo_create (window);
 
+  /* Only copy what was exposed */
+  gdk_cairo_region (cr, region);
+  cairo_clip (cr);
+
   for (i = 0; i < 4; i++)
     {
       CachedFramePiece *piece;
@@ -2526,11 +2969,20 @@ meta_frames_paint_to_drawable (MetaFrames   *frames,
     {
       /* Not a window; happens about 1/3 of the time */
 
+      GdkRectangle clip;
+
+      /* Skips the pieces and buttons of the frame that fall
+       * outside the part of it being cached.
+       */
+      gdk_region_get_clipbox (region, &clip);
+      clip.x += x_offset;
+      clip.y += y_offset;
+
       meta_theme_draw_frame_with_style (meta_theme_get_current (),
                                         frame->style,
                                         widget,
                                         drawable,
-                                        NULL,
+                                        &clip,
                                         x_offset, y_offset,
                                         type,
                                         flags,
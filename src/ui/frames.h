@@ -70,6 +70,7 @@ typedef struct _MetaFrames        MetaFrames;
 typedef struct _MetaFramesClass   MetaFramesClass;
 
 typedef struct _MetaUIFrame         MetaUIFrame;
+typedef struct _MetaFrameShape      MetaFrameShape;
 
 struct _MetaUIFrame
 {
@@ -82,6 +83,7 @@ struct _MetaUIFrame
   char *title; /* NULL once we have a layout */
   guint expose_delayed : 1;
   guint shape_applied : 1;
+  MetaFrameShape *shape; /* NULL unless shape_applied */
   
   /* FIXME get rid of this, it can just be in the MetaFrames struct */
   MetaFrameControl prelit_control;
@@ -152,6 +154,8 @@ void meta_frames_move_resize_frame (MetaFrames *frames,
 				    int         height);
 void meta_frames_queue_draw (MetaFrames *frames,
                              Window      xwindow);
+void meta_frames_queue_icon_draw (MetaFrames *frames,
+                                  Window      xwindow);
 
 void meta_frames_notify_menu_hide (MetaFrames *frames);
 
@@ -26,6 +26,13 @@
 #include "util.h"
 #include <string.h>
 
+#if (defined (__i386__) || defined (__x86_64__)) && \
+    (defined (__clang__) || \
+     (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_X86_GRADIENT_KERNELS 1
+#include <immintrin.h>
+#endif
+
 /* This is all Alfredo's and Dan's usual very nice WindowMaker code,
  * slightly GTK-ized
  */
@@ -87,6 +94,509 @@ blank_pixbuf (int width, int height, gboolean no_padding)
                                    free_buffer, NULL);
 }
 
+/* The per-pixel loops below are the only part of gradient rendering
+ * whose cost grows with the area of the frame, so they go through a
+ * small table of kernels. The scalar versions are the original
+ * WindowMaker loops; the SSE2 and AVX2 ones must produce exactly the
+ * same bytes, which "testgradient --benchmark" checks.
+ */
+typedef struct
+{
+  /* Writes n RGB pixels, the i'th being ((r + i*dr) >> 16, ...) */
+  void (* fill_ramp)       (guchar *ptr,
+                            int     n,
+                            long    r,
+                            long    g,
+                            long    b,
+                            long    dr,
+                            long    dg,
+                            long    db);
+  /* Writes n RGB pixels of a single color */
+  void (* fill_solid)      (guchar *ptr,
+                            int     n,
+                            guchar  r,
+                            guchar  g,
+                            guchar  b);
+  /* Multiplies the alpha of n RGBA pixels by alpha / 255 */
+  void (* multiply_alpha)  (guchar *ptr,
+                            int     n,
+                            guchar  alpha);
+  /* Multiplies the alpha of n RGBA pixels by alphas[i] / 255 */
+  void (* multiply_alphas) (guchar       *ptr,
+                            int           n,
+                            const guchar *alphas);
+} GradientKernels;
+
+static void
+fill_ramp_scalar (guchar *ptr,
+                  int     n,
+                  long    r,
+                  long    g,
+                  long    b,
+                  long    dr,
+                  long    dg,
+                  long    db)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    {
+      *(ptr++) = (unsigned char)(r>>16);
+      *(ptr++) = (unsigned char)(g>>16);
+      *(ptr++) = (unsigned char)(b>>16);
+      r += dr;
+      g += dg;
+      b += db;
+    }
+}
+
+static void
+fill_solid_scalar (guchar *ptr,
+                   int     n,
+                   guchar  r,
+                   guchar  g,
+                   guchar  b)
+{
+  int j;
+
+  ptr[0] = r;
+  ptr[1] = g;
+  ptr[2] = b;
+
+  for (j=1; j <= n/2; j *= 2)
+    memcpy (&(ptr[j*3]), ptr, j*3);
+  memcpy (&(ptr[j*3]), ptr, (n - j)*3);
+}
+
+static void
+multiply_alpha_scalar (guchar *ptr,
+                       int     n,
+                       guchar  alpha)
+{
+  guchar *end = ptr + n * 4;
+
+  while (ptr != end)
+    {
+      ptr += 3; /* skip RGB */
+
+      /* multiply the two alpha channels. not sure this is right.
+       * but some end cases are that if the pixbuf contains 255,
+       * then it should be modified to contain "alpha"; if the
+       * pixbuf contains 0, it should remain 0.
+       */
+      /* ((*p / 255.0) * (alpha / 255.0)) * 255; */
+      *ptr = (guchar) (((int) *ptr * (int) alpha) / (int) 255);
+
+      ++ptr; /* skip A */
+    }
+}
+
+static void
+multiply_alphas_scalar (guchar       *ptr,
+                        int           n,
+                        const guchar *alphas)
+{
+  const guchar *end = alphas + n;
+
+  ptr += 3;
+  while (alphas != end)
+    {
+      *ptr = (guchar) (((int) *ptr * (int) *alphas) / (int) 255);
+
+      ptr += 4;
+      ++alphas;
+    }
+}
+
+static const GradientKernels scalar_kernels =
+{
+  fill_ramp_scalar,
+  fill_solid_scalar,
+  multiply_alpha_scalar,
+  multiply_alphas_scalar
+};
+
+#ifdef HAVE_X86_GRADIENT_KERNELS
+
+/* Both SIMD ramps lay out 3 channels over the lanes of consecutive
+ * vectors, so lane e of the run holds channel e % 3 of pixel e / 3,
+ * and step every lane by its channel's delta times the pixels per run.
+ * Since r + i*dr is exactly what the scalar loop accumulates, only
+ * the order of the additions changes, never the result.
+ */
+static void
+ramp_lanes (gint32 *start,
+            gint32 *step,
+            int     n_lanes,
+            int     pixels_per_run,
+            long    r,
+            long    g,
+            long    b,
+            long    dr,
+            long    dg,
+            long    db)
+{
+  long base[3], delta[3];
+  int e;
+
+  base[0] = r;
+  base[1] = g;
+  base[2] = b;
+  delta[0] = dr;
+  delta[1] = dg;
+  delta[2] = db;
+
+  for (e = 0; e < n_lanes; e++)
+    {
+      start[e] = base[e % 3] + (e / 3) * delta[e % 3];
+      step[e] = pixels_per_run * delta[e % 3];
+    }
+}
+
+/* x / 255 for 0 <= x <= 255 * 255, as the scalar loops compute it */
+#define DIV255_MAGIC 0x8081
+#define DIV255_SHIFT 23
+
+__attribute__ ((target ("sse2"))) static void
+fill_ramp_sse2 (guchar *ptr,
+                int     n,
+                long    r,
+                long    g,
+                long    b,
+                long    dr,
+                long    dg,
+                long    db)
+{
+  gint32 start[48], step[48];
+  __m128i acc[12], inc[3], mask;
+  int i, k;
+
+  /* 16 pixels, 48 bytes, three 16 byte stores per run */
+  ramp_lanes (start, step, 48, 16, r, g, b, dr, dg, db);
+  for (k = 0; k < 12; k++)
+    acc[k] = _mm_loadu_si128 ((const __m128i *) (start + k * 4));
+  for (k = 0; k < 3; k++)
+    inc[k] = _mm_loadu_si128 ((const __m128i *) (step + k * 4));
+  mask = _mm_set1_epi32 (0xff);
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      for (k = 0; k < 3; k++)
+        {
+          __m128i a0, a1, a2, a3;
+
+          a0 = _mm_and_si128 (_mm_srai_epi32 (acc[k * 4 + 0], 16), mask);
+          a1 = _mm_and_si128 (_mm_srai_epi32 (acc[k * 4 + 1], 16), mask);
+          a2 = _mm_and_si128 (_mm_srai_epi32 (acc[k * 4 + 2], 16), mask);
+          a3 = _mm_and_si128 (_mm_srai_epi32 (acc[k * 4 + 3], 16), mask);
+          _mm_storeu_si128 ((__m128i *) (ptr + k * 16),
+                            _mm_packus_epi16 (_mm_packs_epi32 (a0, a1),
+                                              _mm_packs_epi32 (a2, a3)));
+        }
+
+      for (k = 0; k < 12; k++)
+        acc[k] = _mm_add_epi32 (acc[k], inc[k % 3]);
+      ptr += 48;
+    }
+
+  fill_ramp_scalar (ptr, n - i,
+                    r + i * dr, g + i * dg, b + i * db,
+                    dr, dg, db);
+}
+
+__attribute__ ((target ("sse2"))) static void
+fill_solid_sse2 (guchar *ptr,
+                 int     n,
+                 guchar  r,
+                 guchar  g,
+                 guchar  b)
+{
+  guchar pattern[48];
+  __m128i p0, p1, p2;
+  int i;
+
+  if (n < 16)
+    {
+      fill_solid_scalar (ptr, n, r, g, b);
+      return;
+    }
+
+  fill_solid_scalar (pattern, 16, r, g, b);
+  p0 = _mm_loadu_si128 ((const __m128i *) (pattern + 0));
+  p1 = _mm_loadu_si128 ((const __m128i *) (pattern + 16));
+  p2 = _mm_loadu_si128 ((const __m128i *) (pattern + 32));
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      _mm_storeu_si128 ((__m128i *) (ptr + 0), p0);
+      _mm_storeu_si128 ((__m128i *) (ptr + 16), p1);
+      _mm_storeu_si128 ((__m128i *) (ptr + 32), p2);
+      ptr += 48;
+    }
+
+  memcpy (ptr, pattern, (n - i) * 3);
+}
+
+/* Multiplies the alpha bytes of 8 RGBA pixels by 8 16-bit factors */
+__attribute__ ((target ("sse2"))) static void
+multiply_alpha8_sse2 (guchar  *ptr,
+                      __m128i  factors)
+{
+  __m128i v0, v1, a, q, rgb_mask, zero;
+
+  rgb_mask = _mm_set1_epi32 (0x00ffffff);
+  zero = _mm_setzero_si128 ();
+
+  v0 = _mm_loadu_si128 ((const __m128i *) ptr);
+  v1 = _mm_loadu_si128 ((const __m128i *) (ptr + 16));
+
+  a = _mm_packs_epi32 (_mm_srli_epi32 (v0, 24), _mm_srli_epi32 (v1, 24));
+  a = _mm_mullo_epi16 (a, factors);
+  q = _mm_srli_epi16 (_mm_mulhi_epu16 (a, _mm_set1_epi16 ((short) DIV255_MAGIC)),
+                      DIV255_SHIFT - 16);
+
+  v0 = _mm_or_si128 (_mm_and_si128 (v0, rgb_mask),
+                     _mm_slli_epi32 (_mm_unpacklo_epi16 (q, zero), 24));
+  v1 = _mm_or_si128 (_mm_and_si128 (v1, rgb_mask),
+                     _mm_slli_epi32 (_mm_unpackhi_epi16 (q, zero), 24));
+
+  _mm_storeu_si128 ((__m128i *) ptr, v0);
+  _mm_storeu_si128 ((__m128i *) (ptr + 16), v1);
+}
+
+__attribute__ ((target ("sse2"))) static void
+multiply_alpha_sse2 (guchar *ptr,
+                     int     n,
+                     guchar  alpha)
+{
+  __m128i factors;
+  int i;
+
+  factors = _mm_set1_epi16 (alpha);
+  for (i = 0; i + 8 <= n; i += 8)
+    multiply_alpha8_sse2 (ptr + i * 4, factors);
+
+  multiply_alpha_scalar (ptr + i * 4, n - i, alpha);
+}
+
+__attribute__ ((target ("sse2"))) static void
+multiply_alphas_sse2 (guchar       *ptr,
+                      int           n,
+                      const guchar *alphas)
+{
+  __m128i zero;
+  int i;
+
+  zero = _mm_setzero_si128 ();
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m128i factors;
+
+      factors = _mm_loadl_epi64 ((const __m128i *) (alphas + i));
+      multiply_alpha8_sse2 (ptr + i * 4, _mm_unpacklo_epi8 (factors, zero));
+    }
+
+  multiply_alphas_scalar (ptr + i * 4, n - i, alphas + i);
+}
+
+static const GradientKernels sse2_kernels =
+{
+  fill_ramp_sse2,
+  fill_solid_sse2,
+  multiply_alpha_sse2,
+  multiply_alphas_sse2
+};
+
+__attribute__ ((target ("avx2"))) static void
+fill_ramp_avx2 (guchar *ptr,
+                int     n,
+                long    r,
+                long    g,
+                long    b,
+                long    dr,
+                long    dg,
+                long    db)
+{
+  gint32 start[96], step[96];
+  __m256i acc[12], inc[3], mask, order;
+  int i, k;
+
+  /* 32 pixels, 96 bytes, three 32 byte stores per run */
+  ramp_lanes (start, step, 96, 32, r, g, b, dr, dg, db);
+  for (k = 0; k < 12; k++)
+    acc[k] = _mm256_loadu_si256 ((const __m256i *) (start + k * 8));
+  for (k = 0; k < 3; k++)
+    inc[k] = _mm256_loadu_si256 ((const __m256i *) (step + k * 8));
+  mask = _mm256_set1_epi32 (0xff);
+  /* the packs work within 128-bit halves; this puts the dwords back */
+  order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      for (k = 0; k < 3; k++)
+        {
+          __m256i a0, a1, a2, a3, packed;
+
+          a0 = _mm256_and_si256 (_mm256_srai_epi32 (acc[k * 4 + 0], 16), mask);
+          a1 = _mm256_and_si256 (_mm256_srai_epi32 (acc[k * 4 + 1], 16), mask);
+          a2 = _mm256_and_si256 (_mm256_srai_epi32 (acc[k * 4 + 2], 16), mask);
+          a3 = _mm256_and_si256 (_mm256_srai_epi32 (acc[k * 4 + 3], 16), mask);
+          packed = _mm256_packus_epi16 (_mm256_packs_epi32 (a0, a1),
+                                        _mm256_packs_epi32 (a2, a3));
+          _mm256_storeu_si256 ((__m256i *) (ptr + k * 32),
+                               _mm256_permutevar8x32_epi32 (packed, order));
+        }
+
+      for (k = 0; k < 12; k++)
+        acc[k] = _mm256_add_epi32 (acc[k], inc[k % 3]);
+      ptr += 96;
+    }
+
+  fill_ramp_sse2 (ptr, n - i,
+                  r + i * dr, g + i * dg, b + i * db,
+                  dr, dg, db);
+}
+
+/* Multiplies the alpha bytes of 8 RGBA pixels by 8 32-bit factors */
+__attribute__ ((target ("avx2"))) static void
+multiply_alpha8_avx2 (guchar  *ptr,
+                      __m256i  factors)
+{
+  __m256i v, a;
+
+  v = _mm256_loadu_si256 ((const __m256i *) ptr);
+  a = _mm256_mullo_epi32 (_mm256_srli_epi32 (v, 24), factors);
+  a = _mm256_srli_epi32 (_mm256_mullo_epi32 (a, _mm256_set1_epi32 (DIV255_MAGIC)),
+                         DIV255_SHIFT);
+  v = _mm256_or_si256 (_mm256_and_si256 (v, _mm256_set1_epi32 (0x00ffffff)),
+                       _mm256_slli_epi32 (a, 24));
+  _mm256_storeu_si256 ((__m256i *) ptr, v);
+}
+
+__attribute__ ((target ("avx2"))) static void
+multiply_alpha_avx2 (guchar *ptr,
+                     int     n,
+                     guchar  alpha)
+{
+  __m256i factors;
+  int i;
+
+  factors = _mm256_set1_epi32 (alpha);
+  for (i = 0; i + 8 <= n; i += 8)
+    multiply_alpha8_avx2 (ptr + i * 4, factors);
+
+  multiply_alpha_scalar (ptr + i * 4, n - i, alpha);
+}
+
+__attribute__ ((target ("avx2"))) static void
+multiply_alphas_avx2 (guchar       *ptr,
+                      int           n,
+                      const guchar *alphas)
+{
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m128i factors;
+
+      factors = _mm_loadl_epi64 ((const __m128i *) (alphas + i));
+      multiply_alpha8_avx2 (ptr + i * 4, _mm256_cvtepu8_epi32 (factors));
+    }
+
+  multiply_alphas_scalar (ptr + i * 4, n - i, alphas + i);
+}
+
+static const GradientKernels avx2_kernels =
+{
+  fill_ramp_avx2,
+  fill_solid_sse2,
+  multiply_alpha_avx2,
+  multiply_alphas_avx2
+};
+
+#endif /* HAVE_X86_GRADIENT_KERNELS */
+
+static const GradientKernels *kernels = NULL;
+static MetaGradientImpl kernels_impl = META_GRADIENT_IMPL_SCALAR;
+
+gboolean
+meta_gradient_impl_supported (MetaGradientImpl impl)
+{
+  switch (impl)
+    {
+    case META_GRADIENT_IMPL_SCALAR:
+      return TRUE;
+#ifdef HAVE_X86_GRADIENT_KERNELS
+    case META_GRADIENT_IMPL_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2");
+    case META_GRADIENT_IMPL_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2");
+#else
+    case META_GRADIENT_IMPL_SSE2:
+    case META_GRADIENT_IMPL_AVX2:
+      return FALSE;
+#endif
+    case META_GRADIENT_IMPL_LAST:
+      break;
+    }
+
+  return FALSE;
+}
+
+gboolean
+meta_gradient_set_impl (MetaGradientImpl impl)
+{
+  if (!meta_gradient_impl_supported (impl))
+    return FALSE;
+
+  switch (impl)
+    {
+#ifdef HAVE_X86_GRADIENT_KERNELS
+    case META_GRADIENT_IMPL_SSE2:
+      kernels = &sse2_kernels;
+      break;
+    case META_GRADIENT_IMPL_AVX2:
+      kernels = &avx2_kernels;
+      break;
+#endif
+    default:
+      kernels = &scalar_kernels;
+      break;
+    }
+
+  kernels_impl = impl;
+  return TRUE;
+}
+
+MetaGradientImpl
+meta_gradient_get_impl (void)
+{
+  if (kernels == NULL)
+    {
+      /* METACITY_DISABLE_SIMD is there to rule the vector code out
+       * when chasing rendering bugs.
+       */
+      if (g_getenv ("METACITY_DISABLE_SIMD") != NULL)
+        meta_gradient_set_impl (META_GRADIENT_IMPL_SCALAR);
+      else if (!meta_gradient_set_impl (META_GRADIENT_IMPL_AVX2) &&
+               !meta_gradient_set_impl (META_GRADIENT_IMPL_SSE2))
+        meta_gradient_set_impl (META_GRADIENT_IMPL_SCALAR);
+    }
+
+  return kernels_impl;
+}
+
+static const GradientKernels *
+get_kernels (void)
+{
+  if (kernels == NULL)
+    meta_gradient_get_impl ();
+
+  return kernels;
+}
+
 GdkPixbuf*
 meta_gradient_create_simple (int              width,
                              int              height,
@@ -164,13 +674,14 @@ meta_gradient_create_interwoven (int            width,
                                  int            thickness2)
 {
   
-  int i, j, k, l, ll;
+  int i, k, l, ll;
   long r1, g1, b1, dr1, dg1, db1;
   long r2, g2, b2, dr2, dg2, db2;
   GdkPixbuf *pixbuf;
   unsigned char *ptr;
   unsigned char *pixels;
   int rowstride;
+  const GradientKernels *k_fns;
   
   pixbuf = blank_pixbuf (width, height, FALSE);
   if (pixbuf == NULL)
@@ -178,6 +689,7 @@ meta_gradient_create_interwoven (int            width,
     
   pixels = gdk_pixbuf_get_pixels (pixbuf);
   rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  k_fns = get_kernels ();
   
   r1 = colors1[0].red<<8;
   g1 = colors1[0].green<<8;
@@ -200,21 +712,15 @@ meta_gradient_create_interwoven (int            width,
       ptr = pixels + i * rowstride;
       
       if (k == 0)
-        {
-          ptr[0] = (unsigned char) (r1>>16);
-          ptr[1] = (unsigned char) (g1>>16);
-          ptr[2] = (unsigned char) (b1>>16);
-        }
+        k_fns->fill_solid (ptr, width,
+                           (unsigned char) (r1>>16),
+                           (unsigned char) (g1>>16),
+                           (unsigned char) (b1>>16));
       else
-        {
-          ptr[0] = (unsigned char) (r2>>16);
-          ptr[1] = (unsigned char) (g2>>16);
-          ptr[2] = (unsigned char) (b2>>16);
-        }
-
-      for (j=1; j <= width/2; j *= 2)
-        memcpy (&(ptr[j*3]), ptr, j*3);
-      memcpy (&(ptr[j*3]), ptr, (width - j)*3);
+        k_fns->fill_solid (ptr, width,
+                           (unsigned char) (r2>>16),
+                           (unsigned char) (g2>>16),
+                           (unsigned char) (b2>>16));
 
       if (++l == ll)
         {
@@ -292,15 +798,7 @@ meta_gradient_create_horizontal (int width, int height,
   dg = ((gf-g0)<<16)/(int)width;
   db = ((bf-b0)<<16)/(int)width;
   /* render the first line */
-  for (i=0; i<width; i++)
-    {
-      *(ptr++) = (unsigned char)(r>>16);
-      *(ptr++) = (unsigned char)(g>>16);
-      *(ptr++) = (unsigned char)(b>>16);
-      r += dr;
-      g += dg;
-      b += db;
-    }
+  get_kernels ()->fill_ramp (ptr, width, r, g, b, dr, dg, db);
 
   /* copy the first line to the other lines */
   for (i=1; i<height; i++)
@@ -328,7 +826,7 @@ meta_gradient_create_vertical (int width, int height,
                                const GdkColor *from,
                                const GdkColor *to)
 {
-  int i, j;
+  int i;
   long r, g, b, dr, dg, db;
   GdkPixbuf *pixbuf;
   unsigned char *ptr;
@@ -336,6 +834,7 @@ meta_gradient_create_vertical (int width, int height,
   int rf, gf, bf;
   int rowstride;
   unsigned char *pixels;
+  const GradientKernels *k_fns;
   
   pixbuf = blank_pixbuf (width, height, FALSE);
   if (pixbuf == NULL)
@@ -359,17 +858,15 @@ meta_gradient_create_vertical (int width, int height,
   dg = ((gf-g0)<<16)/(int)height;
   db = ((bf-b0)<<16)/(int)height;
 
+  k_fns = get_kernels ();
   for (i=0; i<height; i++)
     {
       ptr = pixels + i * rowstride;
       
-      ptr[0] = (unsigned char)(r>>16);
-      ptr[1] = (unsigned char)(g>>16);
-      ptr[2] = (unsigned char)(b>>16);
-
-      for (j=1; j <= width/2; j *= 2)
-        memcpy (&(ptr[j*3]), ptr, j*3);
-      memcpy (&(ptr[j*3]), ptr, (width - j)*3);
+      k_fns->fill_solid (ptr, width,
+                         (unsigned char)(r>>16),
+                         (unsigned char)(g>>16),
+                         (unsigned char)(b>>16));
 
       r+=dr;
       g+=dg;
@@ -447,13 +944,14 @@ meta_gradient_create_multi_horizontal (int width, int height,
                                        const GdkColor *colors,
                                        int count)
 {
-  int i, j, k;
+  int i, k;
   long r, g, b, dr, dg, db;
   GdkPixbuf *pixbuf;
   unsigned char *ptr;
   unsigned char *pixels;
   int width2;  
   int rowstride;
+  const GradientKernels *k_fns;
   
   g_return_val_if_fail (count > 2, NULL);
 
@@ -479,32 +977,26 @@ meta_gradient_create_multi_horizontal (int width, int height,
   g = colors[0].green << 8;
   b = colors[0].blue << 8;
 
+  k_fns = get_kernels ();
+
   /* render the first line */
   for (i=1; i<count; i++)
     {
       dr = ((int)(colors[i].red   - colors[i-1].red)  <<8)/(int)width2;
       dg = ((int)(colors[i].green - colors[i-1].green)<<8)/(int)width2;
       db = ((int)(colors[i].blue  - colors[i-1].blue) <<8)/(int)width2;
-      for (j=0; j<width2; j++)
-        {
-          *ptr++ = (unsigned char)(r>>16);
-          *ptr++ = (unsigned char)(g>>16);
-          *ptr++ = (unsigned char)(b>>16);
-          r += dr;
-          g += dg;
-          b += db;
-          k++;
-	}
+      k_fns->fill_ramp (ptr, width2, r, g, b, dr, dg, db);
+      ptr += width2 * 3;
+      k += width2;
       r = colors[i].red << 8;
       g = colors[i].green << 8;
       b = colors[i].blue << 8;
     }
-  for (j=k; j<width; j++)
-    {
-      *ptr++ = (unsigned char)(r>>16);
-      *ptr++ = (unsigned char)(g>>16);
-      *ptr++ = (unsigned char)(b>>16);
-    }
+  if (k < width)
+    k_fns->fill_solid (ptr, width - k,
+                       (unsigned char)(r>>16),
+                       (unsigned char)(g>>16),
+                       (unsigned char)(b>>16));
     
   /* copy the first line to the other lines */
   for (i=1; i<height; i++)
@@ -524,8 +1016,8 @@ meta_gradient_create_multi_vertical (int width, int height,
   GdkPixbuf *pixbuf;
   unsigned char *ptr, *tmp, *pixels;
   int height2;
-  int x;
   int rowstride;
+  const GradientKernels *k_fns;
   
   g_return_val_if_fail (count > 2, NULL);
 
@@ -551,6 +1043,7 @@ meta_gradient_create_multi_vertical (int width, int height,
   g = colors[0].green << 8;
   b = colors[0].blue << 8;
 
+  k_fns = get_kernels ();
   for (i=1; i<count; i++)
     {
       dr = ((int)(colors[i].red   - colors[i-1].red)  <<8)/(int)height2;
@@ -559,13 +1052,10 @@ meta_gradient_create_multi_vertical (int width, int height,
 
       for (j=0; j<height2; j++)
         {
-          ptr[0] = (unsigned char)(r>>16);
-          ptr[1] = (unsigned char)(g>>16);
-          ptr[2] = (unsigned char)(b>>16);
-
-          for (x=1; x <= width/2; x *= 2)
-            memcpy (&(ptr[x*3]), ptr, x*3);
-          memcpy (&(ptr[x*3]), ptr, (width - x)*3);
+          k_fns->fill_solid (ptr, width,
+                             (unsigned char)(r>>16),
+                             (unsigned char)(g>>16),
+                             (unsigned char)(b>>16));
 
           ptr += rowstride;
           
@@ -583,13 +1073,10 @@ meta_gradient_create_multi_vertical (int width, int height,
     {
       tmp = ptr;
 
-      ptr[0] = (unsigned char) (r>>16);
-      ptr[1] = (unsigned char) (g>>16);
-      ptr[2] = (unsigned char) (b>>16);
-
-      for (x=1; x <= width/2; x *= 2)
-        memcpy (&(ptr[x*3]), ptr, x*3);
-      memcpy (&(ptr[x*3]), ptr, (width - x)*3);
+      k_fns->fill_solid (ptr, width,
+                         (unsigned char) (r>>16),
+                         (unsigned char) (g>>16),
+                         (unsigned char) (b>>16));
 
       ptr += rowstride;
       
@@ -675,6 +1162,7 @@ simple_multiply_alpha (GdkPixbuf *pixbuf,
   int rowstride;
   int height;
   int row;
+  const GradientKernels *k_fns;
 
   g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
   
@@ -686,30 +1174,12 @@ simple_multiply_alpha (GdkPixbuf *pixbuf,
   pixels = gdk_pixbuf_get_pixels (pixbuf);
   rowstride = gdk_pixbuf_get_rowstride (pixbuf);
   height = gdk_pixbuf_get_height (pixbuf);
+  k_fns = get_kernels ();
 
   row = 0;
   while (row < height)
     {
-      guchar *p;
-      guchar *end;
-
-      p = pixels + row * rowstride;
-      end = p + rowstride;
-
-      while (p != end)
-        {
-          p += 3; /* skip RGB */
-
-          /* multiply the two alpha channels. not sure this is right.
-           * but some end cases are that if the pixbuf contains 255,
-           * then it should be modified to contain "alpha"; if the
-           * pixbuf contains 0, it should remain 0.
-           */
-          /* ((*p / 255.0) * (alpha / 255.0)) * 255; */
-          *p = (guchar) (((int) *p * (int) alpha) / (int) 255);
-          
-          ++p; /* skip A */
-        }
+      k_fns->multiply_alpha (pixels + row * rowstride, rowstride / 4, alpha);
 
       ++row;
     }
@@ -730,6 +1200,7 @@ meta_gradient_add_alpha_horizontal (GdkPixbuf           *pixbuf,
   unsigned char *gradient;
   unsigned char *gradient_p;
   unsigned char *gradient_end;
+  const GradientKernels *k_fns;
   
   g_return_if_fail (n_alphas > 0);
 
@@ -781,30 +1252,15 @@ meta_gradient_add_alpha_horizontal (GdkPixbuf           *pixbuf,
   /* Now for each line of the pixbuf, fill in with the gradient */
   pixels = gdk_pixbuf_get_pixels (pixbuf);
   rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  k_fns = get_kernels ();
   
   p = pixels;
   i = 0;
   while (i < height)
     {
-      unsigned char *row_end = p + rowstride;
-      gradient_p = gradient;
-
-      p += 3;
-      while (gradient_p != gradient_end)
-        {
-          /* multiply the two alpha channels. not sure this is right.
-           * but some end cases are that if the pixbuf contains 255,
-           * then it should be modified to contain "alpha"; if the
-           * pixbuf contains 0, it should remain 0.
-           */
-          /* ((*p / 255.0) * (alpha / 255.0)) * 255; */
-          *p = (guchar) (((int) *p * (int) *gradient_p) / (int) 255);
-
-          p += 4;
-          ++gradient_p;
-        }
+      k_fns->multiply_alphas (p, width, gradient);
 
-      p = row_end;
+      p += rowstride;
       ++i;
     }
   
@@ -61,5 +61,22 @@ void meta_gradient_add_alpha (GdkPixbuf       *pixbuf,
                               int              n_alphas,
                               MetaGradientType type);
 
+/* The pixel loops have scalar, SSE2 and AVX2 implementations which
+ * produce identical output; the fastest one the CPU supports is picked
+ * on first use unless METACITY_DISABLE_SIMD is set. Forcing one is
+ * only useful for testing and benchmarking.
+ */
+typedef enum
+{
+  META_GRADIENT_IMPL_SCALAR,
+  META_GRADIENT_IMPL_SSE2,
+  META_GRADIENT_IMPL_AVX2,
+  META_GRADIENT_IMPL_LAST
+} MetaGradientImpl;
+
+MetaGradientImpl meta_gradient_get_impl       (void);
+gboolean         meta_gradient_set_impl       (MetaGradientImpl impl);
+gboolean         meta_gradient_impl_supported (MetaGradientImpl impl);
+
 
 #endif
@@ -0,0 +1,965 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity per-pixel image operations */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.  */
+
+#include "pixels.h"
+
+#if (defined (__i386__) || defined (__x86_64__)) && \
+    (defined (__clang__) || \
+     (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_X86_PIXEL_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/* These used to be done in doubles, and must still give the same
+ * bytes: "testpixels" checks every RGB value against the old loops.
+ *
+ * 0.30 R + 0.59 G + 0.11 B is exactly (30 R + 59 G + 11 B) / 100,
+ * and the double sum is never more than a rounding error away from
+ * that, so rounding it down only comes out differently when the
+ * division is exact and the error is downwards. Pixels where the
+ * division is exact are worked out the old way.
+ */
+#define INTENSITY(r, g, b) ((r) * 0.30 + (g) * 0.59 + (b) * 0.11)
+#define CLAMP_UCHAR(v) ((guchar) (CLAMP (((int)v), (int)0, (int)255)))
+
+static guchar
+intensity (int r,
+           int g,
+           int b)
+{
+  int n, q;
+
+  n = 30 * r + 59 * g + 11 * b;
+  q = n / 100;
+
+  if (q * 100 == n)
+    return (guchar) INTENSITY (r, g, b);
+
+  return q;
+}
+
+/* The rows of RGBA pixels go through a small table of kernels, like
+ * the gradient code's; three byte pixels are always done by the scalar
+ * loops.
+ */
+typedef struct
+{
+  /* Replaces the RGB of n RGBA pixels with their intensity */
+  void (* grayscale_rgba) (guchar       *ptr,
+                           int           n);
+  /* Copies n RGBA pixels, halving the alpha */
+  void (* dim_rgba)       (guchar       *dest,
+                           const guchar *src,
+                           int           n);
+  /* Colorizes n RGBA pixels */
+  void (* colorize_rgba)  (guchar         *dest,
+                           const guchar   *src,
+                           int             n,
+                           const GdkColor *color);
+  /* Packs n 32-bit xRGB pixels, in the given byte order, into RGB */
+  void (* from_xrgb32)    (guchar       *dest,
+                           const guchar *src,
+                           int           n,
+                           gboolean      lsb_first);
+} PixelKernels;
+
+static void
+grayscale_scalar (guchar *ptr,
+                  int     n,
+                  int     pixstride)
+{
+  guchar *end = ptr + n * pixstride;
+
+  while (ptr != end)
+    {
+      guchar v = intensity (ptr[0], ptr[1], ptr[2]);
+
+      ptr[0] = v;
+      ptr[1] = v;
+      ptr[2] = v;
+
+      ptr += pixstride;
+    }
+}
+
+static void
+grayscale_rgba_scalar (guchar *ptr,
+                       int     n)
+{
+  grayscale_scalar (ptr, n, 4);
+}
+
+static void
+dim_rgba_scalar (guchar       *dest,
+                 const guchar *src,
+                 int           n)
+{
+  const guchar *end = src + n * 4;
+
+  while (src != end)
+    {
+      dest[0] = src[0];
+      dest[1] = src[1];
+      dest[2] = src[2];
+      dest[3] = src[3] / 2;
+
+      src += 4;
+      dest += 4;
+    }
+}
+
+/* One pixel exactly as colorize_pixbuf() in theme.c used to do it */
+static void
+colorize_pixel_double (guchar         *dest,
+                       const guchar   *src,
+                       const GdkColor *color)
+{
+  double intensity;
+  double dr, dg, db;
+
+  intensity = INTENSITY (src[0], src[1], src[2]) / 255.0;
+
+  if (intensity <= 0.5)
+    {
+      /* Go from black at intensity = 0.0 to color at intensity = 0.5 */
+      dr = (color->red * intensity * 2.0) / 65535.0;
+      dg = (color->green * intensity * 2.0) / 65535.0;
+      db = (color->blue * intensity * 2.0) / 65535.0;
+    }
+  else
+    {
+      /* Go from color at intensity = 0.5 to white at intensity = 1.0 */
+      dr = (color->red + (65535 - color->red) * (intensity - 0.5) * 2.0) / 65535.0;
+      dg = (color->green + (65535 - color->green) * (intensity - 0.5) * 2.0) / 65535.0;
+      db = (color->blue + (65535 - color->blue) * (intensity - 0.5) * 2.0) / 65535.0;
+    }
+
+  dest[0] = CLAMP_UCHAR (255 * dr);
+  dest[1] = CLAMP_UCHAR (255 * dg);
+  dest[2] = CLAMP_UCHAR (255 * db);
+}
+
+/* With n = 30 R + 59 G + 11 B, a channel comes out as
+ *
+ *   c n / (50 * 65535)                                n <= 12750
+ *   (c 12750 + (65535 - c) (n - 12750)) / (50 * 65535) otherwise
+ *
+ * rounded down.  As with the intensity, a pixel is only done in
+ * doubles when one of those divisions is exact, leaving out the cases
+ * the doubles get exactly right too: 0, and a channel of 65535 in the
+ * upper half.
+ */
+#define COLORIZE_DIVISOR (50 * 65535)
+
+/* Returns FALSE if the pixel has to be done in doubles */
+static gboolean
+colorize_channel (int     c,
+                  int     n,
+                  guchar *out)
+{
+  guint32 num;
+
+  if (n <= 12750)
+    num = (guint32) c * n;
+  else
+    num = (guint32) c * 12750 + (guint32) (65535 - c) * (n - 12750);
+
+  *out = num / COLORIZE_DIVISOR;
+
+  return num % COLORIZE_DIVISOR != 0 ||
+    num == 0 ||
+    (n > 12750 && c == 65535);
+}
+
+static void
+colorize_row (guchar         *dest,
+              const guchar   *src,
+              int             width,
+              int             pixstride,
+              const GdkColor *color)
+{
+  int x;
+
+  for (x = 0; x < width; x++)
+    {
+      int n;
+
+      n = 30 * src[0] + 59 * src[1] + 11 * src[2];
+
+      if (!(colorize_channel (color->red, n, &dest[0]) &&
+            colorize_channel (color->green, n, &dest[1]) &&
+            colorize_channel (color->blue, n, &dest[2])))
+        colorize_pixel_double (dest, src, color);
+
+      if (pixstride == 4)
+        dest[3] = src[3];
+
+      src += pixstride;
+      dest += pixstride;
+    }
+}
+
+static void
+colorize_rgba_scalar (guchar         *dest,
+                      const guchar   *src,
+                      int             n,
+                      const GdkColor *color)
+{
+  colorize_row (dest, src, n, 4, color);
+}
+
+static void
+from_xrgb32_scalar (guchar       *dest,
+                    const guchar *src,
+                    int           n,
+                    gboolean      lsb_first)
+{
+  int r, g, b;
+  int i;
+
+  /* Byte offsets of the channels within each pixel */
+  if (lsb_first)
+    {
+      r = 2;
+      g = 1;
+      b = 0;
+    }
+  else
+    {
+      r = 1;
+      g = 2;
+      b = 3;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      dest[0] = src[r];
+      dest[1] = src[g];
+      dest[2] = src[b];
+      dest += 3;
+      src += 4;
+    }
+}
+
+static const PixelKernels scalar_kernels =
+{
+  grayscale_rgba_scalar,
+  dim_rgba_scalar,
+  colorize_rgba_scalar,
+  from_xrgb32_scalar
+};
+
+#ifdef HAVE_X86_PIXEL_KERNELS
+
+/* n / 100 for 0 <= n <= 25500 is (n * 5243) >> 19 */
+#define DIV100_MAGIC 5243
+#define DIV100_SHIFT 19
+
+/* Grays 8 RGBA pixels unless any of them is exactly divisible, in
+ * which case the scalar loop does them all.
+ */
+__attribute__ ((target ("sse2"))) static void
+grayscale_rgba8_sse2 (guchar *ptr)
+{
+  __m128i v0, v1, byte_mask, alpha_mask, zero;
+  __m128i r, g, b, n, q, q0, q1;
+
+  byte_mask = _mm_set1_epi32 (0xff);
+  alpha_mask = _mm_set1_epi32 (0xff000000);
+  zero = _mm_setzero_si128 ();
+
+  v0 = _mm_loadu_si128 ((const __m128i *) ptr);
+  v1 = _mm_loadu_si128 ((const __m128i *) (ptr + 16));
+
+  r = _mm_packs_epi32 (_mm_and_si128 (v0, byte_mask),
+                       _mm_and_si128 (v1, byte_mask));
+  g = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (v0, 8), byte_mask),
+                       _mm_and_si128 (_mm_srli_epi32 (v1, 8), byte_mask));
+  b = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (v0, 16), byte_mask),
+                       _mm_and_si128 (_mm_srli_epi32 (v1, 16), byte_mask));
+
+  n = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (30)),
+                                    _mm_mullo_epi16 (g, _mm_set1_epi16 (59))),
+                     _mm_mullo_epi16 (b, _mm_set1_epi16 (11)));
+  q = _mm_srli_epi16 (_mm_mulhi_epu16 (n, _mm_set1_epi16 (DIV100_MAGIC)),
+                      DIV100_SHIFT - 16);
+
+  if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (_mm_mullo_epi16 (q, _mm_set1_epi16 (100)),
+                                          n)) != 0)
+    {
+      grayscale_rgba_scalar (ptr, 8);
+      return;
+    }
+
+  q0 = _mm_unpacklo_epi16 (q, zero);
+  q1 = _mm_unpackhi_epi16 (q, zero);
+  q0 = _mm_or_si128 (_mm_or_si128 (q0, _mm_slli_epi32 (q0, 8)),
+                     _mm_slli_epi32 (q0, 16));
+  q1 = _mm_or_si128 (_mm_or_si128 (q1, _mm_slli_epi32 (q1, 8)),
+                     _mm_slli_epi32 (q1, 16));
+
+  _mm_storeu_si128 ((__m128i *) ptr,
+                    _mm_or_si128 (q0, _mm_and_si128 (v0, alpha_mask)));
+  _mm_storeu_si128 ((__m128i *) (ptr + 16),
+                    _mm_or_si128 (q1, _mm_and_si128 (v1, alpha_mask)));
+}
+
+__attribute__ ((target ("sse2"))) static void
+grayscale_rgba_sse2 (guchar *ptr,
+                     int     n)
+{
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    grayscale_rgba8_sse2 (ptr + i * 4);
+
+  grayscale_rgba_scalar (ptr + i * 4, n - i);
+}
+
+__attribute__ ((target ("sse2"))) static void
+dim_rgba_sse2 (guchar       *dest,
+               const guchar *src,
+               int           n)
+{
+  __m128i rgb_mask, alpha_mask;
+  int i;
+
+  rgb_mask = _mm_set1_epi32 (0x00ffffff);
+  alpha_mask = _mm_set1_epi32 (0x7f000000);
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i v;
+
+      v = _mm_loadu_si128 ((const __m128i *) (src + i * 4));
+      v = _mm_or_si128 (_mm_and_si128 (v, rgb_mask),
+                        _mm_and_si128 (_mm_srli_epi32 (v, 1), alpha_mask));
+      _mm_storeu_si128 ((__m128i *) (dest + i * 4), v);
+    }
+
+  dim_rgba_scalar (dest + i * 4, src + i * 4, n - i);
+}
+
+/* num / COLORIZE_DIVISOR for 0 <= num < 2^30 is
+ * (num * COLORIZE_MAGIC) >> COLORIZE_SHIFT
+ */
+#define COLORIZE_MAGIC 2748821014u
+#define COLORIZE_SHIFT 53
+
+/* Divides the 32-bit lanes of num by COLORIZE_DIVISOR, setting the
+ * lanes of *exact where there is no remainder
+ */
+__attribute__ ((target ("sse2"))) static __m128i
+colorize_divide_sse2 (__m128i  num,
+                      __m128i *exact)
+{
+  __m128i magic, divisor, even, odd;
+
+  magic = _mm_set1_epi32 ((int) COLORIZE_MAGIC);
+  divisor = _mm_set1_epi32 (COLORIZE_DIVISOR);
+
+  even = _mm_srli_epi64 (_mm_mul_epu32 (num, magic), COLORIZE_SHIFT);
+  odd = _mm_srli_epi64 (_mm_mul_epu32 (_mm_srli_epi64 (num, 32), magic),
+                        COLORIZE_SHIFT);
+
+  *exact = _mm_cmpeq_epi32 (num,
+                            _mm_or_si128 (_mm_mul_epu32 (even, divisor),
+                                          _mm_slli_epi64 (_mm_mul_epu32 (odd, divisor), 32)));
+
+  return _mm_or_si128 (even, _mm_slli_epi64 (odd, 32));
+}
+
+/* colorize_row() for 4 pixels at a time, each 32-bit lane holding one
+ * pixel. Pixels the scalar code would do in doubles are redone after
+ * the store, which is fine since dest is never src.
+ */
+__attribute__ ((target ("sse2"))) static void
+colorize_rgba_sse2 (guchar         *dest,
+                    const guchar   *src,
+                    int             n,
+                    const GdkColor *color)
+{
+  __m128i coef_low[3], coef_high[3], base_high[3], exempt[3];
+  __m128i byte_mask, alpha_mask, zero, half;
+  int channels[3];
+  int i, k;
+
+  channels[0] = color->red;
+  channels[1] = color->green;
+  channels[2] = color->blue;
+
+  for (k = 0; k < 3; k++)
+    {
+      coef_low[k] = _mm_set1_epi32 (channels[k]);
+      coef_high[k] = _mm_set1_epi32 (65535 - channels[k]);
+      base_high[k] = _mm_set1_epi32 (channels[k] * 12750);
+      exempt[k] = _mm_set1_epi32 (channels[k] == 65535 ? -1 : 0);
+    }
+
+  byte_mask = _mm_set1_epi32 (0xff);
+  alpha_mask = _mm_set1_epi32 (0xff000000);
+  zero = _mm_setzero_si128 ();
+  half = _mm_set1_epi32 (12750);
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i v, intensity, high, t, out, redo;
+      int mask, j;
+
+      v = _mm_loadu_si128 ((const __m128i *) (src + i * 4));
+
+      /* Products stay below 2^16, so 16-bit multiplies will do */
+      intensity = _mm_add_epi32 (_mm_add_epi32 (_mm_mullo_epi16 (_mm_and_si128 (v, byte_mask),
+                                                                 _mm_set1_epi32 (30)),
+                                                _mm_mullo_epi16 (_mm_and_si128 (_mm_srli_epi32 (v, 8), byte_mask),
+                                                                 _mm_set1_epi32 (59))),
+                                 _mm_mullo_epi16 (_mm_and_si128 (_mm_srli_epi32 (v, 16), byte_mask),
+                                                  _mm_set1_epi32 (11)));
+      high = _mm_cmpgt_epi32 (intensity, half);
+      t = _mm_sub_epi32 (intensity, _mm_and_si128 (high, half));
+
+      out = _mm_and_si128 (v, alpha_mask);
+      redo = zero;
+
+      for (k = 0; k < 3; k++)
+        {
+          __m128i coef, num, x, exact;
+
+          coef = _mm_or_si128 (_mm_and_si128 (high, coef_high[k]),
+                               _mm_andnot_si128 (high, coef_low[k]));
+
+          /* coef < 2^16 and t < 2^15; put the 32-bit product together
+           * from its 16-bit halves
+           */
+          num = _mm_or_si128 (_mm_mullo_epi16 (coef, t),
+                              _mm_slli_epi32 (_mm_mulhi_epu16 (coef, t), 16));
+          num = _mm_add_epi32 (num, _mm_and_si128 (high, base_high[k]));
+
+          x = colorize_divide_sse2 (num, &exact);
+          out = _mm_or_si128 (out, _mm_slli_epi32 (x, 8 * k));
+
+          exact = _mm_andnot_si128 (_mm_cmpeq_epi32 (num, zero), exact);
+          exact = _mm_andnot_si128 (_mm_and_si128 (high, exempt[k]), exact);
+          redo = _mm_or_si128 (redo, exact);
+        }
+
+      _mm_storeu_si128 ((__m128i *) (dest + i * 4), out);
+
+      mask = _mm_movemask_epi8 (redo);
+      for (j = 0; j < 4; j++)
+        if (mask & (1 << (j * 4)))
+          colorize_pixel_double (dest + (i + j) * 4, src + (i + j) * 4, color);
+    }
+
+  colorize_rgba_scalar (dest + i * 4, src + i * 4, n - i, color);
+}
+
+/* Packing four bytes into three needs a byte shuffle, which SSE2
+ * doesn't have
+ */
+static const PixelKernels sse2_kernels =
+{
+  grayscale_rgba_sse2,
+  dim_rgba_sse2,
+  colorize_rgba_sse2,
+  from_xrgb32_scalar
+};
+
+/* As grayscale_rgba8_sse2() for 16 pixels. The packs and unpacks both
+ * work within 128-bit halves, so the pixels come back out in order.
+ * The SSE2 code is called with the upper halves cleared, which saves
+ * a costly state switch on some CPUs.
+ */
+__attribute__ ((target ("avx2"))) static void
+grayscale_rgba16_avx2 (guchar *ptr)
+{
+  __m256i v0, v1, byte_mask, alpha_mask, zero;
+  __m256i r, g, b, n, q, q0, q1;
+
+  byte_mask = _mm256_set1_epi32 (0xff);
+  alpha_mask = _mm256_set1_epi32 (0xff000000);
+  zero = _mm256_setzero_si256 ();
+
+  v0 = _mm256_loadu_si256 ((const __m256i *) ptr);
+  v1 = _mm256_loadu_si256 ((const __m256i *) (ptr + 32));
+
+  r = _mm256_packs_epi32 (_mm256_and_si256 (v0, byte_mask),
+                          _mm256_and_si256 (v1, byte_mask));
+  g = _mm256_packs_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (v0, 8), byte_mask),
+                          _mm256_and_si256 (_mm256_srli_epi32 (v1, 8), byte_mask));
+  b = _mm256_packs_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (v0, 16), byte_mask),
+                          _mm256_and_si256 (_mm256_srli_epi32 (v1, 16), byte_mask));
+
+  n = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (r, _mm256_set1_epi16 (30)),
+                                          _mm256_mullo_epi16 (g, _mm256_set1_epi16 (59))),
+                        _mm256_mullo_epi16 (b, _mm256_set1_epi16 (11)));
+  q = _mm256_srli_epi16 (_mm256_mulhi_epu16 (n, _mm256_set1_epi16 (DIV100_MAGIC)),
+                         DIV100_SHIFT - 16);
+
+  if (_mm256_movemask_epi8 (_mm256_cmpeq_epi16 (_mm256_mullo_epi16 (q, _mm256_set1_epi16 (100)),
+                                                n)) != 0)
+    {
+      _mm256_zeroupper ();
+      grayscale_rgba_sse2 (ptr, 16);
+      return;
+    }
+
+  q0 = _mm256_unpacklo_epi16 (q, zero);
+  q1 = _mm256_unpackhi_epi16 (q, zero);
+  q0 = _mm256_or_si256 (_mm256_or_si256 (q0, _mm256_slli_epi32 (q0, 8)),
+                        _mm256_slli_epi32 (q0, 16));
+  q1 = _mm256_or_si256 (_mm256_or_si256 (q1, _mm256_slli_epi32 (q1, 8)),
+                        _mm256_slli_epi32 (q1, 16));
+
+  _mm256_storeu_si256 ((__m256i *) ptr,
+                       _mm256_or_si256 (q0, _mm256_and_si256 (v0, alpha_mask)));
+  _mm256_storeu_si256 ((__m256i *) (ptr + 32),
+                       _mm256_or_si256 (q1, _mm256_and_si256 (v1, alpha_mask)));
+}
+
+__attribute__ ((target ("avx2"))) static void
+grayscale_rgba_avx2 (guchar *ptr,
+                     int     n)
+{
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    grayscale_rgba16_avx2 (ptr + i * 4);
+
+  _mm256_zeroupper ();
+  grayscale_rgba_sse2 (ptr + i * 4, n - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+dim_rgba_avx2 (guchar       *dest,
+               const guchar *src,
+               int           n)
+{
+  __m256i rgb_mask, alpha_mask;
+  int i;
+
+  rgb_mask = _mm256_set1_epi32 (0x00ffffff);
+  alpha_mask = _mm256_set1_epi32 (0x7f000000);
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i v;
+
+      v = _mm256_loadu_si256 ((const __m256i *) (src + i * 4));
+      v = _mm256_or_si256 (_mm256_and_si256 (v, rgb_mask),
+                           _mm256_and_si256 (_mm256_srli_epi32 (v, 1), alpha_mask));
+      _mm256_storeu_si256 ((__m256i *) (dest + i * 4), v);
+    }
+
+  _mm256_zeroupper ();
+  dim_rgba_sse2 (dest + i * 4, src + i * 4, n - i);
+}
+
+__attribute__ ((target ("avx2"))) static __m256i
+colorize_divide_avx2 (__m256i  num,
+                      __m256i *exact)
+{
+  __m256i magic, divisor, even, odd;
+
+  magic = _mm256_set1_epi32 ((int) COLORIZE_MAGIC);
+  divisor = _mm256_set1_epi32 (COLORIZE_DIVISOR);
+
+  even = _mm256_srli_epi64 (_mm256_mul_epu32 (num, magic), COLORIZE_SHIFT);
+  odd = _mm256_srli_epi64 (_mm256_mul_epu32 (_mm256_srli_epi64 (num, 32), magic),
+                           COLORIZE_SHIFT);
+
+  *exact = _mm256_cmpeq_epi32 (num,
+                               _mm256_or_si256 (_mm256_mul_epu32 (even, divisor),
+                                                _mm256_slli_epi64 (_mm256_mul_epu32 (odd, divisor), 32)));
+
+  return _mm256_or_si256 (even, _mm256_slli_epi64 (odd, 32));
+}
+
+/* As colorize_rgba_sse2() for 8 pixels at a time, with AVX2's 32-bit
+ * multiply doing the products directly
+ */
+__attribute__ ((target ("avx2"))) static void
+colorize_rgba_avx2 (guchar         *dest,
+                    const guchar   *src,
+                    int             n,
+                    const GdkColor *color)
+{
+  __m256i coef_low[3], coef_high[3], base_high[3], exempt[3];
+  __m256i byte_mask, alpha_mask, zero, half;
+  int channels[3];
+  int i, k;
+
+  channels[0] = color->red;
+  channels[1] = color->green;
+  channels[2] = color->blue;
+
+  for (k = 0; k < 3; k++)
+    {
+      coef_low[k] = _mm256_set1_epi32 (channels[k]);
+      coef_high[k] = _mm256_set1_epi32 (65535 - channels[k]);
+      base_high[k] = _mm256_set1_epi32 (channels[k] * 12750);
+      exempt[k] = _mm256_set1_epi32 (channels[k] == 65535 ? -1 : 0);
+    }
+
+  byte_mask = _mm256_set1_epi32 (0xff);
+  alpha_mask = _mm256_set1_epi32 (0xff000000);
+  zero = _mm256_setzero_si256 ();
+  half = _mm256_set1_epi32 (12750);
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i v, intensity, high, t, out, redo;
+      int mask, j;
+
+      v = _mm256_loadu_si256 ((const __m256i *) (src + i * 4));
+
+      intensity = _mm256_add_epi32 (_mm256_add_epi32 (_mm256_mullo_epi32 (_mm256_and_si256 (v, byte_mask),
+                                                                          _mm256_set1_epi32 (30)),
+                                                      _mm256_mullo_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (v, 8), byte_mask),
+                                                                          _mm256_set1_epi32 (59))),
+                                    _mm256_mullo_epi32 (_mm256_and_si256 (_mm256_srli_epi32 (v, 16), byte_mask),
+                                                        _mm256_set1_epi32 (11)));
+      high = _mm256_cmpgt_epi32 (intensity, half);
+      t = _mm256_sub_epi32 (intensity, _mm256_and_si256 (high, half));
+
+      out = _mm256_and_si256 (v, alpha_mask);
+      redo = zero;
+
+      for (k = 0; k < 3; k++)
+        {
+          __m256i coef, num, x, exact;
+
+          coef = _mm256_blendv_epi8 (coef_low[k], coef_high[k], high);
+          num = _mm256_add_epi32 (_mm256_mullo_epi32 (coef, t),
+                                  _mm256_and_si256 (high, base_high[k]));
+
+          x = colorize_divide_avx2 (num, &exact);
+          out = _mm256_or_si256 (out, _mm256_slli_epi32 (x, 8 * k));
+
+          exact = _mm256_andnot_si256 (_mm256_cmpeq_epi32 (num, zero), exact);
+          exact = _mm256_andnot_si256 (_mm256_and_si256 (high, exempt[k]), exact);
+          redo = _mm256_or_si256 (redo, exact);
+        }
+
+      _mm256_storeu_si256 ((__m256i *) (dest + i * 4), out);
+
+      mask = _mm256_movemask_epi8 (redo);
+      for (j = 0; j < 8; j++)
+        if (mask & (1 << (j * 4)))
+          colorize_pixel_double (dest + (i + j) * 4, src + (i + j) * 4, color);
+    }
+
+  _mm256_zeroupper ();
+  colorize_rgba_sse2 (dest + i * 4, src + i * 4, n - i, color);
+}
+
+/* Shuffles each 128-bit half's four pixels into twelve bytes, then
+ * moves the two runs of twelve together and stores exactly 24 bytes.
+ */
+__attribute__ ((target ("avx2"))) static void
+from_xrgb32_avx2 (guchar       *dest,
+                  const guchar *src,
+                  int           n,
+                  gboolean      lsb_first)
+{
+  __m256i shuffle, compact, v;
+  int i;
+
+  if (lsb_first)
+    shuffle = _mm256_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                -1, -1, -1, -1,
+                                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                -1, -1, -1, -1);
+  else
+    shuffle = _mm256_setr_epi8 (1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15,
+                                -1, -1, -1, -1,
+                                1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15,
+                                -1, -1, -1, -1);
+  compact = _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 3, 7);
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      v = _mm256_loadu_si256 ((const __m256i *) (src + i * 4));
+      v = _mm256_permutevar8x32_epi32 (_mm256_shuffle_epi8 (v, shuffle),
+                                       compact);
+
+      _mm_storeu_si128 ((__m128i *) (dest + i * 3),
+                        _mm256_castsi256_si128 (v));
+      _mm_storel_epi64 ((__m128i *) (dest + i * 3 + 16),
+                        _mm256_extracti128_si256 (v, 1));
+    }
+
+  _mm256_zeroupper ();
+  from_xrgb32_scalar (dest + i * 3, src + i * 4, n - i, lsb_first);
+}
+
+static const PixelKernels avx2_kernels =
+{
+  grayscale_rgba_avx2,
+  dim_rgba_avx2,
+  colorize_rgba_avx2,
+  from_xrgb32_avx2
+};
+
+#endif /* HAVE_X86_PIXEL_KERNELS */
+
+static const PixelKernels *kernels = NULL;
+static MetaPixelsImpl kernels_impl = META_PIXELS_IMPL_SCALAR;
+
+gboolean
+meta_pixels_impl_supported (MetaPixelsImpl impl)
+{
+  switch (impl)
+    {
+    case META_PIXELS_IMPL_SCALAR:
+      return TRUE;
+#ifdef HAVE_X86_PIXEL_KERNELS
+    case META_PIXELS_IMPL_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2");
+    case META_PIXELS_IMPL_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2");
+#else
+    case META_PIXELS_IMPL_SSE2:
+    case META_PIXELS_IMPL_AVX2:
+      return FALSE;
+#endif
+    case META_PIXELS_IMPL_LAST:
+      break;
+    }
+
+  return FALSE;
+}
+
+gboolean
+meta_pixels_set_impl (MetaPixelsImpl impl)
+{
+  if (!meta_pixels_impl_supported (impl))
+    return FALSE;
+
+  switch (impl)
+    {
+#ifdef HAVE_X86_PIXEL_KERNELS
+    case META_PIXELS_IMPL_SSE2:
+      kernels = &sse2_kernels;
+      break;
+    case META_PIXELS_IMPL_AVX2:
+      kernels = &avx2_kernels;
+      break;
+#endif
+    default:
+      kernels = &scalar_kernels;
+      break;
+    }
+
+  kernels_impl = impl;
+  return TRUE;
+}
+
+MetaPixelsImpl
+meta_pixels_get_impl (void)
+{
+  if (kernels == NULL)
+    {
+      if (g_getenv ("METACITY_DISABLE_SIMD") != NULL)
+        meta_pixels_set_impl (META_PIXELS_IMPL_SCALAR);
+      else if (!meta_pixels_set_impl (META_PIXELS_IMPL_AVX2) &&
+               !meta_pixels_set_impl (META_PIXELS_IMPL_SSE2))
+        meta_pixels_set_impl (META_PIXELS_IMPL_SCALAR);
+    }
+
+  return kernels_impl;
+}
+
+static const PixelKernels *
+get_kernels (void)
+{
+  if (kernels == NULL)
+    meta_pixels_get_impl ();
+
+  return kernels;
+}
+
+GdkPixbuf*
+meta_pixels_grayscale (GdkPixbuf *pixbuf)
+{
+  const PixelKernels *k;
+  GdkPixbuf *gray;
+  guchar *pixels;
+  int rowstride;
+  int width;
+  int height;
+  int row;
+
+  gray = gdk_pixbuf_copy (pixbuf);
+  if (gray == NULL)
+    return NULL;
+
+  k = get_kernels ();
+  pixels = gdk_pixbuf_get_pixels (gray);
+  rowstride = gdk_pixbuf_get_rowstride (gray);
+  width = gdk_pixbuf_get_width (gray);
+  height = gdk_pixbuf_get_height (gray);
+
+  for (row = 0; row < height; row++)
+    {
+      if (gdk_pixbuf_get_has_alpha (gray))
+        (* k->grayscale_rgba) (pixels + row * rowstride, width);
+      else
+        grayscale_scalar (pixels + row * rowstride, width, 3);
+    }
+
+  return gray;
+}
+
+GdkPixbuf*
+meta_pixels_dim (GdkPixbuf *pixbuf)
+{
+  const PixelKernels *k;
+  GdkPixbuf *dimmed;
+  const guchar *src;
+  guchar *dest;
+  int src_rowstride;
+  int dest_rowstride;
+  int width;
+  int height;
+  int row;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  dimmed = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  if (dimmed == NULL)
+    return NULL;
+
+  k = get_kernels ();
+  src = gdk_pixbuf_get_pixels (pixbuf);
+  src_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  dest = gdk_pixbuf_get_pixels (dimmed);
+  dest_rowstride = gdk_pixbuf_get_rowstride (dimmed);
+
+  for (row = 0; row < height; row++)
+    {
+      if (gdk_pixbuf_get_has_alpha (pixbuf))
+        {
+          (* k->dim_rgba) (dest, src, width);
+        }
+      else
+        {
+          const guchar *s = src;
+          guchar *d = dest;
+          guchar *end = dest + width * 4;
+
+          /* An opaque pixel at half opacity */
+          while (d != end)
+            {
+              d[0] = s[0];
+              d[1] = s[1];
+              d[2] = s[2];
+              d[3] = 255 / 2;
+
+              s += 3;
+              d += 4;
+            }
+        }
+
+      src += src_rowstride;
+      dest += dest_rowstride;
+    }
+
+  return dimmed;
+}
+
+GdkPixbuf*
+meta_pixels_colorize (GdkPixbuf      *pixbuf,
+                      const GdkColor *color)
+{
+  const PixelKernels *k;
+  GdkPixbuf *colorized;
+  const guchar *src;
+  guchar *dest;
+  int src_rowstride;
+  int dest_rowstride;
+  int width;
+  int height;
+  int pixstride;
+  int row;
+
+  colorized = gdk_pixbuf_new (gdk_pixbuf_get_colorspace (pixbuf),
+                              gdk_pixbuf_get_has_alpha (pixbuf),
+                              gdk_pixbuf_get_bits_per_sample (pixbuf),
+                              gdk_pixbuf_get_width (pixbuf),
+                              gdk_pixbuf_get_height (pixbuf));
+  if (colorized == NULL)
+    return NULL;
+
+  k = get_kernels ();
+  src = gdk_pixbuf_get_pixels (pixbuf);
+  src_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  dest = gdk_pixbuf_get_pixels (colorized);
+  dest_rowstride = gdk_pixbuf_get_rowstride (colorized);
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  pixstride = gdk_pixbuf_get_has_alpha (pixbuf) ? 4 : 3;
+
+  for (row = 0; row < height; row++)
+    {
+      if (pixstride == 4)
+        (* k->colorize_rgba) (dest + row * dest_rowstride,
+                              src + row * src_rowstride,
+                              width, color);
+      else
+        colorize_row (dest + row * dest_rowstride,
+                      src + row * src_rowstride,
+                      width, 3, color);
+    }
+
+  return colorized;
+}
+
+void
+meta_pixels_from_xrgb32 (GdkPixbuf    *pixbuf,
+                         const guchar *data,
+                         int           bytes_per_line,
+                         gboolean      lsb_first)
+{
+  const PixelKernels *k;
+  guchar *pixels;
+  int rowstride;
+  int width;
+  int height;
+  int row;
+
+  g_return_if_fail (!gdk_pixbuf_get_has_alpha (pixbuf));
+
+  k = get_kernels ();
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  for (row = 0; row < height; row++)
+    (* k->from_xrgb32) (pixels + row * rowstride,
+                        data + row * bytes_per_line,
+                        width, lsb_first);
+}
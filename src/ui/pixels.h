@@ -0,0 +1,71 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity per-pixel image operations */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.  */
+
+#ifndef META_PIXELS_H
+#define META_PIXELS_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gdk/gdk.h>
+
+/* Returns a copy of pixbuf with each pixel replaced by its intensity,
+ * 0.30 R + 0.59 G + 0.11 B rounded down
+ */
+GdkPixbuf* meta_pixels_grayscale (GdkPixbuf      *pixbuf);
+
+/* Returns a copy of pixbuf, with an alpha channel, at half the
+ * opacity
+ */
+GdkPixbuf* meta_pixels_dim       (GdkPixbuf      *pixbuf);
+
+/* Returns a copy of pixbuf shaded from black through color to white
+ * by the intensity of each pixel
+ */
+GdkPixbuf* meta_pixels_colorize  (GdkPixbuf      *pixbuf,
+                                  const GdkColor *color);
+
+/* Fills pixbuf, which must be RGB without alpha, from rows of 32-bit
+ * pixels holding 8-bit R, G and B at 0xff0000, 0xff00 and 0xff, in
+ * the given byte order; the top byte is ignored
+ */
+void       meta_pixels_from_xrgb32 (GdkPixbuf    *pixbuf,
+                                    const guchar *data,
+                                    int           bytes_per_line,
+                                    gboolean      lsb_first);
+
+/* As for the gradient code, there are scalar, SSE2 and AVX2
+ * implementations which produce identical output, and the fastest
+ * one the CPU supports is picked on first use unless
+ * METACITY_DISABLE_SIMD is set.
+ */
+typedef enum
+{
+  META_PIXELS_IMPL_SCALAR,
+  META_PIXELS_IMPL_SSE2,
+  META_PIXELS_IMPL_AVX2,
+  META_PIXELS_IMPL_LAST
+} MetaPixelsImpl;
+
+MetaPixelsImpl meta_pixels_get_impl       (void);
+gboolean       meta_pixels_set_impl       (MetaPixelsImpl impl);
+gboolean       meta_pixels_impl_supported (MetaPixelsImpl impl);
+
+#endif
@@ -33,12 +33,18 @@
 #include "../core/workspace.h"
 #include "../core/frame-private.h"
 #include "draw-workspace.h"
+#include "pixels.h"
 #include <gtk/gtk.h>
 #include <math.h>
 
 #define OUTSIDE_SELECT_RECT 2
 #define INSIDE_SELECT_RECT 2
 
+/* Only this many rows of entries are shown at once; the popup pages
+ * through the rest as the selection moves.
+ */
+#define MAX_PAGE_ROWS 4
+
 typedef struct _TabEntry TabEntry;
 
 struct _TabEntry
@@ -50,17 +56,31 @@ struct _TabEntry
   GdkRectangle     rect;
   GdkRectangle     inner_rect;
   guint blank : 1;
+  guint hidden : 1;
+  guint needs_icon : 1;
 };
 
 struct _MetaTabPopup
 {
   GtkWidget *window;
   GtkWidget *label;
+  GtkWidget *table;
   GList *current;
   GList *entries;
   TabEntry *current_selected_entry;
   GtkWidget *outline_window;
   gboolean outline;
+
+  /* Entries only get widgets while their page is shown */
+  int width;
+  int page_rows;
+  int page;
+  int max_label_width;
+  int screen_width;
+
+  MetaTabEntryIconFunc icon_func;
+  gpointer icon_data;
+  guint icon_idle;
 };
 
 static GtkWidget* selectable_image_new (GdkPixbuf *pixbuf);
@@ -112,44 +132,6 @@ outline_window_expose (GtkWidget      *widget,
   return FALSE;
 }
 
-static GdkPixbuf*
-dimm_icon (GdkPixbuf *pixbuf)
-{
-  int x, y, pixel_stride, row_stride;
-  guchar *row, *pixels;
-  int w, h;
-  GdkPixbuf *dimmed_pixbuf;
-
-  if (gdk_pixbuf_get_has_alpha (pixbuf))
-    {
-      dimmed_pixbuf = gdk_pixbuf_copy (pixbuf);
-    }
-  else
-    {
-      dimmed_pixbuf = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
-    }
-
-  w = gdk_pixbuf_get_width (dimmed_pixbuf);
-  h = gdk_pixbuf_get_height (dimmed_pixbuf);      
-
-  pixel_stride = 4;
-
-  row = gdk_pixbuf_get_pixels (dimmed_pixbuf);
-  row_stride = gdk_pixbuf_get_rowstride (dimmed_pixbuf);
-
-  for (y = 0; y < h; y++)
-    {
-      pixels = row;                     
-      for (x = 0; x < w; x++) 
-        {
-          pixels[3] /= 2;                               
-          pixels += pixel_stride;
-        }                       
-      row += row_stride;
-    }
-  return dimmed_pixbuf;
-}
-
 static TabEntry*  
 tab_entry_new (const MetaTabEntry *entry, 
                gint                screen_width,
@@ -194,13 +176,11 @@ tab_entry_new (const MetaTabEntry *entry,
   te->widget = NULL;
   te->icon = entry->icon;
   te->blank = entry->blank;
+  te->hidden = entry->hidden;
+  te->needs_icon = !entry->blank;
   te->dimmed_icon = NULL;
   if (te->icon)
-    {
-      g_object_ref (G_OBJECT (te->icon));
-      if (entry->hidden)
-        te->dimmed_icon = dimm_icon (entry->icon);
-    }
+    g_object_ref (G_OBJECT (te->icon));
   
   if (outline)
     {
@@ -217,6 +197,196 @@ tab_entry_new (const MetaTabEntry *entry,
   return te;
 }
 
+static GtkWidget*
+entry_widget_new (MetaTabPopup *popup,
+                  TabEntry     *te)
+{
+  GtkWidget *image;
+
+  if (te->blank)
+    {
+      /* just stick a widget here to avoid special cases */
+      image = gtk_alignment_new (0.0, 0.0, 0.0, 0.0);
+    }
+  else if (popup->outline)
+    {
+      if (te->hidden && te->icon && te->dimmed_icon == NULL)
+        te->dimmed_icon = meta_pixels_dim (te->icon);
+
+      if (te->dimmed_icon)
+        {
+          image = selectable_image_new (te->dimmed_icon);
+        }
+      else 
+        {
+          image = selectable_image_new (te->icon);
+        }
+
+      gtk_misc_set_padding (GTK_MISC (image),
+                            INSIDE_SELECT_RECT + OUTSIDE_SELECT_RECT + 1,
+                            INSIDE_SELECT_RECT + OUTSIDE_SELECT_RECT + 1);
+      gtk_misc_set_alignment (GTK_MISC (image), 0.5, 0.5);
+    }   
+  else
+    {
+      image = selectable_workspace_new ((MetaWorkspace *) te->key);
+    }
+
+  return image;
+}
+
+/* Swaps in the icons the icon function hands back for the entries on
+ * the page being shown, one entry per call, after the popup has had a
+ * chance to paint.
+ */
+static gboolean
+load_icons_idle (gpointer data)
+{
+  MetaTabPopup *popup;
+  GList *tmp;
+  int n;
+
+  popup = data;
+
+  tmp = g_list_nth (popup->entries, popup->page * popup->width * popup->page_rows);
+  for (n = 0; tmp && n < popup->width * popup->page_rows; n++, tmp = tmp->next)
+    {
+      TabEntry *te;
+      GdkPixbuf *icon;
+
+      te = tmp->data;
+      if (!te->needs_icon)
+        continue;
+
+      te->needs_icon = FALSE;
+
+      icon = (* popup->icon_func) (te->key, popup->icon_data);
+      if (icon == NULL)
+        continue;
+
+      if (te->icon)
+        g_object_unref (G_OBJECT (te->icon));
+      te->icon = icon;
+
+      if (te->dimmed_icon)
+        {
+          g_object_unref (G_OBJECT (te->dimmed_icon));
+          te->dimmed_icon = meta_pixels_dim (te->icon);
+        }
+
+      if (te->widget)
+        gtk_image_set_from_pixbuf (GTK_IMAGE (te->widget),
+                                   te->dimmed_icon ? te->dimmed_icon : te->icon);
+
+      return TRUE;
+    }
+
+  popup->icon_idle = 0;
+
+  return FALSE;
+}
+
+/* Replaces the entry widgets in the table with those of the given
+ * page, measuring only their titles
+ */
+static void
+show_page (MetaTabPopup *popup,
+           int           page)
+{
+  GtkWidget *label;
+  GList *tmp;
+  int per_page;
+  int left, top;
+  int max_label_width;
+
+  if (page == popup->page)
+    return;
+
+  per_page = popup->width * popup->page_rows;
+
+  if (popup->page >= 0)
+    {
+      int n;
+
+      tmp = g_list_nth (popup->entries, popup->page * per_page);
+      for (n = 0; tmp && n < per_page; n++, tmp = tmp->next)
+        {
+          TabEntry *te = tmp->data;
+
+          gtk_widget_destroy (te->widget);
+          te->widget = NULL;
+        }
+    }
+
+  popup->page = page;
+
+  /* A scratch label, so the real one keeps its text and ellipsizing */
+  label = gtk_label_new (NULL);
+  g_object_ref_sink (label);
+  max_label_width = 0;
+
+  tmp = g_list_nth (popup->entries, page * per_page);
+  for (top = 0; tmp && top < popup->page_rows; top++)
+    {
+      for (left = 0; tmp && left < popup->width; left++, tmp = tmp->next)
+        {
+          TabEntry *te;
+          GtkRequisition req;
+
+          te = tmp->data;
+          te->widget = entry_widget_new (popup, te);
+
+          gtk_table_attach (GTK_TABLE (popup->table),
+                            te->widget,
+                            left, left + 1,        top, top + 1,
+                            0,                     0,
+                            0,                     0);
+          gtk_widget_show (te->widget);
+
+          if (te->title)
+            {
+              gtk_label_set_markup (GTK_LABEL (label), te->title);
+              gtk_widget_size_request (label, &req);
+              max_label_width = MAX (max_label_width, req.width);
+            }
+        }
+    }
+
+  g_object_unref (label);
+
+  /* Limit the window size to no bigger than screen_width/4 */
+  if (max_label_width > (popup->screen_width / 4))
+    {
+      max_label_width = popup->screen_width / 4;
+    }
+
+  max_label_width += 20; /* add random padding */
+
+  if (max_label_width > popup->max_label_width)
+    {
+      popup->max_label_width = max_label_width;
+
+      if (GTK_WIDGET_VISIBLE (popup->window))
+        gtk_window_resize (GTK_WINDOW (popup->window), max_label_width, 1);
+      else
+        gtk_window_set_default_size (GTK_WINDOW (popup->window),
+                                     max_label_width,
+                                     -1);
+    }
+
+  if (popup->icon_func && popup->icon_idle == 0)
+    popup->icon_idle = g_idle_add (load_icons_idle, popup);
+}
+
+static void
+show_page_of_entry (MetaTabPopup *popup,
+                    GList        *link)
+{
+  show_page (popup,
+             g_list_position (popup->entries, link) /
+             (popup->width * popup->page_rows));
+}
+
 MetaTabPopup*
 meta_ui_tab_popup_new (const MetaTabEntry *entries,
                        int                 screen_number,
@@ -225,14 +395,12 @@ meta_ui_tab_popup_new (const MetaTabEntry *entries,
                        gboolean            outline)
 {
   MetaTabPopup *popup;
-  int i, left, right, top, bottom;
+  int i;
   int height;
   GtkWidget *table;
   GtkWidget *vbox;
   GtkWidget *align;
-  GList *tmp;
   GtkWidget *frame;
-  int max_label_width; /* the actual max width of the labels we create */
   AtkObject *obj;
   GdkScreen *screen;
   int screen_width;
@@ -281,7 +449,17 @@ meta_ui_tab_popup_new (const MetaTabEntry *entries,
   if (i % width)
     height += 1;
 
-  table = gtk_table_new (height, width, FALSE);
+  popup->width = width;
+  popup->page_rows = MIN (height, MAX_PAGE_ROWS);
+  popup->page = -1;
+  popup->max_label_width = 0;
+  popup->screen_width = screen_width;
+  popup->icon_func = NULL;
+  popup->icon_data = NULL;
+  popup->icon_idle = 0;
+
+  table = gtk_table_new (MAX (popup->page_rows, 1), width, FALSE);
+  popup->table = table;
   vbox = gtk_vbox_new (FALSE, 0);
   
   frame = gtk_frame_new (NULL);
@@ -312,92 +490,13 @@ meta_ui_tab_popup_new (const MetaTabEntry *entries,
 
   gtk_box_pack_end (GTK_BOX (vbox), popup->label, FALSE, FALSE, 0);
 
-  max_label_width = 0;
-  top = 0;
-  bottom = 1;
-  tmp = popup->entries;
-
-  while (tmp && top < height)
-    {      
-      left = 0;
-      right = 1;
-
-      while (tmp && left < width)
-        {
-          GtkWidget *image;
-          GtkRequisition req;
-
-          TabEntry *te;
-
-          te = tmp->data;
-
-          if (te->blank)
-            {
-              /* just stick a widget here to avoid special cases */
-              image = gtk_alignment_new (0.0, 0.0, 0.0, 0.0);
-            }
-          else if (outline)
-            {
-              if (te->dimmed_icon)
-                {
-                  image = selectable_image_new (te->dimmed_icon);
-                }
-              else 
-                {
-                  image = selectable_image_new (te->icon);
-                }
-
-              gtk_misc_set_padding (GTK_MISC (image),
-                                    INSIDE_SELECT_RECT + OUTSIDE_SELECT_RECT + 1,
-                                    INSIDE_SELECT_RECT + OUTSIDE_SELECT_RECT + 1);
-              gtk_misc_set_alignment (GTK_MISC (image), 0.5, 0.5);
-            }   
-          else
-            {
-              image = selectable_workspace_new ((MetaWorkspace *) te->key);
-            }
-
-          te->widget = image;
-
-          gtk_table_attach (GTK_TABLE (table),
-                            te->widget,
-                            left, right,           top, bottom,
-                            0,                     0,
-                            0,                     0);
-
-          /* Efficiency rules! */
-          gtk_label_set_markup (GTK_LABEL (popup->label),
-                              te->title);
-          gtk_widget_size_request (popup->label, &req);
-          max_label_width = MAX (max_label_width, req.width);
-          
-          tmp = tmp->next;
-          
-          ++left;
-          ++right;
-        }
-      
-      ++top;
-      ++bottom;
-    }
-
-  /* remove all the temporary text */
-  gtk_label_set_text (GTK_LABEL (popup->label), "");
   /* Make it so that we ellipsize if the text is too long */
   gtk_label_set_ellipsize (GTK_LABEL (popup->label), PANGO_ELLIPSIZE_END);
 
-  /* Limit the window size to no bigger than screen_width/4 */
-  if (max_label_width>(screen_width/4)) 
-    {
-      max_label_width = screen_width/4;
-    }
+  /* The entries themselves are made once we know which page to show,
+   * so that nothing here depends on how many windows there are.
+   */
 
-  max_label_width += 20; /* add random padding */
-  
-  gtk_window_set_default_size (GTK_WINDOW (popup->window),
-                               max_label_width,
-                               -1);
-  
   return popup;
 }
 
@@ -422,6 +521,9 @@ meta_ui_tab_popup_free (MetaTabPopup *popup)
 {
   meta_verbose ("Destroying tab popup window\n");
   
+  if (popup->icon_idle != 0)
+    g_source_remove (popup->icon_idle);
+
   gtk_widget_destroy (popup->outline_window);
   gtk_widget_destroy (popup->window);
   
@@ -432,12 +534,27 @@ meta_ui_tab_popup_free (MetaTabPopup *popup)
   g_free (popup);
 }
 
+void
+meta_ui_tab_popup_set_icon_func (MetaTabPopup         *popup,
+                                 MetaTabEntryIconFunc  func,
+                                 gpointer              data)
+{
+  popup->icon_func = func;
+  popup->icon_data = data;
+
+  if (func && popup->page >= 0 && popup->icon_idle == 0)
+    popup->icon_idle = g_idle_add (load_icons_idle, popup);
+}
+
 void
 meta_ui_tab_popup_set_showing (MetaTabPopup *popup,
                                gboolean      showing)
 {
   if (showing)
     {
+      if (popup->page < 0)
+        show_page (popup, 0);
+
       gtk_widget_show_all (popup->window);
     }
   else
@@ -460,7 +577,11 @@ display_entry (MetaTabPopup *popup,
   GdkRegion *inner_region;
 
   
-  if (popup->current_selected_entry)
+  /* This may take away the old selection's widget */
+  show_page_of_entry (popup, popup->current);
+
+  if (popup->current_selected_entry &&
+      popup->current_selected_entry->widget)
   {
     if (popup->outline)
       unselect_image (popup->current_selected_entry->widget);
@@ -883,18 +1004,36 @@ meta_convert_meta_to_wnck (MetaWindow *window, MetaScreen *screen)
 }
 
 
-static gboolean
-meta_select_workspace_expose_event (GtkWidget      *widget,
-                                    GdkEventExpose *event)
+/* Returns the retained drawing of the workspace at the given size,
+ * redrawing it first if the core has dropped it since, or if it was
+ * drawn at another size or with another style.
+ */
+static GdkPixmap*
+get_workspace_thumbnail (GtkWidget     *widget,
+                         MetaWorkspace *workspace,
+                         int            width,
+                         int            height)
 {
-  MetaWorkspace *workspace;
   WnckWindowDisplayInfo *windows;
+  GdkPixmap *pixmap;
   GtkStyle *style;
-  cairo_t *cr;
   int i, n_windows;
+  int pixmap_width, pixmap_height;
   GList *tmp, *list;
 
-  workspace = META_SELECT_WORKSPACE (widget)->workspace;
+  style = gtk_widget_get_style (widget);
+
+  if (workspace->thumbnail)
+    {
+      pixmap = GDK_PIXMAP (workspace->thumbnail);
+      gdk_drawable_get_size (pixmap, &pixmap_width, &pixmap_height);
+
+      if (pixmap_width == width && pixmap_height == height &&
+          g_object_get_data (G_OBJECT (pixmap), "meta-style") == style)
+        return pixmap;
+
+      meta_workspace_invalidate_thumbnail (workspace);
+    }
               
   list = meta_stack_list_windows (workspace->screen->stack, workspace);
   n_windows = g_list_length (list);
@@ -929,12 +1068,12 @@ meta_select_workspace_expose_event (GtkWidget      *widget,
 
   g_list_free (list);
 
+  pixmap = gdk_pixmap_new (widget->window, width, height, -1);
+
   wnck_draw_workspace (widget,
-                       widget->window,
-                       SELECT_OUTLINE_WIDTH,
-                       SELECT_OUTLINE_WIDTH,
-                       widget->allocation.width - SELECT_OUTLINE_WIDTH * 2,
-                       widget->allocation.height - SELECT_OUTLINE_WIDTH * 2,
+                       pixmap,
+                       0, 0,
+                       width, height,
                        workspace->screen->rect.width,
                        workspace->screen->rect.height,
                        NULL,
@@ -943,11 +1082,43 @@ meta_select_workspace_expose_event (GtkWidget      *widget,
                        n_windows);
 
   g_free (windows);
+
+  g_object_set_data (G_OBJECT (pixmap), "meta-style", style);
+  workspace->thumbnail = G_OBJECT (pixmap);
+
+  return pixmap;
+}
+
+static gboolean
+meta_select_workspace_expose_event (GtkWidget      *widget,
+                                    GdkEventExpose *event)
+{
+  MetaWorkspace *workspace;
+  GdkPixmap *thumbnail;
+  GtkStyle *style;
+  cairo_t *cr;
+
+  workspace = META_SELECT_WORKSPACE (widget)->workspace;
+
+  thumbnail = get_workspace_thumbnail (widget, workspace,
+                                       widget->allocation.width - SELECT_OUTLINE_WIDTH * 2,
+                                       widget->allocation.height - SELECT_OUTLINE_WIDTH * 2);
+
+  cr = gdk_cairo_create (widget->window);
+  gdk_cairo_region (cr, event->region);
+  cairo_clip (cr);
+
+  gdk_cairo_set_source_pixmap (cr, thumbnail,
+                               SELECT_OUTLINE_WIDTH, SELECT_OUTLINE_WIDTH);
+  cairo_rectangle (cr,
+                   SELECT_OUTLINE_WIDTH, SELECT_OUTLINE_WIDTH,
+                   widget->allocation.width - SELECT_OUTLINE_WIDTH * 2,
+                   widget->allocation.height - SELECT_OUTLINE_WIDTH * 2);
+  cairo_fill (cr);
   
   if (META_SELECT_WORKSPACE (widget)->selected)
     {
       style = gtk_widget_get_style (widget);
-      cr = gdk_cairo_create (widget->window);
 
       gdk_cairo_set_source_color (cr,
                                   &style->fg[gtk_widget_get_state (widget)]);
@@ -958,10 +1129,10 @@ meta_select_workspace_expose_event (GtkWidget      *widget,
                        widget->allocation.width - SELECT_OUTLINE_WIDTH,
                        widget->allocation.height - SELECT_OUTLINE_WIDTH);
       cairo_stroke (cr);
-
-      cairo_destroy (cr);
     }
 
+  cairo_destroy (cr);
+
   return TRUE;
 }
 
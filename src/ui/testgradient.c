@@ -22,6 +22,8 @@
 
 #include "gradient.h"
 #include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef void (* RenderGradientFunc) (GdkDrawable *drawable,
                                      cairo_t     *cr,
@@ -322,9 +324,249 @@ meta_gradient_test (void)
 
 }
 
+/* Benchmark mode: renders every gradient type at a given size with each
+ * pixel loop implementation the CPU supports, checking the output is
+ * byte for byte the same as the scalar one. Needs no display.
+ */
+typedef GdkPixbuf* (* BenchGradientFunc) (int width,
+                                          int height);
+
+static GdkPixbuf*
+bench_simple (int width, int height, MetaGradientType type)
+{
+  GdkColor from, to;
+
+  gdk_color_parse ("blue", &from);
+  gdk_color_parse ("green", &to);
+
+  return meta_gradient_create_simple (width, height, &from, &to, type);
+}
+
+static GdkPixbuf*
+bench_multi (int width, int height, MetaGradientType type)
+{
+  GdkColor colors[5];
+
+  gdk_color_parse ("red", &colors[0]);
+  gdk_color_parse ("blue", &colors[1]);
+  gdk_color_parse ("orange", &colors[2]);
+  gdk_color_parse ("pink", &colors[3]);
+  gdk_color_parse ("green", &colors[4]);
+
+  return meta_gradient_create_multi (width, height,
+                                     colors, G_N_ELEMENTS (colors), type);
+}
+
+static GdkPixbuf*
+bench_alpha (int width, int height, const guchar *alphas, int n_alphas)
+{
+  GdkPixbuf *pixbuf;
+  GdkPixbuf *with_alpha;
+
+  pixbuf = bench_simple (width, height, META_GRADIENT_VERTICAL);
+  with_alpha = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+  g_object_unref (G_OBJECT (pixbuf));
+
+  meta_gradient_add_alpha (with_alpha, alphas, n_alphas,
+                           META_GRADIENT_HORIZONTAL);
+
+  return with_alpha;
+}
+
+static GdkPixbuf*
+bench_horizontal (int width, int height)
+{
+  return bench_simple (width, height, META_GRADIENT_HORIZONTAL);
+}
+
+static GdkPixbuf*
+bench_vertical (int width, int height)
+{
+  return bench_simple (width, height, META_GRADIENT_VERTICAL);
+}
+
+static GdkPixbuf*
+bench_diagonal (int width, int height)
+{
+  return bench_simple (width, height, META_GRADIENT_DIAGONAL);
+}
+
+static GdkPixbuf*
+bench_multi_horizontal (int width, int height)
+{
+  return bench_multi (width, height, META_GRADIENT_HORIZONTAL);
+}
+
+static GdkPixbuf*
+bench_multi_vertical (int width, int height)
+{
+  return bench_multi (width, height, META_GRADIENT_VERTICAL);
+}
+
+static GdkPixbuf*
+bench_multi_diagonal (int width, int height)
+{
+  return bench_multi (width, height, META_GRADIENT_DIAGONAL);
+}
+
+static GdkPixbuf*
+bench_interwoven (int width, int height)
+{
+  GdkColor colors[4];
+
+  gdk_color_parse ("red", &colors[0]);
+  gdk_color_parse ("blue", &colors[1]);
+  gdk_color_parse ("pink", &colors[2]);
+  gdk_color_parse ("green", &colors[3]);
+
+  return meta_gradient_create_interwoven (width, height,
+                                          colors, MAX (height / 10, 1),
+                                          colors + 2, MAX (height / 14, 1));
+}
+
+static GdkPixbuf*
+bench_alpha_simple (int width, int height)
+{
+  const guchar alphas[] = { 0xaa };
+
+  return bench_alpha (width, height, alphas, G_N_ELEMENTS (alphas));
+}
+
+static GdkPixbuf*
+bench_alpha_horizontal (int width, int height)
+{
+  const guchar alphas[] = { 0xff, 0xaa, 0x2f, 0x0, 0xcc, 0xff, 0xff };
+
+  return bench_alpha (width, height, alphas, G_N_ELEMENTS (alphas));
+}
+
+static gboolean
+pixbufs_equal (GdkPixbuf *a,
+               GdkPixbuf *b)
+{
+  int row_bytes;
+  int row;
+
+  if (gdk_pixbuf_get_width (a) != gdk_pixbuf_get_width (b) ||
+      gdk_pixbuf_get_height (a) != gdk_pixbuf_get_height (b) ||
+      gdk_pixbuf_get_n_channels (a) != gdk_pixbuf_get_n_channels (b))
+    return FALSE;
+
+  row_bytes = gdk_pixbuf_get_width (a) * gdk_pixbuf_get_n_channels (a);
+
+  for (row = 0; row < gdk_pixbuf_get_height (a); row++)
+    {
+      if (memcmp (gdk_pixbuf_get_pixels (a) + row * gdk_pixbuf_get_rowstride (a),
+                  gdk_pixbuf_get_pixels (b) + row * gdk_pixbuf_get_rowstride (b),
+                  row_bytes) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static int
+run_gradient_benchmark (int width,
+                        int height,
+                        int iterations)
+{
+  static const struct
+  {
+    const char *name;
+    BenchGradientFunc func;
+  } cases[] = {
+    { "horizontal", bench_horizontal },
+    { "vertical", bench_vertical },
+    { "diagonal", bench_diagonal },
+    { "multi horizontal", bench_multi_horizontal },
+    { "multi vertical", bench_multi_vertical },
+    { "multi diagonal", bench_multi_diagonal },
+    { "interwoven", bench_interwoven },
+    { "alpha simple", bench_alpha_simple },
+    { "alpha horizontal", bench_alpha_horizontal }
+  };
+  static const char *impl_names[META_GRADIENT_IMPL_LAST] = {
+    "scalar", "sse2", "avx2"
+  };
+  MetaGradientImpl impl;
+  GTimer *timer;
+  int failures;
+  guint i;
+
+  g_print ("Rendering %dx%d gradients, %d iterations each\n",
+           width, height, iterations);
+  g_print ("%-18s %-8s %12s %12s\n",
+           "gradient", "impl", "usec/call", "Mpixels/s");
+
+  timer = g_timer_new ();
+  failures = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      GdkPixbuf *reference;
+
+      meta_gradient_set_impl (META_GRADIENT_IMPL_SCALAR);
+      reference = (* cases[i].func) (width, height);
+
+      for (impl = META_GRADIENT_IMPL_SCALAR; impl < META_GRADIENT_IMPL_LAST; impl++)
+        {
+          GdkPixbuf *pixbuf;
+          double elapsed;
+          int n;
+
+          if (!meta_gradient_set_impl (impl))
+            continue;
+
+          pixbuf = (* cases[i].func) (width, height);
+          if (!pixbufs_equal (reference, pixbuf))
+            {
+              g_printerr ("%s: %s output differs from scalar output\n",
+                          cases[i].name, impl_names[impl]);
+              ++failures;
+            }
+          g_object_unref (G_OBJECT (pixbuf));
+
+          g_timer_start (timer);
+          for (n = 0; n < iterations; n++)
+            g_object_unref (G_OBJECT ((* cases[i].func) (width, height)));
+          g_timer_stop (timer);
+
+          elapsed = g_timer_elapsed (timer, NULL);
+          g_print ("%-18s %-8s %12.1f %12.1f\n",
+                   cases[i].name, impl_names[impl],
+                   elapsed / iterations * 1e6,
+                   ((double) width * height * iterations) / elapsed / 1e6);
+        }
+
+      g_object_unref (G_OBJECT (reference));
+    }
+
+  g_timer_destroy (timer);
+
+  return failures == 0 ? 0 : 1;
+}
+
 int
 main (int argc, char **argv)
 {
+  if (argc > 1 && strcmp (argv[1], "--benchmark") == 0)
+    {
+      int width = argc > 2 ? atoi (argv[2]) : 3840;
+      int height = argc > 3 ? atoi (argv[3]) : 32;
+      int iterations = argc > 4 ? atoi (argv[4]) : 200;
+
+      if (width <= 0 || height <= 0 || iterations <= 0)
+        {
+          g_printerr ("Usage: %s --benchmark [WIDTH [HEIGHT [ITERATIONS]]]\n",
+                      argv[0]);
+          return 1;
+        }
+
+      g_type_init ();
+
+      return run_gradient_benchmark (width, height, iterations);
+    }
+
   gtk_init (&argc, &argv);
 
   meta_gradient_test ();
@@ -0,0 +1,486 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity per-pixel image operation tests */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.  */
+
+/* Checks every implementation in pixels.c against the loops it
+ * replaced, over an image holding every RGB value once, then times
+ * each of them on that image and on a tab popup sized icon.
+ */
+
+#include "pixels.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INTENSITY(r, g, b) ((r) * 0.30 + (g) * 0.59 + (b) * 0.11)
+#define CLAMP_UCHAR(v) ((guchar) (CLAMP (((int)v), (int)0, (int)255)))
+
+/* grayscale_pixbuf() from metacity-grayscale.c */
+static GdkPixbuf*
+old_grayscale (GdkPixbuf *pixbuf)
+{
+  GdkPixbuf *gray;
+  guchar *pixels;
+  int rowstride;
+  int pixstride;
+  int row;
+  int n_rows;
+  int width;
+
+  gray = gdk_pixbuf_copy (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (gray);
+  pixstride = gdk_pixbuf_get_has_alpha (gray) ? 4 : 3;
+
+  pixels = gdk_pixbuf_get_pixels (gray);
+  n_rows = gdk_pixbuf_get_height (gray);
+  width = gdk_pixbuf_get_width (gray);
+
+  row = 0;
+  while (row < n_rows)
+    {
+      guchar *p = pixels + row * rowstride;
+      guchar *end = p + (pixstride * width);
+
+      while (p != end)
+        {
+          double v = INTENSITY (p[0], p[1], p[2]);
+
+          p[0] = (guchar) v;
+          p[1] = (guchar) v;
+          p[2] = (guchar) v;
+
+          p += pixstride;
+        }
+
+      ++row;
+    }
+
+  return gray;
+}
+
+/* dimm_icon() from tabpopup.c */
+static GdkPixbuf*
+old_dim (GdkPixbuf *pixbuf)
+{
+  int x, y, pixel_stride, row_stride;
+  guchar *row, *pixels;
+  int w, h;
+  GdkPixbuf *dimmed_pixbuf;
+
+  if (gdk_pixbuf_get_has_alpha (pixbuf))
+    dimmed_pixbuf = gdk_pixbuf_copy (pixbuf);
+  else
+    dimmed_pixbuf = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+
+  w = gdk_pixbuf_get_width (dimmed_pixbuf);
+  h = gdk_pixbuf_get_height (dimmed_pixbuf);
+
+  pixel_stride = 4;
+
+  row = gdk_pixbuf_get_pixels (dimmed_pixbuf);
+  row_stride = gdk_pixbuf_get_rowstride (dimmed_pixbuf);
+
+  for (y = 0; y < h; y++)
+    {
+      pixels = row;
+      for (x = 0; x < w; x++)
+        {
+          pixels[3] /= 2;
+          pixels += pixel_stride;
+        }
+      row += row_stride;
+    }
+  return dimmed_pixbuf;
+}
+
+/* colorize_pixbuf() from theme.c */
+static GdkPixbuf*
+old_colorize (GdkPixbuf      *orig,
+              const GdkColor *new_color)
+{
+  GdkPixbuf *pixbuf;
+  double intensity;
+  int x, y;
+  const guchar *src;
+  guchar *dest;
+  int orig_rowstride;
+  int dest_rowstride;
+  int width, height;
+  gboolean has_alpha;
+  const guchar *src_pixels;
+  guchar *dest_pixels;
+
+  pixbuf = gdk_pixbuf_new (gdk_pixbuf_get_colorspace (orig), gdk_pixbuf_get_has_alpha (orig),
+                           gdk_pixbuf_get_bits_per_sample (orig),
+                           gdk_pixbuf_get_width (orig), gdk_pixbuf_get_height (orig));
+
+  if (pixbuf == NULL)
+    return NULL;
+
+  orig_rowstride = gdk_pixbuf_get_rowstride (orig);
+  dest_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+  has_alpha = gdk_pixbuf_get_has_alpha (orig);
+  src_pixels = gdk_pixbuf_get_pixels (orig);
+  dest_pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  for (y = 0; y < height; y++)
+    {
+      src = src_pixels + y * orig_rowstride;
+      dest = dest_pixels + y * dest_rowstride;
+
+      for (x = 0; x < width; x++)
+        {
+          double dr, dg, db;
+
+          intensity = INTENSITY (src[0], src[1], src[2]) / 255.0;
+
+          if (intensity <= 0.5)
+            {
+              /* Go from black at intensity = 0.0 to new_color at intensity = 0.5 */
+              dr = (new_color->red * intensity * 2.0) / 65535.0;
+              dg = (new_color->green * intensity * 2.0) / 65535.0;
+              db = (new_color->blue * intensity * 2.0) / 65535.0;
+            }
+          else
+            {
+              /* Go from new_color at intensity = 0.5 to white at intensity = 1.0 */
+              dr = (new_color->red + (65535 - new_color->red) * (intensity - 0.5) * 2.0) / 65535.0;
+              dg = (new_color->green + (65535 - new_color->green) * (intensity - 0.5) * 2.0) / 65535.0;
+              db = (new_color->blue + (65535 - new_color->blue) * (intensity - 0.5) * 2.0) / 65535.0;
+            }
+
+          dest[0] = CLAMP_UCHAR (255 * dr);
+          dest[1] = CLAMP_UCHAR (255 * dg);
+          dest[2] = CLAMP_UCHAR (255 * db);
+
+          if (has_alpha)
+            {
+              dest[3] = src[3];
+              src += 4;
+              dest += 4;
+            }
+          else
+            {
+              src += 3;
+              dest += 3;
+            }
+        }
+    }
+
+  return pixbuf;
+}
+
+/* 4096x4096, pixel (x, y) being R = x / 16, G = y / 16 and
+ * B = (y % 16) * 16 + x % 16, so every RGB value turns up once
+ */
+static GdkPixbuf*
+every_color (gboolean has_alpha)
+{
+  GdkPixbuf *pixbuf;
+  guchar *pixels;
+  int rowstride;
+  int pixstride;
+  int x, y;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, 4096, 4096);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  pixstride = has_alpha ? 4 : 3;
+
+  for (y = 0; y < 4096; y++)
+    {
+      guchar *p = pixels + y * rowstride;
+
+      for (x = 0; x < 4096; x++)
+        {
+          p[0] = x / 16;
+          p[1] = y / 16;
+          p[2] = (y % 16) * 16 + x % 16;
+          if (has_alpha)
+            p[3] = x ^ y;
+
+          p += pixstride;
+        }
+    }
+
+  return pixbuf;
+}
+
+static gboolean
+pixbufs_equal (GdkPixbuf *a,
+               GdkPixbuf *b)
+{
+  int row_bytes;
+  int row;
+
+  if (gdk_pixbuf_get_width (a) != gdk_pixbuf_get_width (b) ||
+      gdk_pixbuf_get_height (a) != gdk_pixbuf_get_height (b) ||
+      gdk_pixbuf_get_n_channels (a) != gdk_pixbuf_get_n_channels (b))
+    return FALSE;
+
+  row_bytes = gdk_pixbuf_get_width (a) * gdk_pixbuf_get_n_channels (a);
+
+  for (row = 0; row < gdk_pixbuf_get_height (a); row++)
+    {
+      if (memcmp (gdk_pixbuf_get_pixels (a) + row * gdk_pixbuf_get_rowstride (a),
+                  gdk_pixbuf_get_pixels (b) + row * gdk_pixbuf_get_rowstride (b),
+                  row_bytes) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Packs an RGB pixbuf into 32-bit xRGB rows in the given byte order,
+ * runs them back through every implementation and compares.  The
+ * pad byte is junk, as it can be in a real readback.
+ */
+static int
+check_xrgb32 (GdkPixbuf  *rgb,
+              const char *impl_names[])
+{
+  int width, height;
+  guchar *data;
+  MetaPixelsImpl impl;
+  int lsb_first;
+  int failures;
+  int x, y;
+
+  width = gdk_pixbuf_get_width (rgb);
+  height = gdk_pixbuf_get_height (rgb);
+  data = g_malloc (width * height * 4);
+  failures = 0;
+
+  for (lsb_first = 0; lsb_first < 2; lsb_first++)
+    {
+      for (y = 0; y < height; y++)
+        {
+          const guchar *p = gdk_pixbuf_get_pixels (rgb) +
+            y * gdk_pixbuf_get_rowstride (rgb);
+          guchar *q = data + y * width * 4;
+
+          for (x = 0; x < width; x++)
+            {
+              if (lsb_first)
+                {
+                  q[0] = p[2];
+                  q[1] = p[1];
+                  q[2] = p[0];
+                  q[3] = x ^ y;
+                }
+              else
+                {
+                  q[0] = x ^ y;
+                  q[1] = p[0];
+                  q[2] = p[1];
+                  q[3] = p[2];
+                }
+              p += 3;
+              q += 4;
+            }
+        }
+
+      for (impl = META_PIXELS_IMPL_SCALAR; impl < META_PIXELS_IMPL_LAST; impl++)
+        {
+          GdkPixbuf *pixbuf;
+
+          if (!meta_pixels_set_impl (impl))
+            continue;
+
+          pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+          meta_pixels_from_xrgb32 (pixbuf, data, width * 4, lsb_first);
+          if (!pixbufs_equal (rgb, pixbuf))
+            {
+              g_printerr ("xrgb32 %dx%d (%s, %s): output differs from the source\n",
+                          width, height, lsb_first ? "LSBFirst" : "MSBFirst",
+                          impl_names[impl]);
+              ++failures;
+            }
+          g_object_unref (G_OBJECT (pixbuf));
+        }
+    }
+
+  g_free (data);
+
+  return failures;
+}
+
+/* Black and white are the colors for which the most pixels still get
+ * done in doubles.
+ */
+static const char *colors[] = {
+  "black", "white", "#3465a4", "#ff0000", "#808080"
+};
+
+typedef enum
+{
+  OP_GRAYSCALE,
+  OP_DIM,
+  OP_COLORIZE,
+  OP_LAST
+} Op;
+
+static const char *op_names[OP_LAST] = {
+  "grayscale", "dim", "colorize"
+};
+
+static GdkPixbuf*
+run_op (Op              op,
+        gboolean        old,
+        GdkPixbuf      *pixbuf,
+        const GdkColor *color)
+{
+  switch (op)
+    {
+    case OP_GRAYSCALE:
+      return old ? old_grayscale (pixbuf) : meta_pixels_grayscale (pixbuf);
+    case OP_DIM:
+      return old ? old_dim (pixbuf) : meta_pixels_dim (pixbuf);
+    case OP_COLORIZE:
+      return old ? old_colorize (pixbuf, color) : meta_pixels_colorize (pixbuf, color);
+    case OP_LAST:
+      break;
+    }
+
+  g_assert_not_reached ();
+  return NULL;
+}
+
+static double
+time_op (Op              op,
+         gboolean        old,
+         GdkPixbuf      *pixbuf,
+         const GdkColor *color,
+         int             iterations)
+{
+  GTimer *timer;
+  double elapsed;
+  int n;
+
+  timer = g_timer_new ();
+  for (n = 0; n < iterations; n++)
+    g_object_unref (G_OBJECT (run_op (op, old, pixbuf, color)));
+  g_timer_stop (timer);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed / iterations * 1e6;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const char *impl_names[META_PIXELS_IMPL_LAST] = {
+    "scalar", "sse2", "avx2"
+  };
+  GdkPixbuf *images[2];
+  GdkPixbuf *icon;
+  GdkColor color;
+  MetaPixelsImpl impl;
+  int iterations;
+  int failures;
+  int alpha;
+  Op op;
+  guint i;
+
+  iterations = argc > 1 ? atoi (argv[1]) : 2000;
+  if (iterations <= 0)
+    {
+      g_printerr ("Usage: %s [ITERATIONS]\n", argv[0]);
+      return 1;
+    }
+
+  g_type_init ();
+
+  images[0] = every_color (FALSE);
+  images[1] = every_color (TRUE);
+  failures = 0;
+
+  for (alpha = 0; alpha < 2; alpha++)
+    for (op = 0; op < OP_LAST; op++)
+      for (i = 0; i < (op == OP_COLORIZE ? G_N_ELEMENTS (colors) : 1); i++)
+        {
+          GdkPixbuf *reference;
+
+          gdk_color_parse (colors[i], &color);
+          reference = run_op (op, TRUE, images[alpha], &color);
+
+          for (impl = META_PIXELS_IMPL_SCALAR; impl < META_PIXELS_IMPL_LAST; impl++)
+            {
+              GdkPixbuf *pixbuf;
+
+              if (!meta_pixels_set_impl (impl))
+                continue;
+
+              pixbuf = run_op (op, FALSE, images[alpha], &color);
+              if (!pixbufs_equal (reference, pixbuf))
+                {
+                  g_printerr ("%s %s (%s, %s): output differs from the old code\n",
+                              op_names[op], alpha ? "RGBA" : "RGB",
+                              op == OP_COLORIZE ? colors[i] : "-",
+                              impl_names[impl]);
+                  ++failures;
+                }
+              g_object_unref (G_OBJECT (pixbuf));
+            }
+
+          g_object_unref (G_OBJECT (reference));
+        }
+
+  /* The odd width leaves a tail for the vector loops */
+  failures += check_xrgb32 (images[0], impl_names);
+  icon = gdk_pixbuf_new_subpixbuf (images[0], 0, 0, 4093, 16);
+  failures += check_xrgb32 (icon, impl_names);
+  g_object_unref (G_OBJECT (icon));
+
+  if (failures == 0)
+    g_print ("All implementations match the old code for every RGB value\n");
+
+  /* Time them on a 48x48 icon, what the tab popup dims */
+  icon = gdk_pixbuf_new_subpixbuf (images[1], 1024, 1024, 48, 48);
+  gdk_color_parse (colors[2], &color);
+
+  g_print ("%d iterations on a 48x48 RGBA icon\n", iterations);
+  g_print ("%-10s %-8s %12s\n", "op", "impl", "usec/call");
+
+  for (op = 0; op < OP_LAST; op++)
+    {
+      g_print ("%-10s %-8s %12.2f\n", op_names[op], "old",
+               time_op (op, TRUE, icon, &color, iterations));
+
+      for (impl = META_PIXELS_IMPL_SCALAR; impl < META_PIXELS_IMPL_LAST; impl++)
+        {
+          if (!meta_pixels_set_impl (impl))
+            continue;
+
+          g_print ("%-10s %-8s %12.2f\n", op_names[op], impl_names[impl],
+                   time_op (op, FALSE, icon, &color, iterations));
+        }
+    }
+
+  g_object_unref (G_OBJECT (icon));
+  g_object_unref (G_OBJECT (images[0]));
+  g_object_unref (G_OBJECT (images[1]));
+
+  return failures == 0 ? 0 : 1;
+}
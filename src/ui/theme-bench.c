@@ -0,0 +1,539 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity theme rendering benchmark */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Draws frames for every theme in the source tree across a matrix of
+ * client sizes, frame types, frame states and button states, into
+ * pixmaps that are never shown, and prints percentile timings as
+ * tab-separated lines so runs can be diffed and graphed.
+ *
+ * Each combination is timed three ways: drawing the whole frame, the
+ * way the theme viewer and a cache miss in frames.c do; filling the
+ * four cached border pieces frames.c keeps per frame; and painting
+ * those pieces back, which is what an expose costs on a cache hit.
+ * A second, separately timed draw of each frame reports every draw
+ * op through meta_draw_op_set_timing_func(), giving per-op-type
+ * timings for each theme.
+ *
+ * GTK needs an X display, but nothing is mapped, so any server will
+ * do; run it under Xvfb on a machine without one.  Run it from the
+ * src directory so the themes are loaded from the source tree.
+ */
+
+#include <config.h>
+#include "util.h"
+#include "theme-private.h"
+#include "theme-parser.h"
+#include "preview-widget.h"
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERATIONS 20
+
+#define SOURCE_THEMES_DIR "./themes"
+
+static const struct
+{
+  int width;
+  int height;
+} client_sizes[] = {
+  { 80, 40 },
+  { 400, 300 },
+  { 1280, 960 }
+};
+
+#define BASE_FLAGS (META_FRAME_ALLOWS_DELETE |            \
+                    META_FRAME_ALLOWS_MENU |              \
+                    META_FRAME_ALLOWS_MINIMIZE |          \
+                    META_FRAME_ALLOWS_MAXIMIZE |          \
+                    META_FRAME_ALLOWS_VERTICAL_RESIZE |   \
+                    META_FRAME_ALLOWS_HORIZONTAL_RESIZE | \
+                    META_FRAME_ALLOWS_SHADE |             \
+                    META_FRAME_ALLOWS_MOVE)
+
+static const struct
+{
+  const char *name;
+  MetaFrameFlags flags;
+} frame_states[] = {
+  { "focused",   BASE_FLAGS | META_FRAME_HAS_FOCUS },
+  { "unfocused", BASE_FLAGS },
+  { "maximized", BASE_FLAGS | META_FRAME_HAS_FOCUS | META_FRAME_MAXIMIZED },
+  { "shaded",    BASE_FLAGS | META_FRAME_HAS_FOCUS | META_FRAME_SHADED }
+};
+
+/* State of the close button; the others stay normal, as they do
+ * while the pointer is over just one of them.
+ */
+static const struct
+{
+  const char *name;
+  MetaButtonState close_state;
+} button_states[] = {
+  { "normal",   META_BUTTON_STATE_NORMAL },
+  { "prelight", META_BUTTON_STATE_PRELIGHT },
+  { "pressed",  META_BUTTON_STATE_PRESSED }
+};
+
+#define N_DRAW_TYPES (META_DRAW_TILE + 1)
+
+typedef struct
+{
+  GtkWidget *widget;
+  PangoLayout *layout;
+  int text_height;
+  MetaButtonLayout button_layout;
+  GdkPixbuf *mini_icon;
+  GdkPixbuf *icon;
+  int iterations;
+} BenchContext;
+
+static void
+print_percentiles (GArray *samples)
+{
+  gint64 *values;
+  guint n;
+
+  values = (gint64 *) samples->data;
+  n = samples->len;
+
+  if (n == 0)
+    {
+      g_print ("\t0\t-\t-\t-\t-\t-\n");
+      return;
+    }
+
+  /* Nearest rank */
+#define PERCENTILE(p) values[((n - 1) * (p)) / 100]
+  g_print ("\t%u\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+           "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+           "\t%" G_GINT64_FORMAT "\n",
+           n, values[0], PERCENTILE (50), PERCENTILE (90),
+           PERCENTILE (99), values[n - 1]);
+#undef PERCENTILE
+}
+
+static int
+compare_samples (const void *a,
+                 const void *b)
+{
+  gint64 sample_a = *(const gint64 *) a;
+  gint64 sample_b = *(const gint64 *) b;
+
+  if (sample_a < sample_b)
+    return -1;
+  else if (sample_a > sample_b)
+    return 1;
+  else
+    return 0;
+}
+
+static void
+sort_samples (GArray *samples)
+{
+  qsort (samples->data, samples->len, sizeof (gint64), compare_samples);
+}
+
+static void
+record_draw_op (MetaDrawType type,
+                gint64       usec,
+                gpointer     data)
+{
+  GArray **op_samples = data;
+
+  g_array_append_val (op_samples[type], usec);
+}
+
+static gint64
+elapsed_usec (const GTimeVal *start)
+{
+  GTimeVal now;
+
+  g_get_current_time (&now);
+
+  return (now.tv_sec - start->tv_sec) * G_USEC_PER_SEC +
+    (now.tv_usec - start->tv_usec);
+}
+
+static void
+draw_frame (BenchContext    *ctx,
+            MetaTheme       *theme,
+            GdkDrawable     *drawable,
+            GdkRectangle    *clip,
+            int              x_offset,
+            int              y_offset,
+            MetaFrameType    type,
+            MetaFrameFlags   flags,
+            int              client_width,
+            int              client_height,
+            MetaButtonState  states[META_BUTTON_TYPE_LAST])
+{
+  meta_theme_draw_frame (theme,
+                         ctx->widget,
+                         drawable,
+                         clip,
+                         x_offset, y_offset,
+                         type,
+                         flags,
+                         client_width, client_height,
+                         ctx->layout,
+                         ctx->text_height,
+                         &ctx->button_layout,
+                         states,
+                         ctx->mini_icon,
+                         ctx->icon);
+}
+
+/* The same four pieces populate_cache() in frames.c sets up */
+static void
+get_cache_pieces (int           client_width,
+                  int           client_height,
+                  int           top,
+                  int           bottom,
+                  int           left,
+                  int           right,
+                  GdkRectangle  pieces[4])
+{
+  pieces[0].x = 0;
+  pieces[0].y = 0;
+  pieces[0].width = left + client_width + right;
+  pieces[0].height = top;
+
+  pieces[1].x = 0;
+  pieces[1].y = top;
+  pieces[1].width = left;
+  pieces[1].height = client_height;
+
+  pieces[2].x = left + client_width;
+  pieces[2].y = top;
+  pieces[2].width = right;
+  pieces[2].height = client_height;
+
+  pieces[3].x = 0;
+  pieces[3].y = top + client_height;
+  pieces[3].width = left + client_width + right;
+  pieces[3].height = bottom;
+}
+
+static void
+bench_combination (BenchContext    *ctx,
+                   MetaTheme       *theme,
+                   MetaFrameType    type,
+                   int              size,
+                   int              state,
+                   int              buttons,
+                   GArray         **op_samples)
+{
+  MetaButtonState states[META_BUTTON_TYPE_LAST];
+  MetaFrameFlags flags;
+  GdkRectangle pieces[4];
+  GdkPixmap *piece_pixmaps[4];
+  GArray *draw_samples;
+  GArray *fill_samples;
+  GArray *hit_samples;
+  int client_width;
+  int client_height;
+  int top, bottom, left, right;
+  int i;
+  int j;
+
+  flags = frame_states[state].flags;
+  client_width = client_sizes[size].width;
+  client_height = client_sizes[size].height;
+  if (flags & META_FRAME_SHADED)
+    client_height = 0;
+
+  for (i = 0; i < META_BUTTON_TYPE_LAST; i++)
+    states[i] = META_BUTTON_STATE_NORMAL;
+  states[META_BUTTON_TYPE_CLOSE] = button_states[buttons].close_state;
+
+  meta_theme_get_frame_borders (theme, type, ctx->text_height, flags,
+                                &top, &bottom, &left, &right);
+  get_cache_pieces (client_width, client_height,
+                    top, bottom, left, right, pieces);
+
+  draw_samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  fill_samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  hit_samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  for (i = 0; i < ctx->iterations; i++)
+    {
+      GdkPixmap *pixmap;
+      GTimeVal start;
+      gint64 usec;
+      cairo_t *cr;
+
+      /* Creating the pixmap each time is right, since GDK does the
+       * same with its double buffering.
+       */
+      g_get_current_time (&start);
+      pixmap = gdk_pixmap_new (ctx->widget->window,
+                               left + client_width + right,
+                               top + client_height + bottom,
+                               -1);
+      draw_frame (ctx, theme, pixmap, NULL, 0, 0, type, flags,
+                  client_width, client_height, states);
+      gdk_flush ();
+      usec = elapsed_usec (&start);
+      g_array_append_val (draw_samples, usec);
+
+      /* Like generate_pixmap() in frames.c */
+      g_get_current_time (&start);
+      for (j = 0; j < 4; j++)
+        {
+          piece_pixmaps[j] = gdk_pixmap_new (ctx->widget->window,
+                                             MAX (pieces[j].width, 1),
+                                             MAX (pieces[j].height, 1),
+                                             -1);
+          draw_frame (ctx, theme, piece_pixmaps[j], &pieces[j],
+                      -pieces[j].x, -pieces[j].y, type, flags,
+                      client_width, client_height, states);
+        }
+      gdk_flush ();
+      usec = elapsed_usec (&start);
+      g_array_append_val (fill_samples, usec);
+
+      /* Like cached_pixels_draw() in frames.c */
+      g_get_current_time (&start);
+      cr = gdk_cairo_create (pixmap);
+      for (j = 0; j < 4; j++)
+        {
+          gdk_cairo_set_source_pixmap (cr, piece_pixmaps[j],
+                                       pieces[j].x, pieces[j].y);
+          cairo_paint (cr);
+        }
+      cairo_destroy (cr);
+      gdk_flush ();
+      usec = elapsed_usec (&start);
+      g_array_append_val (hit_samples, usec);
+
+      for (j = 0; j < 4; j++)
+        g_object_unref (G_OBJECT (piece_pixmaps[j]));
+
+      /* Kept apart from the timings above, since timing each op
+       * means waiting for the server after each one.
+       */
+      meta_draw_op_set_timing_func (record_draw_op, op_samples);
+      draw_frame (ctx, theme, pixmap, NULL, 0, 0, type, flags,
+                  client_width, client_height, states);
+      meta_draw_op_set_timing_func (NULL, NULL);
+
+      g_object_unref (G_OBJECT (pixmap));
+    }
+
+  sort_samples (draw_samples);
+  sort_samples (fill_samples);
+  sort_samples (hit_samples);
+
+#define PRINT_KEY(what)                                                 \
+  g_print ("%s\t%s\t%s\t%s\t%s\t%dx%d", what, theme->name,              \
+           meta_frame_type_to_string (type), frame_states[state].name,  \
+           button_states[buttons].name,                                 \
+           client_sizes[size].width, client_sizes[size].height)
+
+  PRINT_KEY ("frame");
+  print_percentiles (draw_samples);
+  PRINT_KEY ("cache-fill");
+  print_percentiles (fill_samples);
+  PRINT_KEY ("cache-hit");
+  print_percentiles (hit_samples);
+#undef PRINT_KEY
+
+  g_array_free (draw_samples, TRUE);
+  g_array_free (fill_samples, TRUE);
+  g_array_free (hit_samples, TRUE);
+}
+
+static gboolean
+bench_theme (BenchContext *ctx,
+             const char   *name)
+{
+  MetaTheme *theme;
+  GArray *op_samples[N_DRAW_TYPES];
+  GError *err;
+  MetaFrameType type;
+  int size;
+  int state;
+  int buttons;
+  int i;
+
+  err = NULL;
+  theme = meta_theme_load (name, &err);
+  if (theme == NULL)
+    {
+      g_printerr ("Error loading theme %s: %s\n", name, err->message);
+      g_error_free (err);
+      return FALSE;
+    }
+
+  for (i = 0; i < N_DRAW_TYPES; i++)
+    op_samples[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  for (type = 0; type < META_FRAME_TYPE_LAST; type++)
+    for (size = 0; size < (int) G_N_ELEMENTS (client_sizes); size++)
+      for (state = 0; state < (int) G_N_ELEMENTS (frame_states); state++)
+        for (buttons = 0; buttons < (int) G_N_ELEMENTS (button_states); buttons++)
+          bench_combination (ctx, theme, type, size, state, buttons,
+                             op_samples);
+
+  for (i = 0; i < N_DRAW_TYPES; i++)
+    {
+      if (op_samples[i]->len > 0)
+        {
+          sort_samples (op_samples[i]);
+          g_print ("op\t%s\t%s\t-\t-\t-", theme->name,
+                   meta_draw_type_to_string (i));
+          print_percentiles (op_samples[i]);
+        }
+      g_array_free (op_samples[i], TRUE);
+    }
+
+  meta_theme_free (theme);
+
+  return TRUE;
+}
+
+static int
+compare_theme_names (const void *a,
+                     const void *b)
+{
+  return strcmp (*(const char * const *) a, *(const char * const *) b);
+}
+
+/* Every directory in src/themes, sorted so runs line up, as a NULL
+ * terminated array to free with g_strfreev(); NULL if the directory
+ * can't be read.
+ */
+static char**
+list_source_themes (void)
+{
+  GDir *dir;
+  GPtrArray *names;
+  const char *name;
+  GError *err;
+
+  err = NULL;
+  dir = g_dir_open (SOURCE_THEMES_DIR, 0, &err);
+  if (dir == NULL)
+    {
+      g_printerr ("Failed to list themes: %s\n", err->message);
+      g_error_free (err);
+      return NULL;
+    }
+
+  names = g_ptr_array_new ();
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      char *path;
+
+      path = g_build_filename (SOURCE_THEMES_DIR, name, NULL);
+      if (g_file_test (path, G_FILE_TEST_IS_DIR))
+        g_ptr_array_add (names, g_strdup (name));
+      g_free (path);
+    }
+  g_dir_close (dir);
+
+  qsort (names->pdata, names->len, sizeof (char *), compare_theme_names);
+  g_ptr_array_add (names, NULL);
+
+  return (char **) g_ptr_array_free (names, FALSE);
+}
+
+int
+main (int argc, char **argv)
+{
+  BenchContext ctx;
+  const char **themes;
+  char **source_themes;
+  gboolean ok;
+  int i;
+
+  gtk_init (&argc, &argv);
+
+  /* Makes meta_theme_load() look in ./themes first */
+  meta_set_debugging (TRUE);
+
+  ctx.iterations = DEFAULT_ITERATIONS;
+  source_themes = NULL;
+
+  i = 1;
+  if (argc > 2 && strcmp (argv[1], "-n") == 0)
+    {
+      ctx.iterations = atoi (argv[2]);
+      i = 3;
+    }
+  if (ctx.iterations <= 0 || (i < argc && argv[i][0] == '-'))
+    {
+      g_printerr ("Usage: theme-bench [-n ITERATIONS] [THEMENAME...]\n");
+      return 1;
+    }
+  if (i < argc)
+    themes = (const char **) &argv[i];
+  else
+    {
+      source_themes = list_source_themes ();
+      if (source_themes == NULL)
+        return 1;
+      themes = (const char **) source_themes;
+    }
+
+  ctx.widget = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_widget_realize (ctx.widget);
+
+  ctx.layout = gtk_widget_create_pango_layout (ctx.widget,
+                                               "Window Title Goes Here");
+  ctx.text_height =
+    meta_pango_font_desc_get_text_height (ctx.widget->style->font_desc,
+                                          gtk_widget_get_pango_context (ctx.widget));
+  ctx.mini_icon = meta_preview_get_mini_icon ();
+  ctx.icon = meta_preview_get_icon ();
+
+  for (i = 0; i < MAX_BUTTONS_PER_CORNER; i++)
+    {
+      ctx.button_layout.left_buttons[i] = META_BUTTON_FUNCTION_LAST;
+      ctx.button_layout.right_buttons[i] = META_BUTTON_FUNCTION_LAST;
+    }
+  ctx.button_layout.left_buttons[0] = META_BUTTON_FUNCTION_MENU;
+  ctx.button_layout.right_buttons[0] = META_BUTTON_FUNCTION_MINIMIZE;
+  ctx.button_layout.right_buttons[1] = META_BUTTON_FUNCTION_MAXIMIZE;
+  ctx.button_layout.right_buttons[2] = META_BUTTON_FUNCTION_CLOSE;
+
+  /* Times are in microseconds.  Frame rows are keyed by theme, frame
+   * type, frame state, close button state and client size; op rows
+   * by theme and draw op type.
+   */
+  g_print ("#kind\ttheme\ttype\tstate\tbuttons\tsize"
+           "\tcount\tmin\tp50\tp90\tp99\tmax\n");
+
+  ok = TRUE;
+  for (i = 0; themes[i] != NULL; i++)
+    if (!bench_theme (&ctx, themes[i]))
+      ok = FALSE;
+
+  g_object_unref (G_OBJECT (ctx.layout));
+  gtk_widget_destroy (ctx.widget);
+  g_strfreev (source_themes);
+
+  return ok ? 0 : 1;
+}
@@ -276,10 +276,10 @@ parse_info_free (ParseInfo *info)
   g_free (info->theme_dir);
 
   g_slist_free (info->states);
-  
-  if (info->theme)
-    meta_theme_free (info->theme);
 
+  /* The theme goes last, since freeing ops that draw images uses the
+   * theme's image cache
+   */
   if (info->layout)
     meta_frame_layout_unref (info->layout);
 
@@ -294,6 +294,9 @@ parse_info_free (ParseInfo *info)
 
   if (info->style_set)
     meta_frame_style_set_unref (info->style_set);
+
+  if (info->theme)
+    meta_theme_free (info->theme);
 }
 
 static void
@@ -2159,6 +2162,7 @@ parse_draw_op_element (GMarkupParseContext  *context,
 
       op->data.image.pixbuf = pixbuf;
       op->data.image.colorize_spec = colorize_spec;
+      op->data.image.cache = info->theme->image_cache;
 
       op->data.image.x = meta_draw_spec_new (info->theme, x, NULL);
       op->data.image.y = meta_draw_spec_new (info->theme, y, NULL);
@@ -3915,12 +3919,17 @@ meta_theme_load (const char *theme_name,
   theme_dir = NULL;
   theme_file = NULL;
   
-  if (meta_is_debugging ())
+  /* Try in themes in our source tree, most of which only have a
+   * version 1 file.  Leaves version one below the file found, as
+   * the loop below does.
+   */
+  for (version = THEME_VERSION;
+       meta_is_debugging () && (version > 0) && (text == NULL);
+       version--)
     {
       gchar *theme_filename = g_strdup_printf (METACITY_THEME_FILENAME_FORMAT,
-                                               THEME_VERSION);
+                                               version);
 
-      /* Try in themes in our source tree */
       theme_dir = g_build_filename ("./themes", theme_name, NULL);
       
       theme_file = g_build_filename (theme_dir,
@@ -3940,13 +3949,14 @@ meta_theme_load (const char *theme_name,
           g_free (theme_file);
           theme_file = NULL;
         }
-      version = THEME_VERSION;
 
       g_free (theme_filename);
     }
   
   /* We try all supported versions from current to oldest */
-  for (version = THEME_VERSION; (version > 0) && (text == NULL); version--)
+  for (version = (text == NULL) ? THEME_VERSION : version;
+       (version > 0) && (text == NULL);
+       version--)
     {
       gchar *theme_filename = g_strdup_printf (METACITY_THEME_FILENAME_FORMAT,
                                                version);
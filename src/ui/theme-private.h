@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Metacity Theme Rendering: hooks for the tools in the source tree,
+ * kept out of the installed theme.h
+ */
+
+/* 
+ * Copyright (C) 2001 Havoc Pennington
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef META_THEME_PRIVATE_H
+#define META_THEME_PRIVATE_H
+
+#include "theme.h"
+
+/* Called after every op an op list draws while set, with the time the
+ * op took including the X server's share.  An include or tile op is
+ * reported with the time of everything it drew, after its own ops have
+ * been reported individually.  For benchmarking; pass NULL to stop.
+ */
+typedef void (* MetaDrawOpTimingFunc) (MetaDrawType type,
+                                       gint64       usec,
+                                       gpointer     data);
+
+void            meta_draw_op_set_timing_func (MetaDrawOpTimingFunc func,
+                                              gpointer             data);
+
+#endif
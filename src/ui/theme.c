@@ -53,10 +53,11 @@
  */
 
 #include <config.h>
-#include "theme.h"
+#include "theme-private.h"
 #include "theme-parser.h"
 #include "util.h"
 #include "gradient.h"
+#include "pixels.h"
 #include <gtk/gtk.h>
 #include <string.h>
 #include <stdlib.h>
@@ -77,8 +78,6 @@
 #define ALPHA_TO_UCHAR(d) ((unsigned char) ((d) * 255))
 
 #define DEBUG_FILL_STRUCT(s) memset ((s), 0xef, sizeof (*(s)))
-#define CLAMP_UCHAR(v) ((guchar) (CLAMP (((int)v), (int)0, (int)255)))
-#define INTENSITY(r, g, b) ((r) * 0.30 + (g) * 0.59 + (b) * 0.11)
 
 static void gtk_style_shade		(GdkColor	 *a,
 					 GdkColor	 *b,
@@ -95,84 +94,6 @@ static void hls_to_rgb			(gdouble	 *h,
  */
 static MetaTheme *meta_current_theme = NULL;
 
-static GdkPixbuf *
-colorize_pixbuf (GdkPixbuf *orig,
-                 GdkColor  *new_color)
-{
-  GdkPixbuf *pixbuf;
-  double intensity;
-  int x, y;
-  const guchar *src;
-  guchar *dest;
-  int orig_rowstride;
-  int dest_rowstride;
-  int width, height;
-  gboolean has_alpha;
-  const guchar *src_pixels;
-  guchar *dest_pixels;
-  
-  pixbuf = gdk_pixbuf_new (gdk_pixbuf_get_colorspace (orig), gdk_pixbuf_get_has_alpha (orig),
-			   gdk_pixbuf_get_bits_per_sample (orig),
-			   gdk_pixbuf_get_width (orig), gdk_pixbuf_get_height (orig));
-
-  if (pixbuf == NULL)
-    return NULL;
-  
-  orig_rowstride = gdk_pixbuf_get_rowstride (orig);
-  dest_rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
-  has_alpha = gdk_pixbuf_get_has_alpha (orig);
-  src_pixels = gdk_pixbuf_get_pixels (orig);
-  dest_pixels = gdk_pixbuf_get_pixels (pixbuf);
-  
-  for (y = 0; y < height; y++)
-    {
-      src = src_pixels + y * orig_rowstride;
-      dest = dest_pixels + y * dest_rowstride;
-
-      for (x = 0; x < width; x++)
-        {
-          double dr, dg, db;
-          
-          intensity = INTENSITY (src[0], src[1], src[2]) / 255.0;
-
-          if (intensity <= 0.5)
-            {
-              /* Go from black at intensity = 0.0 to new_color at intensity = 0.5 */
-              dr = (new_color->red * intensity * 2.0) / 65535.0;
-              dg = (new_color->green * intensity * 2.0) / 65535.0;
-              db = (new_color->blue * intensity * 2.0) / 65535.0;
-            }
-          else
-            {
-              /* Go from new_color at intensity = 0.5 to white at intensity = 1.0 */
-              dr = (new_color->red + (65535 - new_color->red) * (intensity - 0.5) * 2.0) / 65535.0;
-              dg = (new_color->green + (65535 - new_color->green) * (intensity - 0.5) * 2.0) / 65535.0;
-              db = (new_color->blue + (65535 - new_color->blue) * (intensity - 0.5) * 2.0) / 65535.0;
-            }
-          
-          dest[0] = CLAMP_UCHAR (255 * dr);
-          dest[1] = CLAMP_UCHAR (255 * dg);
-          dest[2] = CLAMP_UCHAR (255 * db);
-          
-          if (has_alpha)
-            {
-              dest[3] = src[3];
-              src += 4;
-              dest += 4;
-            }
-          else
-            {
-              src += 3;
-              dest += 3;
-            }
-        }
-    }
-
-  return pixbuf;
-}
-
 static void
 color_composite (const GdkColor *bg,
                  const GdkColor *fg,
@@ -2722,6 +2643,175 @@ meta_draw_spec_new (MetaTheme  *theme,
   return spec;
 }
 
+/* Upper bounds on what a theme's image cache holds; whichever is hit
+ * first evicts the least recently drawn entries.
+ */
+#define IMAGE_CACHE_MAX_ENTRIES 256
+#define IMAGE_CACHE_MAX_BYTES   (8 * 1024 * 1024)
+
+typedef struct
+{
+  const MetaDrawOp *op;
+  const MetaAlphaGradientSpec *alpha_spec;
+  MetaImageFillType fill_type;
+  int width;
+  int height;
+  guint32 colorize_pixel;
+} MetaImageCacheKey;
+
+typedef struct
+{
+  MetaImageCacheKey key;
+  GdkPixbuf *pixbuf;
+  gsize size;
+  GList *link;             /* in the cache's lru queue */
+} MetaImageCacheEntry;
+
+struct _MetaImageCache
+{
+  GHashTable *entries;
+  GQueue lru;              /* most recently used first */
+  gsize size;
+};
+
+static guint
+image_cache_key_hash (gconstpointer v)
+{
+  const MetaImageCacheKey *key = v;
+
+  return (GPOINTER_TO_UINT (key->op) ^
+          (key->width * 7919) ^
+          (key->height * 104729) ^
+          key->colorize_pixel);
+}
+
+static gboolean
+image_cache_key_equal (gconstpointer a,
+                       gconstpointer b)
+{
+  const MetaImageCacheKey *ka = a;
+  const MetaImageCacheKey *kb = b;
+
+  return ka->op == kb->op &&
+    ka->alpha_spec == kb->alpha_spec &&
+    ka->fill_type == kb->fill_type &&
+    ka->width == kb->width &&
+    ka->height == kb->height &&
+    ka->colorize_pixel == kb->colorize_pixel;
+}
+
+static void
+image_cache_entry_free (gpointer data)
+{
+  MetaImageCacheEntry *entry = data;
+
+  g_object_unref (G_OBJECT (entry->pixbuf));
+  g_slice_free (MetaImageCacheEntry, entry);
+}
+
+static MetaImageCache*
+meta_image_cache_new (void)
+{
+  MetaImageCache *cache;
+
+  cache = g_new0 (MetaImageCache, 1);
+  cache->entries = g_hash_table_new_full (image_cache_key_hash,
+                                          image_cache_key_equal,
+                                          NULL,
+                                          image_cache_entry_free);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+static void
+meta_image_cache_free (MetaImageCache *cache)
+{
+  g_queue_clear (&cache->lru);
+  g_hash_table_destroy (cache->entries);
+
+  DEBUG_FILL_STRUCT (cache);
+  g_free (cache);
+}
+
+static void
+image_cache_remove (MetaImageCache      *cache,
+                    MetaImageCacheEntry *entry)
+{
+  g_queue_delete_link (&cache->lru, entry->link);
+  cache->size -= entry->size;
+  g_hash_table_remove (cache->entries, &entry->key);
+}
+
+/* Returns a new reference to the cached pixbuf, or NULL */
+static GdkPixbuf*
+meta_image_cache_lookup (MetaImageCache          *cache,
+                         const MetaImageCacheKey *key)
+{
+  MetaImageCacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry == NULL)
+    return NULL;
+
+  g_queue_unlink (&cache->lru, entry->link);
+  g_queue_push_head_link (&cache->lru, entry->link);
+
+  return g_object_ref (G_OBJECT (entry->pixbuf));
+}
+
+static void
+meta_image_cache_insert (MetaImageCache          *cache,
+                         const MetaImageCacheKey *key,
+                         GdkPixbuf               *pixbuf)
+{
+  MetaImageCacheEntry *entry;
+  gsize size;
+
+  size = gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+  if (size > IMAGE_CACHE_MAX_BYTES / 4)
+    return;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry != NULL)
+    image_cache_remove (cache, entry);
+
+  while (cache->lru.length > 0 &&
+         (cache->lru.length >= IMAGE_CACHE_MAX_ENTRIES ||
+          cache->size + size > IMAGE_CACHE_MAX_BYTES))
+    image_cache_remove (cache, g_queue_peek_tail (&cache->lru));
+
+  entry = g_slice_new (MetaImageCacheEntry);
+  entry->key = *key;
+  entry->pixbuf = g_object_ref (G_OBJECT (pixbuf));
+  entry->size = size;
+  g_queue_push_head (&cache->lru, entry);
+  entry->link = cache->lru.head;
+  cache->size += size;
+
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+}
+
+/* Called when an op is freed, so a later op at the same address
+ * can't be handed its pixbufs.
+ */
+static void
+meta_image_cache_forget_op (MetaImageCache   *cache,
+                            const MetaDrawOp *op)
+{
+  GList *link;
+
+  link = cache->lru.head;
+  while (link != NULL)
+    {
+      MetaImageCacheEntry *entry = link->data;
+
+      link = link->next;
+      if (entry->key.op == op)
+        image_cache_remove (cache, entry);
+    }
+}
+
 MetaDrawOp*
 meta_draw_op_new (MetaDrawType type)
 {
@@ -2878,6 +2968,9 @@ meta_draw_op_free (MetaDrawOp *op)
       if (op->data.image.colorize_cache_pixbuf)
         g_object_unref (G_OBJECT (op->data.image.colorize_cache_pixbuf));
 
+      if (op->data.image.cache)
+        meta_image_cache_forget_op (op->data.image.cache, op);
+
       meta_draw_spec_free (op->data.image.x);
       meta_draw_spec_free (op->data.image.y);
       meta_draw_spec_free (op->data.image.width);
@@ -3309,12 +3402,29 @@ draw_op_as_pixbuf (const MetaDrawOp    *op,
       
     case META_DRAW_IMAGE:
       {
+        MetaImageCacheKey key;
+
+        key.op = op;
+        key.alpha_spec = op->data.image.alpha_spec;
+        key.fill_type = op->data.image.fill_type;
+        key.width = width;
+        key.height = height;
+        key.colorize_pixel = 0;
+
 	if (op->data.image.colorize_spec)
 	  {
 	    GdkColor color;
 
             meta_color_spec_render (op->data.image.colorize_spec,
                                     widget, &color);
+            key.colorize_pixel = GDK_COLOR_RGB (color);
+
+            if (op->data.image.cache)
+              {
+                pixbuf = meta_image_cache_lookup (op->data.image.cache, &key);
+                if (pixbuf)
+                  break;
+              }
             
             if (op->data.image.colorize_cache_pixbuf == NULL ||
                 op->data.image.colorize_cache_pixel != GDK_COLOR_RGB (color))
@@ -3324,8 +3434,8 @@ draw_op_as_pixbuf (const MetaDrawOp    *op,
                 
                 /* const cast here */
                 ((MetaDrawOp*)op)->data.image.colorize_cache_pixbuf =
-                  colorize_pixbuf (op->data.image.pixbuf,
-                                   &color);
+                  meta_pixels_colorize (op->data.image.pixbuf,
+                                        &color);
                 ((MetaDrawOp*)op)->data.image.colorize_cache_pixel =
                   GDK_COLOR_RGB (color);
               }
@@ -3342,6 +3452,13 @@ draw_op_as_pixbuf (const MetaDrawOp    *op,
 	  }
 	else
 	  {
+            if (op->data.image.cache)
+              {
+                pixbuf = meta_image_cache_lookup (op->data.image.cache, &key);
+                if (pixbuf)
+                  break;
+              }
+
 	    pixbuf = scale_and_alpha_pixbuf (op->data.image.pixbuf,
                                              op->data.image.alpha_spec,
                                              op->data.image.fill_type,
@@ -3349,6 +3466,9 @@ draw_op_as_pixbuf (const MetaDrawOp    *op,
                                              op->data.image.vertical_stripes,
                                              op->data.image.horizontal_stripes);
 	  }
+
+        if (pixbuf && op->data.image.cache)
+          meta_image_cache_insert (op->data.image.cache, &key, pixbuf);
         break;
       }
       
@@ -3960,6 +4080,50 @@ meta_draw_op_list_unref (MetaDrawOpList *op_list)
     }
 }
 
+static MetaDrawOpTimingFunc draw_op_timing_func = NULL;
+static gpointer draw_op_timing_data = NULL;
+
+void
+meta_draw_op_set_timing_func (MetaDrawOpTimingFunc func,
+                              gpointer             data)
+{
+  draw_op_timing_func = func;
+  draw_op_timing_data = data;
+}
+
+static void
+draw_op_timed (const MetaDrawOp    *op,
+               GtkStyle            *style_gtk,
+               GtkWidget           *widget,
+               GdkDrawable         *drawable,
+               const GdkRectangle  *clip,
+               const MetaDrawInfo  *info,
+               MetaRectangle        rect,
+               MetaPositionExprEnv *env)
+{
+  GTimeVal start;
+  GTimeVal end;
+
+  /* Wait for the server so its share of the op isn't billed to
+   * whichever op happens to come next.
+   */
+  gdk_flush ();
+  g_get_current_time (&start);
+
+  meta_draw_op_draw_with_env (op,
+                              style_gtk, widget, drawable, clip, info,
+                              rect,
+                              env);
+
+  gdk_flush ();
+  g_get_current_time (&end);
+
+  (* draw_op_timing_func) (op->type,
+                           (end.tv_sec - start.tv_sec) * G_USEC_PER_SEC +
+                           (end.tv_usec - start.tv_usec),
+                           draw_op_timing_data);
+}
+
 void
 meta_draw_op_list_draw_with_style  (const MetaDrawOpList *op_list,
                                     GtkStyle             *style_gtk,
@@ -4022,10 +4186,16 @@ meta_draw_op_list_draw_with_style  (const MetaDrawOpList *op_list,
       else if (active_clip.width > 0 &&
                active_clip.height > 0)
         {
-          meta_draw_op_draw_with_env (op,
-                                      style_gtk, widget, drawable, &active_clip, info,
-                                      rect,
-                                      &env);
+          if (draw_op_timing_func != NULL)
+            draw_op_timed (op,
+                           style_gtk, widget, drawable, &active_clip, info,
+                           rect,
+                           &env);
+          else
+            meta_draw_op_draw_with_env (op,
+                                        style_gtk, widget, drawable, &active_clip, info,
+                                        rect,
+                                        &env);
         }
     }
 }
@@ -4105,6 +4275,152 @@ meta_draw_op_list_contains (MetaDrawOpList    *op_list,
   return FALSE;
 }
 
+static MetaDrawDependencies
+draw_spec_get_dependencies (const MetaDrawSpec *spec)
+{
+  MetaDrawDependencies deps;
+  int i;
+
+  if (spec == NULL || spec->constant)
+    return 0;
+
+  deps = 0;
+  for (i = 0; i < spec->n_tokens; i++)
+    {
+      const char *name;
+
+      if (spec->tokens[i].type != POS_TOKEN_VARIABLE)
+        continue;
+
+      name = spec->tokens[i].d.v.name;
+
+      if (strcmp (name, "title_width") == 0 ||
+          strcmp (name, "title_height") == 0)
+        deps |= META_DRAW_DEPENDS_TITLE;
+      else if (strcmp (name, "mini_icon_width") == 0 ||
+               strcmp (name, "mini_icon_height") == 0 ||
+               strcmp (name, "icon_width") == 0 ||
+               strcmp (name, "icon_height") == 0)
+        deps |= META_DRAW_DEPENDS_ICON;
+      else
+        deps |= META_DRAW_DEPENDS_SIZE;
+    }
+
+  return deps;
+}
+
+#define SPEC_DEPS(spec) draw_spec_get_dependencies (spec)
+
+static MetaDrawDependencies
+draw_op_get_dependencies (const MetaDrawOp *op)
+{
+  const MetaDrawOpList *op_list;
+
+  op_list = NULL;
+
+  switch (op->type)
+    {
+    case META_DRAW_LINE:
+      return SPEC_DEPS (op->data.line.x1) | SPEC_DEPS (op->data.line.y1) |
+        SPEC_DEPS (op->data.line.x2) | SPEC_DEPS (op->data.line.y2);
+
+    case META_DRAW_RECTANGLE:
+      return SPEC_DEPS (op->data.rectangle.x) |
+        SPEC_DEPS (op->data.rectangle.y) |
+        SPEC_DEPS (op->data.rectangle.width) |
+        SPEC_DEPS (op->data.rectangle.height);
+
+    case META_DRAW_ARC:
+      return SPEC_DEPS (op->data.arc.x) | SPEC_DEPS (op->data.arc.y) |
+        SPEC_DEPS (op->data.arc.width) | SPEC_DEPS (op->data.arc.height);
+
+    case META_DRAW_CLIP:
+      return SPEC_DEPS (op->data.clip.x) | SPEC_DEPS (op->data.clip.y) |
+        SPEC_DEPS (op->data.clip.width) | SPEC_DEPS (op->data.clip.height);
+
+    case META_DRAW_TINT:
+      return SPEC_DEPS (op->data.tint.x) | SPEC_DEPS (op->data.tint.y) |
+        SPEC_DEPS (op->data.tint.width) | SPEC_DEPS (op->data.tint.height);
+
+    case META_DRAW_GRADIENT:
+      return SPEC_DEPS (op->data.gradient.x) |
+        SPEC_DEPS (op->data.gradient.y) |
+        SPEC_DEPS (op->data.gradient.width) |
+        SPEC_DEPS (op->data.gradient.height);
+
+    case META_DRAW_IMAGE:
+      return SPEC_DEPS (op->data.image.x) | SPEC_DEPS (op->data.image.y) |
+        SPEC_DEPS (op->data.image.width) | SPEC_DEPS (op->data.image.height);
+
+    case META_DRAW_GTK_ARROW:
+      return SPEC_DEPS (op->data.gtk_arrow.x) |
+        SPEC_DEPS (op->data.gtk_arrow.y) |
+        SPEC_DEPS (op->data.gtk_arrow.width) |
+        SPEC_DEPS (op->data.gtk_arrow.height);
+
+    case META_DRAW_GTK_BOX:
+      return SPEC_DEPS (op->data.gtk_box.x) | SPEC_DEPS (op->data.gtk_box.y) |
+        SPEC_DEPS (op->data.gtk_box.width) |
+        SPEC_DEPS (op->data.gtk_box.height);
+
+    case META_DRAW_GTK_VLINE:
+      return SPEC_DEPS (op->data.gtk_vline.x) |
+        SPEC_DEPS (op->data.gtk_vline.y1) |
+        SPEC_DEPS (op->data.gtk_vline.y2);
+
+    case META_DRAW_ICON:
+      return META_DRAW_DEPENDS_ICON |
+        SPEC_DEPS (op->data.icon.x) | SPEC_DEPS (op->data.icon.y) |
+        SPEC_DEPS (op->data.icon.width) | SPEC_DEPS (op->data.icon.height);
+
+    case META_DRAW_TITLE:
+      return META_DRAW_DEPENDS_TITLE |
+        SPEC_DEPS (op->data.title.x) | SPEC_DEPS (op->data.title.y);
+
+    case META_DRAW_OP_LIST:
+      return meta_draw_op_list_get_dependencies (op->data.op_list.op_list) |
+        SPEC_DEPS (op->data.op_list.x) | SPEC_DEPS (op->data.op_list.y) |
+        SPEC_DEPS (op->data.op_list.width) |
+        SPEC_DEPS (op->data.op_list.height);
+
+    case META_DRAW_TILE:
+      return meta_draw_op_list_get_dependencies (op->data.tile.op_list) |
+        SPEC_DEPS (op->data.tile.x) | SPEC_DEPS (op->data.tile.y) |
+        SPEC_DEPS (op->data.tile.width) | SPEC_DEPS (op->data.tile.height) |
+        SPEC_DEPS (op->data.tile.tile_xoffset) |
+        SPEC_DEPS (op->data.tile.tile_yoffset) |
+        SPEC_DEPS (op->data.tile.tile_width) |
+        SPEC_DEPS (op->data.tile.tile_height);
+    }
+
+  return META_DRAW_DEPENDS_TITLE | META_DRAW_DEPENDS_ICON |
+    META_DRAW_DEPENDS_SIZE;
+}
+
+#undef SPEC_DEPS
+
+/**
+ * Works out which of the things that can change while a frame is
+ * shown affect what an op list draws.  A clip op counts, since it
+ * changes where everything after it goes.
+ *
+ * \param op_list  The op list
+ *
+ * \return  The union of what every op in the list depends on
+ */
+MetaDrawDependencies
+meta_draw_op_list_get_dependencies (const MetaDrawOpList *op_list)
+{
+  MetaDrawDependencies deps;
+  int i;
+
+  deps = 0;
+  for (i = 0; i < op_list->n_ops; i++)
+    deps |= draw_op_get_dependencies (op_list->ops[i]);
+
+  return deps;
+}
+
 /**
  * Constructor for a MetaFrameStyle.
  *
@@ -4402,34 +4718,36 @@ button_rect (MetaButtonType           type,
     }
 }
 
-void
-meta_frame_style_draw_with_style (MetaFrameStyle          *style,
-                                  GtkStyle                *style_gtk,
-                                  GtkWidget               *widget,
-                                  GdkDrawable             *drawable,
-                                  int                      x_offset,
-                                  int                      y_offset,
-                                  const GdkRectangle      *clip,
-                                  const MetaFrameGeometry *fgeom,
-                                  int                      client_width,
-                                  int                      client_height,
-                                  PangoLayout             *title_layout,
-                                  int                      text_height,
-                                  MetaButtonState          button_states[META_BUTTON_TYPE_LAST],
-                                  GdkPixbuf               *mini_icon,
-                                  GdkPixbuf               *icon)
+static MetaDrawOpList*
+get_piece (MetaFrameStyle *style,
+           MetaFramePiece  piece)
+{
+  MetaDrawOpList *op_list;
+  MetaFrameStyle *parent;
+
+  parent = style;
+  op_list = NULL;
+  while (parent && op_list == NULL)
+    {
+      op_list = parent->pieces[piece];
+      parent = parent->parent;
+    }
+
+  return op_list;
+}
+
+/* Where a piece of the frame goes, in frame coordinates */
+static void
+piece_rect (MetaFramePiece           piece,
+            const MetaFrameGeometry *fgeom,
+            GdkRectangle            *rect)
 {
-  int i, j;
   GdkRectangle titlebar_rect;
   GdkRectangle left_titlebar_edge;
   GdkRectangle right_titlebar_edge;
   GdkRectangle bottom_titlebar_edge;
   GdkRectangle top_titlebar_edge;
   GdkRectangle left_edge, right_edge, bottom_edge;
-  PangoRectangle extents;
-  MetaDrawInfo draw_info;
-  
-  g_return_if_fail (style_gtk->colormap == gdk_drawable_get_colormap (drawable));
 
   titlebar_rect.x = 0;
   titlebar_rect.y = 0;
@@ -4471,6 +4789,201 @@ meta_frame_style_draw_with_style (MetaFrameStyle          *style,
   bottom_edge.width = fgeom->width;
   bottom_edge.height = fgeom->bottom_height;
 
+  switch (piece)
+    {
+    case META_FRAME_PIECE_ENTIRE_BACKGROUND:
+      rect->x = 0;
+      rect->y = 0;
+      rect->width = fgeom->width;
+      rect->height = fgeom->height;
+      break;
+
+    case META_FRAME_PIECE_TITLEBAR:
+      *rect = titlebar_rect;
+      break;
+
+    case META_FRAME_PIECE_LEFT_TITLEBAR_EDGE:
+      *rect = left_titlebar_edge;
+      break;
+
+    case META_FRAME_PIECE_RIGHT_TITLEBAR_EDGE:
+      *rect = right_titlebar_edge;
+      break;
+
+    case META_FRAME_PIECE_TOP_TITLEBAR_EDGE:
+      *rect = top_titlebar_edge;
+      break;
+
+    case META_FRAME_PIECE_BOTTOM_TITLEBAR_EDGE:
+      *rect = bottom_titlebar_edge;
+      break;
+
+    case META_FRAME_PIECE_TITLEBAR_MIDDLE:
+      rect->x = left_titlebar_edge.x + left_titlebar_edge.width;
+      rect->y = top_titlebar_edge.y + top_titlebar_edge.height;
+      rect->width = titlebar_rect.width - left_titlebar_edge.width -
+        right_titlebar_edge.width;
+      rect->height = titlebar_rect.height - top_titlebar_edge.height - bottom_titlebar_edge.height;
+      break;
+
+    case META_FRAME_PIECE_TITLE:
+      *rect = fgeom->title_rect;
+      break;
+
+    case META_FRAME_PIECE_LEFT_EDGE:
+      *rect = left_edge;
+      break;
+
+    case META_FRAME_PIECE_RIGHT_EDGE:
+      *rect = right_edge;
+      break;
+
+    case META_FRAME_PIECE_BOTTOM_EDGE:
+      *rect = bottom_edge;
+      break;
+
+    case META_FRAME_PIECE_OVERLAY:
+      rect->x = 0;
+      rect->y = 0;
+      rect->width = fgeom->width;
+      rect->height = fgeom->height;
+      break;
+
+    case META_FRAME_PIECE_LAST:
+      g_assert_not_reached ();
+      break;
+    }
+}
+
+/**
+ * Finds the part of a frame that has to be drawn again when something
+ * it shows changes, such as the title or the icon: the union of the
+ * pieces and buttons whose op lists depend on it.  The frame's
+ * geometry must be the same as when it was last drawn; anything that
+ * changes the size of the frame needs all of it drawn.
+ *
+ * \param theme    The theme
+ * \param type     The frame's type
+ * \param flags    The frame's flags, which pick the style
+ * \param fgeom    The frame's geometry
+ * \param changed  What changed
+ * \param damage   Set to the part to draw again, in frame coordinates
+ *
+ * \return  FALSE if nothing in the frame depends on what changed
+ */
+gboolean
+meta_theme_get_frame_damage (MetaTheme               *theme,
+                             MetaFrameType            type,
+                             MetaFrameFlags           flags,
+                             const MetaFrameGeometry *fgeom,
+                             MetaDrawDependencies     changed,
+                             GdkRectangle            *damage)
+{
+  MetaFrameStyle *style;
+  GdkRectangle rect;
+  gboolean found;
+  int middle_bg_offset;
+  int i, j;
+
+  style = meta_theme_get_frame_style (theme, type, flags);
+  if (style == NULL)
+    return FALSE;
+
+  found = FALSE;
+
+  for (i = 0; i < META_FRAME_PIECE_LAST; i++)
+    {
+      MetaDrawOpList *op_list;
+
+      op_list = get_piece (style, i);
+      if (op_list == NULL ||
+          (meta_draw_op_list_get_dependencies (op_list) & changed) == 0)
+        continue;
+
+      piece_rect (i, fgeom, &rect);
+      if (rect.width <= 0 || rect.height <= 0)
+        continue;
+
+      if (found)
+        gdk_rectangle_union (damage, &rect, damage);
+      else
+        *damage = rect;
+      found = TRUE;
+    }
+
+  /* Any state of a button might be the one showing */
+  middle_bg_offset = 0;
+  j = 0;
+  while (j < META_BUTTON_TYPE_LAST)
+    {
+      MetaDrawDependencies deps;
+      MetaButtonState state;
+
+      deps = 0;
+      for (state = 0; state < META_BUTTON_STATE_LAST; state++)
+        {
+          MetaDrawOpList *op_list;
+
+          op_list = get_button (style, j, state);
+          if (op_list)
+            deps |= meta_draw_op_list_get_dependencies (op_list);
+        }
+
+      if (deps & changed)
+        {
+          button_rect (j, fgeom, middle_bg_offset, &rect);
+
+          /* Buttons that aren't shown have empty rects */
+          if (rect.width > 0 && rect.height > 0)
+            {
+              if (found)
+                gdk_rectangle_union (damage, &rect, damage);
+              else
+                *damage = rect;
+              found = TRUE;
+            }
+        }
+
+      /* MIDDLE_BACKGROUND type may get drawn more than once */
+      if ((j == META_BUTTON_TYPE_RIGHT_MIDDLE_BACKGROUND ||
+           j == META_BUTTON_TYPE_LEFT_MIDDLE_BACKGROUND) &&
+          middle_bg_offset < MAX_MIDDLE_BACKGROUNDS)
+        {
+          ++middle_bg_offset;
+        }
+      else
+        {
+          middle_bg_offset = 0;
+          ++j;
+        }
+    }
+
+  return found;
+}
+
+void
+meta_frame_style_draw_with_style (MetaFrameStyle          *style,
+                                  GtkStyle                *style_gtk,
+                                  GtkWidget               *widget,
+                                  GdkDrawable             *drawable,
+                                  int                      x_offset,
+                                  int                      y_offset,
+                                  const GdkRectangle      *clip,
+                                  const MetaFrameGeometry *fgeom,
+                                  int                      client_width,
+                                  int                      client_height,
+                                  PangoLayout             *title_layout,
+                                  int                      text_height,
+                                  MetaButtonState          button_states[META_BUTTON_TYPE_LAST],
+                                  GdkPixbuf               *mini_icon,
+                                  GdkPixbuf               *icon)
+{
+  int i, j;
+  PangoRectangle extents;
+  MetaDrawInfo draw_info;
+  
+  g_return_if_fail (style_gtk->colormap == gdk_drawable_get_colormap (drawable));
+
   if (title_layout)
     pango_layout_get_pixel_extents (title_layout,
                                     NULL, &extents);
@@ -4489,70 +5002,7 @@ meta_frame_style_draw_with_style (MetaFrameStyle          *style,
       GdkRectangle rect;
       GdkRectangle combined_clip;
       
-      switch ((MetaFramePiece) i)
-        {
-        case META_FRAME_PIECE_ENTIRE_BACKGROUND:
-          rect.x = 0;
-          rect.y = 0;
-          rect.width = fgeom->width;
-          rect.height = fgeom->height;
-          break;
-
-        case META_FRAME_PIECE_TITLEBAR:
-          rect = titlebar_rect;
-          break;
-
-        case META_FRAME_PIECE_LEFT_TITLEBAR_EDGE:
-          rect = left_titlebar_edge;
-          break;
-
-        case META_FRAME_PIECE_RIGHT_TITLEBAR_EDGE:
-          rect = right_titlebar_edge;
-          break;
-
-        case META_FRAME_PIECE_TOP_TITLEBAR_EDGE:
-          rect = top_titlebar_edge;
-          break;
-
-        case META_FRAME_PIECE_BOTTOM_TITLEBAR_EDGE:
-          rect = bottom_titlebar_edge;
-          break;
-
-        case META_FRAME_PIECE_TITLEBAR_MIDDLE:
-          rect.x = left_titlebar_edge.x + left_titlebar_edge.width;
-          rect.y = top_titlebar_edge.y + top_titlebar_edge.height;
-          rect.width = titlebar_rect.width - left_titlebar_edge.width -
-            right_titlebar_edge.width;
-          rect.height = titlebar_rect.height - top_titlebar_edge.height - bottom_titlebar_edge.height;
-          break;
-
-        case META_FRAME_PIECE_TITLE:
-          rect = fgeom->title_rect;
-          break;
-
-        case META_FRAME_PIECE_LEFT_EDGE:
-          rect = left_edge;
-          break;
-
-        case META_FRAME_PIECE_RIGHT_EDGE:
-          rect = right_edge;
-          break;
-
-        case META_FRAME_PIECE_BOTTOM_EDGE:
-          rect = bottom_edge;
-          break;
-
-        case META_FRAME_PIECE_OVERLAY:
-          rect.x = 0;
-          rect.y = 0;
-          rect.width = fgeom->width;
-          rect.height = fgeom->height;
-          break;
-
-        case META_FRAME_PIECE_LAST:
-          g_assert_not_reached ();
-          break;
-        }
+      piece_rect (i, fgeom, &rect);
 
       rect.x += x_offset;
       rect.y += y_offset;
@@ -4567,15 +5017,8 @@ meta_frame_style_draw_with_style (MetaFrameStyle          *style,
       if (combined_clip.width > 0 && combined_clip.height > 0)
         {
           MetaDrawOpList *op_list;
-          MetaFrameStyle *parent;
 
-          parent = style;
-          op_list = NULL;
-          while (parent && op_list == NULL)
-            {
-              op_list = parent->pieces[i];
-              parent = parent->parent;
-            }
+          op_list = get_piece (style, i);
 
           if (op_list)
             {
@@ -4944,6 +5387,8 @@ meta_theme_new (void)
                            g_str_equal,
                            g_free,
                            (GDestroyNotify) meta_frame_style_set_unref);
+
+  theme->image_cache = meta_image_cache_new ();
   
   /* Create our variable quarks so we can look up variables without
      having to strcmp for the names */
@@ -5000,6 +5445,9 @@ meta_theme_free (MetaTheme *theme)
     if (theme->style_sets_by_type[i])
       meta_frame_style_set_unref (theme->style_sets_by_type[i]);
 
+  /* after the draw ops that point to it are gone */
+  meta_image_cache_free (theme->image_cache);
+
   DEBUG_FILL_STRUCT (theme);
   g_free (theme);
 }
@@ -6144,6 +6592,44 @@ meta_gradient_type_to_string (MetaGradientType type)
   return "<unknown>";
 }
 
+const char*
+meta_draw_type_to_string (MetaDrawType type)
+{
+  switch (type)
+    {
+    case META_DRAW_LINE:
+      return "line";
+    case META_DRAW_RECTANGLE:
+      return "rectangle";
+    case META_DRAW_ARC:
+      return "arc";
+    case META_DRAW_CLIP:
+      return "clip";
+    case META_DRAW_TINT:
+      return "tint";
+    case META_DRAW_GRADIENT:
+      return "gradient";
+    case META_DRAW_IMAGE:
+      return "image";
+    case META_DRAW_GTK_ARROW:
+      return "gtk_arrow";
+    case META_DRAW_GTK_BOX:
+      return "gtk_box";
+    case META_DRAW_GTK_VLINE:
+      return "gtk_vline";
+    case META_DRAW_ICON:
+      return "icon";
+    case META_DRAW_TITLE:
+      return "title";
+    case META_DRAW_OP_LIST:
+      return "include";
+    case META_DRAW_TILE:
+      return "tile";
+    }
+
+  return "<unknown>";
+}
+
 GtkStateType
 meta_gtk_state_from_string (const char *str)
 {
@@ -42,6 +42,7 @@ typedef struct _MetaFrameGeometry MetaFrameGeometry;
 typedef struct _MetaTheme MetaTheme;
 typedef struct _MetaPositionExprEnv MetaPositionExprEnv;
 typedef struct _MetaDrawInfo MetaDrawInfo;
+typedef struct _MetaImageCache MetaImageCache;
 
 #define META_THEME_ERROR (g_quark_from_static_string ("meta-theme-error"))
 
@@ -493,6 +494,8 @@ struct _MetaDrawOp
 
       guint32 colorize_cache_pixel;
       GdkPixbuf *colorize_cache_pixbuf;
+      /** The theme's cache of this image rendered at each size; may be NULL */
+      MetaImageCache *cache;
       MetaImageFillType fill_type;
       unsigned int vertical_stripes : 1;
       unsigned int horizontal_stripes : 1;
@@ -809,6 +812,12 @@ struct _MetaTheme
   GHashTable *styles_by_name;
   GHashTable *style_sets_by_name;
   MetaFrameStyleSet *style_sets_by_type[META_FRAME_TYPE_LAST];
+  /**
+   * Image draw ops scaled, tiled, colorized and alpha-blended to the
+   * sizes they have recently been drawn at, so that repaints at an
+   * unchanged size don't redo the work.
+   */
+  MetaImageCache *image_cache;
 
   GQuark quark_width;
   GQuark quark_height;
@@ -931,6 +940,19 @@ void            meta_draw_op_list_draw_with_style  (const MetaDrawOpList *op_lis
                                                     const GdkRectangle   *clip,
                                                     const MetaDrawInfo   *info,
                                                     MetaRectangle         rect);
+
+/* Things that can change while a frame is shown, besides the frame's
+ * style, which an op list's output may depend on.
+ */
+typedef enum
+{
+  META_DRAW_DEPENDS_TITLE = 1 << 0,
+  META_DRAW_DEPENDS_ICON  = 1 << 1,
+  META_DRAW_DEPENDS_SIZE  = 1 << 2
+} MetaDrawDependencies;
+
+MetaDrawDependencies meta_draw_op_list_get_dependencies (const MetaDrawOpList *op_list);
+
 void           meta_draw_op_list_append (MetaDrawOpList       *op_list,
                                          MetaDrawOp           *op);
 gboolean       meta_draw_op_list_validate (MetaDrawOpList    *op_list,
@@ -1017,6 +1039,13 @@ MetaFrameStyle* meta_theme_get_frame_style (MetaTheme     *theme,
                                             MetaFrameType  type,
                                             MetaFrameFlags flags);
 
+gboolean meta_theme_get_frame_damage (MetaTheme               *theme,
+                                      MetaFrameType            type,
+                                      MetaFrameFlags           flags,
+                                      const MetaFrameGeometry *fgeom,
+                                      MetaDrawDependencies     changed,
+                                      GdkRectangle            *damage);
+
 double meta_theme_get_title_scale (MetaTheme     *theme,
                                    MetaFrameType  type,
                                    MetaFrameFlags flags);
@@ -1167,6 +1196,7 @@ MetaFrameType         meta_frame_type_from_string      (const char            *s
 const char*           meta_frame_type_to_string        (MetaFrameType          type);
 MetaGradientType      meta_gradient_type_from_string   (const char            *str);
 const char*           meta_gradient_type_to_string     (MetaGradientType       type);
+const char*           meta_draw_type_to_string         (MetaDrawType           type);
 GtkStateType          meta_gtk_state_from_string       (const char            *str);
 const char*           meta_gtk_state_to_string         (GtkStateType           state);
 GtkShadowType         meta_gtk_shadow_from_string      (const char            *str);
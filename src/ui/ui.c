@@ -22,6 +22,7 @@
  * 02111-1307, USA.
  */
 
+#include <config.h>
 #include "prefs.h"
 #include "ui.h"
 #include "frames.h"
@@ -29,6 +30,7 @@
 #include "menu.h"
 #include "core.h"
 #include "theme.h"
+#include "pixels.h"
 
 #include "inlinepixbufs.h"
 
@@ -37,11 +39,24 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
 static void meta_stock_icons_init (void);
 static void meta_ui_accelerator_parse (const char      *accel,
                                        guint           *keysym,
                                        guint           *keycode,
                                        GdkModifierType *keymask);
+static GdkPixbuf* get_pixbuf_from_pixmap_fast (GdkScreen *screen,
+                                               Pixmap     pmap,
+                                               int        src_x,
+                                               int        src_y,
+                                               int        width,
+                                               int        height,
+                                               int        depth);
 
 struct _MetaUI
 {
@@ -455,6 +470,13 @@ meta_ui_queue_frame_draw (MetaUI *ui,
 }
 
 
+void
+meta_ui_queue_frame_icon_draw (MetaUI *ui,
+                               Window xwindow)
+{
+  meta_frames_queue_icon_draw (ui->frames, xwindow);
+}
+
 void
 meta_ui_set_frame_title (MetaUI     *ui,
                          Window      xwindow,
@@ -693,7 +715,14 @@ meta_gdk_pixbuf_get_from_pixmap (GdkPixbuf   *dest,
   else
     drawable = gdk_pixmap_foreign_new (xpixmap);
 
-  if (drawable)
+  if (drawable && dest == NULL)
+    retval = get_pixbuf_from_pixmap_fast (gdk_drawable_get_screen (drawable),
+                                          xpixmap,
+                                          src_x, src_y,
+                                          width, height,
+                                          gdk_drawable_get_depth (drawable));
+
+  if (drawable && retval == NULL)
     {
       cmap = get_cmap (drawable);
   
@@ -1165,6 +1194,217 @@ meta_ui_get_direction (void)
   return META_UI_DIRECTION_LTR;
 }
 
+#ifdef HAVE_XSHM
+/* One shared memory segment, kept between captures and grown to the
+ * largest image asked for.  Captures are thumbnail sized, so it stays
+ * small.
+ */
+static XShmSegmentInfo capture_shm = { 0, -1, (char *) -1, False };
+static gsize capture_shm_size = 0;
+static gboolean capture_shm_broken = FALSE;
+
+static void
+capture_shm_free (Display *xdisplay)
+{
+  if (capture_shm.shmaddr == (char *) -1)
+    return;
+
+  XShmDetach (xdisplay, &capture_shm);
+  XSync (xdisplay, False);
+  shmdt (capture_shm.shmaddr);
+
+  capture_shm.shmaddr = (char *) -1;
+  capture_shm.shmid = -1;
+  capture_shm_size = 0;
+}
+
+static gboolean
+capture_shm_ensure (Display *xdisplay,
+                    gsize    size)
+{
+  int shmid;
+
+  if (capture_shm_broken)
+    return FALSE;
+
+  if (size <= capture_shm_size)
+    return TRUE;
+
+  capture_shm_free (xdisplay);
+
+  shmid = shmget (IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (shmid < 0)
+    {
+      capture_shm_broken = TRUE;
+      return FALSE;
+    }
+
+  capture_shm.shmid = shmid;
+  capture_shm.shmaddr = shmat (shmid, NULL, 0);
+  capture_shm.readOnly = False;
+
+  /* Marked for removal now, so it goes away with us however we exit;
+   * it stays until the X server detaches too.
+   */
+  shmctl (shmid, IPC_RMID, NULL);
+
+  if (capture_shm.shmaddr == (char *) -1)
+    {
+      capture_shm_broken = TRUE;
+      return FALSE;
+    }
+
+  /* Fails when the server is on another machine */
+  gdk_error_trap_push ();
+  XShmAttach (xdisplay, &capture_shm);
+  XSync (xdisplay, False);
+  if (gdk_error_trap_pop () != 0)
+    {
+      shmdt (capture_shm.shmaddr);
+      capture_shm.shmaddr = (char *) -1;
+      capture_shm_broken = TRUE;
+      return FALSE;
+    }
+
+  capture_shm_size = size;
+
+  return TRUE;
+}
+#endif /* HAVE_XSHM */
+
+/* Reads a pixmap back from the server, through shared memory when
+ * we can.  Must be called inside an error trap.
+ */
+static XImage*
+get_image (Display *xdisplay,
+           Pixmap   pmap,
+           Visual  *xvisual,
+           int      depth,
+           int      src_x,
+           int      src_y,
+           int      width,
+           int      height)
+{
+#ifdef HAVE_XSHM
+  if (!capture_shm_broken && XShmQueryExtension (xdisplay))
+    {
+      XImage *image;
+
+      image = XShmCreateImage (xdisplay, xvisual, depth, ZPixmap,
+                               NULL, &capture_shm, width, height);
+      if (image != NULL)
+        {
+          if (capture_shm_ensure (xdisplay,
+                                  (gsize) image->bytes_per_line * height))
+            {
+              image->data = capture_shm.shmaddr;
+              if (XShmGetImage (xdisplay, pmap, image, src_x, src_y,
+                                AllPlanes))
+                return image;
+            }
+
+          image->data = NULL;
+          XDestroyImage (image);
+        }
+    }
+#endif
+
+  return XGetImage (xdisplay, pmap, src_x, src_y, width, height,
+                    AllPlanes, ZPixmap);
+}
+
+static void
+free_image (XImage *image)
+{
+#ifdef HAVE_XSHM
+  /* The shared segment isn't ours to free */
+  if (image->data == capture_shm.shmaddr)
+    image->data = NULL;
+#endif
+
+  XDestroyImage (image);
+}
+
+/* Converts an image in the 32 bits per pixel, 8 bits per channel
+ * layout nearly every 24 and 32 bit TrueColor visual uses.  Alpha,
+ * if there is any, is dropped, as the GDK conversion this replaces
+ * does.  The rows go through the same SSE2/AVX2 dispatch as the
+ * other pixel kernels.
+ */
+static void
+convert_xrgb32 (const XImage *image,
+                GdkPixbuf    *pixbuf)
+{
+  meta_pixels_from_xrgb32 (pixbuf, (const guchar *) image->data,
+                           image->bytes_per_line,
+                           image->byte_order == LSBFirst);
+}
+
+/* Whether convert_xrgb32() can handle what comes back for a visual */
+static gboolean
+visual_is_xrgb32 (GdkVisual *visual)
+{
+  return visual != NULL &&
+    visual->type == GDK_VISUAL_TRUE_COLOR &&
+    visual->red_mask == 0xff0000 &&
+    visual->green_mask == 0x00ff00 &&
+    visual->blue_mask == 0x0000ff;
+}
+
+/* Captures a pixmap straight from Xlib for the common visuals, and
+ * returns NULL for anything else so the caller can let GDK do it.
+ * Readback cost scales with the pixmap, so callers wanting a
+ * thumbnail should scale on the server first, as the compositor does.
+ */
+static GdkPixbuf*
+get_pixbuf_from_pixmap_fast (GdkScreen *screen,
+                             Pixmap     pmap,
+                             int        src_x,
+                             int        src_y,
+                             int        width,
+                             int        height,
+                             int        depth)
+{
+  Display *xdisplay;
+  GdkVisual *visual;
+  XImage *image;
+  GdkPixbuf *pixbuf;
+
+  if (depth == 24)
+    visual = gdk_screen_get_system_visual (screen);
+  else if (depth == 32)
+    visual = gdk_screen_get_rgba_visual (screen);
+  else
+    visual = NULL;
+
+  if (!visual_is_xrgb32 (visual) || visual->depth != depth)
+    return NULL;
+
+  xdisplay = GDK_SCREEN_XDISPLAY (screen);
+
+  gdk_error_trap_push ();
+  image = get_image (xdisplay, pmap, GDK_VISUAL_XVISUAL (visual),
+                     depth, src_x, src_y, width, height);
+  if (gdk_error_trap_pop () != 0 || image == NULL)
+    {
+      if (image != NULL)
+        free_image (image);
+      return NULL;
+    }
+
+  pixbuf = NULL;
+  if (image->bits_per_pixel == 32)
+    {
+      pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+      if (pixbuf != NULL)
+        convert_xrgb32 (image, pixbuf);
+    }
+
+  free_image (image);
+
+  return pixbuf;
+}
+
 GdkPixbuf *
 meta_ui_get_pixbuf_from_pixmap (Pixmap   pmap)
 {
@@ -1180,6 +1420,15 @@ meta_ui_get_pixbuf_from_pixmap (Pixmap   pmap)
   gdk_drawable_get_size (GDK_DRAWABLE (gpmap), &width, &height);
   
   depth = gdk_drawable_get_depth (GDK_DRAWABLE (gpmap));
+
+  pixbuf = get_pixbuf_from_pixmap_fast (screen, pmap, 0, 0,
+                                        width, height, depth);
+  if (pixbuf != NULL)
+    {
+      g_object_unref (gpmap);
+      return pixbuf;
+    }
+
   if (depth <= 24)
     cmap = gdk_screen_get_system_colormap (screen);
   else
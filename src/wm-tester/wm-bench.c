@@ -0,0 +1,1096 @@
+/* Reproducible window manager benchmark */
+
+/*
+ * Copyright (C) 2026 Metacity contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Drives a running window manager through scripted workloads and
+ * measures how it keeps up.  It is meant to be run on a headless
+ * server, for instance:
+ *
+ *   Xvfb :9 -screen 0 1280x1024x24 &
+ *   DISPLAY=:9 metacity --replace &
+ *   DISPLAY=:9 ./wm-bench --wm-pid $! --seed 42 --windows 200
+ *
+ * All the choices a workload makes come from --seed, so runs with the
+ * same seed and window count do the same things in the same order.
+ * For each workload we print:
+ *
+ *  - how long operations took, at percentiles: the time from asking
+ *    for something to seeing the window manager's answer to it;
+ *  - requests the window manager sent, and replies it got, per
+ *    operation, as seen by the RECORD extension.  Every reply is a
+ *    round trip, unless the window manager did something else while
+ *    it waited;
+ *  - CPU time the window manager used, from /proc, given --wm-pid.
+ *
+ * Pointer and keyboard input for the drag and alt-tab workloads is
+ * faked with XTEST.
+ */
+
+#define _XOPEN_SOURCE 600 /* for gettimeofday(), poll(), snprintf() */
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/record.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define DEFAULT_SEED 1
+#define DEFAULT_WINDOWS 50
+#define DEFAULT_ITERATIONS 200
+
+/* How long (ms) we wait for the window manager to answer before
+ * counting an operation as timed out
+ */
+#define TIMEOUT 2000
+/* Edge resistance can hold a dragged window still on purpose */
+#define DRAG_TIMEOUT 500
+
+#define DRAG_STEP 20
+#define DRAG_MARGIN 100
+
+typedef struct
+{
+  const char *name;
+
+  double *latencies; /* ms */
+  int n_latencies;
+  int n_allocated;
+  int n_timeouts;
+  int skipped;
+
+  unsigned long start_requests;
+  unsigned long start_replies;
+  double start_cpu;
+
+  unsigned long wm_requests;
+  unsigned long wm_replies;
+  double wm_cpu; /* ms, or < 0 if we can't tell */
+} Workload;
+
+typedef void (* WorkloadFunc) (Workload *workload);
+
+typedef Bool (* EventPredicate) (XEvent *event, void *data);
+
+typedef struct
+{
+  Atom atom;
+  long value;
+  Bool equal; /* wait for the property to become value, or to stop being it */
+} PropertyWait;
+
+typedef struct
+{
+  Window window;
+  int x, y;
+} ConfigureWait;
+
+static Display *dpy;
+static Window root;
+static int screen_width;
+static int screen_height;
+
+static Window *windows;
+static int n_windows;
+static int n_iterations;
+static Window probe;
+static Time last_time = CurrentTime;
+
+static unsigned int random_state;
+
+static int wm_pid;
+static Display *record_dpy;
+static XRecordContext record_context;
+static unsigned long wm_requests;
+static unsigned long wm_replies;
+
+static Atom atom_net_active_window;
+static Atom atom_net_current_desktop;
+static Atom atom_net_number_of_desktops;
+static Atom atom_net_frame_extents;
+static Atom atom_net_request_frame_extents;
+static Atom atom_net_supporting_wm_check;
+static Atom atom_net_wm_name;
+static Atom atom_utf8_string;
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "wm-bench [--seed N] [--windows N] [--iterations N] [--wm-pid PID]\n"
+           "         [map] [restack] [title] [workspace] [alt-tab] [drag]\n");
+  exit (1);
+}
+
+/* The same sequence on every platform, which rand() doesn't promise */
+static int
+random_int (int n)
+{
+  random_state = random_state * 1103515245 + 12345;
+
+  return (random_state >> 16) % n;
+}
+
+static double
+now_ms (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void
+note_event_time (XEvent *event)
+{
+  switch (event->type)
+    {
+    case PropertyNotify:
+      last_time = event->xproperty.time;
+      break;
+    case KeyPress:
+    case KeyRelease:
+      last_time = event->xkey.time;
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      last_time = event->xbutton.time;
+      break;
+    case MotionNotify:
+      last_time = event->xmotion.time;
+      break;
+    default:
+      break;
+    }
+}
+
+/* Handles events until predicate is satisfied, or returns False after
+ * timeout ms
+ */
+static Bool
+wait_for_event (EventPredicate predicate,
+                void          *data,
+                int            timeout)
+{
+  double deadline;
+  XEvent event;
+
+  deadline = now_ms () + timeout;
+
+  while (True)
+    {
+      struct pollfd pfd;
+      double remaining;
+
+      while (XPending (dpy))
+        {
+          XNextEvent (dpy, &event);
+          note_event_time (&event);
+
+          if (predicate (&event, data))
+            return True;
+        }
+
+      remaining = deadline - now_ms ();
+      if (remaining <= 0)
+        return False;
+
+      pfd.fd = ConnectionNumber (dpy);
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      poll (&pfd, 1, (int) remaining + 1);
+    }
+}
+
+static long
+get_cardinal (Window window,
+              Atom   atom,
+              long   fallback)
+{
+  Atom type;
+  int format;
+  unsigned long n_items;
+  unsigned long bytes_after;
+  unsigned char *data;
+  long value;
+
+  data = NULL;
+  if (XGetWindowProperty (dpy, window, atom, 0, 1, False, AnyPropertyType,
+                          &type, &format, &n_items, &bytes_after,
+                          &data) != Success)
+    return fallback;
+
+  value = fallback;
+  if (data != NULL && format == 32 && n_items == 1)
+    value = ((long *) data)[0];
+
+  if (data)
+    XFree (data);
+
+  return value;
+}
+
+static void
+send_client_message (Window window,
+                     Atom   type,
+                     long   l0,
+                     long   l1,
+                     long   l2)
+{
+  XEvent event;
+
+  memset (&event, 0, sizeof (event));
+  event.xclient.type = ClientMessage;
+  event.xclient.window = window;
+  event.xclient.message_type = type;
+  event.xclient.format = 32;
+  event.xclient.data.l[0] = l0;
+  event.xclient.data.l[1] = l1;
+  event.xclient.data.l[2] = l2;
+
+  XSendEvent (dpy, root, False,
+              SubstructureRedirectMask | SubstructureNotifyMask,
+              &event);
+}
+
+static Bool
+is_map_notify (XEvent *event,
+               void   *data)
+{
+  Window *window = data;
+
+  return event->type == MapNotify && event->xmap.window == *window;
+}
+
+static Bool
+root_property_changed (XEvent *event,
+                       void   *data)
+{
+  PropertyWait *wait = data;
+  long value;
+
+  if (event->type != PropertyNotify ||
+      event->xproperty.window != root ||
+      event->xproperty.atom != wait->atom)
+    return False;
+
+  value = get_cardinal (root, wait->atom, None);
+
+  return wait->equal ? value == wait->value : value != wait->value;
+}
+
+static Bool
+is_probe_answer (XEvent *event,
+                 void   *data)
+{
+  return event->type == PropertyNotify &&
+    event->xproperty.window == probe &&
+    event->xproperty.atom == atom_net_frame_extents;
+}
+
+/* Only the window manager's synthetic ConfigureNotify is in root
+ * coordinates; the server's real ones are relative to the frame.  The
+ * position answered becomes the one the next step waits to change.
+ */
+static Bool
+is_new_position (XEvent *event,
+                 void   *data)
+{
+  ConfigureWait *wait = data;
+
+  if (event->type != ConfigureNotify ||
+      !event->xconfigure.send_event ||
+      event->xconfigure.window != wait->window)
+    return False;
+
+  if (event->xconfigure.x == wait->x && event->xconfigure.y == wait->y)
+    return False;
+
+  wait->x = event->xconfigure.x;
+  wait->y = event->xconfigure.y;
+
+  return True;
+}
+
+static Bool
+is_probe_property (XEvent *event,
+                   void   *data)
+{
+  return event->type == PropertyNotify &&
+    event->xproperty.window == probe &&
+    event->xproperty.atom == XA_WM_NAME;
+}
+
+/* Returns once the window manager has dealt with everything we sent
+ * it before; it answers _NET_REQUEST_FRAME_EXTENTS by setting a
+ * property on the window that asked, which we'll see.
+ */
+static Bool
+wm_sync (void)
+{
+  send_client_message (probe, atom_net_request_frame_extents, 0, 0, 0);
+
+  return wait_for_event (is_probe_answer, NULL, TIMEOUT);
+}
+
+/* A timestamp to put in our requests, so the window manager doesn't
+ * take them for stale ones
+ */
+static void
+update_server_time (void)
+{
+  XChangeProperty (dpy, probe, XA_WM_NAME, XA_STRING, 8,
+                   PropModeAppend, NULL, 0);
+  wait_for_event (is_probe_property, NULL, TIMEOUT);
+}
+
+static void
+record_callback (XPointer              closure,
+                 XRecordInterceptData *data)
+{
+  if (data->category == XRecordFromClient)
+    wm_requests++;
+  else if (data->category == XRecordFromServer)
+    wm_replies++;
+
+  XRecordFreeData (data);
+}
+
+/* Counts the window manager's requests and replies on a connection of
+ * their own; the window's owner is the client we watch.
+ */
+static Bool
+start_recording (Window wm_window)
+{
+  int major, minor;
+  XRecordRange *range;
+  XRecordClientSpec client;
+
+  record_dpy = XOpenDisplay (DisplayString (dpy));
+  if (record_dpy == NULL)
+    return False;
+
+  if (!XRecordQueryVersion (record_dpy, &major, &minor))
+    {
+      XCloseDisplay (record_dpy);
+      record_dpy = NULL;
+      return False;
+    }
+
+  range = XRecordAllocRange ();
+  range->core_requests.first = 1;
+  range->core_requests.last = 127;
+  range->ext_requests.ext_major.first = 128;
+  range->ext_requests.ext_major.last = 255;
+  range->ext_requests.ext_minor.first = 0;
+  range->ext_requests.ext_minor.last = 255;
+  range->core_replies.first = 1;
+  range->core_replies.last = 127;
+  range->ext_replies.ext_major.first = 128;
+  range->ext_replies.ext_major.last = 255;
+  range->ext_replies.ext_minor.first = 0;
+  range->ext_replies.ext_minor.last = 255;
+
+  client = wm_window;
+  record_context = XRecordCreateContext (dpy, 0, &client, 1, &range, 1);
+  XFree (range);
+  XSync (dpy, False);
+
+  if (record_context == 0 ||
+      !XRecordEnableContextAsync (record_dpy, record_context,
+                                  record_callback, NULL))
+    {
+      XCloseDisplay (record_dpy);
+      record_dpy = NULL;
+      return False;
+    }
+
+  return True;
+}
+
+/* Takes in what RECORD has sent us so far, waiting a little for
+ * anything still on its way
+ */
+static void
+drain_recording (void)
+{
+  struct pollfd pfd;
+
+  if (record_dpy == NULL)
+    return;
+
+  do
+    {
+      XRecordProcessReplies (record_dpy);
+
+      pfd.fd = ConnectionNumber (record_dpy);
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+    }
+  while (poll (&pfd, 1, 20) > 0);
+}
+
+static void
+stop_recording (void)
+{
+  if (record_dpy == NULL)
+    return;
+
+  XRecordDisableContext (dpy, record_context);
+  XRecordFreeContext (dpy, record_context);
+  XSync (dpy, False);
+  drain_recording ();
+  XCloseDisplay (record_dpy);
+  record_dpy = NULL;
+}
+
+/* utime + stime from /proc/<pid>/stat, in ms */
+static double
+get_wm_cpu (void)
+{
+  char path[64];
+  char buf[1024];
+  FILE *f;
+  size_t len;
+  char *p;
+  unsigned long utime, stime;
+
+  if (wm_pid <= 0)
+    return -1;
+
+  snprintf (path, sizeof (path), "/proc/%d/stat", wm_pid);
+  f = fopen (path, "r");
+  if (f == NULL)
+    return -1;
+
+  len = fread (buf, 1, sizeof (buf) - 1, f);
+  fclose (f);
+  buf[len] = '\0';
+
+  /* The command name may have spaces in it; the fields after it don't */
+  p = strrchr (buf, ')');
+  if (p == NULL ||
+      sscanf (p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+              &utime, &stime) != 2)
+    return -1;
+
+  return (utime + stime) * 1000.0 / sysconf (_SC_CLK_TCK);
+}
+
+static void
+begin_workload (Workload *workload)
+{
+  wm_sync ();
+  drain_recording ();
+
+  workload->start_requests = wm_requests;
+  workload->start_replies = wm_replies;
+  workload->start_cpu = get_wm_cpu ();
+}
+
+static void
+end_workload (Workload *workload)
+{
+  double cpu;
+
+  wm_sync ();
+  drain_recording ();
+
+  workload->wm_requests = wm_requests - workload->start_requests;
+  workload->wm_replies = wm_replies - workload->start_replies;
+
+  cpu = get_wm_cpu ();
+  if (cpu < 0 || workload->start_cpu < 0)
+    workload->wm_cpu = -1;
+  else
+    workload->wm_cpu = cpu - workload->start_cpu;
+}
+
+static void
+add_latency (Workload *workload,
+             double    start)
+{
+  if (workload->n_latencies == workload->n_allocated)
+    {
+      workload->n_allocated = workload->n_allocated ?
+        workload->n_allocated * 2 : 64;
+      workload->latencies = realloc (workload->latencies,
+                                     workload->n_allocated * sizeof (double));
+    }
+
+  workload->latencies[workload->n_latencies++] = now_ms () - start;
+}
+
+static void
+finish_operation (Workload *workload,
+                  double    start,
+                  Bool      answered)
+{
+  if (answered)
+    add_latency (workload, start);
+  else
+    workload->n_timeouts++;
+}
+
+static Window
+create_test_window (int n)
+{
+  Window window;
+  char title[64];
+  XClassHint class_hint;
+  int width, height;
+
+  width = 100 + random_int (300);
+  height = 80 + random_int (220);
+
+  window = XCreateSimpleWindow (dpy, root, 0, 0, width, height, 0,
+                                WhitePixel (dpy, DefaultScreen (dpy)),
+                                WhitePixel (dpy, DefaultScreen (dpy)));
+  XSelectInput (dpy, window, StructureNotifyMask | PropertyChangeMask);
+
+  snprintf (title, sizeof (title), "wm-bench %d", n);
+  XStoreName (dpy, window, title);
+  XChangeProperty (dpy, window, atom_net_wm_name, atom_utf8_string, 8,
+                   PropModeReplace, (unsigned char *) title, strlen (title));
+
+  class_hint.res_name = "wm-bench";
+  class_hint.res_class = "Wm-bench";
+  XSetClassHint (dpy, window, &class_hint);
+
+  return window;
+}
+
+static void
+run_map (Workload *workload)
+{
+  int i;
+
+  for (i = 0; i < n_windows; i++)
+    {
+      double start;
+
+      windows[i] = create_test_window (i);
+
+      start = now_ms ();
+      XMapWindow (dpy, windows[i]);
+      finish_operation (workload, start,
+                        wait_for_event (is_map_notify, &windows[i], TIMEOUT));
+    }
+}
+
+static Bool
+activate_window (Window window)
+{
+  PropertyWait wait;
+
+  wait.atom = atom_net_active_window;
+  wait.value = window;
+  wait.equal = True;
+
+  /* Say we're a pager, so focus stealing prevention leaves us be */
+  send_client_message (window, atom_net_active_window, 2, last_time, 0);
+
+  return wait_for_event (root_property_changed, &wait, TIMEOUT);
+}
+
+static void
+run_restack (Workload *workload)
+{
+  Window active;
+  int i;
+
+  if (n_windows < 2)
+    {
+      workload->skipped = True;
+      return;
+    }
+
+  active = get_cardinal (root, atom_net_active_window, None);
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      int index;
+      double start;
+      Bool answered;
+
+      index = random_int (n_windows);
+      if (windows[index] == active)
+        index = (index + 1) % n_windows;
+
+      start = now_ms ();
+      answered = activate_window (windows[index]);
+      finish_operation (workload, start, answered);
+
+      if (answered)
+        active = windows[index];
+    }
+}
+
+static void
+run_title (Workload *workload)
+{
+  int i;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      char title[64];
+      int index;
+      double start;
+
+      index = random_int (n_windows);
+      snprintf (title, sizeof (title), "wm-bench %d, title %d", index, i);
+
+      start = now_ms ();
+      XChangeProperty (dpy, windows[index], atom_net_wm_name,
+                       atom_utf8_string, 8, PropModeReplace,
+                       (unsigned char *) title, strlen (title));
+      finish_operation (workload, start, wm_sync ());
+    }
+}
+
+static Bool
+switch_workspace (long workspace)
+{
+  PropertyWait wait;
+
+  wait.atom = atom_net_current_desktop;
+  wait.value = workspace;
+  wait.equal = True;
+
+  send_client_message (root, atom_net_current_desktop,
+                       workspace, last_time, 0);
+
+  return wait_for_event (root_property_changed, &wait, TIMEOUT);
+}
+
+static void
+run_workspace (Workload *workload)
+{
+  long n_workspaces;
+  long original;
+  long current;
+  int i;
+
+  n_workspaces = get_cardinal (root, atom_net_number_of_desktops, 1);
+  if (n_workspaces < 2)
+    {
+      workload->skipped = True;
+      return;
+    }
+
+  original = get_cardinal (root, atom_net_current_desktop, 0);
+  current = original;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      long target;
+      double start;
+      Bool answered;
+
+      target = random_int (n_workspaces - 1);
+      if (target >= current)
+        target++;
+
+      start = now_ms ();
+      answered = switch_workspace (target);
+      finish_operation (workload, start, answered);
+
+      if (answered)
+        current = target;
+    }
+
+  /* The other workloads want our windows in sight */
+  update_server_time ();
+  switch_workspace (original);
+}
+
+static void
+run_alt_tab (Workload *workload)
+{
+  KeyCode alt, tab;
+  int i;
+
+  alt = XKeysymToKeycode (dpy, XK_Alt_L);
+  tab = XKeysymToKeycode (dpy, XK_Tab);
+
+  if (n_windows < 2 || alt == 0 || tab == 0)
+    {
+      workload->skipped = True;
+      return;
+    }
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      PropertyWait wait;
+      int n_tabs;
+      int j;
+      double start;
+
+      wait.atom = atom_net_active_window;
+      wait.value = get_cardinal (root, atom_net_active_window, None);
+      wait.equal = False;
+
+      /* Go back one to four windows; we're timing from the release of
+       * Alt, when the window manager has to switch.
+       */
+      n_tabs = 1 + random_int (4);
+
+      XTestFakeKeyEvent (dpy, alt, True, 0);
+      for (j = 0; j < n_tabs; j++)
+        {
+          XTestFakeKeyEvent (dpy, tab, True, 0);
+          XTestFakeKeyEvent (dpy, tab, False, 0);
+        }
+      wm_sync ();
+
+      start = now_ms ();
+      XTestFakeKeyEvent (dpy, alt, False, 0);
+      finish_operation (workload, start,
+                        wait_for_event (root_property_changed, &wait, TIMEOUT));
+    }
+}
+
+static void
+run_drag (Workload *workload)
+{
+  Window window;
+  Window child;
+  Atom type;
+  int format;
+  unsigned long n_items;
+  unsigned long bytes_after;
+  unsigned char *data;
+  long top;
+  XWindowAttributes attrs;
+  ConfigureWait wait;
+  int pointer_x, pointer_y;
+  int i;
+
+  window = windows[random_int (n_windows)];
+  update_server_time ();
+  activate_window (window);
+
+  /* Find the middle of the titlebar */
+  top = 0;
+  data = NULL;
+  if (XGetWindowProperty (dpy, window, atom_net_frame_extents, 0, 4, False,
+                          XA_CARDINAL, &type, &format, &n_items, &bytes_after,
+                          &data) == Success &&
+      data != NULL && format == 32 && n_items == 4)
+    top = ((long *) data)[2];
+  if (data)
+    XFree (data);
+
+  if (top <= 0 || !XGetWindowAttributes (dpy, window, &attrs))
+    {
+      workload->skipped = True;
+      return;
+    }
+
+  XTranslateCoordinates (dpy, window, root, 0, 0,
+                         &wait.x, &wait.y, &child);
+  wait.window = window;
+
+  pointer_x = wait.x + attrs.width / 2;
+  pointer_y = wait.y - top / 2;
+
+  XTestFakeMotionEvent (dpy, -1, pointer_x, pointer_y, 0);
+  XTestFakeButtonEvent (dpy, 1, True, 0);
+  wm_sync ();
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      int dx, dy;
+      double start;
+      Bool answered;
+
+      dx = random_int (2 * DRAG_STEP + 1) - DRAG_STEP;
+      dy = random_int (2 * DRAG_STEP + 1) - DRAG_STEP;
+      if (dx == 0 && dy == 0)
+        dx = 1;
+
+      /* Keep to the middle of the screen, away from its edges */
+      if (pointer_x + dx < DRAG_MARGIN ||
+          pointer_x + dx > screen_width - DRAG_MARGIN)
+        dx = -dx;
+      if (pointer_y + dy < DRAG_MARGIN ||
+          pointer_y + dy > screen_height - DRAG_MARGIN)
+        dy = -dy;
+
+      pointer_x += dx;
+      pointer_y += dy;
+
+      start = now_ms ();
+      XTestFakeMotionEvent (dpy, -1, pointer_x, pointer_y, 0);
+
+      /* The window manager tells us where the window went with a
+       * synthetic ConfigureNotify
+       */
+      answered = wait_for_event (is_new_position, &wait, DRAG_TIMEOUT);
+      finish_operation (workload, start, answered);
+    }
+
+  XTestFakeButtonEvent (dpy, 1, False, 0);
+  wm_sync ();
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  if (da < db)
+    return -1;
+  else if (da > db)
+    return 1;
+  else
+    return 0;
+}
+
+/* Nearest rank; latencies must be sorted */
+static double
+percentile (Workload *workload,
+            int       percent)
+{
+  int rank;
+
+  rank = (percent * workload->n_latencies + 99) / 100;
+  if (rank < 1)
+    rank = 1;
+
+  return workload->latencies[rank - 1];
+}
+
+static void
+print_header (void)
+{
+  printf ("%-10s %6s %8s %8s %8s %8s %8s %10s %10s %10s\n",
+          "workload", "ops", "timeouts", "p50 ms", "p90 ms", "p99 ms",
+          "max ms", "wm req/op", "wm rep/op", "wm cpu ms");
+}
+
+static void
+print_workload (Workload *workload)
+{
+  int n_ops;
+
+  if (workload->skipped)
+    {
+      printf ("%-10s skipped\n", workload->name);
+      return;
+    }
+
+  n_ops = workload->n_latencies + workload->n_timeouts;
+  printf ("%-10s %6d %8d ", workload->name, n_ops, workload->n_timeouts);
+
+  if (workload->n_latencies > 0)
+    {
+      qsort (workload->latencies, workload->n_latencies, sizeof (double),
+             compare_doubles);
+      printf ("%8.2f %8.2f %8.2f %8.2f ",
+              percentile (workload, 50),
+              percentile (workload, 90),
+              percentile (workload, 99),
+              workload->latencies[workload->n_latencies - 1]);
+    }
+  else
+    printf ("%8s %8s %8s %8s ", "-", "-", "-", "-");
+
+  if (record_dpy != NULL && n_ops > 0)
+    printf ("%10.1f %10.1f ",
+            (double) workload->wm_requests / n_ops,
+            (double) workload->wm_replies / n_ops);
+  else
+    printf ("%10s %10s ", "-", "-");
+
+  if (workload->wm_cpu >= 0)
+    printf ("%10.1f\n", workload->wm_cpu);
+  else
+    printf ("%10s\n", "-");
+}
+
+static struct
+{
+  const char *name;
+  WorkloadFunc func;
+  Bool needs_xtest;
+  Bool wanted;
+} workloads[] = {
+  { "map",       run_map,       False, False },
+  { "restack",   run_restack,   False, False },
+  { "title",     run_title,     False, False },
+  { "workspace", run_workspace, False, False },
+  { "alt-tab",   run_alt_tab,   True,  False },
+  { "drag",      run_drag,      True,  False }
+};
+
+#define N_WORKLOADS ((int) (sizeof (workloads) / sizeof (workloads[0])))
+
+int
+main (int argc, char **argv)
+{
+  Window wm_window;
+  Bool any_wanted;
+  Bool have_xtest;
+  int event_base, error_base, major, minor;
+  unsigned int seed;
+  int i;
+
+  seed = DEFAULT_SEED;
+  n_windows = DEFAULT_WINDOWS;
+  n_iterations = DEFAULT_ITERATIONS;
+  wm_pid = 0;
+  any_wanted = False;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      int j;
+
+      if (strcmp (arg, "--seed") == 0 && i + 1 < argc)
+        seed = strtoul (argv[++i], NULL, 10);
+      else if (strcmp (arg, "--windows") == 0 && i + 1 < argc)
+        n_windows = atoi (argv[++i]);
+      else if (strcmp (arg, "--iterations") == 0 && i + 1 < argc)
+        n_iterations = atoi (argv[++i]);
+      else if (strcmp (arg, "--wm-pid") == 0 && i + 1 < argc)
+        wm_pid = atoi (argv[++i]);
+      else
+        {
+          for (j = 0; j < N_WORKLOADS; j++)
+            if (strcmp (arg, workloads[j].name) == 0)
+              break;
+
+          if (j == N_WORKLOADS)
+            usage ();
+
+          workloads[j].wanted = True;
+          any_wanted = True;
+        }
+    }
+
+  if (n_windows < 1 || n_iterations < 1)
+    usage ();
+
+  if (!any_wanted)
+    for (i = 0; i < N_WORKLOADS; i++)
+      workloads[i].wanted = True;
+
+  random_state = seed;
+
+  dpy = XOpenDisplay (NULL);
+  if (dpy == NULL)
+    {
+      fprintf (stderr, "Could not open display\n");
+      return 1;
+    }
+
+  root = DefaultRootWindow (dpy);
+  screen_width = DisplayWidth (dpy, DefaultScreen (dpy));
+  screen_height = DisplayHeight (dpy, DefaultScreen (dpy));
+
+  atom_net_active_window = XInternAtom (dpy, "_NET_ACTIVE_WINDOW", False);
+  atom_net_current_desktop = XInternAtom (dpy, "_NET_CURRENT_DESKTOP", False);
+  atom_net_number_of_desktops = XInternAtom (dpy, "_NET_NUMBER_OF_DESKTOPS", False);
+  atom_net_frame_extents = XInternAtom (dpy, "_NET_FRAME_EXTENTS", False);
+  atom_net_request_frame_extents = XInternAtom (dpy, "_NET_REQUEST_FRAME_EXTENTS", False);
+  atom_net_supporting_wm_check = XInternAtom (dpy, "_NET_SUPPORTING_WM_CHECK", False);
+  atom_net_wm_name = XInternAtom (dpy, "_NET_WM_NAME", False);
+  atom_utf8_string = XInternAtom (dpy, "UTF8_STRING", False);
+
+  wm_window = get_cardinal (root, atom_net_supporting_wm_check, None);
+  if (wm_window == None)
+    {
+      fprintf (stderr, "No EWMH window manager is running\n");
+      return 1;
+    }
+
+  XSelectInput (dpy, root, PropertyChangeMask);
+
+  /* Never mapped; we only ask the window manager about its frame */
+  probe = XCreateSimpleWindow (dpy, root, 0, 0, 1, 1, 0, 0, 0);
+  XSelectInput (dpy, probe, PropertyChangeMask);
+
+  have_xtest = XTestQueryExtension (dpy, &event_base, &error_base,
+                                    &major, &minor);
+  if (!have_xtest)
+    fprintf (stderr, "No XTEST extension; skipping alt-tab and drag\n");
+
+  if (!start_recording (wm_window))
+    fprintf (stderr, "No RECORD extension; not counting requests\n");
+
+  if (wm_pid <= 0)
+    fprintf (stderr, "No --wm-pid; not measuring CPU time\n");
+
+  update_server_time ();
+
+  printf ("seed %u, %d windows, %d iterations\n",
+          seed, n_windows, n_iterations);
+  print_header ();
+
+  windows = calloc (n_windows, sizeof (Window));
+
+  /* The others need the windows, so they're always mapped */
+  for (i = 0; i < N_WORKLOADS; i++)
+    {
+      Workload workload;
+
+      if (!workloads[i].wanted && workloads[i].func != run_map)
+        continue;
+
+      memset (&workload, 0, sizeof (workload));
+      workload.name = workloads[i].name;
+
+      if (workloads[i].needs_xtest && !have_xtest)
+        workload.skipped = True;
+      else
+        {
+          update_server_time ();
+          begin_workload (&workload);
+          workloads[i].func (&workload);
+          end_workload (&workload);
+        }
+
+      if (workloads[i].wanted)
+        print_workload (&workload);
+
+      free (workload.latencies);
+    }
+
+  stop_recording ();
+
+  for (i = 0; i < n_windows; i++)
+    if (windows[i] != None)
+      XDestroyWindow (dpy, windows[i]);
+  XDestroyWindow (dpy, probe);
+  XCloseDisplay (dpy);
+  free (windows);
+
+  return 0;
+}